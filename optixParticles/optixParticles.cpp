@@ -49,6 +49,7 @@
 
 #include <sutil.h>
 #include "common.h"
+#include "particle_frames.h"
 #include <Arcball.h>
 
 #include <cstring>
@@ -57,8 +58,8 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <stdexcept>
 #include <stdint.h>
-#include <map>
 
 using namespace optix;
 
@@ -72,15 +73,6 @@ struct ParticlesBuffer
     Buffer      radii;
 };
 
-struct ParticleFrameData {
-    std::vector<float3> positions;
-    std::vector<float3> velocities;
-    std::vector<float3> colors;
-    std::vector<float>  radii;
-    float3 bbox_min;
-    float3 bbox_max;
-};
-
 //------------------------------------------------------------------------------
 //
 // Globals
@@ -112,6 +104,8 @@ int             mouse_button;
 std::string     particles_file_base;
 int             current_particle_frame = 1;
 int             max_particle_frames = 25;
+size_t          frame_cache_size = 8;
+std::unique_ptr<ParticleFrameCache> frame_cache;
 
 // Accumulation frame
 unsigned int    accumulation_frame = 0;
@@ -288,83 +282,25 @@ void createContext( int usage_report_level, UsageReportLogger* logger )
 }
 
 
-static inline float parseFloat( const char *&token )
-{
-  token += strspn( token, " \t" );
-  float f = (float) atof( token );
-  token += strcspn( token, " \t\r" );
-  return f;
-}
-
-
-static inline float3 get_min(
-    const float3 &v1,
-    const float3 &v2)
+// copies the arrays of the frame into the buffers, the layouts are the same
+static void fillBuffers( const ParticleFrame &frame )
 {
-    float3 result;
-    result.x = std::min<float>( v1.x, v2.x );
-    result.y = std::min<float>( v1.y, v2.y );
-    result.z = std::min<float>( v1.z, v2.z );
-    return result;
-}
-
+    const size_t count = frame.count;
 
-static inline float3 get_max(
-    const float3 &v1,
-    const float3 &v2)
-{
-    float3 result;
-    result.x = std::max<float>( v1.x, v2.x );
-    result.y = std::max<float>( v1.y, v2.y );
-    result.z = std::max<float>( v1.z, v2.z );
-    return result;
-}
-
-
-static void fillBuffers(
-    const std::vector<float3> &positions,
-    const std::vector<float3> &velocities,
-    const std::vector<float3> &colors,
-    const std::vector<float>  &radii)
-{
-    buffers.positions->setSize( positions.size() );
-    float *pos = reinterpret_cast<float*> ( buffers.positions->map() );
-    for ( int i=0, index = 0; i<static_cast<int>(positions.size()); ++i ) {
-        float3 p = positions[i];
-
-        pos[index++] = p.x;
-        pos[index++] = p.y;
-        pos[index++] = p.z;
-    }
+    buffers.positions->setSize( count );
+    memcpy( buffers.positions->map(), frame.positions, count * 3 * sizeof( float ) );
     buffers.positions->unmap();
 
-    buffers.velocities->setSize( velocities.size() );
-    float *vel = reinterpret_cast<float*> ( buffers.velocities->map() );
-    for ( int i=0, index = 0; i<static_cast<int>(velocities.size()); ++i ) {
-        float3 v = velocities[i];
-
-        vel[index++] = v.x;
-        vel[index++] = v.y;
-        vel[index++] = v.z;
-    }
+    buffers.velocities->setSize( count );
+    memcpy( buffers.velocities->map(), frame.velocities, count * 3 * sizeof( float ) );
     buffers.velocities->unmap();
 
-    buffers.colors->setSize( colors.size() );
-    float *col = reinterpret_cast<float*> ( buffers.colors->map() );
-    for ( int i=0, index = 0; i<static_cast<int>(colors.size()); ++i ) {
-        float3 c = colors[i];
-
-        col[index++] = c.x;
-        col[index++] = c.y;
-        col[index++] = c.z;
-    }
+    buffers.colors->setSize( count );
+    memcpy( buffers.colors->map(), frame.colors, count * 3 * sizeof( float ) );
     buffers.colors->unmap();
 
-    buffers.radii->setSize( radii.size() );
-    float *rad = reinterpret_cast<float*> ( buffers.radii->map() );
-    for ( int i=0; i<static_cast<int>(radii.size()); ++i ) {
-        rad[i] = radii[i];
-    }
+    buffers.radii->setSize( count );
+    memcpy( buffers.radii->map(), frame.radii, count * sizeof( float ) );
     buffers.radii->unmap();
 }
 
@@ -418,130 +354,44 @@ Program createIntersectionProgram( Context context )
         ? "particle_intersect_motion" : "particle_intersect" );
 }
 
-// loads up the particles file corresponding to the current frame (if it is a sequence)
-void loadParticles()
+// name of the particles file of a frame of the sequence, or of the single file
+std::string particlesFileName( int frame )
 {
+    if ( frame <= 0 )
+        return particles_file_base;
 
-    // caching to avoid reloading the particles with every frame
-    // however, we still refill the buffers and rebuild the acceleration structure
-    static std::map<int, ParticleFrameData> dataCache;
-
-    std::map<int, ParticleFrameData>::iterator cacheIt = dataCache.find(current_particle_frame);
-    if(cacheIt == dataCache.end())
-    {
-        ParticleFrameData newCacheEntry;
-
-        std::vector<float3>& positions = newCacheEntry.positions;
-        std::vector<float3>& velocities = newCacheEntry.velocities;
-        std::vector<float3>& colors = newCacheEntry.colors;
-        std::vector<float>&  radii = newCacheEntry.radii;
-
-        std::string filename = particles_file_base;
-
-        if ( current_particle_frame > 0 ) {
-            std::ostringstream s;
-            s << current_particle_frame;
-
-            if ( current_particle_frame < 10 )
-                filename += ".000" + s.str() + ".txt";
-            else
-                filename += ".00" + s.str() + ".txt";
-        }
-        else
-            filename = particles_file_base;
+    std::ostringstream s;
+    s << frame;
 
+    if ( frame < 10 )
+        return particles_file_base + ".000" + s.str() + ".txt";
+    else
+        return particles_file_base + ".00" + s.str() + ".txt";
+}
 
-        std::ifstream ifs( filename.c_str() );
-
-        float3 bbox_min, bbox_max;
-        bbox_min.x = bbox_min.y = bbox_min.z = 1e16f;
-        bbox_max.x = bbox_max.y = bbox_max.z = -1e16f;
-
-        int maxchars = 8192;
-        std::vector<char> buf(static_cast<size_t>(maxchars)); // Alloc enough size
-
-        while ( ifs.peek() != -1 ) {
-            ifs.getline( &buf[0], maxchars );
-
-            std::string linebuf(&buf[0]);
-
-            // Trim newline '\r\n' or '\n'
-            if ( linebuf.size() > 0 ) {
-                if ( linebuf[linebuf.size() - 1] == '\n' )
-                    linebuf.erase(linebuf.size() - 1);
-            }
-
-            if ( linebuf.size() > 0 ) {
-                if ( linebuf[linebuf.size() - 1] == '\r' )
-                    linebuf.erase( linebuf.size() - 1 );
-            }
-
-            // Skip if empty line.
-            if ( linebuf.empty() ) {
-                continue;
-            }
-
-            // Skip leading space.
-            const char *token = linebuf.c_str();
-            token += strspn( token, " \t" );
-
-            assert( token );
-            if ( token[0] == '\0' )
-                continue; // empty line
-
-            if ( token[0] == '#' )
-                continue; // comment line
-
-            // meaningful line here. The expected format is: position, velocity, color and radius
-
-            // position
-            float x  = parseFloat( token );
-            float y  = parseFloat( token );
-            float z  = parseFloat( token );
-
-            // velocity
-            float vx = parseFloat( token );
-            float vy = parseFloat( token );
-            float vz = parseFloat( token );
-
-            // color
-            float r  = parseFloat( token );
-            float g  = parseFloat( token );
-            float b  = parseFloat( token );
-
-            // radius
-            float rd = parseFloat( token );
-
-            positions.push_back( make_float3( x, y, z ) );
-            velocities.push_back( make_float3( vx, vy, vz ) );
-            colors.push_back( make_float3( r, g, b ) );
-            radii.push_back( rd );
-
-            // updates the bounding box with the bounding box of the current particle
-            const float3 p_min = make_float3( x - rd, y - rd, z - rd );
-            const float3 p_max = make_float3( x + rd, y + rd, z + rd );
-
-            bbox_min = get_min( bbox_min, p_min );
-            bbox_max = get_max( bbox_max, p_max );
-        }
-
-        newCacheEntry.bbox_min = bbox_min;
-        newCacheEntry.bbox_max = bbox_max;
-        cacheIt = dataCache.insert(std::make_pair(current_particle_frame, newCacheEntry)).first;
-    }
 
-    ParticleFrameData& cacheEntry = cacheIt->second;
+// loads up the particles file corresponding to the current frame (if it is a sequence)
+void loadParticles()
+{
+    // caching to avoid reloading the particles with every frame, the next frame
+    // of a sequence is loaded in the background while the current one is shown.
+    // However, we still refill the buffers and rebuild the acceleration structure
+    if ( !frame_cache )
+        frame_cache.reset( new ParticleFrameCache( []( int frame ) { return loadParticleFrame( particlesFileName( frame ) ); },
+                                                   frame_cache_size ) );
 
-    // all vectors have the same size
-    const int num_particles = (int) cacheEntry.positions.size();
+    std::shared_ptr<const ParticleFrame> frame = frame_cache->get( current_particle_frame );
+    if ( current_particle_frame > 0 )
+        frame_cache->prefetch( current_particle_frame < max_particle_frames ? current_particle_frame + 1 : 1 );
 
-    geometry->setPrimitiveCount( num_particles );
+    geometry->setPrimitiveCount( frame->count );
 
     // fills up the buffers
-    fillBuffers( cacheEntry.positions, cacheEntry.velocities, cacheEntry.colors, cacheEntry.radii );
+    fillBuffers( *frame );
 
     // the bounding box will actually be used only for the first frame
-    aabb.set( cacheEntry.bbox_min, cacheEntry.bbox_max );
+    aabb.set( make_float3( frame->bbox_min[0], frame->bbox_min[1], frame->bbox_min[2] ),
+              make_float3( frame->bbox_max[0], frame->bbox_max[1], frame->bbox_max[2] ) );
 
     // builds the BVH (or re-builds it if already existing)
     Acceleration accel = geometry_group->getAcceleration();
@@ -549,6 +399,30 @@ void loadParticles()
 }
 
 
+// converts the particles file, or all frames of the sequence, to binary frames
+void convertParticles()
+{
+    const int first = current_particle_frame > 0 ? 1 : 0;
+    const int last  = current_particle_frame > 0 ? max_particle_frames : 0;
+    for ( int frame = first; frame <= last; ++frame ) {
+        const std::string filename = particlesFileName( frame );
+        const double start = sutil::currentTime();
+        std::shared_ptr<ParticleFrame> data = parseParticleText( filename );
+        const double parsed = sutil::currentTime();
+        const std::string binary_filename = particleBinaryName( filename );
+        if ( !writeParticleBinary( *data, binary_filename ) )
+            throw std::runtime_error( "Cannot write '" + binary_filename + "'" );
+        const double written = sutil::currentTime();
+        mapParticleFrame( binary_filename );
+        const double mapped = sutil::currentTime();
+
+        std::cerr << "Wrote " << binary_filename << ": " << data->count << " particles, parsed in "
+                  << ( parsed - start ) * 1000.0 << " ms, written in " << ( written - parsed ) * 1000.0
+                  << " ms, mapped in " << ( mapped - written ) * 1000.0 << " ms\n";
+    }
+}
+
+
 void setupParticles()
 {
     // the buffers will be set to the right size at a later stage
@@ -900,6 +774,8 @@ void printUsageAndExit( const std::string& argv0 )
         "  -s | --shade                        Shade the particles with a Lambert material.\n"
         "  -m | --motionblur [F]               Enables motion blur, with an optional extent.\n"
         "  -r | --report <LEVEL>               Enable usage reporting and report level [1-3].\n"
+        "  -c | --cache <N>                    Number of particle frames kept in memory (default 8).\n"
+        "       --convert                      Write binary .pbin frames next to the .txt frames and exit.\n"
         "App Keystrokes:\n"
         "  p  Play/pause particle animation\n"
         "  m  Increase number of path tracing iterations per animation frame during animation\n"
@@ -917,6 +793,7 @@ int main( int argc, char** argv )
     std::string out_file;
     std::string particles_file = std::string( sutil::samplesDir() ) + "/data/particles/particles.0001.txt";
     int usage_report_level = 0;
+    bool convert = false;
     for( int i=1; i<argc; ++i )
     {
         const std::string arg( argv[i] );
@@ -972,6 +849,19 @@ int main( int argc, char** argv )
             }
             usage_report_level = atoi( argv[++i] );
         }
+        else if( arg == "-c" || arg == "--cache" )
+        {
+            if( i == argc-1 )
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit( argv[0] );
+            }
+            frame_cache_size = static_cast<size_t>( std::max( 1, atoi( argv[++i] ) ) );
+        }
+        else if( arg == "--convert" )
+        {
+            convert = true;
+        }
         else
         {
             std::cerr << "Unknown option '" << arg << "'\n";
@@ -981,6 +871,13 @@ int main( int argc, char** argv )
 
     try
     {
+        if( convert )
+        {
+            setParticlesBaseName( particles_file );
+            convertParticles();
+            return 0;
+        }
+
         glutInitialize( &argc, argv );
 
 #ifndef __APPLE__
@@ -0,0 +1,525 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "particle_frames.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+
+namespace
+{
+
+// Bytes of text per thread below which parsing a frame is not split further
+const size_t MIN_BYTES_PER_THREAD = 64 * 1024;
+
+inline float parseFloat( const char *&token )
+{
+    token += strspn( token, " \t" );
+    float f = (float) atof( token );
+    token += strcspn( token, " \t\r" );
+    return f;
+}
+
+inline uint64_t alignOffset( uint64_t offset )
+{
+    return ( offset + 63u ) & ~uint64_t( 63u );
+}
+
+// Particles of one range of lines
+struct ParsedChunk
+{
+    std::vector<float> positions;
+    std::vector<float> velocities;
+    std::vector<float> colors;
+    std::vector<float> radii;
+    float bbox_min[3];
+    float bbox_max[3];
+};
+
+void parseLines( const char* begin, const char* end, ParsedChunk& chunk )
+{
+    for ( int k = 0; k < 3; ++k ) {
+        chunk.bbox_min[k] = 1e16f;
+        chunk.bbox_max[k] = -1e16f;
+    }
+
+    std::string linebuf;
+    while ( begin < end ) {
+        const char* line_end = static_cast<const char*>( memchr( begin, '\n', end - begin ) );
+        if ( !line_end )
+            line_end = end;
+        linebuf.assign( begin, line_end );
+        begin = line_end + 1;
+
+        // Trim '\r' of '\r\n'
+        if ( !linebuf.empty() && linebuf[linebuf.size() - 1] == '\r' )
+            linebuf.erase( linebuf.size() - 1 );
+
+        // Skip leading space, empty and comment lines
+        const char *token = linebuf.c_str();
+        token += strspn( token, " \t" );
+        if ( token[0] == '\0' || token[0] == '#' )
+            continue;
+
+        // The expected format is: position, velocity, color and radius
+        float v[10];
+        for ( int k = 0; k < 10; ++k )
+            v[k] = parseFloat( token );
+
+        chunk.positions.insert( chunk.positions.end(), v, v + 3 );
+        chunk.velocities.insert( chunk.velocities.end(), v + 3, v + 6 );
+        chunk.colors.insert( chunk.colors.end(), v + 6, v + 9 );
+        chunk.radii.push_back( v[9] );
+
+        // updates the bounding box with the bounding box of the current particle
+        for ( int k = 0; k < 3; ++k ) {
+            chunk.bbox_min[k] = std::min<float>( chunk.bbox_min[k], v[k] - v[9] );
+            chunk.bbox_max[k] = std::max<float>( chunk.bbox_max[k], v[k] + v[9] );
+        }
+    }
+}
+
+bool modificationTime( const std::string& filename, time_t& time )
+{
+    struct stat info;
+    if ( stat( filename.c_str(), &info ) != 0 )
+        return false;
+    time = info.st_mtime;
+    return true;
+}
+
+bool endsWith( const std::string& s, const std::string& suffix )
+{
+    return s.size() >= suffix.size() && s.compare( s.size() - suffix.size(), suffix.size(), suffix ) == 0;
+}
+
+} // namespace
+
+
+//------------------------------------------------------------------------------
+//
+// ParticleFrame
+//
+//------------------------------------------------------------------------------
+
+ParticleFrame::ParticleFrame()
+    : count( 0 )
+    , positions( 0 )
+    , velocities( 0 )
+    , colors( 0 )
+    , radii( 0 )
+    , m_mapping( 0 )
+    , m_mapping_size( 0 )
+{
+    for ( int k = 0; k < 3; ++k ) {
+        bbox_min[k] = 1e16f;
+        bbox_max[k] = -1e16f;
+    }
+}
+
+
+ParticleFrame::~ParticleFrame()
+{
+    if ( m_mapping ) {
+#ifdef _WIN32
+        UnmapViewOfFile( m_mapping );
+#else
+        munmap( m_mapping, m_mapping_size );
+#endif
+    }
+}
+
+
+std::shared_ptr<ParticleFrame> parseParticleText( const std::string& filename )
+{
+    std::ifstream ifs( filename.c_str(), std::ios::in | std::ios::binary );
+    if ( !ifs )
+        throw std::runtime_error( "ParticleFrame: cannot open '" + filename + "'" );
+    ifs.seekg( 0, std::ios::end );
+    const size_t size = static_cast<size_t>( ifs.tellg() );
+    ifs.seekg( 0, std::ios::beg );
+    std::vector<char> text( size );
+    if ( size > 0 && !ifs.read( &text[0], size ) )
+        throw std::runtime_error( "ParticleFrame: cannot read '" + filename + "'" );
+
+    // Splits the text at line ends into one range per thread
+    const unsigned int hardware_threads = std::max( 1u, std::thread::hardware_concurrency() );
+    const size_t thread_count = std::max<size_t>( 1, std::min<size_t>( hardware_threads, size / MIN_BYTES_PER_THREAD ) );
+    std::vector<size_t> bounds( thread_count + 1, size );
+    bounds[0] = 0;
+    for ( size_t t = 1; t < thread_count; ++t ) {
+        size_t b = std::max( bounds[t - 1], t * size / thread_count );
+        while ( b < size && text[b - 1] != '\n' )
+            ++b;
+        bounds[t] = b;
+    }
+
+    const char* data = size > 0 ? &text[0] : "";
+    std::vector<ParsedChunk> chunks( thread_count );
+    std::vector<std::thread> threads;
+    for ( size_t t = 1; t < thread_count; ++t )
+        threads.push_back( std::thread( parseLines, data + bounds[t], data + bounds[t + 1], std::ref( chunks[t] ) ) );
+    parseLines( data + bounds[0], data + bounds[1], chunks[0] );
+    for ( size_t t = 0; t < threads.size(); ++t )
+        threads[t].join();
+
+    // Concatenates the chunks in the order of the file
+    size_t count = 0;
+    for ( size_t t = 0; t < thread_count; ++t )
+        count += chunks[t].radii.size();
+
+    std::shared_ptr<ParticleFrame> frame( new ParticleFrame() );
+    frame->m_storage.resize( std::max<size_t>( 1, count * 10 ) );
+    float* positions  = &frame->m_storage[0];
+    float* velocities = positions + count * 3;
+    float* colors     = velocities + count * 3;
+    float* radii      = colors + count * 3;
+    frame->count      = static_cast<unsigned int>( count );
+    frame->positions  = positions;
+    frame->velocities = velocities;
+    frame->colors     = colors;
+    frame->radii      = radii;
+    for ( size_t t = 0; t < thread_count; ++t ) {
+        const ParsedChunk& chunk = chunks[t];
+        const size_t n = chunk.radii.size();
+        if ( n > 0 ) {
+            memcpy( positions,  &chunk.positions[0],  n * 3 * sizeof( float ) );
+            memcpy( velocities, &chunk.velocities[0], n * 3 * sizeof( float ) );
+            memcpy( colors,     &chunk.colors[0],     n * 3 * sizeof( float ) );
+            memcpy( radii,      &chunk.radii[0],      n * sizeof( float ) );
+            positions  += n * 3;
+            velocities += n * 3;
+            colors     += n * 3;
+            radii      += n;
+        }
+        for ( int k = 0; k < 3; ++k ) {
+            frame->bbox_min[k] = std::min<float>( frame->bbox_min[k], chunk.bbox_min[k] );
+            frame->bbox_max[k] = std::max<float>( frame->bbox_max[k], chunk.bbox_max[k] );
+        }
+    }
+    return frame;
+}
+
+
+std::shared_ptr<ParticleFrame> mapParticleFrame( const std::string& filename )
+{
+    void* mapping = 0;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if ( file != INVALID_HANDLE_VALUE ) {
+        LARGE_INTEGER file_size;
+        if ( GetFileSizeEx( file, &file_size ) && file_size.QuadPart > 0 ) {
+            HANDLE file_mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+            if ( file_mapping ) {
+                mapping = MapViewOfFile( file_mapping, FILE_MAP_READ, 0, 0, 0 );
+                size = static_cast<size_t>( file_size.QuadPart );
+                CloseHandle( file_mapping );
+            }
+        }
+        CloseHandle( file );
+    }
+#else
+    const int fd = open( filename.c_str(), O_RDONLY );
+    if ( fd >= 0 ) {
+        struct stat info;
+        if ( fstat( fd, &info ) == 0 && info.st_size > 0 ) {
+            size = static_cast<size_t>( info.st_size );
+            mapping = mmap( 0, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if ( mapping == MAP_FAILED )
+                mapping = 0;
+        }
+        close( fd );
+    }
+#endif
+    if ( !mapping )
+        throw std::runtime_error( "ParticleFrame: cannot map '" + filename + "'" );
+
+    // Owns the mapping from here on, also if the checks below throw
+    std::shared_ptr<ParticleFrame> frame( new ParticleFrame() );
+    frame->m_mapping = mapping;
+    frame->m_mapping_size = size;
+
+    const char* bytes = static_cast<const char*>( mapping );
+    const ParticleFileHeader* header = reinterpret_cast<const ParticleFileHeader*>( bytes );
+    if ( size < sizeof( ParticleFileHeader ) ||
+         memcmp( header->magic, PARTICLE_FILE_MAGIC, sizeof( header->magic ) ) != 0 ||
+         header->version != PARTICLE_FILE_VERSION )
+        throw std::runtime_error( "ParticleFrame: '" + filename + "' is not a particle frame" );
+
+    const uint64_t count = header->count;
+    const uint64_t offsets[4] = { header->positions_offset, header->velocities_offset, header->colors_offset, header->radii_offset };
+    const uint64_t sizes[4] = { count * 12, count * 12, count * 12, count * 4 };
+    for ( int i = 0; i < 4; ++i ) {
+        if ( offsets[i] % sizeof( float ) != 0 || offsets[i] > size || sizes[i] > size - offsets[i] )
+            throw std::runtime_error( "ParticleFrame: '" + filename + "' is truncated" );
+    }
+
+    frame->count      = header->count;
+    frame->positions  = reinterpret_cast<const float*>( bytes + offsets[0] );
+    frame->velocities = reinterpret_cast<const float*>( bytes + offsets[1] );
+    frame->colors     = reinterpret_cast<const float*>( bytes + offsets[2] );
+    frame->radii      = reinterpret_cast<const float*>( bytes + offsets[3] );
+    for ( int k = 0; k < 3; ++k ) {
+        frame->bbox_min[k] = header->bbox_min[k];
+        frame->bbox_max[k] = header->bbox_max[k];
+    }
+    return frame;
+}
+
+
+bool writeParticleBinary( const ParticleFrame& frame, const std::string& filename )
+{
+    ParticleFileHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, PARTICLE_FILE_MAGIC, sizeof( header.magic ) );
+    header.version = PARTICLE_FILE_VERSION;
+    header.count   = frame.count;
+    for ( int k = 0; k < 3; ++k ) {
+        header.bbox_min[k] = frame.bbox_min[k];
+        header.bbox_max[k] = frame.bbox_max[k];
+    }
+    const uint64_t vec3_size = uint64_t( frame.count ) * 12;
+    header.positions_offset  = alignOffset( sizeof( ParticleFileHeader ) );
+    header.velocities_offset = alignOffset( header.positions_offset + vec3_size );
+    header.colors_offset     = alignOffset( header.velocities_offset + vec3_size );
+    header.radii_offset      = alignOffset( header.colors_offset + vec3_size );
+
+    // Written under a temporary name and renamed, so a partly written file is never mapped
+    const std::string temp_filename = filename + ".tmp";
+    {
+        std::ofstream out( temp_filename.c_str(), std::ios::out | std::ios::binary );
+        if ( !out )
+            return false;
+
+        const char zeros[64] = { 0 };
+        const float* arrays[4] = { frame.positions, frame.velocities, frame.colors, frame.radii };
+        const uint64_t offsets[4] = { header.positions_offset, header.velocities_offset, header.colors_offset, header.radii_offset };
+        const uint64_t sizes[4] = { vec3_size, vec3_size, vec3_size, uint64_t( frame.count ) * 4 };
+        uint64_t pos = sizeof( header );
+        out.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+        for ( int i = 0; i < 4; ++i ) {
+            out.write( zeros, static_cast<std::streamsize>( offsets[i] - pos ) );
+            if ( sizes[i] > 0 )
+                out.write( reinterpret_cast<const char*>( arrays[i] ), static_cast<std::streamsize>( sizes[i] ) );
+            pos = offsets[i] + sizes[i];
+        }
+        if ( !out )
+        {
+            out.close();
+            remove( temp_filename.c_str() );
+            return false;
+        }
+    }
+    remove( filename.c_str() );
+    if ( rename( temp_filename.c_str(), filename.c_str() ) != 0 ) {
+        remove( temp_filename.c_str() );
+        return false;
+    }
+    return true;
+}
+
+
+std::string particleBinaryName( const std::string& filename )
+{
+    if ( endsWith( filename, ".txt" ) )
+        return filename.substr( 0, filename.size() - 4 ) + ".pbin";
+    return filename + ".pbin";
+}
+
+
+std::shared_ptr<ParticleFrame> loadParticleFrame( const std::string& filename )
+{
+    if ( endsWith( filename, ".pbin" ) )
+        return mapParticleFrame( filename );
+
+    // Uses the binary frame unless the text is newer
+    const std::string binary_filename = particleBinaryName( filename );
+    time_t text_time = 0, binary_time = 0;
+    const bool has_text = modificationTime( filename, text_time );
+    if ( modificationTime( binary_filename, binary_time ) && ( !has_text || binary_time >= text_time ) ) {
+        try {
+            return mapParticleFrame( binary_filename );
+        }
+        catch ( const std::exception& ) {
+            // not a valid frame, converted again below
+            if ( !has_text )
+                throw;
+        }
+    }
+
+    std::shared_ptr<ParticleFrame> frame = parseParticleText( filename );
+    writeParticleBinary( *frame, binary_filename );
+    return frame;
+}
+
+
+//------------------------------------------------------------------------------
+//
+// ParticleFrameCache
+//
+//------------------------------------------------------------------------------
+
+ParticleFrameCache::ParticleFrameCache( Loader loader, size_t capacity )
+    : m_loader( loader )
+    , m_capacity( std::max<size_t>( 1, capacity ) )
+    , m_hits( 0 )
+    , m_misses( 0 )
+    , m_loading( -1 )
+    , m_quit( false )
+{
+    m_thread = std::thread( &ParticleFrameCache::run, this );
+}
+
+
+ParticleFrameCache::~ParticleFrameCache()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_quit = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+
+void ParticleFrameCache::setCapacity( size_t capacity )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_capacity = std::max<size_t>( 1, capacity );
+    while ( m_entries.size() > m_capacity ) {
+        m_index.erase( m_entries.back().first );
+        m_entries.pop_back();
+    }
+}
+
+
+std::shared_ptr<const ParticleFrame> ParticleFrameCache::get( int frame )
+{
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        for ( ;; ) {
+            std::map<int, Entries::iterator>::iterator it = m_index.find( frame );
+            if ( it != m_index.end() ) {
+                m_entries.splice( m_entries.begin(), m_entries, it->second );
+                ++m_hits;
+                return m_entries.front().second;
+            }
+            if ( m_loading != frame )
+                break;
+
+            // being prefetched, waits for it
+            m_cond.wait( lock );
+        }
+        m_requests.erase( std::remove( m_requests.begin(), m_requests.end(), frame ), m_requests.end() );
+        ++m_misses;
+    }
+
+    std::shared_ptr<const ParticleFrame> data = m_loader( frame );
+    std::lock_guard<std::mutex> lock( m_mutex );
+    insert( frame, data );
+    return data;
+}
+
+
+void ParticleFrameCache::prefetch( int frame )
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_index.count( frame ) || m_loading == frame ||
+             std::find( m_requests.begin(), m_requests.end(), frame ) != m_requests.end() )
+            return;
+        m_requests.push_back( frame );
+    }
+    m_cond.notify_all();
+}
+
+
+// Called with m_mutex locked
+void ParticleFrameCache::insert( int frame, std::shared_ptr<const ParticleFrame> data )
+{
+    std::map<int, Entries::iterator>::iterator it = m_index.find( frame );
+    if ( it != m_index.end() ) {
+        m_entries.erase( it->second );
+        m_index.erase( it );
+    }
+    m_entries.push_front( std::make_pair( frame, data ) );
+    m_index[frame] = m_entries.begin();
+
+    while ( m_entries.size() > m_capacity ) {
+        m_index.erase( m_entries.back().first );
+        m_entries.pop_back();
+    }
+}
+
+
+void ParticleFrameCache::run()
+{
+    std::unique_lock<std::mutex> lock( m_mutex );
+    for ( ;; ) {
+        m_cond.wait( lock, [this]() { return m_quit || !m_requests.empty(); } );
+        if ( m_quit )
+            return;
+
+        const int frame = m_requests.front();
+        m_requests.pop_front();
+        if ( m_index.count( frame ) )
+            continue;
+
+        m_loading = frame;
+        lock.unlock();
+        std::shared_ptr<const ParticleFrame> data;
+        try {
+            data = m_loader( frame );
+        }
+        catch ( ... ) {
+            // reported by get() when the frame is needed
+        }
+        lock.lock();
+
+        m_loading = -1;
+        if ( data )
+            insert( frame, data );
+        m_cond.notify_all();
+    }
+}
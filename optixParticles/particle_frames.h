@@ -0,0 +1,170 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+//
+// Particle frames and their binary format
+//
+// A .txt frame has one particle per line: position, velocity, color and radius,
+// ten floats separated by blanks, '#' starts a comment line. The binary .pbin
+// format stores the same data as four arrays, each in the layout of the OptiX
+// buffer it is copied into (three packed floats for positions, velocities and
+// colors, one float for radii), behind a header with the particle count and the
+// bounding box of the spheres. Binary frames are mapped into memory and copied
+// straight from the mapping into the mapped OptiX buffers.
+//
+//------------------------------------------------------------------------------
+
+struct ParticleFileHeader
+{
+    char     magic[8];              // PARTICLE_FILE_MAGIC
+    uint32_t version;               // PARTICLE_FILE_VERSION
+    uint32_t count;
+    float    bbox_min[3];
+    float    bbox_max[3];
+    uint64_t positions_offset;      // in bytes from the start of the file,
+    uint64_t velocities_offset;     // all arrays are 64 byte aligned
+    uint64_t colors_offset;
+    uint64_t radii_offset;
+};
+
+#define PARTICLE_FILE_MAGIC   "OXPARTS"
+#define PARTICLE_FILE_VERSION 1u
+
+
+// Read-only view of one frame, owns the memory behind the arrays (a mapped
+// .pbin file or the result of parsing a .txt file)
+class ParticleFrame
+{
+public:
+    ParticleFrame();
+    ~ParticleFrame();
+
+    unsigned int count;
+    const float* positions;     // 3 floats per particle
+    const float* velocities;    // 3 floats per particle
+    const float* colors;        // 3 floats per particle
+    const float* radii;         // 1 float per particle
+    float        bbox_min[3];
+    float        bbox_max[3];
+
+private:
+    friend std::shared_ptr<ParticleFrame> mapParticleFrame( const std::string& );
+    friend std::shared_ptr<ParticleFrame> parseParticleText( const std::string& );
+
+    ParticleFrame( const ParticleFrame& );              // forbidden
+    ParticleFrame& operator=( const ParticleFrame& );   // forbidden
+
+    // one of the two is used
+    void*              m_mapping;
+    size_t             m_mapping_size;
+    std::vector<float> m_storage;
+};
+
+
+// Parses a .txt frame on all hardware threads. Throws std::runtime_error if the
+// file cannot be read.
+std::shared_ptr<ParticleFrame> parseParticleText( const std::string& filename );
+
+// Maps a .pbin frame. Throws std::runtime_error if the file cannot be mapped or is
+// not a valid frame.
+std::shared_ptr<ParticleFrame> mapParticleFrame( const std::string& filename );
+
+// Writes a frame as .pbin, returns false on failure
+bool writeParticleBinary( const ParticleFrame& frame, const std::string& filename );
+
+// The .pbin name of a .txt frame, "particles.0001.txt" -> "particles.0001.pbin"
+std::string particleBinaryName( const std::string& filename );
+
+// Loads a frame given by the name of its .txt file. Maps the .pbin next to it if
+// that is at least as new, otherwise parses the text and tries to write the .pbin
+// for the next run. A .pbin filename is mapped directly.
+std::shared_ptr<ParticleFrame> loadParticleFrame( const std::string& filename );
+
+
+// Keeps the most recently used frames and loads frames ahead of time on a
+// background thread
+class ParticleFrameCache
+{
+public:
+    typedef std::function<std::shared_ptr<ParticleFrame>( int frame )> Loader;
+
+    ParticleFrameCache( Loader loader, size_t capacity );
+    ~ParticleFrameCache();
+
+    void   setCapacity( size_t capacity );
+    size_t getCapacity() const { return m_capacity; }
+
+    // Returns the frame, loading it on the calling thread unless it is cached or
+    // being prefetched. Exceptions of the loader are passed on.
+    std::shared_ptr<const ParticleFrame> get( int frame );
+
+    // Starts loading the frame on the background thread if it is not cached.
+    // Errors are dropped, get() reports them when the frame is needed.
+    void prefetch( int frame );
+
+    // get() calls that found the frame cached or prefetched
+    size_t getHitCount() const { return m_hits; }
+    size_t getMissCount() const { return m_misses; }
+
+private:
+    typedef std::list< std::pair< int, std::shared_ptr<const ParticleFrame> > > Entries;
+
+    void insert( int frame, std::shared_ptr<const ParticleFrame> data );
+    void run();
+
+    Loader      m_loader;
+    size_t      m_capacity;
+    size_t      m_hits;
+    size_t      m_misses;
+
+    // Most recently used first, guarded by m_mutex like the prefetch state
+    Entries                         m_entries;
+    std::map<int, Entries::iterator> m_index;
+
+    std::mutex              m_mutex;
+    std::condition_variable m_cond;
+    std::deque<int>         m_requests;
+    int                     m_loading;    // frame of the background thread, -1 if idle
+    bool                    m_quit;
+    std::thread             m_thread;
+};
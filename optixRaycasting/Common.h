@@ -30,6 +30,9 @@
 
 #include <optixu/optixu_math_namespace.h>
 
+#include <stddef.h>
+#include <stdint.h>
+
 //
 // Common definitions shared by host and device code
 //
@@ -53,3 +56,18 @@ struct Hit
   optix::float2 texcoord;
 };
 
+
+//
+// Occlusion queries write one bit per ray: bit i%32 of word i/32 is set when ray i
+// hits anything between its tmin and tmax.
+//
+
+inline size_t occlusionMaskWords( size_t num_rays )
+{
+  return ( num_rays + 31 ) / 32;
+}
+
+inline bool isOccluded( const uint32_t* mask, size_t ray )
+{
+  return ( ( mask[ray / 32] >> ( ray % 32 ) ) & 1u ) != 0;
+}
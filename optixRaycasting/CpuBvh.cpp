@@ -0,0 +1,689 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "CpuBvh.h"
+#include "WorkStealingPool.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace {
+
+const int LEAF_SIZE = 4;
+const int SAH_BINS = 16;
+
+// Deeper binary nodes fall back to median splits, which bounds the traversal stack
+const int MAX_SAH_DEPTH = 48;
+const int STACK_SIZE = 256;
+
+// Leaves and nodes per chunk of a parallel refit
+const size_t REFIT_GRAIN = 1024;
+
+struct StackEntry
+{
+  int32_t code;
+  float   tnear;
+};
+
+inline float halfArea( const float* bmin, const float* bmax )
+{
+  const float dx = bmax[0] - bmin[0];
+  const float dy = bmax[1] - bmin[1];
+  const float dz = bmax[2] - bmin[2];
+  return dx*dy + dy*dz + dz*dx;
+}
+
+inline void growBounds( float* bmin, float* bmax, const float* other_min, const float* other_max )
+{
+  for( int k = 0; k < 3; ++k )
+  {
+    bmin[k] = std::min( bmin[k], other_min[k] );
+    bmax[k] = std::max( bmax[k], other_max[k] );
+  }
+}
+
+inline void emptyBounds( float* bmin, float* bmax )
+{
+  const float inf = std::numeric_limits<float>::infinity();
+  bmin[0] = bmin[1] = bmin[2] = inf;
+  bmax[0] = bmax[1] = bmax[2] = -inf;
+}
+
+// Node bounds grow by a few ulps. The slab test then never cuts off a triangle lying in
+// the face of its box, and a ray along a face with a zero direction component gets
+// infinite slab distances of the right sign instead of a NaN.
+inline void padBounds( float* bmin, float* bmax )
+{
+  for( int k = 0; k < 3; ++k )
+  {
+    const float pad = 1.e-6f * std::max( std::fabs( bmin[k] ), std::fabs( bmax[k] ) ) + 1.e-20f;
+    bmin[k] -= pad;
+    bmax[k] += pad;
+  }
+}
+
+// fn( begin, end ) over [0, count), on the pool if there is enough work
+template<typename Fn>
+void forRange( WorkStealingPool* pool, size_t count, const Fn& fn )
+{
+  if( !pool || pool->getNumThreads() == 1 || count <= REFIT_GRAIN )
+  {
+    fn( size_t( 0 ), count );
+    return;
+  }
+  pool->parallelFor( count, REFIT_GRAIN, [&]( size_t begin, size_t end, unsigned int ) { fn( begin, end ); } );
+}
+
+inline __m128 dot3( __m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz )
+{
+  return _mm_add_ps( _mm_add_ps( _mm_mul_ps( ax, bx ), _mm_mul_ps( ay, by ) ), _mm_mul_ps( az, bz ) );
+}
+
+} // namespace
+
+
+CpuBvh::CpuBvh()
+  : m_sah_cost( 0.0f )
+  , m_build_sah_cost( 0.0f )
+  , m_indices( NULL )
+  , m_positions( NULL )
+{
+}
+
+void CpuBvh::build( int num_triangles, const int32_t* indices, const float* positions )
+{
+  m_nodes.clear();
+  m_leaves.clear();
+  m_levels.clear();
+  m_level_begin.clear();
+  m_sah_cost = 0.0f;
+  m_build_sah_cost = 0.0f;
+  if( num_triangles <= 0 )
+    return;
+
+  m_indices = indices;
+  m_positions = positions;
+  m_prim_bounds.resize( 6 * num_triangles );
+  m_prim_centroids.resize( 3 * num_triangles );
+  m_order.resize( num_triangles );
+  for( int i = 0; i < num_triangles; ++i )
+  {
+    float* bmin = &m_prim_bounds[6*i];
+    float* bmax = bmin + 3;
+    emptyBounds( bmin, bmax );
+    for( int j = 0; j < 3; ++j )
+    {
+      const float* p = positions + 3*indices[3*i+j];
+      growBounds( bmin, bmax, p, p );
+    }
+    for( int k = 0; k < 3; ++k )
+      m_prim_centroids[3*i+k] = 0.5f * ( bmin[k] + bmax[k] );
+    m_order[i] = i;
+  }
+
+  std::vector<BuildNode> nodes;
+  nodes.reserve( 2 * ( num_triangles / LEAF_SIZE + 1 ) );
+  buildBinary( nodes, 0, num_triangles, 0 );
+
+  m_nodes.reserve( nodes.size() / 3 + 1 );
+  m_leaves.reserve( nodes.size() / 2 + 1 );
+  if( nodes[0].left < 0 )
+  {
+    // A single leaf still gets a root node, traversal starts at node 0
+    Node root;
+    for( int k = 0; k < 3; ++k )
+      for( int c = 0; c < 4; ++c )
+      {
+        root.bmin[k][c] = std::numeric_limits<float>::infinity();
+        root.bmax[k][c] = -std::numeric_limits<float>::infinity();
+      }
+    for( int c = 0; c < 4; ++c )
+      root.child[c] = 0;
+    float bmin[3] = { nodes[0].bmin[0], nodes[0].bmin[1], nodes[0].bmin[2] };
+    float bmax[3] = { nodes[0].bmax[0], nodes[0].bmax[1], nodes[0].bmax[2] };
+    padBounds( bmin, bmax );
+    for( int k = 0; k < 3; ++k )
+    {
+      root.bmin[k][0] = bmin[k];
+      root.bmax[k][0] = bmax[k];
+    }
+    m_nodes.push_back( root );
+    m_nodes[0].child[0] = ~makeLeaf( nodes[0] );
+  }
+  else
+  {
+    collapse( nodes, 0 );
+  }
+
+  // Breadth first order of the nodes, so refit() can update a whole level at once
+  m_levels.assign( 1, 0 );
+  m_level_begin.assign( 1, 0 );
+  size_t level_end = 1;
+  for( size_t i = 0; i < m_levels.size(); ++i )
+  {
+    if( i == level_end )
+    {
+      m_level_begin.push_back( i );
+      level_end = m_levels.size();
+    }
+    for( int c = 0; c < 4; ++c )
+    {
+      // Node 0 is the root, a child code of 0 is an unused slot
+      const int32_t code = m_nodes[m_levels[i]].child[c];
+      if( code > 0 )
+        m_levels.push_back( code );
+    }
+  }
+  m_level_begin.push_back( m_levels.size() );
+
+  // Unchanged positions reproduce the bounds of the build exactly
+  refit( indices, positions, NULL );
+  m_build_sah_cost = m_sah_cost;
+
+  m_indices = NULL;
+  m_positions = NULL;
+  std::vector<float>().swap( m_prim_bounds );
+  std::vector<float>().swap( m_prim_centroids );
+  std::vector<int>().swap( m_order );
+}
+
+int CpuBvh::buildBinary( std::vector<BuildNode>& nodes, int begin, int end, int depth )
+{
+  const int index = static_cast<int>( nodes.size() );
+  nodes.push_back( BuildNode() );
+
+  BuildNode node;
+  node.left = -1;
+  node.right = -1;
+  node.first = begin;
+  node.count = end - begin;
+
+  float cmin[3], cmax[3];
+  emptyBounds( node.bmin, node.bmax );
+  emptyBounds( cmin, cmax );
+  for( int i = begin; i < end; ++i )
+  {
+    const int prim = m_order[i];
+    const float* bounds = &m_prim_bounds[6*prim];
+    const float* centroid = &m_prim_centroids[3*prim];
+    growBounds( node.bmin, node.bmax, bounds, bounds + 3 );
+    growBounds( cmin, cmax, centroid, centroid );
+  }
+
+  if( node.count <= LEAF_SIZE )
+  {
+    nodes[index] = node;
+    return index;
+  }
+
+  // Binned SAH over the centroids, on all three axes
+  int   best_axis = -1;
+  int   best_split = 0;
+  float best_cost = std::numeric_limits<float>::max();
+  if( depth < MAX_SAH_DEPTH )
+  {
+    for( int axis = 0; axis < 3; ++axis )
+    {
+      const float extent = cmax[axis] - cmin[axis];
+      if( !( extent > 0.0f ) )
+        continue;
+      const float scale = SAH_BINS / extent;
+
+      int   bin_count[SAH_BINS];
+      float bin_min[SAH_BINS][3];
+      float bin_max[SAH_BINS][3];
+      for( int b = 0; b < SAH_BINS; ++b )
+      {
+        bin_count[b] = 0;
+        emptyBounds( bin_min[b], bin_max[b] );
+      }
+      for( int i = begin; i < end; ++i )
+      {
+        const int prim = m_order[i];
+        const int b = std::min( SAH_BINS - 1, static_cast<int>( ( m_prim_centroids[3*prim+axis] - cmin[axis] ) * scale ) );
+        ++bin_count[b];
+        growBounds( bin_min[b], bin_max[b], &m_prim_bounds[6*prim], &m_prim_bounds[6*prim+3] );
+      }
+
+      // Cost of the right side of each split, then sweep from the left
+      float right_area[SAH_BINS];
+      int   right_count[SAH_BINS];
+      float acc_min[3], acc_max[3];
+      int   acc_count = 0;
+      emptyBounds( acc_min, acc_max );
+      for( int b = SAH_BINS - 1; b > 0; --b )
+      {
+        growBounds( acc_min, acc_max, bin_min[b], bin_max[b] );
+        acc_count += bin_count[b];
+        right_area[b] = acc_count > 0 ? halfArea( acc_min, acc_max ) : 0.0f;
+        right_count[b] = acc_count;
+      }
+
+      emptyBounds( acc_min, acc_max );
+      acc_count = 0;
+      for( int b = 0; b < SAH_BINS - 1; ++b )
+      {
+        growBounds( acc_min, acc_max, bin_min[b], bin_max[b] );
+        acc_count += bin_count[b];
+        if( acc_count == 0 || right_count[b+1] == 0 )
+          continue;
+        const float cost = halfArea( acc_min, acc_max ) * acc_count + right_area[b+1] * right_count[b+1];
+        if( cost < best_cost )
+        {
+          best_cost = cost;
+          best_axis = axis;
+          best_split = b;
+        }
+      }
+    }
+  }
+
+  int mid = begin;
+  if( best_axis >= 0 )
+  {
+    const float scale = SAH_BINS / ( cmax[best_axis] - cmin[best_axis] );
+    const float origin = cmin[best_axis];
+    const std::vector<float>& centroids = m_prim_centroids;
+    mid = static_cast<int>( std::partition( m_order.begin() + begin, m_order.begin() + end,
+      [&]( int prim ) {
+        return std::min( SAH_BINS - 1, static_cast<int>( ( centroids[3*prim+best_axis] - origin ) * scale ) ) <= best_split;
+      } ) - m_order.begin() );
+  }
+
+  if( mid == begin || mid == end )
+  {
+    // Coincident centroids or too deep, split at the median of the widest axis
+    int axis = 0;
+    for( int k = 1; k < 3; ++k )
+      if( cmax[k] - cmin[k] > cmax[axis] - cmin[axis] )
+        axis = k;
+    const std::vector<float>& centroids = m_prim_centroids;
+    mid = begin + ( end - begin ) / 2;
+    std::nth_element( m_order.begin() + begin, m_order.begin() + mid, m_order.begin() + end,
+      [&]( int a, int b ) { return centroids[3*a+axis] < centroids[3*b+axis]; } );
+  }
+
+  node.left = buildBinary( nodes, begin, mid, depth + 1 );
+  node.right = buildBinary( nodes, mid, end, depth + 1 );
+  nodes[index] = node;
+  return index;
+}
+
+int CpuBvh::collapse( const std::vector<BuildNode>& nodes, int index )
+{
+  const int node_index = static_cast<int>( m_nodes.size() );
+  m_nodes.push_back( Node() );
+
+  // Open the largest interior children until there are four
+  int children[4] = { nodes[index].left, nodes[index].right, -1, -1 };
+  int num_children = 2;
+  while( num_children < 4 )
+  {
+    int   best = -1;
+    float best_area = -1.0f;
+    for( int i = 0; i < num_children; ++i )
+    {
+      const BuildNode& child = nodes[children[i]];
+      const float area = halfArea( child.bmin, child.bmax );
+      if( child.left >= 0 && area > best_area )
+      {
+        best = i;
+        best_area = area;
+      }
+    }
+    if( best < 0 )
+      break;
+    const BuildNode& opened = nodes[children[best]];
+    children[best] = opened.left;
+    children[num_children++] = opened.right;
+  }
+
+  Node node;
+  for( int c = 0; c < 4; ++c )
+  {
+    float bmin[3], bmax[3];
+    int32_t code = 0;
+    if( c < num_children )
+    {
+      const BuildNode& child = nodes[children[c]];
+      for( int k = 0; k < 3; ++k )
+      {
+        bmin[k] = child.bmin[k];
+        bmax[k] = child.bmax[k];
+      }
+      padBounds( bmin, bmax );
+      code = child.left < 0 ? ~makeLeaf( child ) : collapse( nodes, children[c] );
+    }
+    else
+    {
+      emptyBounds( bmin, bmax );
+    }
+
+    for( int k = 0; k < 3; ++k )
+    {
+      node.bmin[k][c] = bmin[k];
+      node.bmax[k][c] = bmax[k];
+    }
+    node.child[c] = code;
+  }
+
+  m_nodes[node_index] = node;
+  return node_index;
+}
+
+int CpuBvh::makeLeaf( const BuildNode& node )
+{
+  static const float zero[3] = { 0.0f, 0.0f, 0.0f };
+
+  Leaf leaf;
+  for( int c = 0; c < 4; ++c )
+  {
+    if( c < node.count )
+    {
+      const int triId = m_order[node.first + c];
+      setTriangle( leaf, c, m_positions + 3*m_indices[3*triId+0], m_positions + 3*m_indices[3*triId+1],
+        m_positions + 3*m_indices[3*triId+2] );
+      leaf.triId[c] = triId;
+    }
+    else
+    {
+      setTriangle( leaf, c, zero, zero, zero );
+      leaf.triId[c] = -1;
+    }
+  }
+
+  m_leaves.push_back( leaf );
+  return static_cast<int>( m_leaves.size() ) - 1;
+}
+
+void CpuBvh::setTriangle( Leaf& leaf, int slot, const float* v0, const float* v1, const float* v2 )
+{
+  float e0[3], e1[3];
+  for( int k = 0; k < 3; ++k )
+  {
+    e0[k] = v1[k] - v0[k];
+    e1[k] = v0[k] - v2[k];
+    leaf.p0[k][slot] = v0[k];
+    leaf.e0[k][slot] = e0[k];
+    leaf.e1[k][slot] = e1[k];
+  }
+  leaf.n[0][slot] = e1[1]*e0[2] - e1[2]*e0[1];
+  leaf.n[1][slot] = e1[2]*e0[0] - e1[0]*e0[2];
+  leaf.n[2][slot] = e1[0]*e0[1] - e1[1]*e0[0];
+}
+
+void CpuBvh::refit( const int32_t* indices, const float* positions, WorkStealingPool* pool )
+{
+  if( m_nodes.empty() )
+    return;
+
+  m_leaf_bounds.resize( 6 * m_leaves.size() );
+  m_node_bounds.resize( 6 * m_nodes.size() );
+
+  forRange( pool, m_leaves.size(), [&]( size_t begin, size_t end ) {
+    refitLeaves( indices, positions, begin, end );
+  } );
+
+  // Children are on deeper levels, so each level only reads bounds that are done
+  for( size_t level = m_level_begin.size() - 1; level-- > 0; )
+  {
+    const size_t first = m_level_begin[level];
+    forRange( pool, m_level_begin[level+1] - first, [&]( size_t begin, size_t end ) {
+      refitNodes( first + begin, first + end );
+    } );
+  }
+
+  m_sah_cost = computeSahCost();
+}
+
+void CpuBvh::refitLeaves( const int32_t* indices, const float* positions, size_t begin, size_t end )
+{
+  for( size_t l = begin; l < end; ++l )
+  {
+    Leaf& leaf = m_leaves[l];
+    float* bmin = &m_leaf_bounds[6*l];
+    float* bmax = bmin + 3;
+    emptyBounds( bmin, bmax );
+    for( int c = 0; c < 4; ++c )
+    {
+      const int triId = leaf.triId[c];
+      if( triId < 0 )
+        continue;
+      const float* v0 = positions + 3*indices[3*triId+0];
+      const float* v1 = positions + 3*indices[3*triId+1];
+      const float* v2 = positions + 3*indices[3*triId+2];
+      setTriangle( leaf, c, v0, v1, v2 );
+      growBounds( bmin, bmax, v0, v0 );
+      growBounds( bmin, bmax, v1, v1 );
+      growBounds( bmin, bmax, v2, v2 );
+    }
+  }
+}
+
+void CpuBvh::refitNodes( size_t begin, size_t end )
+{
+  for( size_t i = begin; i < end; ++i )
+  {
+    const int32_t index = m_levels[i];
+    Node& node = m_nodes[index];
+    float* node_min = &m_node_bounds[6*index];
+    float* node_max = node_min + 3;
+    emptyBounds( node_min, node_max );
+    for( int c = 0; c < 4; ++c )
+    {
+      const int32_t code = node.child[c];
+      if( code == 0 )
+        continue;
+      const float* child = code > 0 ? &m_node_bounds[6*code] : &m_leaf_bounds[6*~code];
+      growBounds( node_min, node_max, child, child + 3 );
+
+      float bmin[3] = { child[0], child[1], child[2] };
+      float bmax[3] = { child[3], child[4], child[5] };
+      padBounds( bmin, bmax );
+      for( int k = 0; k < 3; ++k )
+      {
+        node.bmin[k][c] = bmin[k];
+        node.bmax[k][c] = bmax[k];
+      }
+    }
+  }
+}
+
+float CpuBvh::computeSahCost() const
+{
+  const float root_area = halfArea( &m_node_bounds[0], &m_node_bounds[3] );
+  if( !( root_area > 0.0f ) )
+    return 0.0f;
+
+  double cost = 0.0;
+  for( size_t n = 0; n < m_nodes.size(); ++n )
+    cost += halfArea( &m_node_bounds[6*n], &m_node_bounds[6*n+3] );
+  for( size_t l = 0; l < m_leaves.size(); ++l )
+  {
+    int count = 0;
+    for( int c = 0; c < 4; ++c )
+      count += m_leaves[l].triId[c] >= 0 ? 1 : 0;
+    cost += halfArea( &m_leaf_bounds[6*l], &m_leaf_bounds[6*l+3] ) * count;
+  }
+  return static_cast<float>( cost / root_area );
+}
+
+bool CpuBvh::intersect( const Ray& ray, CpuBvhHit& hit, CpuBvhFilter filter, const void* filter_data ) const
+{
+  return traverse<false>( ray, hit, filter, filter_data );
+}
+
+bool CpuBvh::occluded( const Ray& ray, CpuBvhFilter filter, const void* filter_data ) const
+{
+  CpuBvhHit hit;
+  return traverse<true>( ray, hit, filter, filter_data );
+}
+
+template<bool AnyHit>
+bool CpuBvh::traverse( const Ray& ray, CpuBvhHit& hit, CpuBvhFilter filter, const void* filter_data ) const
+{
+  hit.triId = -1;
+  if( m_nodes.empty() )
+    return false;
+
+  const float inv_dir[3] = { 1.0f / ray.dir.x, 1.0f / ray.dir.y, 1.0f / ray.dir.z };
+  const bool  negative[3] = { inv_dir[0] < 0.0f, inv_dir[1] < 0.0f, inv_dir[2] < 0.0f };
+
+  const __m128 org_x  = _mm_set1_ps( ray.origin.x );
+  const __m128 org_y  = _mm_set1_ps( ray.origin.y );
+  const __m128 org_z  = _mm_set1_ps( ray.origin.z );
+  const __m128 dir_x  = _mm_set1_ps( ray.dir.x );
+  const __m128 dir_y  = _mm_set1_ps( ray.dir.y );
+  const __m128 dir_z  = _mm_set1_ps( ray.dir.z );
+  const __m128 idir_x = _mm_set1_ps( inv_dir[0] );
+  const __m128 idir_y = _mm_set1_ps( inv_dir[1] );
+  const __m128 idir_z = _mm_set1_ps( inv_dir[2] );
+  const __m128 tmin   = _mm_set1_ps( ray.tmin );
+  const __m128 zero   = _mm_setzero_ps();
+  const __m128 one    = _mm_set1_ps( 1.0f );
+  float tmax = ray.tmax;
+
+  // The nearest hit child of a node is visited next, the others wait on the stack
+  StackEntry stack[STACK_SIZE];
+  int sp = 0;
+  int32_t code = 0;
+
+  for( ;; )
+  {
+    if( code >= 0 )
+    {
+      // Slab test of the four children, near and far planes picked by the ray direction
+      const Node& node = m_nodes[code];
+      const __m128 near_x = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( negative[0] ? node.bmax[0] : node.bmin[0] ), org_x ), idir_x );
+      const __m128 near_y = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( negative[1] ? node.bmax[1] : node.bmin[1] ), org_y ), idir_y );
+      const __m128 near_z = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( negative[2] ? node.bmax[2] : node.bmin[2] ), org_z ), idir_z );
+      const __m128 far_x  = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( negative[0] ? node.bmin[0] : node.bmax[0] ), org_x ), idir_x );
+      const __m128 far_y  = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( negative[1] ? node.bmin[1] : node.bmax[1] ), org_y ), idir_y );
+      const __m128 far_z  = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( negative[2] ? node.bmin[2] : node.bmax[2] ), org_z ), idir_z );
+      const __m128 tnear = _mm_max_ps( _mm_max_ps( near_x, near_y ), _mm_max_ps( near_z, tmin ) );
+      const __m128 tfar  = _mm_min_ps( _mm_min_ps( far_x, far_y ), _mm_min_ps( far_z, _mm_set1_ps( tmax ) ) );
+      const int mask = _mm_movemask_ps( _mm_cmple_ps( tnear, tfar ) );
+
+      if( mask != 0 && ( mask & ( mask - 1 ) ) == 0 )
+      {
+        code = node.child[mask == 1 ? 0 : mask == 2 ? 1 : mask == 4 ? 2 : 3];
+        continue;
+      }
+      if( mask != 0 )
+      {
+        float tnear_lanes[4];
+        _mm_storeu_ps( tnear_lanes, tnear );
+
+        // Push the hit children sorted far to near and continue with the top one. Any
+        // hit ends the traversal of occlusion rays, which skip the sort.
+        const int base = sp;
+        for( int c = 0; c < 4; ++c )
+        {
+          if( !( mask & ( 1 << c ) ) )
+            continue;
+          StackEntry child;
+          child.code = node.child[c];
+          child.tnear = tnear_lanes[c];
+          int j = sp++;
+          while( !AnyHit && j > base && stack[j-1].tnear < child.tnear )
+          {
+            stack[j] = stack[j-1];
+            --j;
+          }
+          stack[j] = child;
+        }
+        code = stack[--sp].code;
+        continue;
+      }
+    }
+    else
+    {
+      const Leaf& leaf = m_leaves[~code];
+      const __m128 n_x = _mm_loadu_ps( leaf.n[0] );
+      const __m128 n_y = _mm_loadu_ps( leaf.n[1] );
+      const __m128 n_z = _mm_loadu_ps( leaf.n[2] );
+      const __m128 inv = _mm_div_ps( one, dot3( n_x, n_y, n_z, dir_x, dir_y, dir_z ) );
+      const __m128 e2_x = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( leaf.p0[0] ), org_x ), inv );
+      const __m128 e2_y = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( leaf.p0[1] ), org_y ), inv );
+      const __m128 e2_z = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( leaf.p0[2] ), org_z ), inv );
+      const __m128 i_x = _mm_sub_ps( _mm_mul_ps( dir_y, e2_z ), _mm_mul_ps( dir_z, e2_y ) );
+      const __m128 i_y = _mm_sub_ps( _mm_mul_ps( dir_z, e2_x ), _mm_mul_ps( dir_x, e2_z ) );
+      const __m128 i_z = _mm_sub_ps( _mm_mul_ps( dir_x, e2_y ), _mm_mul_ps( dir_y, e2_x ) );
+      const __m128 beta  = dot3( i_x, i_y, i_z, _mm_loadu_ps( leaf.e1[0] ), _mm_loadu_ps( leaf.e1[1] ), _mm_loadu_ps( leaf.e1[2] ) );
+      const __m128 gamma = dot3( i_x, i_y, i_z, _mm_loadu_ps( leaf.e0[0] ), _mm_loadu_ps( leaf.e0[1] ), _mm_loadu_ps( leaf.e0[2] ) );
+      const __m128 t     = dot3( n_x, n_y, n_z, e2_x, e2_y, e2_z );
+
+      // NaNs of unused slots and degenerate triangles fail all compares
+      __m128 valid = _mm_and_ps( _mm_cmplt_ps( t, _mm_set1_ps( tmax ) ), _mm_cmpgt_ps( t, tmin ) );
+      valid = _mm_and_ps( valid, _mm_and_ps( _mm_cmpge_ps( beta, zero ), _mm_cmpge_ps( gamma, zero ) ) );
+      valid = _mm_and_ps( valid, _mm_cmple_ps( _mm_add_ps( beta, gamma ), one ) );
+      int mask = _mm_movemask_ps( valid );
+      if( AnyHit && mask != 0 && !filter )
+        return true;
+      if( mask != 0 )
+      {
+        float t_lanes[4], beta_lanes[4], gamma_lanes[4];
+        _mm_storeu_ps( t_lanes, t );
+        _mm_storeu_ps( beta_lanes, beta );
+        _mm_storeu_ps( gamma_lanes, gamma );
+        while( mask != 0 )
+        {
+          int c = -1;
+          for( int i = 0; i < 4; ++i )
+            if( ( mask & ( 1 << i ) ) && ( c < 0 || t_lanes[i] < t_lanes[c] ) )
+              c = i;
+          mask &= ~( 1 << c );
+
+          if( filter && !filter( filter_data, leaf.triId[c], beta_lanes[c], gamma_lanes[c] ) )
+            continue;
+          if( AnyHit )
+            return true;
+
+          tmax = t_lanes[c];
+          hit.t = t_lanes[c];
+          hit.triId = leaf.triId[c];
+          hit.u = beta_lanes[c];
+          hit.v = gamma_lanes[c];
+          break;
+        }
+      }
+    }
+
+    // Next entry that may still be closer than the current hit
+    do
+    {
+      if( sp == 0 )
+        return hit.triId >= 0;
+    } while( stack[--sp].tnear > tmax );
+    code = stack[sp].code;
+  }
+}
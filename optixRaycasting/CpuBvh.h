@@ -0,0 +1,152 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "Common.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Forward decls
+class WorkStealingPool;
+
+// A 4-wide BVH over a triangle mesh for ray queries on the CPU.
+
+// The tree is built with a binned SAH split into a binary tree, which is then collapsed
+// so each node holds the bounds of up to four children. Traversal tests a ray against
+// all four child boxes at once with SSE. Leaves hold up to four triangles, also stored
+// for testing them at once, with the same intersection formula as intersect_triangle()
+// in OptiX so the CPU and GPU paths agree on the hits.
+//
+// For animated vertices with a fixed topology, refit() keeps the tree and recomputes
+// the leaf triangles and all bounds bottom-up, one level of nodes at a time. The SAH
+// cost tells how much the tree has degraded since the last build, so the caller can
+// decide when a rebuild pays off.
+
+struct CpuBvhHit
+{
+  float t;
+  int   triId;
+  float u;  // barycentrics of vertices 1 and 2, as Hit::u and Hit::v
+  float v;
+};
+
+// Called for candidate hits closer than the current closest one. Returning false
+// ignores the hit and traversal continues, like rtIgnoreIntersection() in any-hit.
+typedef bool (*CpuBvhFilter)( const void* data, int triId, float u, float v );
+
+class CpuBvh
+{
+public:
+  CpuBvh();
+
+  // indices: 3 per triangle, positions: 3 floats per vertex
+  void build( int num_triangles, const int32_t* indices, const float* positions );
+
+  // Closest hit with ray.tmin < t < ray.tmax
+  bool intersect( const Ray& ray, CpuBvhHit& hit, CpuBvhFilter filter = NULL, const void* filter_data = NULL ) const;
+
+  // Any hit with ray.tmin < t < ray.tmax. Stops at the first hit the filter accepts.
+  bool occluded( const Ray& ray, CpuBvhFilter filter = NULL, const void* filter_data = NULL ) const;
+
+  // New vertex positions for the triangles and indices of the last build(). The leaves
+  // and each level of nodes run on the pool, if there is one.
+  void refit( const int32_t* indices, const float* positions, WorkStealingPool* pool = NULL );
+
+  // Surface area heuristic cost: the areas of the nodes plus the areas of the leaves
+  // times their triangle counts, relative to the area of the root
+  float getSahCost() const { return m_sah_cost; }
+  float getBuildSahCost() const { return m_build_sah_cost; }
+
+  size_t getNodeCount() const { return m_nodes.size(); }
+  size_t getLeafCount() const { return m_leaves.size(); }
+
+private:
+  // Children of a node, in structure of arrays layout. child[i] >= 0 is a node index,
+  // a leaf is stored as ~leaf_index. Unused slots have empty bounds, which no ray hits.
+  struct Node
+  {
+    float   bmin[3][4];
+    float   bmax[3][4];
+    int32_t child[4];
+  };
+
+  // Up to four triangles as p0 and the edges and normal of intersect_triangle().
+  // Unused slots have a zero normal, which no ray hits.
+  struct Leaf
+  {
+    float   p0[3][4];
+    float   e0[3][4];   // p1 - p0
+    float   e1[3][4];   // p0 - p2
+    float   n[3][4];    // cross( e1, e0 )
+    int32_t triId[4];
+  };
+
+  // Binary tree of the SAH build, before it is collapsed
+  struct BuildNode
+  {
+    float bmin[3];
+    float bmax[3];
+    int   left;    // -1 for leaves
+    int   right;
+    int   first;   // range of m_order in leaves
+    int   count;
+  };
+
+  int  buildBinary( std::vector<BuildNode>& nodes, int begin, int end, int depth );
+  int  collapse( const std::vector<BuildNode>& nodes, int index );
+  int  makeLeaf( const BuildNode& node );
+  static void setTriangle( Leaf& leaf, int slot, const float* v0, const float* v1, const float* v2 );
+
+  void  refitLeaves( const int32_t* indices, const float* positions, size_t begin, size_t end );
+  void  refitNodes( size_t begin, size_t end );
+  float computeSahCost() const;
+
+  template<bool AnyHit>
+  bool traverse( const Ray& ray, CpuBvhHit& hit, CpuBvhFilter filter, const void* filter_data ) const;
+
+  std::vector<Node> m_nodes;
+  std::vector<Leaf> m_leaves;
+
+  // For refit(): the nodes ordered by depth with the start of each level, and the
+  // unpadded bounds of the nodes and leaves, 6 floats each
+  std::vector<int32_t> m_levels;
+  std::vector<size_t>  m_level_begin;
+  std::vector<float>   m_node_bounds;
+  std::vector<float>   m_leaf_bounds;
+  float                m_sah_cost;
+  float                m_build_sah_cost;
+
+  // Build inputs, only valid during build()
+  const int32_t*     m_indices;
+  const float*       m_positions;
+  std::vector<float> m_prim_bounds;     // 6 per triangle
+  std::vector<float> m_prim_centroids;  // 3 per triangle
+  std::vector<int>   m_order;
+};
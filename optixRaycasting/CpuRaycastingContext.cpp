@@ -0,0 +1,435 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Common.h"
+#include "CpuRaycastingContext.h"
+#include "WorkStealingPool.h"
+
+#include <PPMLoader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+
+// Rays per chunk of the thread pool, a few ten microseconds of work. Whole words of the
+// occlusion mask, so no two threads write the same word.
+const size_t RAY_CHUNK_SIZE = 256;
+static_assert( RAY_CHUNK_SIZE % 32 == 0, "Chunks must cover whole occlusion mask words" );
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsBetween( Clock::time_point begin, Clock::time_point end )
+{
+  return std::chrono::duration<double>( end - begin ).count();
+}
+
+CpuRaycastingContext::CpuRaycastingContext( unsigned int num_threads )
+  : m_pool( new WorkStealingPool( num_threads ) )
+  , m_bvh_refit( false )
+  , m_max_sah_growth( 1.5f )
+  , m_mask_width( 0 )
+  , m_mask_height( 0 )
+  , m_rays( NULL )
+  , m_num_rays( 0 )
+  , m_hits( NULL )
+  , m_num_hits( 0 )
+  , m_occlusion( NULL )
+  , m_num_occlusion_rays( 0 )
+  , m_sort_rays( false )
+{
+  m_bvh_stats.build_seconds = 0.0;
+  m_bvh_stats.refit_seconds = 0.0;
+  m_bvh_stats.sah_growth = 1.0f;
+  m_bvh_stats.refits = 0;
+  m_bvh_stats.rebuilds = 0;
+  m_stats.sort_seconds = 0.0;
+  m_stats.trace_seconds = 0.0;
+  m_stats.scatter_seconds = 0.0;
+  m_stats.sort_passes = 0;
+}
+
+CpuRaycastingContext::~CpuRaycastingContext()
+{
+}
+
+void CpuRaycastingContext::setNumThreads( unsigned int num_threads )
+{
+  m_pool.reset();
+  m_pool.reset( new WorkStealingPool( num_threads ) );
+}
+
+unsigned int CpuRaycastingContext::getNumThreads() const
+{
+  return m_pool->getNumThreads();
+}
+
+size_t CpuRaycastingContext::getStealCount() const
+{
+  return m_pool->getStealCount();
+}
+
+void CpuRaycastingContext::setTriangles( int num_triangles, int32_t* indices, int num_vertices, float* positions, float* texcoords )
+{
+  m_indices.assign( indices, indices + 3*num_triangles );
+  m_positions.assign( positions, positions + 3*num_vertices );
+  if( texcoords )
+    m_texcoords.assign( texcoords, texcoords + 2*num_vertices );
+  else
+    m_texcoords.clear();
+
+  const Clock::time_point build_begin = Clock::now();
+  m_bvh.build( num_triangles, m_indices.data(), m_positions.data() );
+  m_bvh_stats.build_seconds = secondsBetween( build_begin, Clock::now() );
+  m_bvh_stats.refit_seconds = 0.0;
+  m_bvh_stats.sah_growth = 1.0f;
+  m_bvh_stats.refits = 0;
+  m_bvh_stats.rebuilds = 0;
+}
+
+void CpuRaycastingContext::updatePositions( const float* positions )
+{
+  std::copy( positions, positions + m_positions.size(), m_positions.begin() );
+  const int num_triangles = static_cast<int>( m_indices.size() / 3 );
+
+  m_bvh_stats.build_seconds = 0.0;
+  m_bvh_stats.refit_seconds = 0.0;
+  if( m_bvh_refit )
+  {
+    const Clock::time_point refit_begin = Clock::now();
+    m_bvh.refit( m_indices.data(), m_positions.data(), m_pool.get() );
+    m_bvh_stats.refit_seconds = secondsBetween( refit_begin, Clock::now() );
+    ++m_bvh_stats.refits;
+
+    const float build_cost = m_bvh.getBuildSahCost();
+    m_bvh_stats.sah_growth = build_cost > 0.0f ? m_bvh.getSahCost() / build_cost : 1.0f;
+    if( m_bvh_stats.sah_growth <= m_max_sah_growth )
+      return;
+  }
+
+  const Clock::time_point build_begin = Clock::now();
+  m_bvh.build( num_triangles, m_indices.data(), m_positions.data() );
+  m_bvh_stats.build_seconds = secondsBetween( build_begin, Clock::now() );
+  m_bvh_stats.sah_growth = 1.0f;
+  ++m_bvh_stats.rebuilds;
+}
+
+void CpuRaycastingContext::setRaysHostPointer( const Ray* rays, size_t n )
+{
+  m_rays = rays;
+  m_num_rays = n;
+}
+
+void CpuRaycastingContext::setHitsHostPointer( Hit* hits, size_t n )
+{
+  m_hits = hits;
+  m_num_hits = n;
+}
+
+void CpuRaycastingContext::setOcclusionMaskHostPointer( uint32_t* mask, size_t num_rays )
+{
+  m_occlusion = mask;
+  m_num_occlusion_rays = num_rays;
+}
+
+void CpuRaycastingContext::setMask( const char* texture_filename )
+{
+  // Like sutil::loadTexture(), a mask that fails to load is opaque
+  PPMLoader ppm( texture_filename );
+  if( ppm.failed() )
+  {
+    m_mask.clear();
+    m_mask_width = 0;
+    m_mask_height = 0;
+    return;
+  }
+
+  // Same orientation as the texture buffer of PPMLoader::loadTexture()
+  m_mask_width = static_cast<int>( ppm.width() );
+  m_mask_height = static_cast<int>( ppm.height() );
+  m_mask.resize( size_t( m_mask_width ) * m_mask_height );
+  const unsigned char* raster = ppm.raster();
+  for( int j = 0; j < m_mask_height; ++j )
+    for( int i = 0; i < m_mask_width; ++i )
+      m_mask[size_t( j )*m_mask_width + i] = raster[( size_t( m_mask_height-j-1 )*m_mask_width + i )*3] / 255.0f;
+}
+
+void CpuRaycastingContext::execute()
+{
+  if( m_num_rays > 0 && ( !m_rays || !m_hits ) )
+    throw std::runtime_error( "CpuRaycastingContext: Ray and hit buffers must be set before execute" );
+
+  const size_t n = std::min( m_num_rays, m_num_hits );
+  if( m_sort_rays )
+  {
+    executeSorted( n, false );
+    return;
+  }
+
+  const Clock::time_point trace_begin = Clock::now();
+  m_pool->parallelFor( n, RAY_CHUNK_SIZE, [this]( size_t begin, size_t end, unsigned int ) {
+    traceRays( m_rays, m_hits, begin, end );
+  } );
+  m_stats.sort_seconds = 0.0;
+  m_stats.trace_seconds = secondsBetween( trace_begin, Clock::now() );
+  m_stats.scatter_seconds = 0.0;
+  m_stats.sort_passes = 0;
+}
+
+void CpuRaycastingContext::executeOcclusion()
+{
+  if( m_num_rays > 0 && ( !m_rays || !m_occlusion ) )
+    throw std::runtime_error( "CpuRaycastingContext: Ray and occlusion mask buffers must be set before executeOcclusion" );
+
+  const size_t n = std::min( m_num_rays, m_num_occlusion_rays );
+  if( m_sort_rays )
+  {
+    executeSorted( n, true );
+    return;
+  }
+
+  const Clock::time_point trace_begin = Clock::now();
+  m_pool->parallelFor( n, RAY_CHUNK_SIZE, [this]( size_t begin, size_t end, unsigned int ) {
+    traceOcclusion( begin, end );
+  } );
+  m_stats.sort_seconds = 0.0;
+  m_stats.trace_seconds = secondsBetween( trace_begin, Clock::now() );
+  m_stats.scatter_seconds = 0.0;
+  m_stats.sort_passes = 0;
+}
+
+void CpuRaycastingContext::executeSorted( size_t n, bool occlusion )
+{
+  const Clock::time_point sort_begin = Clock::now();
+  m_sorter.sort( m_rays, n, *m_pool );
+  const uint32_t* order = m_sorter.getOrder().data();
+  m_sorted_rays.resize( n );
+  m_pool->parallelFor( n, RAY_CHUNK_SIZE, [this, order]( size_t begin, size_t end, unsigned int ) {
+    for( size_t i = begin; i < end; ++i )
+      m_sorted_rays[i] = m_rays[order[i]];
+  } );
+
+  const Clock::time_point trace_begin = Clock::now();
+  if( occlusion )
+  {
+    const CpuBvhFilter filter = m_mask.empty() ? NULL : &CpuRaycastingContext::maskFilter;
+    m_sorted_occluded.resize( n );
+    m_pool->parallelFor( n, RAY_CHUNK_SIZE, [this, filter]( size_t begin, size_t end, unsigned int ) {
+      for( size_t i = begin; i < end; ++i )
+        m_sorted_occluded[i] = m_bvh.occluded( m_sorted_rays[i], filter, this ) ? 1 : 0;
+    } );
+  }
+  else
+  {
+    m_sorted_hits.resize( n );
+    m_pool->parallelFor( n, RAY_CHUNK_SIZE, [this]( size_t begin, size_t end, unsigned int ) {
+      traceRays( m_sorted_rays.data(), m_sorted_hits.data(), begin, end );
+    } );
+  }
+
+  const Clock::time_point scatter_begin = Clock::now();
+  if( occlusion )
+  {
+    // Scatter one byte per ray, then pack whole words per chunk
+    m_occluded.resize( n );
+    m_pool->parallelFor( n, RAY_CHUNK_SIZE, [this, order]( size_t begin, size_t end, unsigned int ) {
+      for( size_t i = begin; i < end; ++i )
+        m_occluded[order[i]] = m_sorted_occluded[i];
+    } );
+    m_pool->parallelFor( n, RAY_CHUNK_SIZE, [this]( size_t begin, size_t end, unsigned int ) {
+      for( size_t word_begin = begin; word_begin < end; word_begin += 32 )
+      {
+        const size_t word_end = std::min( word_begin + 32, end );
+        uint32_t word = 0;
+        for( size_t r = word_begin; r < word_end; ++r )
+          word |= uint32_t( m_occluded[r] ) << ( r - word_begin );
+        m_occlusion[word_begin / 32] = word;
+      }
+    } );
+  }
+  else
+  {
+    m_pool->parallelFor( n, RAY_CHUNK_SIZE, [this, order]( size_t begin, size_t end, unsigned int ) {
+      for( size_t i = begin; i < end; ++i )
+        m_hits[order[i]] = m_sorted_hits[i];
+    } );
+  }
+  const Clock::time_point end = Clock::now();
+
+  m_stats.sort_seconds = secondsBetween( sort_begin, trace_begin );
+  m_stats.trace_seconds = secondsBetween( trace_begin, scatter_begin );
+  m_stats.scatter_seconds = secondsBetween( scatter_begin, end );
+  m_stats.sort_passes = m_sorter.getPassCount();
+}
+
+void CpuRaycastingContext::executeReference()
+{
+  if( m_num_rays > 0 && ( !m_rays || !m_hits ) )
+    throw std::runtime_error( "CpuRaycastingContext: Ray and hit buffers must be set before execute" );
+
+  const size_t n = std::min( m_num_rays, m_num_hits );
+  const int num_triangles = static_cast<int>( m_indices.size() / 3 );
+  for( size_t r = 0; r < n; ++r )
+  {
+    const Ray& ray = m_rays[r];
+    CpuBvhHit best;
+    best.t = ray.tmax;
+    best.triId = -1;
+    for( int tri = 0; tri < num_triangles; ++tri )
+    {
+      // intersect_triangle() of OptiX
+      const optix::float3 p0 = optix::make_float3( m_positions[3*m_indices[3*tri+0]], m_positions[3*m_indices[3*tri+0]+1], m_positions[3*m_indices[3*tri+0]+2] );
+      const optix::float3 p1 = optix::make_float3( m_positions[3*m_indices[3*tri+1]], m_positions[3*m_indices[3*tri+1]+1], m_positions[3*m_indices[3*tri+1]+2] );
+      const optix::float3 p2 = optix::make_float3( m_positions[3*m_indices[3*tri+2]], m_positions[3*m_indices[3*tri+2]+1], m_positions[3*m_indices[3*tri+2]+2] );
+      const optix::float3 e0 = p1 - p0;
+      const optix::float3 e1 = p0 - p2;
+      const optix::float3 n  = optix::cross( e1, e0 );
+      const optix::float3 e2 = ( 1.0f / optix::dot( n, ray.dir ) ) * ( p0 - ray.origin );
+      const optix::float3 i  = optix::cross( ray.dir, e2 );
+      const float beta  = optix::dot( i, e1 );
+      const float gamma = optix::dot( i, e0 );
+      const float t     = optix::dot( n, e2 );
+      if( t < best.t && t > ray.tmin && beta >= 0.0f && gamma >= 0.0f && beta + gamma <= 1.0f &&
+          maskFilter( this, tri, beta, gamma ) )
+      {
+        best.t = t;
+        best.triId = tri;
+        best.u = beta;
+        best.v = gamma;
+      }
+    }
+    writeHit( best, m_hits[r] );
+  }
+}
+
+void CpuRaycastingContext::traceRays( const Ray* rays, Hit* hits, size_t begin, size_t end ) const
+{
+  const CpuBvhFilter filter = m_mask.empty() ? NULL : &CpuRaycastingContext::maskFilter;
+  for( size_t r = begin; r < end; ++r )
+  {
+    CpuBvhHit h;
+    m_bvh.intersect( rays[r], h, filter, this );
+    writeHit( h, hits[r] );
+  }
+}
+
+// Bits past the last ray of the final word are cleared
+void CpuRaycastingContext::traceOcclusion( size_t begin, size_t end ) const
+{
+  const CpuBvhFilter filter = m_mask.empty() ? NULL : &CpuRaycastingContext::maskFilter;
+  for( size_t word_begin = begin; word_begin < end; word_begin += 32 )
+  {
+    const size_t word_end = std::min( word_begin + 32, end );
+    uint32_t word = 0;
+    for( size_t r = word_begin; r < word_end; ++r )
+      if( m_bvh.occluded( m_rays[r], filter, this ) )
+        word |= 1u << ( r - word_begin );
+    m_occlusion[word_begin / 32] = word;
+  }
+}
+
+void CpuRaycastingContext::writeHit( const CpuBvhHit& h, Hit& hit ) const
+{
+  if( h.triId < 0 )
+  {
+    hit.t           = -1.0f;
+    hit.triId       = -1;
+    hit.u           = 0.0f;
+    hit.v           = 0.0f;
+    hit.geom_normal = optix::make_float3( 1, 0, 0 );
+    hit.texcoord    = optix::make_float2( 0.0f, 0.0f );
+    return;
+  }
+
+  const int32_t* v_idx = &m_indices[3*h.triId];
+  const optix::float3 p0 = optix::make_float3( m_positions[3*v_idx[0]], m_positions[3*v_idx[0]+1], m_positions[3*v_idx[0]+2] );
+  const optix::float3 p1 = optix::make_float3( m_positions[3*v_idx[1]], m_positions[3*v_idx[1]+1], m_positions[3*v_idx[1]+2] );
+  const optix::float3 p2 = optix::make_float3( m_positions[3*v_idx[2]], m_positions[3*v_idx[2]+1], m_positions[3*v_idx[2]+2] );
+
+  hit.t           = h.t;
+  hit.triId       = h.triId;
+  hit.u           = h.u;
+  hit.v           = h.v;
+  hit.geom_normal = optix::normalize( optix::cross( p0 - p2, p1 - p0 ) );
+
+  if( m_texcoords.empty() ) {
+    hit.texcoord = optix::make_float2( 0.0f, 0.0f );
+  } else {
+    const optix::float2 t0 = optix::make_float2( m_texcoords[2*v_idx[0]], m_texcoords[2*v_idx[0]+1] );
+    const optix::float2 t1 = optix::make_float2( m_texcoords[2*v_idx[1]], m_texcoords[2*v_idx[1]+1] );
+    const optix::float2 t2 = optix::make_float2( m_texcoords[2*v_idx[2]], m_texcoords[2*v_idx[2]+1] );
+    hit.texcoord = t1*h.u + t2*h.v + t0*(1.0f-h.u-h.v);
+  }
+}
+
+// Bilinear lookup with repeat wrapping, as the mask sampler of the OptiX context
+float CpuRaycastingContext::sampleMask( float s, float t ) const
+{
+  const float x = s * m_mask_width - 0.5f;
+  const float y = t * m_mask_height - 0.5f;
+  const float x0 = std::floor( x );
+  const float y0 = std::floor( y );
+  const float fx = x - x0;
+  const float fy = y - y0;
+
+  int ix[2], iy[2];
+  for( int k = 0; k < 2; ++k )
+  {
+    ix[k] = ( static_cast<int>( x0 ) + k ) % m_mask_width;
+    iy[k] = ( static_cast<int>( y0 ) + k ) % m_mask_height;
+    if( ix[k] < 0 ) ix[k] += m_mask_width;
+    if( iy[k] < 0 ) iy[k] += m_mask_height;
+  }
+
+  const float* row0 = &m_mask[size_t( iy[0] )*m_mask_width];
+  const float* row1 = &m_mask[size_t( iy[1] )*m_mask_width];
+  const float a = row0[ix[0]] + ( row0[ix[1]] - row0[ix[0]] ) * fx;
+  const float b = row1[ix[0]] + ( row1[ix[1]] - row1[ix[0]] ) * fx;
+  return a + ( b - a ) * fy;
+}
+
+bool CpuRaycastingContext::maskFilter( const void* data, int triId, float u, float v )
+{
+  const CpuRaycastingContext* context = static_cast<const CpuRaycastingContext*>( data );
+  if( context->m_mask.empty() )
+    return true;
+
+  float s = 0.0f;
+  float t = 0.0f;
+  if( !context->m_texcoords.empty() )
+  {
+    const int32_t* v_idx = &context->m_indices[3*triId];
+    const float* t0 = &context->m_texcoords[2*v_idx[0]];
+    const float* t1 = &context->m_texcoords[2*v_idx[1]];
+    const float* t2 = &context->m_texcoords[2*v_idx[2]];
+    s = t1[0]*u + t2[0]*v + t0[0]*( 1.0f - u - v );
+    t = t1[1]*u + t2[1]*v + t0[1]*( 1.0f - u - v );
+  }
+  return context->sampleMask( s, t ) >= 0.5f;
+}
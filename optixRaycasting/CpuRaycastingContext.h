@@ -0,0 +1,188 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "CpuBvh.h"
+#include "RaySort.h"
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+// Forward decls
+struct Ray;
+struct Hit;
+class WorkStealingPool;
+
+
+// The query model of OptiXRaycastingContext on the CPU, for machines without a GPU.
+
+// Geometry is copied from host pointers into a 4-wide BVH (CpuBvh). Ray and hit buffers
+// are host pointers in the Ray and Hit layouts of Common.h, so the same buffers and
+// pre and post processing work with both contexts. execute() splits the rays into chunks
+// over a work-stealing thread pool. Hits match the OptiX context: misses have t = -1 and
+// triId = -1, u and v are the barycentrics of vertices 1 and 2, and the optional mask
+// ignores hits where its red channel is below 0.5.
+//
+// executeOcclusion() answers only whether each ray hits anything before its tmax. It
+// stops at the first hit and writes the bit-packed mask described in Common.h.
+//
+// With ray sorting enabled, both queries first reorder the rays by RaySorter, trace
+// them in that order and scatter the results back to the order of the ray buffer.
+// The extra passes over the rays pay off for incoherent batches, such as bounce or
+// ambient occlusion rays, whose neighbours in the buffer traverse unrelated parts of
+// the BVH.
+//
+// updatePositions() moves the vertices of animated geometry. By default the BVH is
+// rebuilt. With refitting enabled, the tree is kept and only its bounds are
+// recomputed. This is much cheaper but degrades as the geometry moves away from the
+// build, so the BVH is rebuilt once its SAH cost has grown by the given factor.
+
+class CpuRaycastingContext
+{
+public:
+  // 0 threads uses all hardware threads
+  explicit CpuRaycastingContext( unsigned int num_threads = 0 );
+  virtual ~CpuRaycastingContext();
+
+  void setNumThreads( unsigned int num_threads );
+  unsigned int getNumThreads() const;
+
+  // host pointers, copied
+  void setTriangles( int num_triangles, int32_t* indices, int num_vertices, float* positions, float* texcoords );
+
+  // host pointer to new positions of the vertices of setTriangles(), copied
+  void updatePositions( const float* positions );
+
+  // optional refit on updatePositions(), off by default
+  void setBvhRefit( bool enable, float max_sah_growth = 1.5f ) {
+    m_bvh_refit = enable;
+    m_max_sah_growth = max_sah_growth;
+  }
+  bool getBvhRefit() const {
+    return m_bvh_refit;
+  }
+
+  // The last setTriangles or updatePositions
+  struct BvhStats
+  {
+    double build_seconds;   // 0 if the BVH was only refit
+    double refit_seconds;   // 0 if it was rebuilt right away
+    float  sah_growth;      // SAH cost of the tree over the cost after its build
+    size_t refits;          // since setTriangles
+    size_t rebuilds;
+  };
+  const BvhStats& getLastBvhStats() const {
+    return m_bvh_stats;
+  }
+
+  // host pointers, used in place
+  void setRaysHostPointer( const Ray* rays, size_t n );
+  void setHitsHostPointer( Hit* hits, size_t n );
+
+  // host pointer to occlusionMaskWords( num_rays ) words, used in place
+  void setOcclusionMaskHostPointer( uint32_t* mask, size_t num_rays );
+
+  // optional mask
+  void setMask( const char* texture_filename );
+
+  // Note: Hits can be read as soon as this function returns.
+  void execute();
+
+  // Any hit query into the occlusion mask, hits are not written.
+  void executeOcclusion();
+
+  // Tests every ray against every triangle on the calling thread. Slow, for validating execute().
+  void executeReference();
+
+  // optional reordering stage, off by default
+  void setRaySorting( bool enable ) {
+    m_sort_rays = enable;
+  }
+  bool getRaySorting() const {
+    return m_sort_rays;
+  }
+
+  // Wall clock time of the stages of the last execute or executeOcclusion
+  struct QueryStats
+  {
+    double sort_seconds;      // keys, radix sort and gathering the rays
+    double trace_seconds;
+    double scatter_seconds;   // results back to the order of the ray buffer
+    int    sort_passes;
+  };
+  const QueryStats& getLastQueryStats() const {
+    return m_stats;
+  }
+
+  const CpuBvh& getBvh() const {
+    return m_bvh;
+  }
+
+  // Chunks of rays taken from another thread, summed over all executes
+  size_t getStealCount() const;
+
+private:
+  void executeSorted( size_t n, bool occlusion );
+  void traceRays( const Ray* rays, Hit* hits, size_t begin, size_t end ) const;
+  void traceOcclusion( size_t begin, size_t end ) const;
+  void writeHit( const CpuBvhHit& h, Hit& hit ) const;
+  float sampleMask( float s, float t ) const;
+  static bool maskFilter( const void* data, int triId, float u, float v );
+
+  std::unique_ptr<WorkStealingPool> m_pool;
+
+  std::vector<int32_t> m_indices;
+  std::vector<float>   m_positions;
+  std::vector<float>   m_texcoords;
+  CpuBvh               m_bvh;
+  bool                 m_bvh_refit;
+  float                m_max_sah_growth;
+  BvhStats             m_bvh_stats;
+
+  // Red channel in texture orientation, the first row is the bottom of the image
+  std::vector<float> m_mask;
+  int                m_mask_width;
+  int                m_mask_height;
+
+  const Ray* m_rays;
+  size_t     m_num_rays;
+  Hit*       m_hits;
+  size_t     m_num_hits;
+  uint32_t*  m_occlusion;
+  size_t     m_num_occlusion_rays;
+
+  bool                 m_sort_rays;
+  RaySorter            m_sorter;
+  std::vector<Ray>     m_sorted_rays;
+  std::vector<Hit>     m_sorted_hits;
+  std::vector<uint8_t> m_sorted_occluded;
+  std::vector<uint8_t> m_occluded;
+  QueryStats           m_stats;
+};
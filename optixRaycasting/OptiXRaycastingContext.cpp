@@ -41,8 +41,8 @@ const char* const CUDA_SOURCE = "OptiXRaycastingContext.cu";
 OptiXRaycastingContext::OptiXRaycastingContext()
 {
   m_context = optix::Context::create();
-  m_context->setRayTypeCount( 1 );
-  m_context->setEntryPointCount( 1 );
+  m_context->setRayTypeCount( 2 );      // closest hit, occlusion
+  m_context->setEntryPointCount( 2 );   // closest hit, occlusion
 
   // Set small stack for a simple kernel without much shading.
   m_context->setStackSize( 200 );
@@ -73,10 +73,25 @@ OptiXRaycastingContext::OptiXRaycastingContext()
   optix::Program closest_hit = m_context->createProgramFromPTXString( ptx, "closest_hit" );
   m_material->setClosestHitProgram( /*ray type*/ 0, closest_hit );
 
+  // Any hit program that terminates occlusion rays.
+  optix::Program any_hit_occlusion = m_context->createProgramFromPTXString( ptx, "any_hit_occlusion" );
+  m_material->setAnyHitProgram( /*ray type*/ 1, any_hit_occlusion );
+
   // Raygen program that reads rays directly from an input buffer.
   optix::Program ray_gen = m_context->createProgramFromPTXString( ptx, "ray_gen" );
   m_context->setRayGenerationProgram( /*entry point*/ 0, ray_gen );
 
+  // Raygen program of occlusion queries, writes the occlusion mask.
+  optix::Program ray_gen_occlusion = m_context->createProgramFromPTXString( ptx, "ray_gen_occlusion" );
+  m_context->setRayGenerationProgram( /*entry point*/ 1, ray_gen_occlusion );
+
+  // Empty output buffers, so either query can run with only its own output set.
+  m_hits = m_context->createBuffer( RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_USER, 0 );
+  m_hits->setElementSize( sizeof(Hit) );
+  m_context["hits"]->set( m_hits );
+  m_occlusion = m_context->createBuffer( RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_UNSIGNED_INT, 0 );
+  m_context["occlusion_mask"]->set( m_occlusion );
+
   // Exception program for debugging
   /*
   optix::Program exception_program = m_context->createProgramFromPTXString( ptx, "exception" );
@@ -128,6 +143,8 @@ void OptiXRaycastingContext::setMask( const char* texture_filename )
   const char *ptx = sutil::getPtxString( SAMPLE_NAME, CUDA_SOURCE );
   optix::Program any_hit = m_context->createProgramFromPTXString( ptx, "any_hit" );
   m_material->setAnyHitProgram( /*ray type*/ 0, any_hit );
+  optix::Program any_hit_occlusion = m_context->createProgramFromPTXString( ptx, "any_hit_occlusion_masked" );
+  m_material->setAnyHitProgram( /*ray type*/ 1, any_hit_occlusion );
 
   optix::TextureSampler sampler = sutil::loadTexture( m_context, texture_filename, optix::make_float3(1.0f, 1.0f, 1.0f) );
   m_context[ "mask_sampler" ]->set( sampler );
@@ -151,6 +168,14 @@ void OptiXRaycastingContext::setHitsDevicePointer( Hit* hits, size_t n )
   m_context["hits"]->set( m_hits );
 }
 
+void OptiXRaycastingContext::setOcclusionMaskDevicePointer( uint32_t* mask, size_t num_rays )
+{
+  if ( m_occlusion ) m_occlusion->destroy();
+  m_occlusion = m_context->createBuffer( RT_BUFFER_INPUT_OUTPUT | RT_BUFFER_GPU_LOCAL, RT_FORMAT_UNSIGNED_INT, occlusionMaskWords( num_rays ) );
+  m_occlusion->setDevicePointer( m_optix_device_ordinal, mask );
+  m_context["occlusion_mask"]->set( m_occlusion );
+}
+
 void OptiXRaycastingContext::execute()
 {
   RTsize n;
@@ -158,3 +183,10 @@ void OptiXRaycastingContext::execute()
   m_context->launch( /*entry point*/ 0, n );
 }
 
+void OptiXRaycastingContext::executeOcclusion()
+{
+  RTsize n;
+  m_rays->getSize(n);
+  m_context->launch( /*entry point*/ 1, n );
+}
+
@@ -66,7 +66,8 @@ RT_PROGRAM void intersect( int primIdx )
             h.triId = primIdx;
             h.u = beta;
             h.v = gamma;
-            h.geom_normal = optix::normalize( normal );
+            // Occlusion rays (ray type 1) only use the texcoords, for the mask
+            h.geom_normal = ray.ray_type == 0 ? optix::normalize( normal ) : normal;
 
             if ( texcoord_buffer.size() == 0 ) {
               h.texcoord = optix::make_float2( 0.0f, 0.0f ); 
@@ -136,6 +137,32 @@ RT_PROGRAM void any_hit()
 }
 
 
+//------------------------------------------------------------------------------
+//
+// Any-hit programs of occlusion rays stop at the first hit
+//
+//------------------------------------------------------------------------------
+
+rtDeclareVariable( unsigned int, occlusion_prd, rtPayload, );
+
+RT_PROGRAM void any_hit_occlusion()
+{
+    occlusion_prd = 1u;
+    rtTerminateRay();
+}
+
+RT_PROGRAM void any_hit_occlusion_masked()
+{
+    float4 mask = tex2D( mask_sampler, hit_attr.texcoord.x, hit_attr.texcoord.y );
+    if ( mask.x < 0.5f ) {
+      rtIgnoreIntersection(); // make surface transparent
+    } else {
+      occlusion_prd = 1u;
+      rtTerminateRay();
+    }
+}
+
+
 
 //------------------------------------------------------------------------------
 //
@@ -168,6 +195,27 @@ RT_PROGRAM void ray_gen()
     hits[ launch_index ] = hit_prd;
 }
 
+// Occlusion query, one bit per ray as described in Common.h
+rtBuffer<unsigned int, 1> occlusion_mask;
+
+RT_PROGRAM void ray_gen_occlusion()
+{
+    unsigned int occluded = 0u;
+
+    Ray ray = rays[launch_index];
+    rtTrace( top_object,
+             optix::make_Ray( ray.origin, ray.dir, 1, ray.tmin, ray.tmax ),
+             occluded );
+
+    // The other bits of the word belong to other launch indices
+    const unsigned int bit = 1u << ( launch_index & 31u );
+    if ( occluded ) {
+      atomicOr( &occlusion_mask[ launch_index >> 5 ], bit );
+    } else {
+      atomicAnd( &occlusion_mask[ launch_index >> 5 ], ~bit );
+    }
+}
+
 //------------------------------------------------------------------------------
 //
 // Exception program for debugging only
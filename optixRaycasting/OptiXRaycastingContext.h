@@ -60,12 +60,19 @@ public:
   void setRaysDevicePointer( const Ray* rays, size_t n );
   void setHitsDevicePointer( Hit* hits, size_t n );
 
+  // device pointer to occlusionMaskWords( num_rays ) words
+  void setOcclusionMaskDevicePointer( uint32_t* mask, size_t num_rays );
+
   // optional mask
   void setMask( const char* texture_filename );
 
   // Note: Rays and hits can be read from device pointers as soon as this function returns.
   void execute();
 
+  // Any hit query, sets the bit of each ray that hits anything before its tmax in the
+  // occlusion mask. Stops at the first hit and does not write hits.
+  void executeOcclusion();
+
 private:
   optix::Context m_context;
   int m_cuda_device_ordinal;
@@ -78,6 +85,7 @@ private:
   optix::Material m_material;
   optix::Buffer m_rays;
   optix::Buffer m_hits; 
+  optix::Buffer m_occlusion;
   
 };
 
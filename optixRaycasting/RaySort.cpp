@@ -0,0 +1,207 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Common.h"
+#include "RaySort.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+
+namespace {
+
+const int    KEY_BITS = 33;
+const int    DIGIT_BITS = 11;
+const size_t RADIX = size_t( 1 ) << DIGIT_BITS;
+
+// Smaller batches use fewer blocks, so the digit counts stay cheap to scan
+const size_t MIN_BLOCK_SIZE = 16384;
+
+// Spreads the low 10 bits of x to every third bit
+inline uint32_t spreadBits( uint32_t x )
+{
+  x &= 0x3ff;
+  x = ( x | ( x << 16 ) ) & 0x030000ff;
+  x = ( x | ( x <<  8 ) ) & 0x0300f00f;
+  x = ( x | ( x <<  4 ) ) & 0x030c30c3;
+  x = ( x | ( x <<  2 ) ) & 0x09249249;
+  return x;
+}
+
+inline uint32_t quantize( float x, float lo, float scale )
+{
+  const float q = ( x - lo ) * scale;
+  return q > 0.0f ? std::min( static_cast<uint32_t>( q ), 1023u ) : 0u;
+}
+
+} // namespace
+
+
+RaySorter::RaySorter()
+  : m_num_blocks( 0 )
+  , m_block_size( 0 )
+  , m_passes( 0 )
+{
+}
+
+void RaySorter::sort( const Ray* rays, size_t n, WorkStealingPool& pool )
+{
+  m_passes = 0;
+  m_order.resize( n );
+  if( n == 0 )
+    return;
+  if( n > std::numeric_limits<uint32_t>::max() )
+    throw std::runtime_error( "RaySorter: Too many rays" );
+
+  m_num_blocks = std::min( ( n + MIN_BLOCK_SIZE - 1 ) / MIN_BLOCK_SIZE, size_t( 4 ) * pool.getNumThreads() );
+  m_num_blocks = std::max<size_t>( m_num_blocks, 1 );
+  m_block_size = ( n + m_num_blocks - 1 ) / m_num_blocks;
+  m_num_blocks = ( n + m_block_size - 1 ) / m_block_size;
+
+  computeKeys( rays, n, pool );
+
+  m_keys_tmp.resize( n );
+  m_order_tmp.resize( n );
+  m_counts.resize( m_num_blocks * RADIX );
+
+  for( int shift = 0; shift < KEY_BITS; shift += DIGIT_BITS )
+  {
+    pool.parallelFor( m_num_blocks, 1, [this, n, shift]( size_t begin, size_t end, unsigned int ) {
+      for( size_t b = begin; b < end; ++b )
+      {
+        uint32_t* counts = &m_counts[b * RADIX];
+        std::fill( counts, counts + RADIX, 0u );
+        const size_t last = std::min( ( b + 1 ) * m_block_size, n );
+        for( size_t i = b * m_block_size; i < last; ++i )
+          ++counts[( m_keys[i] >> shift ) & ( RADIX - 1 )];
+      }
+    } );
+
+    // Nothing to do if all keys share the digit
+    const size_t first_digit = ( m_keys[0] >> shift ) & ( RADIX - 1 );
+    size_t first_digit_count = 0;
+    for( size_t b = 0; b < m_num_blocks; ++b )
+      first_digit_count += m_counts[b * RADIX + first_digit];
+    if( first_digit_count == n )
+      continue;
+
+    // Exclusive prefix sum in (digit, block) order turns the counts into the offsets of
+    // each block's keys
+    uint32_t offset = 0;
+    for( size_t d = 0; d < RADIX; ++d )
+    {
+      for( size_t b = 0; b < m_num_blocks; ++b )
+      {
+        const uint32_t count = m_counts[b * RADIX + d];
+        m_counts[b * RADIX + d] = offset;
+        offset += count;
+      }
+    }
+
+    pool.parallelFor( m_num_blocks, 1, [this, n, shift]( size_t begin, size_t end, unsigned int ) {
+      for( size_t b = begin; b < end; ++b )
+      {
+        uint32_t* offsets = &m_counts[b * RADIX];
+        const size_t last = std::min( ( b + 1 ) * m_block_size, n );
+        for( size_t i = b * m_block_size; i < last; ++i )
+        {
+          const uint32_t dst = offsets[( m_keys[i] >> shift ) & ( RADIX - 1 )]++;
+          m_keys_tmp[dst] = m_keys[i];
+          m_order_tmp[dst] = m_order[i];
+        }
+      }
+    } );
+
+    m_keys.swap( m_keys_tmp );
+    m_order.swap( m_order_tmp );
+    ++m_passes;
+  }
+}
+
+void RaySorter::computeKeys( const Ray* rays, size_t n, WorkStealingPool& pool )
+{
+  // Bounds of the origins, per block and then over the blocks
+  m_bounds.resize( 6 * m_num_blocks );
+  pool.parallelFor( m_num_blocks, 1, [this, rays, n]( size_t begin, size_t end, unsigned int ) {
+    for( size_t b = begin; b < end; ++b )
+    {
+      float* bounds = &m_bounds[6 * b];
+      const optix::float3& o = rays[b * m_block_size].origin;
+      bounds[0] = bounds[3] = o.x;
+      bounds[1] = bounds[4] = o.y;
+      bounds[2] = bounds[5] = o.z;
+      const size_t last = std::min( ( b + 1 ) * m_block_size, n );
+      for( size_t i = b * m_block_size + 1; i < last; ++i )
+      {
+        const optix::float3& p = rays[i].origin;
+        bounds[0] = std::min( bounds[0], p.x );
+        bounds[1] = std::min( bounds[1], p.y );
+        bounds[2] = std::min( bounds[2], p.z );
+        bounds[3] = std::max( bounds[3], p.x );
+        bounds[4] = std::max( bounds[4], p.y );
+        bounds[5] = std::max( bounds[5], p.z );
+      }
+    }
+  } );
+
+  float lo[3], hi[3];
+  for( int k = 0; k < 3; ++k )
+  {
+    lo[k] = m_bounds[k];
+    hi[k] = m_bounds[3 + k];
+  }
+  for( size_t b = 1; b < m_num_blocks; ++b )
+  {
+    for( int k = 0; k < 3; ++k )
+    {
+      lo[k] = std::min( lo[k], m_bounds[6 * b + k] );
+      hi[k] = std::max( hi[k], m_bounds[6 * b + 3 + k] );
+    }
+  }
+
+  float scale[3];
+  for( int k = 0; k < 3; ++k )
+    scale[k] = hi[k] > lo[k] ? 1024.0f / ( hi[k] - lo[k] ) : 0.0f;
+
+  m_keys.resize( n );
+  pool.parallelFor( n, m_block_size, [this, rays, &lo, &scale]( size_t begin, size_t end, unsigned int ) {
+    for( size_t i = begin; i < end; ++i )
+    {
+      const Ray& ray = rays[i];
+      const uint32_t morton =
+        spreadBits( quantize( ray.origin.x, lo[0], scale[0] ) ) |
+        ( spreadBits( quantize( ray.origin.y, lo[1], scale[1] ) ) << 1 ) |
+        ( spreadBits( quantize( ray.origin.z, lo[2], scale[2] ) ) << 2 );
+      const uint32_t octant = ( ray.dir.x < 0.0f ? 1u : 0u ) | ( ray.dir.y < 0.0f ? 2u : 0u ) | ( ray.dir.z < 0.0f ? 4u : 0u );
+      m_keys[i] = ( uint64_t( octant ) << 30 ) | morton;
+      m_order[i] = static_cast<uint32_t>( i );
+    }
+  } );
+}
@@ -0,0 +1,81 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Forward decls
+struct Ray;
+class WorkStealingPool;
+
+
+// Reorders a ray batch so that rays likely to traverse the same parts of a BVH are
+// traced one after another.
+
+// The key of a ray is the octant of its direction in the top 3 bits, followed by the
+// 30 bit Morton code of its origin quantized to 1024 steps per axis of the bounds of
+// all origins. Keys are sorted with a least significant digit radix sort, 11 bits per
+// pass. Each pass splits the keys into contiguous blocks, counts the digits of each
+// block in parallel, and scatters the blocks in parallel to offsets from a prefix sum
+// over (digit, block), which keeps the sort stable. A pass whose digit is the same for
+// all keys is skipped.
+
+class RaySorter
+{
+public:
+  RaySorter();
+
+  // Computes the order of rays[0, n).
+  void sort( const Ray* rays, size_t n, WorkStealingPool& pool );
+
+  // getOrder()[i] is the index of the i-th ray in sorted order
+  const std::vector<uint32_t>& getOrder() const {
+    return m_order;
+  }
+
+  // Radix passes of the last sort, after skipping
+  int getPassCount() const {
+    return m_passes;
+  }
+
+private:
+  void computeKeys( const Ray* rays, size_t n, WorkStealingPool& pool );
+
+  size_t m_num_blocks;
+  size_t m_block_size;
+  int    m_passes;
+
+  std::vector<uint64_t> m_keys;
+  std::vector<uint64_t> m_keys_tmp;
+  std::vector<uint32_t> m_order;
+  std::vector<uint32_t> m_order_tmp;
+  std::vector<uint32_t> m_counts;   // per block and digit
+  std::vector<float>    m_bounds;   // per block origin bounds, 6 floats
+};
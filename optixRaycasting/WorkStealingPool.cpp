@@ -0,0 +1,187 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+
+
+static unsigned int resolveThreadCount( unsigned int num_threads )
+{
+  if( num_threads > 0 )
+    return num_threads;
+  return std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+WorkStealingPool::WorkStealingPool( unsigned int num_threads )
+  : m_queues( resolveThreadCount( num_threads ) )
+  , m_task( NULL )
+  , m_count( 0 )
+  , m_grain( 1 )
+  , m_generation( 0 )
+  , m_active( 0 )
+  , m_stop( false )
+  , m_steals( 0 )
+{
+  for( size_t i = 0; i < m_queues.size(); ++i )
+  {
+    m_queues[i].begin = 0;
+    m_queues[i].end = 0;
+  }
+
+  // Worker 0 is the thread calling parallelFor()
+  for( unsigned int i = 1; i < getNumThreads(); ++i )
+    m_threads.push_back( std::thread( &WorkStealingPool::workerMain, this, i ) );
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_stop = true;
+  }
+  m_start.notify_all();
+  for( size_t i = 0; i < m_threads.size(); ++i )
+    m_threads[i].join();
+}
+
+void WorkStealingPool::parallelFor( size_t count, size_t grain, const Task& task )
+{
+  if( count == 0 )
+    return;
+
+  grain = std::max<size_t>( grain, 1 );
+  const size_t num_chunks = ( count + grain - 1 ) / grain;
+  const size_t num_queues = m_queues.size();
+
+  if( num_queues == 1 || num_chunks == 1 )
+  {
+    for( size_t begin = 0; begin < count; begin += grain )
+      task( begin, std::min( begin + grain, count ), 0 );
+    return;
+  }
+
+  // Deal out contiguous ranges of chunks, so each thread starts on coherent rays
+  for( size_t i = 0; i < num_queues; ++i )
+  {
+    std::lock_guard<std::mutex> lock( m_queues[i].mutex );
+    m_queues[i].begin = num_chunks * i / num_queues;
+    m_queues[i].end = num_chunks * ( i + 1 ) / num_queues;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_task = &task;
+    m_count = count;
+    m_grain = grain;
+    m_active = getNumThreads();
+    ++m_generation;
+  }
+  m_start.notify_all();
+
+  run( 0 );
+
+  // Every worker checks out of the job, even one that found nothing left to do, so none
+  // can still be looking at the task once this returns.
+  std::unique_lock<std::mutex> lock( m_mutex );
+  m_done.wait( lock, [this]() { return m_active == 0; } );
+  m_task = NULL;
+}
+
+void WorkStealingPool::workerMain( unsigned int index )
+{
+  unsigned int generation = 0;
+  for( ;; )
+  {
+    {
+      std::unique_lock<std::mutex> lock( m_mutex );
+      m_start.wait( lock, [this, generation]() { return m_stop || m_generation != generation; } );
+      if( m_stop )
+        return;
+      generation = m_generation;
+    }
+    run( index );
+  }
+}
+
+void WorkStealingPool::run( unsigned int index )
+{
+  const Task& task = *m_task;
+  size_t chunk;
+  while( pop( index, chunk ) || steal( index, chunk ) )
+  {
+    const size_t begin = chunk * m_grain;
+    task( begin, std::min( begin + m_grain, m_count ), index );
+  }
+
+  std::lock_guard<std::mutex> lock( m_mutex );
+  if( --m_active == 0 )
+    m_done.notify_one();
+}
+
+bool WorkStealingPool::pop( unsigned int index, size_t& chunk )
+{
+  Queue& queue = m_queues[index];
+  std::lock_guard<std::mutex> lock( queue.mutex );
+  if( queue.begin == queue.end )
+    return false;
+  chunk = queue.begin++;
+  return true;
+}
+
+bool WorkStealingPool::steal( unsigned int index, size_t& chunk )
+{
+  // No chunks are added while a job runs, so one pass over the other queues finding
+  // them all empty means this thread is done.
+  const unsigned int num_queues = getNumThreads();
+  for( unsigned int i = 1; i < num_queues; ++i )
+  {
+    Queue& victim = m_queues[( index + i ) % num_queues];
+    size_t begin, end;
+    {
+      std::lock_guard<std::mutex> lock( victim.mutex );
+      if( victim.begin == victim.end )
+        continue;
+      end = victim.end;
+      begin = end - ( end - victim.begin + 1 ) / 2;
+      victim.end = begin;
+    }
+
+    m_steals.fetch_add( end - begin );
+    chunk = begin;
+    if( end - begin > 1 )
+    {
+      Queue& queue = m_queues[index];
+      std::lock_guard<std::mutex> lock( queue.mutex );
+      queue.begin = begin + 1;
+      queue.end = end;
+    }
+    return true;
+  }
+  return false;
+}
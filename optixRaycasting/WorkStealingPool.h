@@ -0,0 +1,103 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// A fixed set of worker threads that run data parallel loops with work stealing.
+
+// parallelFor() splits [0, count) into chunks of grain items and deals the chunks out
+// evenly to the per-thread queues. A thread works through its own queue from the front;
+// once it is empty, it steals the back half of the queue of another thread. Coarse
+// chunks keep the queue locks cold, stealing evens out rays that traverse more of the
+// BVH than their neighbours.
+//
+// The calling thread takes part as worker 0, so a pool of one thread runs everything
+// on the caller. The threads persist between calls.
+
+class WorkStealingPool
+{
+public:
+  // task( begin, end, thread_index )
+  typedef std::function<void( size_t, size_t, unsigned int )> Task;
+
+  // 0 threads uses all hardware threads
+  explicit WorkStealingPool( unsigned int num_threads = 0 );
+  ~WorkStealingPool();
+
+  unsigned int getNumThreads() const {
+    return static_cast<unsigned int>( m_queues.size() );
+  }
+
+  // Blocks until all chunks have run.
+  void parallelFor( size_t count, size_t grain, const Task& task );
+
+  // Chunks taken from another thread's queue, summed over all calls
+  size_t getStealCount() const {
+    return m_steals.load();
+  }
+
+private:
+  // Range of chunk indices left to a thread
+  struct Queue
+  {
+    std::mutex mutex;
+    size_t begin;
+    size_t end;
+  };
+
+  void workerMain( unsigned int index );
+  void run( unsigned int index );
+  bool pop( unsigned int index, size_t& chunk );
+  bool steal( unsigned int index, size_t& chunk );
+
+  std::vector<std::thread> m_threads;
+  std::vector<Queue>       m_queues;
+
+  // Current job
+  const Task* m_task;
+  size_t      m_count;
+  size_t      m_grain;
+
+  std::mutex              m_mutex;
+  std::condition_variable m_start;
+  std::condition_variable m_done;
+  unsigned int            m_generation;
+  unsigned int            m_active;   // threads that have not finished the current job
+  bool                    m_stop;
+
+  std::atomic<size_t> m_steals;
+};
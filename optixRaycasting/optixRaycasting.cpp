@@ -30,7 +30,8 @@
 //
 //  This sample uses OptiX as a replacement for Prime, to compute hits only.  Compare to primeSimplePP.
 //  Shading and ray generation are done with separate CUDA kernels and interop.
-//  Also supports an optional mask texture for geometry transparency (the hole in the default fish model).
+//  Also supports an optional mask texture for geometry transparency (the hole in the default fish model),
+//  and times an occlusion (any hit) query against the closest hit query.
 //
 //-----------------------------------------------------------------------------
 
@@ -238,6 +239,50 @@ int main( int argc, char** argv )
 
     writePPM( "output.ppm", &image_h[0].x, width, height );
 
+    //
+    // Occlusion query: one bit per ray, stops at the first hit.  Compare with the closest hit query.
+    //
+
+    const size_t occlusion_words = occlusionMaskWords( size_t(width*height) );
+    uint32_t* occlusion_d = NULL;
+    err = cudaMalloc( &occlusion_d, occlusion_words*sizeof(uint32_t) );
+    if( err != cudaSuccess )
+    {
+      printf( "cudaMalloc failed (%s): %s\n", cudaGetErrorName( err ), cudaGetErrorString( err ) );
+      exit( 1 );
+    }
+    context.setOcclusionMaskDevicePointer( occlusion_d, size_t(width*height) );
+    context.executeOcclusion();  // compile
+
+    const int repeat = 10;
+    double begin = sutil::currentTime();
+    for( int i = 0; i < repeat; ++i )
+      context.execute();
+    const double closest_time = ( sutil::currentTime() - begin ) / repeat;
+
+    begin = sutil::currentTime();
+    for( int i = 0; i < repeat; ++i )
+      context.executeOcclusion();
+    const double occlusion_time = ( sutil::currentTime() - begin ) / repeat;
+
+    // The mask must agree with the closest hits
+    std::vector<uint32_t> occlusion_h( occlusion_words );
+    std::vector<Hit> hits_h( width*height );
+    err = cudaMemcpy( &occlusion_h[0], occlusion_d, occlusion_words*sizeof(uint32_t), cudaMemcpyDeviceToHost );
+    if( err == cudaSuccess )
+      err = cudaMemcpy( &hits_h[0], hits_d, (size_t)(width*height)*sizeof(Hit), cudaMemcpyDeviceToHost );
+    if( err != cudaSuccess )
+    {
+      printf( "cudaMemcpy failed (%s): %s\n", cudaGetErrorName( err ), cudaGetErrorString( err ) );
+      exit( 1 );
+    }
+    size_t mismatches = 0;
+    for( size_t i = 0; i < hits_h.size(); ++i )
+      mismatches += isOccluded( &occlusion_h[0], i ) != ( hits_h[i].t >= 0.0f ) ? 1 : 0;
+
+    std::cout << "Closest hit query: " << closest_time*1.0e3 << " ms, occlusion query: " << occlusion_time*1.0e3
+              << " ms (" << closest_time/occlusion_time << "x), mismatches: " << mismatches << std::endl;
+
     //
     // Re-execute query with different rays
     //
@@ -272,6 +317,7 @@ int main( int argc, char** argv )
     // Clean up
     cudaFree( rays_d );
     cudaFree( hits_d );
+    cudaFree( occlusion_d );
     cudaFree( image_d );
   }
   catch (std::exception& e)
@@ -0,0 +1,778 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//-----------------------------------------------------------------------------
+//
+//  Throughput benchmark of CpuRaycastingContext, the CPU implementation of the
+//  OptiXRaycastingContext query model.  Casts the orthographic rays of optixRaycasting,
+//  a batch of incoherent rays and ambient occlusion rays from the orthographic hits at
+//  each model, on one thread and on all threads, as closest hit and as occlusion
+//  queries, then again with ray sorting.  Validates the hits against a loop over all
+//  triangles, the occlusion mask against the hits and the sorted results against the
+//  unsorted ones.  Then animates the particles of optixParticles as triangles and
+//  compares rebuilding the BVH every frame with refitting it.  Needs no GPU.
+//
+//-----------------------------------------------------------------------------
+
+#include "Common.h"
+#include "CpuRaycastingContext.h"
+
+#include <optixu/optixu_math_namespace.h>
+#include <sutil.h>
+#include <Mesh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+struct ModelDesc
+{
+  std::string mesh;
+  std::string mask;
+};
+
+
+void printUsageAndExit( const char* argv0 )
+{
+  std::cerr
+  << "Usage  : " << argv0 << " [options]\n"
+  << "App options:\n"
+  << "  -h  | --help                               Print this usage message\n"
+  << "  -m  | --mesh <mesh_file>                   Model to be benchmarked, may be repeated (default fish and cow)\n"
+  << "        --mask <ppm_file>                    Mask texture of the previous model (optional)\n"
+  << "  -w  | --width <number>                     Width of the orthographic ray grid\n"
+  << "  -t  | --threads <number>                   Threads of the parallel runs (default all hardware threads)\n"
+  << "  -r  | --repeat <number>                    Executes per measurement, the fastest is reported\n"
+  << "        --ppm                                Write the shaded hits of each model\n"
+  << "  -p  | --particles <file_base>              Particle sequence for the BVH refit benchmark (default data/particles)\n"
+  << "        --frames <number>                    Frames of the particle sequence (default 25)\n"
+  << "        --sah-growth <number>                SAH cost growth that triggers a rebuild after refits (default 1.5)\n"
+  << std::endl;
+  
+  exit(1);
+}
+
+
+void writePPM( const char* filename, const float* image, int width, int height )
+{
+  std::ofstream out( filename, std::ios::out | std::ios::binary );
+  if( !out ) 
+  {
+    std::cerr << "Cannot open file " << filename << "'" << std::endl;
+    return;
+  }
+
+  out << "P6\n" << width << " " << height << "\n255" << std::endl;
+  for( int y=height-1; y >= 0; --y ) // flip vertically
+  {  
+    for( int x = 0; x < width*3; ++x ) 
+    {
+      float val = image[y*width*3 + x];
+      unsigned char cval = val < 0.0f ? 0u : val > 1.0f ? 255u : static_cast<unsigned char>( val*255.0f );
+      out.put( cval );
+    }
+  }
+   
+  std::cout << "Wrote file " << filename << std::endl;
+}
+
+
+// Host versions of the kernels in optixRaycastingKernels.cu
+
+// Note: uses left handed coordinate system
+void createRaysOrthoOnHost( std::vector<Ray>& rays, int width, int height, optix::float3 bbmin, optix::float3 bbmax, float padding )
+{
+  const optix::float3 bbspan = bbmax - bbmin;
+  float dx = bbspan.x * (1 + 2*padding) / width;
+  float dy = bbspan.y * (1 + 2*padding) / height;
+  float x0 = bbmin.x - bbspan.x*padding + dx/2;
+  float y0 = bbmin.y - bbspan.y*padding + dy/2;
+  float z = bbmin.z - std::max(bbspan.z,1.0f)*.001f;
+
+  rays.resize( size_t(width)*height );
+  for( int rayy = 0; rayy < height; ++rayy )
+  {
+    for( int rayx = 0; rayx < width; ++rayx )
+    {
+      Ray& ray = rays[rayx + size_t(rayy)*width];
+      ray.origin = optix::make_float3( x0+rayx*dx, y0+rayy*dy, z );
+      ray.tmin = 0.0f;
+      ray.dir = optix::make_float3( 0, 0, 1 );
+      ray.tmax = 1e34f;
+    }
+  }
+}
+
+void translateRaysOnHost( std::vector<Ray>& rays, optix::float3 offset )
+{
+  for( size_t i = 0; i < rays.size(); ++i )
+    rays[i].origin = rays[i].origin + offset;
+}
+
+void shadeHitsOnHost( std::vector<optix::float3>& image, const std::vector<Hit>& hits )
+{
+  const optix::float3 backgroundColor = optix::make_float3( 0.2f, 0.2f, 0.2f );
+  image.resize( hits.size() );
+  for( size_t i = 0; i < hits.size(); ++i )
+  {
+    if ( hits[i].t < 0.0f ) {
+      image[i] = backgroundColor;
+    }
+    else {
+      image[i] = 0.5f*hits[i].geom_normal + optix::make_float3( 0.5f, 0.5f, 0.5f ); 
+    }
+  }
+}
+
+// Rays from points around the model towards random points in its bounds, so neighbouring
+// rays traverse unrelated parts of the BVH
+void createRaysIncoherentOnHost( std::vector<Ray>& rays, size_t count, optix::float3 bbmin, optix::float3 bbmax )
+{
+  std::mt19937 rng( 7 );
+  std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+  const optix::float3 center = 0.5f * ( bbmin + bbmax );
+  const float radius = optix::length( bbmax - bbmin );
+
+  rays.resize( count );
+  for( size_t i = 0; i < count; ++i )
+  {
+    const float z = 2.0f*uniform( rng ) - 1.0f;
+    const float phi = 2.0f*M_PIf*uniform( rng );
+    const float r = std::sqrt( std::max( 0.0f, 1.0f - z*z ) );
+    const optix::float3 origin = center + radius * optix::make_float3( r*std::cos( phi ), r*std::sin( phi ), z );
+    const optix::float3 target = bbmin + ( bbmax - bbmin ) * optix::make_float3( uniform( rng ), uniform( rng ), uniform( rng ) );
+
+    rays[i].origin = origin;
+    rays[i].tmin = 0.0f;
+    rays[i].dir = optix::normalize( target - origin );
+    rays[i].tmax = 1e34f;
+  }
+}
+
+// Ambient occlusion rays from the hits of the primary rays, uniform over the hemisphere
+// facing the primary ray. Neighbouring rays start close together but go in unrelated
+// directions, which is the batch ray sorting is meant for.
+void createRaysBounceOnHost( std::vector<Ray>& rays, const std::vector<Ray>& primary, const std::vector<Hit>& hits,
+                             float length )
+{
+  std::mt19937 rng( 11 );
+  std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+
+  rays.clear();
+  for( size_t i = 0; i < hits.size(); ++i )
+  {
+    if( hits[i].triId < 0 )
+      continue;
+    optix::float3 normal = hits[i].geom_normal;
+    if( optix::dot( normal, primary[i].dir ) > 0.0f )
+      normal = -normal;
+
+    const float z = 2.0f*uniform( rng ) - 1.0f;
+    const float phi = 2.0f*M_PIf*uniform( rng );
+    const float r = std::sqrt( std::max( 0.0f, 1.0f - z*z ) );
+    optix::float3 dir = optix::make_float3( r*std::cos( phi ), r*std::sin( phi ), z );
+    if( optix::dot( dir, normal ) < 0.0f )
+      dir = -dir;
+
+    Ray ray;
+    ray.origin = primary[i].origin + hits[i].t * primary[i].dir;
+    ray.tmin = 1.e-4f * length;
+    ray.dir = dir;
+    ray.tmax = length;
+    rays.push_back( ray );
+  }
+}
+
+
+// Fastest of repeat executes, in seconds
+double timeExecute( CpuRaycastingContext& context, bool occlusion, int repeat )
+{
+  double best = 0.0;
+  for( int i = 0; i < repeat; ++i )
+  {
+    const double begin = sutil::currentTime();
+    if( occlusion )
+      context.executeOcclusion();
+    else
+      context.execute();
+    const double elapsed = sutil::currentTime() - begin;
+    if( i == 0 || elapsed < best )
+      best = elapsed;
+  }
+  return best;
+}
+
+// Compares every stride-th hit with the brute force reference. Rays through a shared edge
+// may report either triangle, so triangles may differ where the distances agree. The
+// tolerances allow for compilers contracting the two paths into different FMAs.
+bool checkHits( CpuRaycastingContext& context, const std::vector<Ray>& rays, const std::vector<Hit>& hits, size_t stride, size_t& checked )
+{
+  std::vector<Ray> subset;
+  for( size_t i = 0; i < rays.size(); i += stride )
+    subset.push_back( rays[i] );
+  std::vector<Hit> expected( subset.size() );
+
+  context.setRaysHostPointer( &subset[0], subset.size() );
+  context.setHitsHostPointer( &expected[0], expected.size() );
+  context.executeReference();
+
+  checked = subset.size();
+  for( size_t i = 0; i < subset.size(); ++i )
+  {
+    const Hit& a = hits[i*stride];
+    const Hit& b = expected[i];
+    if( ( a.triId < 0 ) != ( b.triId < 0 ) )
+      return false;
+    if( a.triId < 0 )
+      continue;
+    if( std::fabs( a.t - b.t ) > 1.e-5f * std::max( 1.0f, std::fabs( b.t ) ) )
+      return false;
+    if( a.triId == b.triId && ( std::fabs( a.u - b.u ) > 1.e-4f || std::fabs( a.v - b.v ) > 1.e-4f ) )
+      return false;
+  }
+  return true;
+}
+
+// speedup over the closest hit query, 0 for the closest hit query itself
+void printThroughput( const char* rays_name, const char* query, size_t num_rays, unsigned int threads, double seconds,
+                      size_t hit_count, size_t steals, double speedup )
+{
+  std::ostringstream line;
+  line << "[raycast] rays: " << rays_name
+    << "\tquery: " << query
+    << "\tcount: " << num_rays
+    << "\tthreads: " << threads
+    << "\tms: " << seconds * 1.0e3
+    << "\tmrays_per_sec: " << num_rays / seconds * 1.0e-6
+    << "\thit_rate: " << static_cast<double>( hit_count ) / num_rays
+    << "\tsteals: " << steals;
+  if( speedup > 0.0 )
+    line << "\tspeedup: " << speedup;
+  std::cout << line.str() << std::endl;
+}
+
+// Best of repeat executes, split into the stages of the sorted query
+void printSorted( const char* rays_name, const char* query, size_t num_rays, unsigned int threads,
+                  const CpuRaycastingContext::QueryStats& stats, double seconds, double unsorted_seconds )
+{
+  std::ostringstream line;
+  line << "[raycast] rays: " << rays_name
+    << "\tquery: " << query
+    << "\tcount: " << num_rays
+    << "\tthreads: " << threads
+    << "\tsorted: 1"
+    << "\tms: " << seconds * 1.0e3
+    << "\tsort_ms: " << stats.sort_seconds * 1.0e3
+    << "\ttrace_ms: " << stats.trace_seconds * 1.0e3
+    << "\tscatter_ms: " << stats.scatter_seconds * 1.0e3
+    << "\tpasses: " << stats.sort_passes
+    << "\tmrays_per_sec: " << num_rays / seconds * 1.0e-6
+    << "\tspeedup: " << unsorted_seconds / seconds;
+  std::cout << line.str() << std::endl;
+}
+
+// The occlusion mask must agree with the closest hits. Halving tmax below the closest
+// hit of every other ray must clear its bit, which checks the per-ray tmax.
+bool checkOcclusion( CpuRaycastingContext& context, const std::vector<Ray>& rays, const std::vector<Hit>& hits )
+{
+  std::vector<uint32_t> mask( occlusionMaskWords( rays.size() ) );
+  context.setRaysHostPointer( &rays[0], rays.size() );
+  context.setOcclusionMaskHostPointer( &mask[0], rays.size() );
+  context.executeOcclusion();
+  for( size_t i = 0; i < rays.size(); ++i )
+    if( isOccluded( &mask[0], i ) != ( hits[i].triId >= 0 ) )
+      return false;
+
+  std::vector<Ray> clipped = rays;
+  for( size_t i = 0; i < clipped.size(); i += 2 )
+    if( hits[i].triId >= 0 )
+      clipped[i].tmax = clipped[i].tmin + 0.5f * ( hits[i].t - clipped[i].tmin );
+  context.setRaysHostPointer( &clipped[0], clipped.size() );
+  context.executeOcclusion();
+  for( size_t i = 0; i < clipped.size(); ++i )
+    if( isOccluded( &mask[0], i ) != ( i % 2 == 1 && hits[i].triId >= 0 ) )
+      return false;
+  return true;
+}
+
+size_t countHits( const std::vector<Hit>& hits )
+{
+  size_t count = 0;
+  for( size_t i = 0; i < hits.size(); ++i )
+    count += hits[i].triId >= 0 ? 1 : 0;
+  return count;
+}
+
+std::string baseName( const std::string& path )
+{
+  const size_t slash = path.find_last_of( "/\\" );
+  return slash == std::string::npos ? path : path.substr( slash + 1 );
+}
+
+
+bool benchModel( const ModelDesc& desc, int width, unsigned int num_threads, int repeat, bool write_ppm )
+{
+  HostMesh model( desc.mesh );
+
+  CpuRaycastingContext context( num_threads );
+  const unsigned int threads = context.getNumThreads();
+
+  const double build_begin = sutil::currentTime();
+  context.setTriangles( model.num_triangles, model.tri_indices, model.num_vertices, model.positions,
+    model.has_texcoords ? model.texcoords : NULL );
+  const double build_time = sutil::currentTime() - build_begin;
+  if( !desc.mask.empty() )
+    context.setMask( desc.mask.c_str() );
+
+  {
+    std::ostringstream line;
+    line << "[raycast] model: " << baseName( desc.mesh )
+      << "\ttriangles: " << model.num_triangles
+      << "\tmask: " << ( desc.mask.empty() ? "none" : baseName( desc.mask ) )
+      << "\tnodes: " << context.getBvh().getNodeCount()
+      << "\tleaves: " << context.getBvh().getLeafCount()
+      << "\tbuild_ms: " << build_time * 1.0e3;
+    std::cout << line.str() << std::endl;
+  }
+
+  const optix::float3& bbox_min = *reinterpret_cast<const optix::float3*>(model.bbox_min);
+  const optix::float3& bbox_max = *reinterpret_cast<const optix::float3*>(model.bbox_max);
+  const optix::float3 bbox_span = bbox_max - bbox_min;
+  const int height = std::max( 1, static_cast<int>(width * bbox_span.y / bbox_span.x) );
+
+  struct RaySet
+  {
+    const char* name;
+    std::vector<Ray> rays;
+  } sets[4];
+  sets[0].name = "ortho";
+  createRaysOrthoOnHost( sets[0].rays, width, height, bbox_min, bbox_max, 0.05f );
+  sets[1].name = "translated";
+  sets[1].rays = sets[0].rays;
+  translateRaysOnHost( sets[1].rays, bbox_span * optix::make_float3(0.2f, 0, 0) );
+  sets[2].name = "incoherent";
+  createRaysIncoherentOnHost( sets[2].rays, sets[0].rays.size(), bbox_min, bbox_max );
+  {
+    std::vector<Hit> hits( sets[0].rays.size() );
+    context.setRaysHostPointer( &sets[0].rays[0], sets[0].rays.size() );
+    context.setHitsHostPointer( &hits[0], hits.size() );
+    context.execute();
+    sets[3].name = "bounce";
+    createRaysBounceOnHost( sets[3].rays, sets[0].rays, hits, 0.25f * optix::length( bbox_span ) );
+  }
+
+  bool ok = true;
+  for( int s = 0; s < 4; ++s )
+  {
+    std::vector<Ray>& rays = sets[s].rays;
+    if( rays.empty() )
+      continue;
+    std::vector<Hit> hits( rays.size() );
+    std::vector<uint32_t> occlusion( occlusionMaskWords( rays.size() ) );
+    context.setRaysHostPointer( &rays[0], rays.size() );
+    context.setHitsHostPointer( &hits[0], hits.size() );
+    context.setOcclusionMaskHostPointer( &occlusion[0], rays.size() );
+
+    // Closest hit and occlusion queries on one thread, then on all threads
+    double closest_time = 0.0;
+    double occlusion_time = 0.0;
+    for( int pass = threads > 1 ? 0 : 1; pass < 2; ++pass )
+    {
+      const unsigned int pass_threads = pass == 0 ? 1 : threads;
+      context.setNumThreads( pass_threads );
+
+      size_t steals = context.getStealCount();
+      closest_time = timeExecute( context, false, repeat );
+      printThroughput( sets[s].name, "closest", rays.size(), pass_threads, closest_time, countHits( hits ),
+        context.getStealCount() - steals, 0.0 );
+
+      steals = context.getStealCount();
+      occlusion_time = timeExecute( context, true, repeat );
+      size_t occluded = 0;
+      for( size_t i = 0; i < rays.size(); ++i )
+        occluded += isOccluded( &occlusion[0], i ) ? 1 : 0;
+      printThroughput( sets[s].name, "occlusion", rays.size(), pass_threads, occlusion_time, occluded,
+        context.getStealCount() - steals, closest_time / occlusion_time );
+    }
+
+    // Both queries again on all threads with ray sorting, into separate buffers
+    std::vector<Hit> sorted_hits( rays.size() );
+    std::vector<uint32_t> sorted_occlusion( occlusion.size() );
+    context.setHitsHostPointer( &sorted_hits[0], sorted_hits.size() );
+    context.setOcclusionMaskHostPointer( &sorted_occlusion[0], rays.size() );
+    context.setRaySorting( true );
+    {
+      const double sorted_closest_time = timeExecute( context, false, repeat );
+      printSorted( sets[s].name, "closest", rays.size(), threads, context.getLastQueryStats(), sorted_closest_time,
+        closest_time );
+      const double sorted_occlusion_time = timeExecute( context, true, repeat );
+      printSorted( sets[s].name, "occlusion", rays.size(), threads, context.getLastQueryStats(), sorted_occlusion_time,
+        occlusion_time );
+    }
+    context.setRaySorting( false );
+    context.setHitsHostPointer( &hits[0], hits.size() );
+    context.setOcclusionMaskHostPointer( &occlusion[0], rays.size() );
+
+    // Sorting only changes the order of the traversals, so the results must be identical
+    const bool sorted_ok = memcmp( &sorted_hits[0], &hits[0], hits.size() * sizeof( Hit ) ) == 0 &&
+      sorted_occlusion == occlusion;
+
+    if( write_ppm && s < 2 )
+    {
+      std::vector<optix::float3> image;
+      shadeHitsOnHost( image, hits );
+      const std::string filename = baseName( desc.mesh ) + ( s == 0 ? ".ppm" : "_translated.ppm" );
+      writePPM( filename.c_str(), &image[0].x, width, height );
+    }
+
+    // Keep the reference loop to about a million triangle tests per set
+    const size_t stride = std::max<size_t>( 1, rays.size() * size_t( model.num_triangles ) / 1000000 );
+    size_t checked = 0;
+    const bool set_ok = sorted_ok && checkHits( context, rays, hits, stride, checked ) &&
+      checkOcclusion( context, rays, hits );
+    if( !set_ok )
+      std::cout << "[raycast] rays: " << sets[s].name << "\tchecked: " << checked << "\tFAILED" << std::endl;
+    ok &= set_ok;
+  }
+  return ok;
+}
+
+// Particle sequences as in optixParticles, each particle an octahedron of 8 triangles
+
+std::string particleFrameName( const std::string& file_base, int frame )
+{
+  std::ostringstream name;
+  name << file_base << "." << std::setw( 4 ) << std::setfill( '0' ) << frame << ".txt";
+  return name.str();
+}
+
+// Vertex positions of the first count particles of a frame, fewer if the file has fewer.
+// Lines hold position, velocity, color and radius.
+void loadParticleOctahedra( const std::string& filename, size_t count, std::vector<float>& positions )
+{
+  std::ifstream in( filename.c_str() );
+  if( !in )
+    throw std::runtime_error( "Cannot open particles file " + filename );
+
+  positions.clear();
+  std::string line;
+  while( positions.size() < 18 * count && std::getline( in, line ) )
+  {
+    std::istringstream fields( line );
+    float v[10];
+    int n = 0;
+    while( n < 10 && fields >> v[n] )
+      ++n;
+    if( n < 10 )
+      continue; // empty or comment line
+
+    for( int axis = 0; axis < 3; ++axis )
+      for( int side = -1; side <= 1; side += 2 )
+        for( int k = 0; k < 3; ++k )
+          positions.push_back( v[k] + ( k == axis ? side * v[9] : 0.0f ) );
+  }
+}
+
+// Triangles of count octahedra with the vertex order of loadParticleOctahedra()
+void createOctahedronIndices( size_t count, std::vector<int32_t>& indices )
+{
+  // -x +x -y +y -z +z
+  static const int faces[8][3] = {
+    { 1, 3, 5 }, { 3, 0, 5 }, { 0, 2, 5 }, { 2, 1, 5 },
+    { 3, 1, 4 }, { 0, 3, 4 }, { 2, 0, 4 }, { 1, 2, 4 } };
+  indices.resize( 24 * count );
+  for( size_t p = 0; p < count; ++p )
+    for( int f = 0; f < 8; ++f )
+      for( int j = 0; j < 3; ++j )
+        indices[24*p + 3*f + j] = static_cast<int32_t>( 6*p + faces[f][j] );
+}
+
+void positionBounds( const std::vector<float>& positions, optix::float3& bbmin, optix::float3& bbmax )
+{
+  bbmin = optix::make_float3( 1e34f );
+  bbmax = optix::make_float3( -1e34f );
+  for( size_t i = 0; i + 2 < positions.size(); i += 3 )
+  {
+    const optix::float3 p = optix::make_float3( positions[i], positions[i+1], positions[i+2] );
+    bbmin = optix::fminf( bbmin, p );
+    bbmax = optix::fmaxf( bbmax, p );
+  }
+}
+
+// Same hit or miss as the rebuilt BVH at the same distance. Overlapping particles may
+// report either triangle where the distances agree.
+bool sameHits( const std::vector<Hit>& hits, const std::vector<Hit>& expected )
+{
+  for( size_t i = 0; i < hits.size(); ++i )
+  {
+    if( ( hits[i].triId < 0 ) != ( expected[i].triId < 0 ) )
+      return false;
+    if( hits[i].triId >= 0 && std::fabs( hits[i].t - expected[i].t ) > 1.e-5f * std::max( 1.0f, std::fabs( expected[i].t ) ) )
+      return false;
+  }
+  return true;
+}
+
+// Moves the particles of the first frame through the sequence, updating the BVH with a
+// rebuild every frame, with refits only and with refits that rebuild once the SAH cost
+// has grown by max_sah_growth. Casts orthographic rays at each frame.
+bool benchParticles( const std::string& file_base, int num_frames, int width, unsigned int num_threads, int repeat,
+                     float max_sah_growth )
+{
+  std::vector<std::vector<float> > frames( 1 );
+  loadParticleOctahedra( particleFrameName( file_base, 1 ), ~size_t( 0 ) / 32, frames[0] );
+  const size_t count = frames[0].size() / 18;
+  for( int f = 2; f <= num_frames; ++f )
+  {
+    // Particles keep their place in the files, later frames append new ones
+    frames.push_back( std::vector<float>() );
+    loadParticleOctahedra( particleFrameName( file_base, f ), count, frames.back() );
+    if( frames.back().size() != frames[0].size() )
+      throw std::runtime_error( "Fewer particles than in the first frame in " + particleFrameName( file_base, f ) );
+  }
+  std::vector<int32_t> indices;
+  createOctahedronIndices( count, indices );
+
+  struct Mode
+  {
+    const char* name;
+    bool   refit;
+    float  max_sah_growth;
+    std::unique_ptr<CpuRaycastingContext> context;
+    std::vector<Hit> hits;
+    double update_seconds;
+    double trace_seconds;
+    float  max_growth;
+    bool   ok;
+  } modes[3];
+  modes[0].name = "rebuild";
+  modes[0].refit = false;
+  modes[1].name = "refit";
+  modes[1].refit = true;
+  modes[1].max_sah_growth = std::numeric_limits<float>::max();
+  modes[2].name = "adaptive";
+  modes[2].refit = true;
+  modes[2].max_sah_growth = max_sah_growth;
+
+  for( int m = 0; m < 3; ++m )
+  {
+    Mode& mode = modes[m];
+    mode.context.reset( new CpuRaycastingContext( num_threads ) );
+    mode.context->setTriangles( static_cast<int>( 8 * count ), &indices[0], static_cast<int>( 6 * count ), &frames[0][0], NULL );
+    if( mode.refit )
+      mode.context->setBvhRefit( true, mode.max_sah_growth );
+    mode.update_seconds = 0.0;
+    mode.trace_seconds = 0.0;
+    mode.max_growth = 1.0f;
+    mode.ok = true;
+  }
+
+  {
+    std::ostringstream line;
+    line << "[refit] particles: " << baseName( file_base )
+      << "\tcount: " << count
+      << "\ttriangles: " << 8 * count
+      << "\tframes: " << num_frames
+      << "\tthreads: " << modes[0].context->getNumThreads()
+      << "\tbuild_sah: " << modes[0].context->getBvh().getBuildSahCost();
+    std::cout << line.str() << std::endl;
+  }
+
+  std::vector<Ray> rays;
+  for( int f = 1; f < num_frames; ++f )
+  {
+    optix::float3 bbmin, bbmax;
+    positionBounds( frames[f], bbmin, bbmax );
+    const optix::float3 span = bbmax - bbmin;
+    createRaysOrthoOnHost( rays, width, std::max( 1, static_cast<int>( width * span.y / span.x ) ), bbmin, bbmax, 0.05f );
+
+    std::ostringstream line;
+    line << "[refit] frame: " << f + 1;
+    for( int m = 0; m < 3; ++m )
+    {
+      Mode& mode = modes[m];
+      CpuRaycastingContext& context = *mode.context;
+      context.updatePositions( &frames[f][0] );
+      const CpuRaycastingContext::BvhStats& stats = context.getLastBvhStats();
+      const double update_seconds = stats.build_seconds + stats.refit_seconds;
+      const float growth = context.getBvh().getSahCost() / context.getBvh().getBuildSahCost();
+
+      mode.hits.resize( rays.size() );
+      context.setRaysHostPointer( &rays[0], rays.size() );
+      context.setHitsHostPointer( &mode.hits[0], mode.hits.size() );
+      const double trace_seconds = timeExecute( context, false, repeat );
+
+      mode.update_seconds += update_seconds;
+      mode.trace_seconds += trace_seconds;
+      mode.max_growth = std::max( mode.max_growth, growth );
+      if( m > 0 )
+        mode.ok &= sameHits( mode.hits, modes[0].hits );
+
+      line << "\t" << mode.name << "_ms: " << update_seconds * 1.0e3
+        << "\t" << mode.name << "_trace_ms: " << trace_seconds * 1.0e3;
+      if( mode.refit )
+        line << "\t" << mode.name << "_sah: " << growth << ( stats.build_seconds > 0.0 ? "\trebuilt" : "" );
+    }
+    std::cout << line.str() << std::endl;
+  }
+
+  // The refit only BVH against the brute force loop, on a subset of the last frame
+  size_t checked = 0;
+  const size_t stride = std::max<size_t>( 1, rays.size() * 8 * count / 1000000 );
+  modes[1].ok &= checkHits( *modes[1].context, rays, modes[1].hits, stride, checked );
+
+  bool ok = true;
+  for( int m = 0; m < 3; ++m )
+  {
+    const Mode& mode = modes[m];
+    const CpuRaycastingContext::BvhStats& stats = mode.context->getLastBvhStats();
+    const double updates = std::max( 1, num_frames - 1 );
+    std::ostringstream line;
+    line << "[refit] mode: " << mode.name
+      << "\tupdate_ms: " << mode.update_seconds / updates * 1.0e3
+      << "\ttrace_ms: " << mode.trace_seconds / updates * 1.0e3
+      << "\tframe_ms: " << ( mode.update_seconds + mode.trace_seconds ) / updates * 1.0e3
+      << "\tmax_sah_growth: " << mode.max_growth
+      << "\trefits: " << stats.refits
+      << "\trebuilds: " << stats.rebuilds
+      << "\tspeedup: " << ( modes[0].update_seconds + modes[0].trace_seconds ) / ( mode.update_seconds + mode.trace_seconds );
+    if( !mode.ok )
+      line << "\tFAILED";
+    std::cout << line.str() << std::endl;
+    ok &= mode.ok;
+  }
+  return ok;
+}
+
+
+int main( int argc, char** argv )
+{
+  std::vector<ModelDesc> models;
+  int width = 1024;
+  unsigned int num_threads = 0;
+  int repeat = 5;
+  bool write_ppm = false;
+  std::string particles;
+  int num_frames = 25;
+  float max_sah_growth = 1.5f;
+
+  // parse arguments
+  for ( int i = 1; i < argc; ++i ) 
+  { 
+    std::string arg( argv[i] );
+    if( arg == "-h" || arg == "--help" ) 
+    {
+      printUsageAndExit( argv[0] ); 
+    } 
+    else if( (arg == "-m" || arg == "--mesh") && i+1 < argc ) 
+    {
+      ModelDesc desc;
+      desc.mesh = argv[++i];
+      models.push_back( desc );
+    } 
+    else if ( (arg == "--mask") && i+1 < argc && !models.empty() )
+    {
+      models.back().mask = argv[++i];
+    }
+    else if( (arg == "-w" || arg == "--width") && i+1 < argc ) 
+    {
+      width = std::max( 1, atoi(argv[++i]) );
+    } 
+    else if( (arg == "-t" || arg == "--threads") && i+1 < argc ) 
+    {
+      num_threads = static_cast<unsigned int>( std::max( 0, atoi(argv[++i]) ) );
+    } 
+    else if( (arg == "-r" || arg == "--repeat") && i+1 < argc ) 
+    {
+      repeat = std::max( 1, atoi(argv[++i]) );
+    } 
+    else if( arg == "--ppm" )
+    {
+      write_ppm = true;
+    }
+    else if( (arg == "-p" || arg == "--particles") && i+1 < argc )
+    {
+      particles = argv[++i];
+    }
+    else if( arg == "--frames" && i+1 < argc )
+    {
+      num_frames = std::max( 1, atoi(argv[++i]) );
+    }
+    else if( arg == "--sah-growth" && i+1 < argc )
+    {
+      max_sah_growth = static_cast<float>( atof(argv[++i]) );
+    }
+    else 
+    {
+      std::cerr << "Bad option: '" << arg << "'" << std::endl;
+      printUsageAndExit( argv[0] );
+    }
+  }
+
+  // Default models, the fish with the mask as in optixRaycasting
+  if( models.empty() ) {
+    const std::string data_dir = std::string( sutil::samplesDir() ) + "/data/";
+    ModelDesc fish;
+    fish.mesh = data_dir + "fish.obj";
+    fish.mask = data_dir + "fish_mask.ppm";
+    models.push_back( fish );
+    ModelDesc cow;
+    cow.mesh = data_dir + "cow.obj";
+    models.push_back( cow );
+    if( particles.empty() )
+      particles = data_dir + "particles/particles";
+  }
+
+  bool ok = true;
+  try {
+    for( size_t i = 0; i < models.size(); ++i )
+      ok &= benchModel( models[i], width, num_threads, repeat, write_ppm );
+    if( !particles.empty() )
+      ok &= benchParticles( particles, num_frames, width, num_threads, repeat, max_sah_growth );
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    exit(1);
+  }
+
+  std::cout << "[raycast] checks: " << ( ok ? "ok" : "failed" ) << std::endl;
+  return ok ? 0 : 1;
+}
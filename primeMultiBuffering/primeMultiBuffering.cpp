@@ -34,10 +34,15 @@
 //     2) Conserve page-locked host memory. Larger computations can be staged
 //        through a smaller amount page-locked memory
 //
+//  With --pipeline the same rays are also streamed through QueryPipeline from
+//  putil, which runs ray generation, queries and hit processing on separate
+//  threads, and the overlap it achieves is reported.
+//
 //-----------------------------------------------------------------------------
 
 #include <primeCommon.h>
 #include <optix_prime/optix_primepp.h>
+#include <putil/QueryPipeline.h>
 #include <sutil.h>
 #include <memory.h>
 #include <algorithm>
@@ -204,6 +209,8 @@ void printUsageAndExit( const char* argv0 )
   << "  -b  | --buffers <number>    Number of buffer sets. Default is 2.\n"
   << "  -c  | --count <number>      Max count for each buffer. Default is 65536.\n"
   << "  -w  | --width <number>      Specify output image width\n"
+  << "        --context [cpu|(cuda)] Specify context type. Default is cuda\n"
+  << "  -p  | --pipeline <number>   Also run a QueryPipeline with this many stages\n"
   << std::endl;
   
   exit(1);
@@ -218,6 +225,8 @@ int main( int argc, char** argv )
   int height = 0;
   int numBufferSets = 2;
   size_t maxCount = 64*1024;
+  RTPcontexttype contextType = RTP_CONTEXT_TYPE_CUDA;
+  int pipelineStages = 0;
 
   // parse arguments
   for ( int i = 1; i < argc; ++i ) 
@@ -243,6 +252,20 @@ int main( int argc, char** argv )
     {
       maxCount = (size_t)atoi(argv[++i]);
     } 
+    else if( arg == "--context" && i+1 < argc )
+    {
+      std::string param( argv[++i] );
+      if( param == "cpu" )
+        contextType = RTP_CONTEXT_TYPE_CPU;
+      else if( param == "cuda" )
+        contextType = RTP_CONTEXT_TYPE_CUDA;
+      else
+        printUsageAndExit( argv[0] );
+    } 
+    else if( (arg == "-p" || arg == "--pipeline") && i+1 < argc ) 
+    {
+      pipelineStages = atoi(argv[++i]);
+    } 
     else 
     {
       std::cerr << "Bad option: '" << arg << "'" << std::endl;
@@ -255,9 +278,12 @@ int main( int argc, char** argv )
     //
     // Create Context
     //
-    Context context = Context::create(RTP_CONTEXT_TYPE_CUDA);
-    unsigned int device = 0;
-    context->setCudaDeviceNumbers(1, &device);
+    Context context = Context::create(contextType);
+    if( contextType == RTP_CONTEXT_TYPE_CUDA )
+    {
+      unsigned int device = 0;
+      context->setCudaDeviceNumbers(1, &device);
+    }
 
     //
     // Create the Model object
@@ -307,6 +333,44 @@ int main( int argc, char** argv )
       }
     }
 
+    //
+    // Stream the same rays through a pipeline. The producer copies batches of rays
+    // as the manager above, the consumer copies the hits back, while the calling
+    // thread runs the queries.
+    //
+    if( pipelineStages > 0 )
+    {
+      Buffer<Hit> pipelineHits( rays.count(), RTP_BUFFER_TYPE_HOST );
+      QueryPipeline<Ray, Hit> pipeline( model, RTP_QUERY_TYPE_CLOSEST, pipelineStages, maxCount );
+      QueryPipeline<Ray, Hit>::Stats stats = pipeline.run(
+        [&]( size_t index, Ray* batchRays, size_t batchSize ) -> size_t
+        {
+          const size_t first = index*batchSize;
+          const size_t queryCount = first < rays.count() ? std::min( batchSize, rays.count()-first ) : 0;
+          memcpy( batchRays, rays.ptr()+first, queryCount*sizeof(Ray) );
+          return queryCount;
+        },
+        [&]( size_t index, const Ray*, const Hit* batchHits, size_t queryCount )
+        {
+          memcpy( pipelineHits.ptr()+index*maxCount, batchHits, queryCount*sizeof(Hit) );
+        } );
+
+      const bool match = memcmp( pipelineHits.ptr(), hits.ptr(), hits.count()*sizeof(Hit) ) == 0;
+      std::cerr << "Pipeline of " << pipeline.getNumStages() << " stages: "
+                << stats.batches << " batches, " << stats.rays << " rays in "
+                << stats.wallSeconds*1.0e3 << " ms, "
+                << 100.0*stats.overlapFraction() << "% of the serial time hidden, hits "
+                << ( match ? "match" : "DIFFER" ) << "\n";
+      const char* names[] = { "produce", "trace", "consume" };
+      const QueryPipeline<Ray, Hit>::StageStats* stages[] = { &stats.produce, &stats.trace, &stats.consume };
+      for( int i=0; i < 3; ++i )
+      {
+        std::cerr << "  " << names[i] << ": busy " << stages[i]->busySeconds*1.0e3 << " ms, "
+                  << stages[i]->hiddenSeconds*1.0e3 << " ms hidden by overlap, waited "
+                  << stages[i]->waitSeconds*1.0e3 << " ms\n";
+      }
+    }
+
     //
     // Shade the hit results to create image.
     //
@@ -27,6 +27,7 @@
  */
 
 #include "primeCommon.h"
+#include <putil/HostKernels.h>
 #include <math.h>
 #include <fstream>
 #include <iostream>
@@ -134,20 +135,7 @@ void createRaysPersp( Buffer<Ray>& raysBuffer, int width, int height, const floa
   raysBuffer.alloc( width * height );
   if( raysBuffer.type() == RTP_BUFFER_TYPE_HOST )
   {
-    Ray* rays = raysBuffer.ptr();
-
-    int idx=0;
-    for( int h=0; h < height; h++ ) 
-    {
-      float v = float(h)/height * 2.0f - 1.0f;
-      for( int w=0; w < width; w++ ) 
-      {
-        float u = float(w)/width * 2.0f - 1.0f;
-        float3 dir = optix::normalize(u*U + v*V + W);
-        Ray r = { eye, 0.0f, dir, 1e34f };
-        rays[idx++] = r;
-      }
-    }
+    createRaysPerspOnHost( (float4*)raysBuffer.ptr(), width, height, eye, U, V, W );
   }
   else if( raysBuffer.type() == RTP_BUFFER_TYPE_CUDA_LINEAR )
   {
@@ -160,9 +148,7 @@ void translateRays( Buffer<Ray>& raysBuffer, const float3& offset )
 {
   if( raysBuffer.type() == RTP_BUFFER_TYPE_HOST )
   {
-    Ray* rays = raysBuffer.ptr();
-    for( size_t r=0; r < raysBuffer.count(); r++ )
-      rays[r].origin = rays[r].origin + offset;
+    translateRaysOnHost( (float4*)raysBuffer.ptr(), raysBuffer.count(), offset );
   }
   else if( raysBuffer.type() == RTP_BUFFER_TYPE_CUDA_LINEAR )
   {
@@ -175,28 +161,9 @@ void shadeHits( std::vector<float3>& image, Buffer<Hit>& hitsBuffer, PrimeMesh&
 {
   float3 backgroundColor = { 0.2f, 0.2f, 0.2f };
 
-  int3* indices = mesh.getVertexIndices();
-  float3* vertices = mesh.getVertexData();
   const Hit* hits = hitsBuffer.hostPtr();
-  for( size_t i=0; i < hitsBuffer.count(); i++ )
-  {
-    if( hits[i].t < 0.0f )
-    {
-      image[i] = backgroundColor;
-    }
-    else
-    {
-      int3 tri  = indices[hits[i].triId];
-      float3 v0 = vertices[tri.x];
-      float3 v1 = vertices[tri.y];
-      float3 v2 = vertices[tri.z];
-      float3 e0 = v1-v0;
-      float3 e1 = v2-v0;
-      float3 n = optix::normalize( optix::cross( e0, e1 ) );
-
-      image[i] = 0.5f*n + make_float3( 0.5f, 0.5f, 0.5f ); 
-    }
-  }
+  shadeHitsOnHost( &image[0], (const float4*)hits, hitsBuffer.count(), mesh.getVertexIndices(), mesh.getVertexData(),
+    backgroundColor );
 }
 
 //------------------------------------------------------------------------------
@@ -223,43 +190,47 @@ void shadeHits( std::vector<float3>& image, Buffer<HitInstancing>& hitsBuffer, s
 {
   float3 backgroundColor = { 1.0f, 1.0f, 1.0f };
 
+  // The transforms and meshes differ per hit, so only the threads of the host kernels are used
   const HitInstancing* hits = hitsBuffer.hostPtr();
-  for( size_t i=0; i < hitsBuffer.count(); ++i )
+  hostParallelFor( hitsBuffer.count(), 4096, 0, [&]( size_t begin, size_t end )
   {
-    if( hits[i].t < 0.0f )
-    {
-      image[i] = backgroundColor;
-    }
-    else
+    for( size_t i=begin; i < end; ++i )
     {
-      int modelId = modelIds[hits[i].instId];
-      PrimeMesh& mesh = models[modelId];
-      int3* indices = mesh.getVertexIndices();
-      float3* vertices = mesh.getVertexData();
-      SimpleMatrix4x3& Minv = invTransforms[hits[i].instId];
+      if( hits[i].t < 0.0f )
+      {
+        image[i] = backgroundColor;
+      }
+      else
+      {
+        int modelId = modelIds[hits[i].instId];
+        PrimeMesh& mesh = models[modelId];
+        int3* indices = mesh.getVertexIndices();
+        float3* vertices = mesh.getVertexData();
+        SimpleMatrix4x3& Minv = invTransforms[hits[i].instId];
 
-      // Compute normal in object space
-      int3 tri  = indices[hits[i].triId];
-      float3 v0 = vertices[tri.x];
-      float3 v1 = vertices[tri.y];
-      float3 v2 = vertices[tri.z];
-      float3 e0 = v1-v0;
-      float3 e1 = v2-v0;
-      float3  n = optix::cross( e0, e1 ); // save normalization for later
+        // Compute normal in object space
+        int3 tri  = indices[hits[i].triId];
+        float3 v0 = vertices[tri.x];
+        float3 v1 = vertices[tri.y];
+        float3 v2 = vertices[tri.z];
+        float3 e0 = v1-v0;
+        float3 e1 = v2-v0;
+        float3  n = optix::cross( e0, e1 ); // save normalization for later
 
-      // Flip normal if facing away from eye
-      float3 eyeO = transformPoint( Minv, eye );
-      float3 dir = v0 - eyeO;
-      if( optix::dot(n, dir) > 0 )
-        n = -n;
+        // Flip normal if facing away from eye
+        float3 eyeO = transformPoint( Minv, eye );
+        float3 dir = v0 - eyeO;
+        if( optix::dot(n, dir) > 0 )
+          n = -n;
 
-      // Transform to world space
-      n = optix::normalize( transformNormal( Minv, n ) );     
+        // Transform to world space
+        n = optix::normalize( transformNormal( Minv, n ) );     
       
-      // Compute color
-      image[i] = 0.5f*n + make_float3( 0.5f, 0.5f, 0.5f ); 
+        // Compute color
+        image[i] = 0.5f*n + make_float3( 0.5f, 0.5f, 0.5f ); 
+      }
     }
-  }
+  } );
 }
 //------------------------------------------------------------------------------
 void writePpm( const char* filename, const float* image, int width, int height )
@@ -31,13 +31,18 @@
 //  Minimal demonstration of handling multiple GPUs by allocating an
 //  OptiX Prime context for each.
 //
+//  With --engines the rows are instead balanced dynamically by QueryBalancer
+//  from putil over any mix of GPU and CPU contexts, which may differ in speed.
+//
 //-----------------------------------------------------------------------------
 
 #include <primeCommon.h>
 #include <optix_prime/optix_primepp.h>
 #include <optixu/optixu_math_namespace.h>
+#include <putil/QueryBalancer.h>
 #include <sutil.h>
 #include <memory.h>
+#include <sstream>
 
 using namespace optix::prime;
 
@@ -189,6 +194,124 @@ private:
   std::vector<Query>   m_queries;
 };
 
+//------------------------------------------------------------------------------
+// A context, model and query per engine, with the rows balanced between them by
+// QueryBalancer. Engines are given as a comma separated list of "cuda" for every
+// device, "cuda:<device>" and "cpu:<threads>", where 0 threads uses the default
+// of Prime. Several CPU engines with different thread counts stand in for
+// devices of unequal speed.
+class BalancedManager
+{
+public:
+  void init( const std::string& engines )
+  {
+    std::stringstream list( engines );
+    std::string engine;
+    while( std::getline( list, engine, ',' ) )
+    {
+      if( engine == "cuda" )
+      {
+        int deviceCount = 0;
+        CHK_CUDA( cudaGetDeviceCount( &deviceCount ) );
+        for( int i=0; i < deviceCount; ++i )
+          addEngine( RTP_CONTEXT_TYPE_CUDA, unsigned(i) );
+      }
+      else if( engine.compare( 0, 5, "cuda:" ) == 0 )
+      {
+        addEngine( RTP_CONTEXT_TYPE_CUDA, unsigned( atoi( engine.c_str()+5 ) ) );
+      }
+      else if( engine.compare( 0, 4, "cpu:" ) == 0 )
+      {
+        addEngine( RTP_CONTEXT_TYPE_CPU, unsigned( atoi( engine.c_str()+4 ) ) );
+      }
+      else
+      {
+        throw std::runtime_error( "Unknown engine '" + engine + "'" );
+      }
+    }
+    if( m_contexts.empty() )
+      throw std::runtime_error( "No engines" );
+  }
+
+  void createModel( int numTriangles, int3* indices, int numVertices, float3* vertices )
+  {
+    // Each context builds its own model, models cannot be copied between context types
+    for( size_t i=0; i < m_models.size(); ++i )
+    {
+      m_models[i]->setTriangles( numTriangles, RTP_BUFFER_TYPE_HOST,  indices,
+                                 numVertices,  RTP_BUFFER_TYPE_HOST,  vertices );
+      m_models[i]->update( RTP_MODEL_HINT_ASYNC );
+    }
+    for( size_t i=0; i < m_models.size(); ++i )
+    {
+      m_models[i]->finish();
+      m_balancer.addEngine( m_names[i], m_models[i]->createQuery( RTP_QUERY_TYPE_CLOSEST ) );
+    }
+  }
+
+  void createRaysOrtho( int width, int* height,
+     const float3& bbmin, const float3& bbmax, float margin )
+  {
+    m_rays_h.alloc( 0, RTP_BUFFER_TYPE_HOST );
+    ::createRaysOrtho( m_rays_h, width, height, bbmin, bbmax, margin );
+    m_hits_h.alloc( m_rays_h.count(), RTP_BUFFER_TYPE_HOST );
+  }
+
+  void translateRays( const float3& offset )
+  {
+    ::translateRays( m_rays_h, offset );
+  }
+
+  // Executes the query numBatches times to show the balance adapting. Returns a
+  // pointer to the internal hit buffer. Do not delete it.
+  Buffer<Hit>* queryExecute( int numBatches )
+  {
+    for( int batch=0; batch < numBatches; ++batch )
+    {
+      m_balancer.execute( m_rays_h.ptr(), m_hits_h.ptr(), m_rays_h.count() );
+      std::cerr << "Batch " << batch << ": " << m_balancer.getLastWallSeconds()*1.0e3 << " ms\n";
+      for( size_t i=0; i < m_balancer.getEngineCount(); ++i )
+      {
+        QueryBalancer<Ray, Hit>::EngineStats stats = m_balancer.getEngineStats( i );
+        std::cerr << "  " << stats.name << ": " << stats.rays << " rays in " 
+                  << stats.chunks << " chunks (" << stats.stolenChunks << " stolen), busy "
+                  << stats.busySeconds*1.0e3 << " ms, idle " << stats.idleSeconds*1.0e3
+                  << " ms, next share " << stats.weight << "\n";
+      }
+    }
+    return &m_hits_h;
+  }
+
+private:
+  void addEngine( RTPcontexttype type, unsigned number )
+  {
+    std::stringstream name;
+    m_contexts.push_back( Context::create( type ) );
+    if( type == RTP_CONTEXT_TYPE_CUDA )
+    {
+      m_contexts.back()->setCudaDeviceNumbers( 1, &number );
+      name << "cuda:" << number;
+    }
+    else
+    {
+      if( number > 0 )
+        m_contexts.back()->setCpuThreads( number );
+      name << "cpu:" << number;
+    }
+    m_models.push_back( m_contexts.back()->createModel() );
+    m_names.push_back( name.str() );
+  }
+
+  Buffer<Ray> m_rays_h;
+  Buffer<Hit> m_hits_h;
+
+  // Per-engine API objects
+  std::vector<Context>     m_contexts;
+  std::vector<Model>       m_models;
+  std::vector<std::string> m_names;
+  QueryBalancer<Ray, Hit>  m_balancer;
+};
+
 //------------------------------------------------------------------------------
 void printUsageAndExit( const char* argv0 )
 {
@@ -198,6 +321,8 @@ void printUsageAndExit( const char* argv0 )
   << "  -h  | --help                               Print this usage message\n"
   << "  -o  | --obj <obj_file>                     Specify model to be rendered\n"
   << "  -w  | --width <number>                     Specify output image width\n"
+  << "  -e  | --engines <list>                     Balance over engines, e.g. cuda,cpu:4,cpu:1\n"
+  << "  -n  | --batches <number>                   Query executes per image with --engines. Default is 4\n"
   << std::endl;
   
   exit(1);
@@ -210,6 +335,8 @@ int main( int argc, char** argv )
   std::string objFilename = std::string( sutil::samplesDir() ) + "/data/cow.obj";
   int width = 640;
   int height = 0;
+  std::string engines;
+  int numBatches = 4;
 
   // parse arguments
   for ( int i = 1; i < argc; ++i ) 
@@ -227,6 +354,14 @@ int main( int argc, char** argv )
     {
       width = atoi(argv[++i]);
     } 
+    else if( (arg == "-e" || arg == "--engines") && i+1 < argc ) 
+    {
+      engines = argv[++i];
+    } 
+    else if( (arg == "-n" || arg == "--batches") && i+1 < argc ) 
+    {
+      numBatches = std::max( 1, atoi(argv[++i]) );
+    } 
     else 
     {
       std::cerr << "Bad option: '" << arg << "'" << std::endl;
@@ -239,6 +374,28 @@ int main( int argc, char** argv )
     PrimeMesh mesh;
     loadMesh( objFilename, mesh );
 
+    if( !engines.empty() )
+    {
+      BalancedManager manager;
+      manager.init( engines );
+      manager.createModel( mesh.num_triangles, mesh.getVertexIndices(),  
+                           mesh.num_vertices,  mesh.getVertexData() );
+      manager.createRaysOrtho( width, &height, mesh.getBBoxMin(), mesh.getBBoxMax(), 0.05f );
+      Buffer<Hit>* hits = manager.queryExecute( numBatches );
+
+      std::vector<float3> image( width * height );
+      shadeHits( image, *hits, mesh );
+      writePpm( "output.ppm", &image[0].x, width, height );
+
+      float3 extents = mesh.getBBoxMax() - mesh.getBBoxMin();
+      manager.translateRays( extents * make_float3(0.2f, 0, 0) );
+      hits = manager.queryExecute( numBatches );
+      shadeHits( image, *hits, mesh );
+      freeMesh( mesh );
+      writePpm( "outputTranslated.ppm", &image[0].x, width, height );
+      return 0;
+    }
+
     MultiGpuManager manager;
     manager.init();
     manager.createModel( mesh.num_triangles, mesh.getVertexIndices(),  
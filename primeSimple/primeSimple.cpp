@@ -33,8 +33,10 @@
 //-----------------------------------------------------------------------------
 
 #include "primeCommon.h"
+#include <putil/HostKernels.h>
 #include <optixu/optixu_math_namespace.h>
 #include <sutil.h>
+#include <string.h>
 
 
 //------------------------------------------------------------------------------
@@ -48,11 +50,135 @@ void printUsageAndExit( const char* argv0 )
   << "  -c  | --context [cpu|(cuda)]               Specify context type. Default is cuda\n"
   << "  -b  | --buffer [(host)|cuda]               Specify buffer type. Default is host\n"
   << "  -w  | --width <number>                     Specify output image width\n"
+  << "        --bench-host                         Time the host ray generation and shading against scalar loops\n"
   << std::endl;
   
   exit(1);
 }
 
+//------------------------------------------------------------------------------
+//
+//  The scalar host loops of primeCommon.cpp before putil/HostKernels.h, kept as the
+//  baseline of --bench-host
+//
+void createRaysPerspScalar( Ray* rays, int width, int height, const float3& eye, float3 U, float3 V, float3 W )
+{
+  int idx=0;
+  for( int h=0; h < height; h++ ) 
+  {
+    float v = float(h)/height * 2.0f - 1.0f;
+    for( int w=0; w < width; w++ ) 
+    {
+      float u = float(w)/width * 2.0f - 1.0f;
+      float3 dir = optix::normalize(u*U + v*V + W);
+      Ray r = { eye, 0.0f, dir, 1e34f };
+      rays[idx++] = r;
+    }
+  }
+}
+
+void translateRaysScalar( Ray* rays, size_t count, const float3& offset )
+{
+  for( size_t r=0; r < count; r++ )
+    rays[r].origin = rays[r].origin + offset;
+}
+
+void shadeHitsScalar( float3* image, const Hit* hits, size_t count, PrimeMesh& mesh )
+{
+  float3 backgroundColor = { 0.2f, 0.2f, 0.2f };
+
+  int3* indices = mesh.getVertexIndices();
+  float3* vertices = mesh.getVertexData();
+  for( size_t i=0; i < count; i++ )
+  {
+    if( hits[i].t < 0.0f )
+    {
+      image[i] = backgroundColor;
+    }
+    else
+    {
+      int3 tri  = indices[hits[i].triId];
+      float3 v0 = vertices[tri.x];
+      float3 v1 = vertices[tri.y];
+      float3 v2 = vertices[tri.z];
+      float3 e0 = v1-v0;
+      float3 e1 = v2-v0;
+      float3 n = optix::normalize( optix::cross( e0, e1 ) );
+
+      image[i] = 0.5f*n + make_float3( 0.5f, 0.5f, 0.5f ); 
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// Fastest of a few runs of f, in milliseconds
+template<typename F>
+double timeMs( F f )
+{
+  double best = 0.0;
+  for( int i=0; i < 5; ++i )
+  {
+    double start = sutil::currentTime();
+    f();
+    double elapsed = ( sutil::currentTime() - start ) * 1.0e3;
+    if( i == 0 || elapsed < best )
+      best = elapsed;
+  }
+  return best;
+}
+
+void printBenchLine( const char* kernel, size_t count, double scalarMs, double oneThreadMs, double allThreadsMs, bool match )
+{
+  std::cout << "[prime] kernel: " << kernel
+            << "\tcount: " << count
+            << "\tscalar_ms: " << scalarMs
+            << "\tsimd_1_thread_ms: " << oneThreadMs
+            << "\tsimd_all_threads_ms: " << allThreadsMs
+            << "\tspeedup: " << scalarMs / allThreadsMs
+            << "\tmatch: " << ( match ? "yes" : "NO" ) << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Times the scalar loops against the host kernels on one thread and on all threads,
+// with a perspective camera in front of the model and the hits of the query, and checks that the
+// results are identical
+void benchHostKernels( PrimeMesh& mesh, Buffer<Hit>& hitsBuffer, int width, int height )
+{
+  float3 bbmin = mesh.getBBoxMin();
+  float3 bbmax = mesh.getBBoxMax();
+  float3 center = 0.5f*( bbmin + bbmax );
+  float3 eye = center + make_float3( 0.0f, 0.0f, -2.0f*optix::length( bbmax - bbmin ) );
+  float3 U, V, W;
+  W = optix::normalize( center - eye );
+  U = optix::normalize( optix::cross( W, make_float3( 0.0f, 1.0f, 0.0f ) ) ) * float( tan( 30.0f * M_PI/180 ) ) * float(width)/height;
+  V = optix::cross( optix::normalize( U ), W ) * float( tan( 30.0f * M_PI/180 ) );
+
+  const size_t count = size_t(width)*height;
+  std::vector<Ray> scalarRays( count ), rays( count );
+  double scalarMs = timeMs( [&]() { createRaysPerspScalar( &scalarRays[0], width, height, eye, U, V, W ); } );
+  double oneMs = timeMs( [&]() { createRaysPerspOnHost( (float4*)&rays[0], width, height, eye, U, V, W, 1 ); } );
+  double allMs = timeMs( [&]() { createRaysPerspOnHost( (float4*)&rays[0], width, height, eye, U, V, W ); } );
+  printBenchLine( "createRaysPersp", count, scalarMs, oneMs, allMs, memcmp( &scalarRays[0], &rays[0], count*sizeof(Ray) ) == 0 );
+
+  // Each timed run moves the rays further, the same number of times on both sides
+  const float3 offset = make_float3( 1.0e-3f, 0.0f, 0.0f );
+  std::vector<Ray> startRays = rays;
+  scalarMs = timeMs( [&]() { translateRaysScalar( &scalarRays[0], count, offset ); } );
+  oneMs = timeMs( [&]() { translateRaysOnHost( (float4*)&rays[0], count, offset, 1 ); } );
+  rays = startRays;
+  allMs = timeMs( [&]() { translateRaysOnHost( (float4*)&rays[0], count, offset ); } );
+  printBenchLine( "translateRays", count, scalarMs, oneMs, allMs, memcmp( &scalarRays[0], &rays[0], count*sizeof(Ray) ) == 0 );
+
+  const Hit* hits = hitsBuffer.hostPtr();
+  const size_t hitCount = hitsBuffer.count();
+  float3 backgroundColor = { 0.2f, 0.2f, 0.2f };
+  std::vector<float3> scalarImage( hitCount ), image( hitCount );
+  scalarMs = timeMs( [&]() { shadeHitsScalar( &scalarImage[0], hits, hitCount, mesh ); } );
+  oneMs = timeMs( [&]() { shadeHitsOnHost( &image[0], (const float4*)hits, hitCount, mesh.getVertexIndices(), mesh.getVertexData(), backgroundColor, 1 ); } );
+  allMs = timeMs( [&]() { shadeHitsOnHost( &image[0], (const float4*)hits, hitCount, mesh.getVertexIndices(), mesh.getVertexData(), backgroundColor ); } );
+  printBenchLine( "shadeHits", hitCount, scalarMs, oneMs, allMs, memcmp( &scalarImage[0], &image[0], hitCount*sizeof(float3) ) == 0 );
+}
+
 //------------------------------------------------------------------------------
 int main( int argc, char** argv )
 {
@@ -62,6 +188,7 @@ int main( int argc, char** argv )
   std::string objFilename = std::string( sutil::samplesDir() ) + "/data/cow.obj";
   int width = 640;
   int height = 0;
+  bool benchHost = false;
 
   // parse arguments
   for ( int i = 1; i < argc; ++i ) 
@@ -99,6 +226,10 @@ int main( int argc, char** argv )
     {
       width = atoi(argv[++i]);
     } 
+    else if( arg == "--bench-host" )
+    {
+      benchHost = true;
+    }
     else 
     {
       std::cerr << "Bad option: '" << arg << "'" << std::endl;
@@ -202,6 +333,9 @@ int main( int argc, char** argv )
   shadeHits( image, hitsBuffer, mesh );
   writePpm( "output.ppm", &image[0].x, width, height );
 
+  if( benchHost )
+    benchHostKernels( mesh, hitsBuffer, width, height );
+
   //
   // re-execute query with different rays
   //
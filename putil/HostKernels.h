@@ -0,0 +1,245 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include <algorithm>
+#include <atomic>
+#include <emmintrin.h>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------------------------
+//
+// Host versions of the ray generation and shading kernels of the Prime samples,
+// for host buffers and the CPU context.
+//
+// Rows or ranges of rays are split into chunks over threads (0 threads uses all
+// hardware threads) and four rays or hits are processed at a time in SSE2 registers,
+// one register per component. The arithmetic is done in the same order as in the
+// scalar loops they replace, so the results are identical.
+//
+
+//------------------------------------------------------------------------------
+// Calls fn( begin, end ) on chunks of grain items until all count items are done
+template<typename F>
+inline void hostParallelFor( size_t count, size_t grain, unsigned int numThreads, F fn )
+{
+  const size_t chunkCount = (count + grain - 1) / grain;
+  std::atomic<size_t> next( 0 );
+  auto worker = [&]()
+  {
+    for( size_t chunk = next++; chunk < chunkCount; chunk = next++ )
+      fn( chunk*grain, std::min( count, (chunk+1)*grain ) );
+  };
+
+  const unsigned int hardwareThreads = std::max( 1u, std::thread::hardware_concurrency() );
+  const size_t threadCount = std::min<size_t>( numThreads > 0 ? numThreads : hardwareThreads, chunkCount );
+  std::vector<std::thread> threads;
+  for( size_t t = 1; t < threadCount; ++t )
+    threads.push_back( std::thread( worker ) );
+  worker();
+  for( size_t t = 0; t < threads.size(); ++t )
+    threads[t].join();
+}
+
+namespace hostKernelsDetail
+{
+  inline int floatAsInt( float val )
+  {
+    union {float f; int i;} var;
+    var.f = val;
+    return var.i;
+  }
+
+  // optix::normalize on 4 vectors
+  inline void normalize4( __m128& x, __m128& y, __m128& z )
+  {
+    const __m128 len2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) ), _mm_mul_ps( z, z ) );
+    const __m128 invLen = _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_sqrt_ps( len2 ) );
+    x = _mm_mul_ps( x, invLen );
+    y = _mm_mul_ps( y, invLen );
+    z = _mm_mul_ps( z, invLen );
+  }
+
+  inline float3 shadeNormal( const int3* indices, const float3* vertices, int triId )
+  {
+    int3 tri  = indices[triId];
+    float3 v0 = vertices[tri.x];
+    float3 v1 = vertices[tri.y];
+    float3 v2 = vertices[tri.z];
+    float3 e0 = v1-v0;
+    float3 e1 = v2-v0;
+    float3 n = optix::normalize( optix::cross( e0, e1 ) );
+    return 0.5f*n + optix::make_float3( 0.5f, 0.5f, 0.5f );
+  }
+}
+
+//------------------------------------------------------------------------------
+// Rays in the RTP_BUFFER_FORMAT_RAY_ORIGIN_TMIN_DIRECTION_TMAX layout, two float4
+// per ray, as createRaysPerspOnDevice
+inline void createRaysPerspOnHost( float4* rays, int width, int height, float3 eye, float3 U, float3 V, float3 W,
+                                   unsigned int numThreads=0 )
+{
+  const int rowsPerChunk = 8;
+  hostParallelFor( height, rowsPerChunk, numThreads, [=]( size_t begin, size_t end )
+  {
+    const __m128 origin = _mm_setr_ps( eye.x, eye.y, eye.z, 0.0f );
+    const __m128 widthf = _mm_set1_ps( float(width) );
+    const __m128 two = _mm_set1_ps( 2.0f );
+    const __m128 one = _mm_set1_ps( 1.0f );
+    for( int h = int(begin); h < int(end); h++ )
+    {
+      float v = float(h)/height * 2.0f - 1.0f;
+      const float3 vV = v*V;
+      float4* row = rays + size_t(h)*width*2;
+
+      int w = 0;
+      for( ; w + 4 <= width; w += 4 )
+      {
+        const __m128 u = _mm_sub_ps( _mm_mul_ps( _mm_div_ps( _mm_cvtepi32_ps( _mm_setr_epi32( w, w+1, w+2, w+3 ) ), widthf ), two ), one );
+        __m128 dx = _mm_add_ps( _mm_add_ps( _mm_mul_ps( u, _mm_set1_ps( U.x ) ), _mm_set1_ps( vV.x ) ), _mm_set1_ps( W.x ) );
+        __m128 dy = _mm_add_ps( _mm_add_ps( _mm_mul_ps( u, _mm_set1_ps( U.y ) ), _mm_set1_ps( vV.y ) ), _mm_set1_ps( W.y ) );
+        __m128 dz = _mm_add_ps( _mm_add_ps( _mm_mul_ps( u, _mm_set1_ps( U.z ) ), _mm_set1_ps( vV.z ) ), _mm_set1_ps( W.z ) );
+        hostKernelsDetail::normalize4( dx, dy, dz );
+
+        // Directions and tmax of the 4 rays, one register per ray
+        __m128 tmax = _mm_set1_ps( 1e34f );
+        _MM_TRANSPOSE4_PS( dx, dy, dz, tmax );
+        float* out = &row[2*w].x;
+        _mm_storeu_ps( out +  0, origin );
+        _mm_storeu_ps( out +  4, dx );
+        _mm_storeu_ps( out +  8, origin );
+        _mm_storeu_ps( out + 12, dy );
+        _mm_storeu_ps( out + 16, origin );
+        _mm_storeu_ps( out + 20, dz );
+        _mm_storeu_ps( out + 24, origin );
+        _mm_storeu_ps( out + 28, tmax );
+      }
+      for( ; w < width; w++ )
+      {
+        float u = float(w)/width * 2.0f - 1.0f;
+        float3 dir = optix::normalize( u*U + vV + W );
+        row[2*w]   = optix::make_float4( eye, 0.0f );
+        row[2*w+1] = optix::make_float4( dir, 1e34f );
+      }
+    }
+  } );
+}
+
+//------------------------------------------------------------------------------
+// Offsets the origins and leaves tmin alone, which may hold a ray mask
+inline void translateRaysOnHost( float4* rays, size_t count, float3 offset, unsigned int numThreads=0 )
+{
+  const size_t raysPerChunk = 16384;
+  hostParallelFor( count, raysPerChunk, numThreads, [=]( size_t begin, size_t end )
+  {
+    const __m128 add = _mm_setr_ps( offset.x, offset.y, offset.z, 0.0f );
+    const __m128 xyz = _mm_castsi128_ps( _mm_setr_epi32( -1, -1, -1, 0 ) );
+    for( size_t r = begin; r < end; r++ )
+    {
+      float* origin = &rays[2*r].x;
+      const __m128 o = _mm_loadu_ps( origin );
+      _mm_storeu_ps( origin, _mm_or_ps( _mm_and_ps( xyz, _mm_add_ps( o, add ) ), _mm_andnot_ps( xyz, o ) ) );
+    }
+  } );
+}
+
+//------------------------------------------------------------------------------
+// Normal visualization of hits in the RTP_BUFFER_FORMAT_HIT_T_TRIID_U_V layout,
+// background where t is negative
+inline void shadeHitsOnHost( float3* image, const float4* hits, size_t count, const int3* indices, const float3* vertices,
+                             float3 backgroundColor, unsigned int numThreads=0 )
+{
+  const size_t hitsPerChunk = 8192;
+  hostParallelFor( count, hitsPerChunk, numThreads, [=]( size_t begin, size_t end )
+  {
+    size_t i = begin;
+    for( ; i + 4 <= end; i += 4 )
+    {
+      __m128 t   = _mm_loadu_ps( &hits[i].x );
+      __m128 tri = _mm_loadu_ps( &hits[i+1].x );
+      __m128 u   = _mm_loadu_ps( &hits[i+2].x );
+      __m128 v   = _mm_loadu_ps( &hits[i+3].x );
+      _MM_TRANSPOSE4_PS( t, tri, u, v );
+      const __m128 miss = _mm_cmplt_ps( t, _mm_setzero_ps() );
+
+      // Gather the vertices, misses use triangle 0 and are replaced below
+      int triIds[4];
+      _mm_storeu_si128( reinterpret_cast<__m128i*>( triIds ), _mm_andnot_si128( _mm_castps_si128( miss ), _mm_castps_si128( tri ) ) );
+      float p[9][4];
+      for( int k = 0; k < 4; k++ )
+      {
+        const int3 idx = indices[triIds[k]];
+        const float3 v0 = vertices[idx.x];
+        const float3 v1 = vertices[idx.y];
+        const float3 v2 = vertices[idx.z];
+        p[0][k] = v0.x; p[1][k] = v0.y; p[2][k] = v0.z;
+        p[3][k] = v1.x; p[4][k] = v1.y; p[5][k] = v1.z;
+        p[6][k] = v2.x; p[7][k] = v2.y; p[8][k] = v2.z;
+      }
+      const __m128 v0x = _mm_loadu_ps( p[0] ), v0y = _mm_loadu_ps( p[1] ), v0z = _mm_loadu_ps( p[2] );
+      const __m128 e0x = _mm_sub_ps( _mm_loadu_ps( p[3] ), v0x );
+      const __m128 e0y = _mm_sub_ps( _mm_loadu_ps( p[4] ), v0y );
+      const __m128 e0z = _mm_sub_ps( _mm_loadu_ps( p[5] ), v0z );
+      const __m128 e1x = _mm_sub_ps( _mm_loadu_ps( p[6] ), v0x );
+      const __m128 e1y = _mm_sub_ps( _mm_loadu_ps( p[7] ), v0y );
+      const __m128 e1z = _mm_sub_ps( _mm_loadu_ps( p[8] ), v0z );
+      __m128 nx = _mm_sub_ps( _mm_mul_ps( e0y, e1z ), _mm_mul_ps( e0z, e1y ) );
+      __m128 ny = _mm_sub_ps( _mm_mul_ps( e0z, e1x ), _mm_mul_ps( e0x, e1z ) );
+      __m128 nz = _mm_sub_ps( _mm_mul_ps( e0x, e1y ), _mm_mul_ps( e0y, e1x ) );
+      hostKernelsDetail::normalize4( nx, ny, nz );
+
+      const __m128 half = _mm_set1_ps( 0.5f );
+      __m128 r = _mm_add_ps( _mm_mul_ps( half, nx ), half );
+      __m128 g = _mm_add_ps( _mm_mul_ps( half, ny ), half );
+      __m128 b = _mm_add_ps( _mm_mul_ps( half, nz ), half );
+      r = _mm_or_ps( _mm_and_ps( miss, _mm_set1_ps( backgroundColor.x ) ), _mm_andnot_ps( miss, r ) );
+      g = _mm_or_ps( _mm_and_ps( miss, _mm_set1_ps( backgroundColor.y ) ), _mm_andnot_ps( miss, g ) );
+      b = _mm_or_ps( _mm_and_ps( miss, _mm_set1_ps( backgroundColor.z ) ), _mm_andnot_ps( miss, b ) );
+
+      // One register per pixel. The 4th lane of each store lands on the next pixel,
+      // which is written afterwards, and the last pixel is written without it.
+      __m128 pad = _mm_setzero_ps();
+      _MM_TRANSPOSE4_PS( r, g, b, pad );
+      float* out = &image[i].x;
+      _mm_storeu_ps( out + 0, r );
+      _mm_storeu_ps( out + 3, g );
+      _mm_storeu_ps( out + 6, b );
+      float last[4];
+      _mm_storeu_ps( last, pad );
+      image[i+3] = optix::make_float3( last[0], last[1], last[2] );
+    }
+    for( ; i < end; i++ )
+    {
+      const int triId = hostKernelsDetail::floatAsInt( hits[i].y );
+      image[i] = hits[i].x < 0.0f ? backgroundColor : hostKernelsDetail::shadeNormal( indices, vertices, triId );
+    }
+  } );
+}
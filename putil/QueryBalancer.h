@@ -0,0 +1,260 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <optix_prime/optix_primepp.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------------------------
+//
+// Splits each batch of rays into chunks and traces them on several engines at
+// once, for example CUDA contexts on different GPUs and CPU contexts with
+// different thread counts. Every engine is driven by its own host thread.
+//
+// Each engine starts with a contiguous range of chunks in proportion to the
+// throughput it reached in previous batches and steals single chunks from the
+// end of the range of the engine with the most work left once its own range is
+// done. The throughput estimates are updated after every batch, so later
+// batches need fewer steals. Ray and hit buffers are on the host. Engines on a
+// GPU copy their chunks over the bus, so chunks should not be too small.
+//
+// RayT and HitT are the Ray and Hit structs of the samples, with their Prime
+// buffer formats in a static format member.
+//
+template<typename RayT, typename HitT>
+class QueryBalancer
+{
+public:
+  struct EngineStats
+  {
+    std::string name;
+    double      weight;        // share of the next batch planned for this engine
+    size_t      rays;          // traced in the last batch
+    size_t      chunks;
+    size_t      stolenChunks;  // of the above, taken from other engines
+    double      busySeconds;
+    double      idleSeconds;   // from running out of chunks to the end of the batch
+  };
+
+  // chunksPerEngine chunks per engine and batch, more chunks balance better
+  // and cost more query launches
+  explicit QueryBalancer( int chunksPerEngine = 16 )
+    : m_chunksPerEngine( std::max( 1, chunksPerEngine ) )
+    , m_lastWallSeconds( 0.0 )
+  {}
+
+  // The query must belong to a model with the geometry of the batches
+  void addEngine( const std::string& name, optix::prime::Query query )
+  {
+    Engine engine;
+    engine.query = query;
+    engine.stats = EngineStats();
+    engine.stats.name = name;
+    engine.stats.weight = 0.0;
+    m_engines.push_back( engine );
+
+    // New engines start with an equal share
+    for( size_t i=0; i < m_engines.size(); ++i )
+      m_engines[i].stats.weight = 1.0 / m_engines.size();
+  }
+
+  size_t getEngineCount() const { return m_engines.size(); }
+
+  // Traces count rays into count hits, returns when all hits are written.
+  // Exceptions of the queries are rethrown after all engines have stopped.
+  void execute( const RayT* rays, HitT* hits, size_t count )
+  {
+    if( m_engines.empty() || count == 0 )
+      return;
+
+    const size_t engineCount = m_engines.size();
+    const size_t chunkCount = std::min( count, engineCount * m_chunksPerEngine );
+    m_chunkSize = ( count + chunkCount - 1 ) / chunkCount;
+    m_rays = rays;
+    m_hits = hits;
+    m_count = count;
+    m_error = std::exception_ptr();
+
+    // Contiguous chunk ranges in proportion to the weights
+    double total = 0.0;
+    for( size_t i=0; i < engineCount; ++i )
+      total += m_engines[i].stats.weight;
+    const size_t usedChunks = ( count + m_chunkSize - 1 ) / m_chunkSize;
+    double cumulative = 0.0;
+    size_t begin = 0;
+    for( size_t i=0; i < engineCount; ++i )
+    {
+      cumulative += m_engines[i].stats.weight;
+      const size_t end = i+1 == engineCount ? usedChunks : std::min( usedChunks, size_t( usedChunks * cumulative / total + 0.5 ) );
+      Engine& e = m_engines[i];
+      e.chunks.clear();
+      for( size_t c=begin; c < end; ++c )
+        e.chunks.push_back( c );
+      begin = std::max( begin, end );
+
+      e.stats.rays = 0;
+      e.stats.chunks = 0;
+      e.stats.stolenChunks = 0;
+      e.stats.busySeconds = 0.0;
+      e.stats.idleSeconds = 0.0;
+    }
+
+    const Clock::time_point start = Clock::now();
+    std::vector<double> doneSeconds( engineCount, 0.0 );
+    std::vector<std::thread> threads;
+    for( size_t i=1; i < engineCount; ++i )
+      threads.push_back( std::thread( [this, i, start, &doneSeconds]() { run( i, start, doneSeconds[i] ); } ) );
+    run( 0, start, doneSeconds[0] );
+    for( size_t i=0; i < threads.size(); ++i )
+      threads[i].join();
+    m_lastWallSeconds = seconds( start, Clock::now() );
+
+    if( m_error )
+      std::rethrow_exception( m_error );
+
+    // Throughput feedback, smoothed over batches. Engines without work keep their weight.
+    const double smoothing = 0.5;
+    double throughputSum = 0.0;
+    double weightSum = 0.0;
+    for( size_t i=0; i < engineCount; ++i )
+    {
+      EngineStats& s = m_engines[i].stats;
+      s.idleSeconds = m_lastWallSeconds - doneSeconds[i];
+      if( s.rays > 0 && s.busySeconds > 0.0 )
+      {
+        throughputSum += s.rays / s.busySeconds;
+        weightSum += s.weight;
+      }
+    }
+    for( size_t i=0; i < engineCount && throughputSum > 0.0; ++i )
+    {
+      EngineStats& s = m_engines[i].stats;
+      if( s.rays > 0 && s.busySeconds > 0.0 )
+        s.weight = smoothing * s.weight + ( 1.0 - smoothing ) * weightSum * ( s.rays / s.busySeconds ) / throughputSum;
+    }
+  }
+
+  // Of the last execute
+  double getLastWallSeconds() const { return m_lastWallSeconds; }
+  EngineStats getEngineStats( size_t engine ) const { return m_engines[engine].stats; }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Engine
+  {
+    optix::prime::Query query;
+    std::deque<size_t>  chunks;  // guarded by m_mutex
+    EngineStats         stats;   // written by the thread of the engine during execute
+  };
+
+  static double seconds( Clock::time_point begin, Clock::time_point end )
+  {
+    return std::chrono::duration<double>( end - begin ).count();
+  }
+
+  // Next chunk of engine, its own first and then the last of the engine with
+  // the most chunks left. Returns false when no chunks are left.
+  bool nextChunk( size_t engine, size_t& chunk, bool& stolen )
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    if( m_error )
+      return false;
+    std::deque<size_t>& own = m_engines[engine].chunks;
+    if( !own.empty() )
+    {
+      chunk = own.front();
+      own.pop_front();
+      stolen = false;
+      return true;
+    }
+
+    size_t victim = engine;
+    for( size_t i=0; i < m_engines.size(); ++i )
+    {
+      if( m_engines[i].chunks.size() > m_engines[victim].chunks.size() )
+        victim = i;
+    }
+    if( m_engines[victim].chunks.empty() )
+      return false;
+    chunk = m_engines[victim].chunks.back();
+    m_engines[victim].chunks.pop_back();
+    stolen = true;
+    return true;
+  }
+
+  void run( size_t engine, Clock::time_point start, double& doneSeconds )
+  {
+    Engine& e = m_engines[engine];
+    try
+    {
+      size_t chunk;
+      bool stolen;
+      while( nextChunk( engine, chunk, stolen ) )
+      {
+        const size_t first = chunk * m_chunkSize;
+        const size_t count = std::min( m_chunkSize, m_count - first );
+        const Clock::time_point begin = Clock::now();
+        e.query->setRays( count, RayT::format, RTP_BUFFER_TYPE_HOST, const_cast<RayT*>( m_rays + first ) );
+        e.query->setHits( count, HitT::format, RTP_BUFFER_TYPE_HOST, m_hits + first );
+        e.query->execute( 0 );
+        e.stats.busySeconds += seconds( begin, Clock::now() );
+        e.stats.rays += count;
+        e.stats.chunks++;
+        e.stats.stolenChunks += stolen ? 1 : 0;
+      }
+    }
+    catch( ... )
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      if( !m_error )
+        m_error = std::current_exception();
+    }
+    doneSeconds = seconds( start, Clock::now() );
+  }
+
+  size_t              m_chunksPerEngine;
+  std::vector<Engine> m_engines;
+  double              m_lastWallSeconds;
+
+  // State of the current execute
+  std::mutex         m_mutex;
+  std::exception_ptr m_error;
+  const RayT*        m_rays;
+  HitT*              m_hits;
+  size_t             m_count;
+  size_t             m_chunkSize;
+};
@@ -0,0 +1,347 @@
+/* 
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <putil/Buffer.h>
+#include <optix_prime/optix_primepp.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+//
+// Streams batches of rays through a Prime query in three overlapped stages:
+// a producer thread fills ray buffers, the calling thread traces them and a
+// consumer thread processes the hits. The stages pass a ring of ray and hit
+// Buffer pairs around, one query per pair. When all pairs are filled or waiting
+// to be consumed the producer blocks, so a slow consumer throttles the producer
+// instead of growing memory. Batches are traced and consumed in the order they
+// were produced.
+//
+// RayT and HitT are the Ray and Hit structs of the samples, with their Prime
+// buffer formats in a static format member. Works with CPU and CUDA contexts.
+//
+template<typename RayT, typename HitT>
+class QueryPipeline
+{
+public:
+  // Writes up to maxCount rays of batch number index and returns how many, 0 ends the stream
+  typedef std::function<size_t( size_t index, RayT* rays, size_t maxCount )> Producer;
+
+  // Processes the results of batch number index. The buffers are reused after it returns.
+  typedef std::function<void( size_t index, const RayT* rays, const HitT* hits, size_t count )> Consumer;
+
+  struct StageStats
+  {
+    double busySeconds;    // time spent in the callback or the query
+    double hiddenSeconds;  // part of the busy time during which another stage was busy
+    double waitSeconds;    // time spent blocked on the neighbouring stages
+  };
+
+  struct Stats
+  {
+    size_t     batches;
+    size_t     rays;
+    double     wallSeconds;
+    StageStats produce;
+    StageStats trace;
+    StageStats consume;
+
+    // Fraction of the serial time, the sum of the busy times, saved by the overlap
+    double overlapFraction() const
+    {
+      const double serial = produce.busySeconds + trace.busySeconds + consume.busySeconds;
+      return serial > 0.0 ? std::max( 0.0, 1.0 - wallSeconds / serial ) : 0.0;
+    }
+  };
+
+  // numStages ray and hit buffer pairs of batchSize elements each. Two pairs
+  // overlap two stages at a time, three or more let all stages run at once.
+  QueryPipeline( optix::prime::Model model, RTPquerytype queryType, int numStages, size_t batchSize )
+    : m_batchSize( batchSize )
+  {
+    const int count = std::max( 1, numStages );
+    for( int i=0; i < count; ++i )
+    {
+      m_slots.push_back( std::unique_ptr<Slot>( new Slot( batchSize ) ) );
+      m_slots.back()->query = model->createQuery( queryType );
+    }
+  }
+
+  int getNumStages() const { return (int)m_slots.size(); }
+  size_t getBatchSize() const { return m_batchSize; }
+
+  // Runs until the producer returns 0 and all batches are consumed. Exceptions
+  // thrown by the callbacks or the queries stop the pipeline and are rethrown here.
+  Stats run( Producer produce, Consumer consume )
+  {
+    m_free.clear();
+    m_filled.clear();
+    m_traced.clear();
+    for( size_t i=0; i < m_slots.size(); ++i )
+      m_free.push_back( i );
+    m_produceDone = false;
+    m_traceDone = false;
+    m_error = std::exception_ptr();
+
+    Timeline timeline;
+    Stats stats = Stats();
+    m_start = Clock::now();
+
+    std::thread producer( [&]() { produceLoop( produce, stats, timeline.produce ); } );
+    std::thread consumer( [&]() { consumeLoop( consume, stats, timeline.consume ); } );
+    traceLoop( stats, timeline.trace );
+    producer.join();
+    consumer.join();
+
+    stats.wallSeconds = seconds( m_start, Clock::now() );
+    stats.produce.busySeconds = busy( timeline.produce );
+    stats.trace.busySeconds = busy( timeline.trace );
+    stats.consume.busySeconds = busy( timeline.consume );
+    stats.produce.hiddenSeconds = overlap( timeline.produce, timeline.trace, timeline.consume );
+    stats.trace.hiddenSeconds = overlap( timeline.trace, timeline.produce, timeline.consume );
+    stats.consume.hiddenSeconds = overlap( timeline.consume, timeline.produce, timeline.trace );
+
+    if( m_error )
+      std::rethrow_exception( m_error );
+    return stats;
+  }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+  typedef std::pair<double, double> Interval;  // seconds since the start of run()
+
+  struct Slot
+  {
+    explicit Slot( size_t batchSize )
+      : rays( batchSize, RTP_BUFFER_TYPE_HOST, LOCKED )
+      , hits( batchSize, RTP_BUFFER_TYPE_HOST, LOCKED )
+      , count( 0 )
+      , index( 0 )
+    {}
+
+    Buffer<RayT> rays;
+    Buffer<HitT> hits;
+    optix::prime::Query query;
+    size_t count;
+    size_t index;
+  };
+
+  struct Timeline
+  {
+    std::vector<Interval> produce;
+    std::vector<Interval> trace;
+    std::vector<Interval> consume;
+  };
+
+  static double seconds( Clock::time_point begin, Clock::time_point end )
+  {
+    return std::chrono::duration<double>( end - begin ).count();
+  }
+
+  // Interval from begin to now
+  Interval since( Clock::time_point begin ) const
+  {
+    return Interval( seconds( m_start, begin ), seconds( m_start, Clock::now() ) );
+  }
+
+  static double busy( const std::vector<Interval>& intervals )
+  {
+    double total = 0.0;
+    for( size_t i=0; i < intervals.size(); ++i )
+      total += intervals[i].second - intervals[i].first;
+    return total;
+  }
+
+  // Takes the first slot of queue, or returns false when done is set and queue is empty
+  bool pop( std::deque<size_t>& queue, const bool& done, size_t& slot, double& waitSeconds )
+  {
+    const Clock::time_point begin = Clock::now();
+    std::unique_lock<std::mutex> lock( m_mutex );
+    m_cond.wait( lock, [&]() { return !queue.empty() || done || m_error; } );
+    waitSeconds += seconds( begin, Clock::now() );
+    if( queue.empty() || m_error )
+      return false;
+    slot = queue.front();
+    queue.pop_front();
+    return true;
+  }
+
+  void push( std::deque<size_t>& queue, size_t slot )
+  {
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      queue.push_back( slot );
+    }
+    m_cond.notify_all();
+  }
+
+  void finish( bool& done )
+  {
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      done = true;
+    }
+    m_cond.notify_all();
+  }
+
+  void fail()
+  {
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      if( !m_error )
+        m_error = std::current_exception();
+      m_produceDone = true;
+      m_traceDone = true;
+    }
+    m_cond.notify_all();
+  }
+
+  void produceLoop( Producer& produce, Stats& stats, std::vector<Interval>& timeline )
+  {
+    const bool never = false;
+    try
+    {
+      size_t slot;
+      for( size_t index = 0; pop( m_free, never, slot, stats.produce.waitSeconds ); ++index )
+      {
+        Slot& s = *m_slots[slot];
+        const Clock::time_point begin = Clock::now();
+        s.count = std::min( produce( index, s.rays.ptr(), m_batchSize ), m_batchSize );
+        s.index = index;
+        timeline.push_back( since( begin ) );
+        if( s.count == 0 )
+          break;
+        push( m_filled, slot );
+      }
+    }
+    catch( ... )
+    {
+      fail();
+    }
+    finish( m_produceDone );
+  }
+
+  void traceLoop( Stats& stats, std::vector<Interval>& timeline )
+  {
+    try
+    {
+      size_t slot;
+      while( pop( m_filled, m_produceDone, slot, stats.trace.waitSeconds ) )
+      {
+        Slot& s = *m_slots[slot];
+        const Clock::time_point begin = Clock::now();
+        s.query->setRays( s.count, RayT::format, RTP_BUFFER_TYPE_HOST, s.rays.ptr() );
+        s.query->setHits( s.count, HitT::format, RTP_BUFFER_TYPE_HOST, s.hits.ptr() );
+        s.query->execute( 0 );
+        timeline.push_back( since( begin ) );
+        stats.batches++;
+        stats.rays += s.count;
+        push( m_traced, slot );
+      }
+    }
+    catch( ... )
+    {
+      fail();
+    }
+    finish( m_traceDone );
+  }
+
+  void consumeLoop( Consumer& consume, Stats& stats, std::vector<Interval>& timeline )
+  {
+    try
+    {
+      size_t slot;
+      while( pop( m_traced, m_traceDone, slot, stats.consume.waitSeconds ) )
+      {
+        Slot& s = *m_slots[slot];
+        const Clock::time_point begin = Clock::now();
+        consume( s.index, s.rays.ptr(), s.hits.ptr(), s.count );
+        timeline.push_back( since( begin ) );
+        push( m_free, slot );
+      }
+    }
+    catch( ... )
+    {
+      fail();
+    }
+  }
+
+  // Length of the intervals of stage covered by any interval of a or b. The
+  // intervals of each stage are sorted and disjoint, as each stage is one thread.
+  static double overlap( const std::vector<Interval>& stage, const std::vector<Interval>& a, const std::vector<Interval>& b )
+  {
+    std::vector<Interval> others( a );
+    others.insert( others.end(), b.begin(), b.end() );
+    std::sort( others.begin(), others.end() );
+
+    // Merge into disjoint intervals
+    std::vector<Interval> merged;
+    for( size_t i=0; i < others.size(); ++i )
+    {
+      if( !merged.empty() && others[i].first <= merged.back().second )
+        merged.back().second = std::max( merged.back().second, others[i].second );
+      else
+        merged.push_back( others[i] );
+    }
+
+    double covered = 0.0;
+    size_t j = 0;
+    for( size_t i=0; i < stage.size(); ++i )
+    {
+      while( j < merged.size() && merged[j].second <= stage[i].first )
+        ++j;
+      for( size_t k = j; k < merged.size() && merged[k].first < stage[i].second; ++k )
+        covered += std::min( stage[i].second, merged[k].second ) - std::max( stage[i].first, merged[k].first );
+    }
+    return covered;
+  }
+
+  size_t m_batchSize;
+  std::vector< std::unique_ptr<Slot> > m_slots;
+  Clock::time_point m_start;
+
+  // Slots in each state, guarded by m_mutex
+  std::mutex              m_mutex;
+  std::condition_variable m_cond;
+  std::deque<size_t>      m_free;
+  std::deque<size_t>      m_filled;
+  std::deque<size_t>      m_traced;
+  bool                    m_produceDone;
+  bool                    m_traceDone;
+  std::exception_ptr      m_error;
+};
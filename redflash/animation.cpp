@@ -0,0 +1,214 @@
+#include "animation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+using namespace optix;
+
+namespace
+{
+    template<typename Key>
+    bool earlier(const Key& a, const Key& b)
+    {
+        return a.time < b.time;
+    }
+
+    // Index i of the keys [i, i + 1] around time and the position in between,
+    // keys are sorted and not empty
+    template<typename Key>
+    size_t findSegment(const std::vector<Key>& keys, float time, float& s)
+    {
+        s = 0.0f;
+        if (keys.size() == 1 || time <= keys.front().time)
+            return 0;
+        if (time >= keys.back().time)
+        {
+            s = 1.0f;
+            return keys.size() - 2;
+        }
+
+        size_t i = 0;
+        while (keys[i + 1].time <= time)
+            ++i;
+        const float span = keys[i + 1].time - keys[i].time;
+        s = span > 0.0f ? (time - keys[i].time) / span : 1.0f;
+        return i;
+    }
+
+    float4 axisAngle(const float3& axis, float degrees)
+    {
+        const float half = 0.5f * degrees * M_PIf / 180.0f;
+        const float3 n = length(axis) > 0.0f ? normalize(axis) : make_float3(0.0f, 1.0f, 0.0f);
+        return make_float4(n * sinf(half), cosf(half));
+    }
+
+    float4 slerp(const float4& a, float4 b, float s)
+    {
+        // The shorter arc
+        float cosTheta = dot(a, b);
+        if (cosTheta < 0.0f)
+        {
+            b = -b;
+            cosTheta = -cosTheta;
+        }
+
+        if (cosTheta > 0.9995f)
+            return normalize(lerp(a, b, s));
+
+        const float theta = acosf(cosTheta);
+        const float sinTheta = sinf(theta);
+        return (sinf((1.0f - s) * theta) * a + sinf(s * theta) * b) / sinTheta;
+    }
+
+    // Hermite tangent of a key from its neighbours, divided by time
+    float3 tangent(const std::vector<CameraKey>& keys, size_t i, float3 CameraKey::*value)
+    {
+        const size_t prev = i > 0 ? i - 1 : i;
+        const size_t next = i + 1 < keys.size() ? i + 1 : i;
+        const float dt = keys[next].time - keys[prev].time;
+        return dt > 0.0f ? (keys[next].*value - keys[prev].*value) / dt : make_float3(0.0f);
+    }
+
+    float3 catmullRom(const std::vector<CameraKey>& keys, size_t i, float s, float3 CameraKey::*value)
+    {
+        if (keys.size() == 1)
+            return keys[0].*value;
+
+        const float dt = keys[i + 1].time - keys[i].time;
+        const float s2 = s * s;
+        const float s3 = s2 * s;
+        return (2.0f * s3 - 3.0f * s2 + 1.0f) * (keys[i].*value)
+            + (s3 - 2.0f * s2 + s) * dt * tangent(keys, i, value)
+            + (-2.0f * s3 + 3.0f * s2) * (keys[i + 1].*value)
+            + (s3 - s2) * dt * tangent(keys, i + 1, value);
+    }
+}
+
+bool AnimationTrack::load(const std::string& filename, std::string& error)
+{
+    m_camera.clear();
+    m_transforms.clear();
+
+    std::ifstream ifs(filename.c_str());
+    if (!ifs)
+    {
+        error = "Failed to open animation " + filename;
+        return false;
+    }
+
+    std::string line;
+    for (int line_number = 1; std::getline(ifs, line); ++line_number)
+    {
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+
+        std::istringstream iss(line);
+        std::string kind;
+        if (!(iss >> kind))
+            continue;
+
+        bool ok = false;
+        if (kind == "camera")
+        {
+            CameraKey key;
+            ok = static_cast<bool>(iss >> key.time
+                >> key.eye.x >> key.eye.y >> key.eye.z
+                >> key.lookat.x >> key.lookat.y >> key.lookat.z);
+            if (ok)
+                m_camera.push_back(key);
+        }
+        else if (kind == "transform")
+        {
+            std::string object;
+            TransformKey key;
+            float3 axis;
+            float degrees;
+            ok = static_cast<bool>(iss >> object >> key.time
+                >> key.translation.x >> key.translation.y >> key.translation.z
+                >> axis.x >> axis.y >> axis.z >> degrees >> key.scale);
+            if (ok)
+            {
+                key.rotation = axisAngle(axis, degrees);
+
+                auto track = std::find_if(m_transforms.begin(), m_transforms.end(),
+                    [&](const TransformTrack& t) { return t.object == object; });
+                if (track == m_transforms.end())
+                {
+                    m_transforms.push_back(TransformTrack());
+                    m_transforms.back().object = object;
+                    track = m_transforms.end() - 1;
+                }
+                track->keys.push_back(key);
+            }
+        }
+
+        std::string rest;
+        if (!ok || iss >> rest)
+        {
+            std::ostringstream message;
+            message << filename << ":" << line_number << ": malformed key '" << line << "'";
+            error = message.str();
+            return false;
+        }
+    }
+
+    std::stable_sort(m_camera.begin(), m_camera.end(), earlier<CameraKey>);
+    for (auto track = m_transforms.begin(); track != m_transforms.end(); ++track)
+        std::stable_sort(track->keys.begin(), track->keys.end(), earlier<TransformKey>);
+    return true;
+}
+
+float AnimationTrack::duration() const
+{
+    float end = m_camera.empty() ? 0.0f : m_camera.back().time;
+    for (auto track = m_transforms.begin(); track != m_transforms.end(); ++track)
+        end = std::max(end, track->keys.back().time);
+    return std::max(end, 0.0f);
+}
+
+int AnimationTrack::frameCount(float fps) const
+{
+    // The tolerance keeps a last key on a frame boundary despite rounding
+    return static_cast<int>(floorf(duration() * fps + 1.0e-3f)) + 1;
+}
+
+void AnimationTrack::evaluateCamera(float time, float3& eye, float3& lookat) const
+{
+    float s;
+    const size_t i = findSegment(m_camera, time, s);
+    eye = catmullRom(m_camera, i, s, &CameraKey::eye);
+    lookat = catmullRom(m_camera, i, s, &CameraKey::lookat);
+}
+
+void AnimationTrack::evaluateTransform(const TransformTrack& track, float time, float matrix[16])
+{
+    float s;
+    const size_t i = findSegment(track.keys, time, s);
+    const TransformKey& a = track.keys[i];
+    const TransformKey& b = track.keys[std::min(i + 1, track.keys.size() - 1)];
+
+    const float3 t = lerp(a.translation, b.translation, s);
+    const float4 q = slerp(a.rotation, b.rotation, s);
+    const float scale = a.scale + (b.scale - a.scale) * s;
+
+    const float x = q.x, y = q.y, z = q.z, w = q.w;
+    const float rotation[3][3] = {
+        { 1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y - z * w), 2.0f * (x * z + y * w) },
+        { 2.0f * (x * y + z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z - x * w) },
+        { 2.0f * (x * z - y * w), 2.0f * (y * z + x * w), 1.0f - 2.0f * (x * x + y * y) }
+    };
+    const float translation[3] = { t.x, t.y, t.z };
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 3; ++c)
+            matrix[r * 4 + c] = rotation[r][c] * scale;
+        matrix[r * 4 + 3] = translation[r];
+    }
+    matrix[12] = 0.0f;
+    matrix[13] = 0.0f;
+    matrix[14] = 0.0f;
+    matrix[15] = 1.0f;
+}
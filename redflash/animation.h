@@ -0,0 +1,74 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// Animation tracks
+//
+// Keyframes of the camera and of the transforms of scene objects for
+// redflash --animation, read from a text file with one key per line ('#'
+// starts a comment):
+//
+//   camera <time> <eye x y z> <lookat x y z>
+//   transform <object> <time> <translate x y z> <axis x y z> <degrees> <scale>
+//
+// Times are in seconds, keys may come in any order. The camera follows a
+// Catmull-Rom spline through its keys, transforms interpolate translation and
+// scale linearly and the rotation with a slerp. Values are held before the
+// first and after the last key of a track. The objects are the geometry
+// groups of the scene, see setupScene in redflash.cpp.
+//
+//-----------------------------------------------------------------------------
+
+struct CameraKey
+{
+    float time;
+    float3 eye;
+    float3 lookat;
+};
+
+struct TransformKey
+{
+    float time;
+    float3 translation;
+
+    // Unit quaternion (x, y, z, w)
+    float4 rotation;
+    float scale;
+};
+
+struct TransformTrack
+{
+    std::string object;
+    std::vector<TransformKey> keys;
+};
+
+class AnimationTrack
+{
+public:
+    // Returns false with a message in error if the file can not be read or
+    // has a malformed line
+    bool load(const std::string& filename, std::string& error);
+
+    // Time of the last key of all tracks
+    float duration() const;
+
+    // Frames from time 0 to duration() included
+    int frameCount(float fps) const;
+
+    bool hasCamera() const { return !m_camera.empty(); }
+    void evaluateCamera(float time, float3& eye, float3& lookat) const;
+
+    const std::vector<TransformTrack>& transforms() const { return m_transforms; }
+
+    // Row-major object to world matrix, translate * rotate * scale
+    static void evaluateTransform(const TransformTrack& track, float time, float matrix[16]);
+
+private:
+    std::vector<CameraKey> m_camera;
+    std::vector<TransformTrack> m_transforms;
+};
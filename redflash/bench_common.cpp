@@ -0,0 +1,74 @@
+#include "bench_common.h"
+#include "motion.h"
+
+#include <cmath>
+#include <random>
+
+using namespace optix;
+
+double secondsSince(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+std::vector<SphereRecord> sphereField(int count)
+{
+    const float3 extent = make_float3(200.0f, 50.0f, 200.0f);
+    const float radius = 0.4f * powf(8.0f * extent.x * extent.y * extent.z / count, 1.0f / 3.0f);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+    std::vector<SphereRecord> spheres(count);
+    for (int i = 0; i < count; ++i)
+    {
+        spheres[i].center = make_float3(uniform(rng) * extent.x, (uniform(rng) + 1.0f) * extent.y + radius, uniform(rng) * extent.z);
+        spheres[i].radius = radius;
+        spheres[i].material_id = 0;
+        spheres[i].light_id = -1;
+        spheres[i].material_index = 0;
+    }
+    return spheres;
+}
+
+std::vector<TestRay> testRays(int count, bool random_times)
+{
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+    std::vector<TestRay> rays(count);
+    for (int i = 0; i < count; ++i)
+    {
+        float3 origin;
+        do
+        {
+            origin = make_float3(uniform(rng), uniform(rng), uniform(rng));
+        } while (dot(origin, origin) > 1.0f || dot(origin, origin) < 1.0e-4f);
+        rays[i].origin = normalize(origin) * 400.0f + make_float3(0.0f, 50.0f, 0.0f);
+
+        const float3 target = make_float3(uniform(rng) * 200.0f, (uniform(rng) + 1.0f) * 50.0f, uniform(rng) * 200.0f);
+        rays[i].direction = normalize(target - rays[i].origin);
+        rays[i].time = random_times ? 0.5f * uniform(rng) + 0.5f : 0.0f;
+    }
+    return rays;
+}
+
+bool bruteForce(const std::vector<SphereRecord>& spheres, const TestRay& ray, float tmin, float tmax, float& t_hit,
+    const std::vector<float3>& motion_centers, unsigned int motion_steps)
+{
+    bool found = false;
+    for (size_t i = 0; i < spheres.size(); ++i)
+    {
+        SphereRecord sphere = spheres[i];
+        if (motion_steps > 1)
+            sphere.center = motionLerp(&motion_centers[i * motion_steps], motion_steps, ray.time);
+
+        float t;
+        if (intersectSphere(sphere, ray.origin, ray.direction, tmin, tmax, t))
+        {
+            found = true;
+            tmax = t;
+        }
+    }
+    t_hit = tmax;
+    return found;
+}
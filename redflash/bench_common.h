@@ -0,0 +1,36 @@
+#pragma once
+
+#include "sphere.h"
+
+#include <chrono>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// Timer and test scene helpers shared by the CPU benchmarks of redflash_bench.
+//
+//-----------------------------------------------------------------------------
+
+// Wall clock seconds since begin
+double secondsSince(std::chrono::steady_clock::time_point begin);
+
+struct TestRay
+{
+    float3 origin;
+    float3 direction;
+
+    // Ray time in the motion range, see motion.h
+    float time;
+};
+
+// count spheres in the layout of the sphere_field scene of redflash, without the ground
+std::vector<SphereRecord> sphereField(int count);
+
+// From random points around sphereField towards random points inside it. With
+// random_times the rays have uniform times in [0, 1], otherwise 0.
+std::vector<TestRay> testRays(int count, bool random_times = false);
+
+// Nearest hit in (tmin, tmax) of a loop over all spheres. Moving spheres have
+// motion_steps centers each in motion_centers and are moved to the ray time.
+bool bruteForce(const std::vector<SphereRecord>& spheres, const TestRay& ray, float tmin, float tmax, float& t_hit,
+    const std::vector<float3>& motion_centers = std::vector<float3>(), unsigned int motion_steps = 1);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include "redflash.h"
+#include "random.h"
+
+//-----------------------------------------------------------------------------
+//
+// Compile-time specialized BSDFs
+//
+// BSDF<Type> is specialized for every BSDFType and has two fused entry points:
+//
+//   sample   draws a direction for wo and returns its value and pdf with it
+//   evalPdf  value and pdf for a given direction, used by light sampling
+//
+// The value includes the cosine term. Both entry points compute the half
+// vector, Fresnel and microfacet terms once for the value and the pdf. The
+// closest hit programs are instantiated per BSDF type (closestHit<Type> in
+// redflash.cu), so there is no callable program dispatch. Everything is
+// __host__ __device__ and is also compiled into redflash_bench for the CPU
+// checks in bsdf_bench.cpp.
+//
+//-----------------------------------------------------------------------------
+
+struct BSDFSample
+{
+    float3 direction;
+    float3 f;
+    float pdf;
+};
+
+template<BSDFType Type>
+struct BSDF;
+
+#include "bsdf_diffuse.h"
+#include "bsdf_disney.h"
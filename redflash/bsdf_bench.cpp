@@ -0,0 +1,348 @@
+#include "bsdf_bench.h"
+#include "bench_common.h"
+#include "bsdf.h"
+#include "lobe_table.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace optix;
+
+namespace
+{
+    // Largest relative difference allowed between the value and pdf returned by
+    // sample and by evalPdf for the same direction
+    const float consistency_tolerance = 1.0e-4f;
+
+    // Keeps the timed loops from being optimized away
+    volatile float timing_sink;
+
+    struct BSDFCase
+    {
+        std::string name;
+        MaterialParameter mat;
+    };
+
+    std::vector<BSDFCase> materialGrid()
+    {
+        std::vector<BSDFCase> cases;
+
+        BSDFCase diffuse;
+        diffuse.name = "diffuse";
+        diffuse.mat.albedo = make_float3(0.8f);
+        diffuse.mat.bsdf = DIFFUSE;
+        cases.push_back(diffuse);
+
+        const float roughness[] = { 0.05f, 0.3f, 0.8f };
+        const float metallic[] = { 0.0f, 1.0f };
+        const float clearcoat[] = { 0.0f, 1.0f };
+        for (int r = 0; r < 3; ++r)
+        {
+            for (int m = 0; m < 2; ++m)
+            {
+                for (int c = 0; c < 2; ++c)
+                {
+                    BSDFCase disney;
+                    std::ostringstream name;
+                    name << "disney_r" << roughness[r] << "_m" << metallic[m] << "_c" << clearcoat[c];
+                    disney.name = name.str();
+                    disney.mat.albedo = make_float3(0.9f, 0.6f, 0.3f);
+                    disney.mat.roughness = roughness[r];
+                    disney.mat.metallic = metallic[m];
+                    disney.mat.clearcoat = clearcoat[c];
+                    disney.mat.bsdf = DISNEY;
+                    cases.push_back(disney);
+                }
+            }
+        }
+
+        // Glossy dielectric with a dark base, where the diffuse lobe is nearly black
+        BSDFCase glossy;
+        glossy.name = "disney_dark_glossy";
+        glossy.mat.albedo = make_float3(0.02f);
+        glossy.mat.roughness = 0.1f;
+        glossy.mat.bsdf = DISNEY;
+        cases.push_back(glossy);
+
+        return cases;
+    }
+
+    float relativeError(float a, float b)
+    {
+        return fabsf(a - b) / std::max(std::max(fabsf(a), fabsf(b)), 1.0e-6f);
+    }
+
+    double nanosecondsSince(std::chrono::steady_clock::time_point begin, int count)
+    {
+        return secondsSince(begin) * 1.0e9 / count;
+    }
+
+    template<BSDFType Type>
+    bool runCase(const BSDFCase& c, float theta, int sample_count)
+    {
+        State state;
+        state.hitpoint = make_float3(0.0f);
+        state.normal = make_float3(0.0f, 0.0f, 1.0f);
+        state.ffnormal = state.normal;
+        const float3 wo = make_float3(sinf(theta), 0.0f, cosf(theta));
+
+        // Consistency of the fused entry points and directional albedo (white furnace)
+        unsigned int seed = tea<16>(static_cast<unsigned int>(theta * 1000.0f), 1);
+        double albedo = 0.0;
+        float max_error = 0.0f;
+        bool finite = true;
+        std::vector<float3> directions(sample_count);
+        for (int i = 0; i < sample_count; ++i)
+        {
+            BSDFSample s;
+            BSDF<Type>::sample(c.mat, state, wo, seed, s);
+            directions[i] = s.direction;
+
+            if (!(s.pdf > 0.0f))
+                continue;
+
+            float3 f;
+            float pdf;
+            BSDF<Type>::evalPdf(c.mat, state, wo, s.direction, f, pdf);
+            max_error = std::max(max_error, relativeError(s.pdf, pdf));
+            max_error = std::max(max_error, relativeError(s.f.x, f.x));
+            max_error = std::max(max_error, relativeError(s.f.y, f.y));
+            max_error = std::max(max_error, relativeError(s.f.z, f.z));
+
+            const float3 weight = s.f / s.pdf;
+            finite &= std::isfinite(weight.x) && std::isfinite(weight.y) && std::isfinite(weight.z);
+            albedo += (weight.x + weight.y + weight.z) / 3.0;
+        }
+        albedo /= sample_count;
+
+        // Timings
+        float sum = 0.0f;
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < sample_count; ++i)
+        {
+            BSDFSample s;
+            BSDF<Type>::sample(c.mat, state, wo, seed, s);
+            sum += s.pdf;
+        }
+        const double sample_ns = nanosecondsSince(begin, sample_count);
+
+        begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < sample_count; ++i)
+        {
+            float3 f;
+            float pdf;
+            BSDF<Type>::evalPdf(c.mat, state, wo, directions[i], f, pdf);
+            sum += pdf + f.x;
+        }
+        const double eval_pdf_ns = nanosecondsSince(begin, sample_count);
+        timing_sink = sum;
+
+        const bool ok = max_error <= consistency_tolerance && finite;
+        std::ostringstream line;
+        line << "[bsdf] material: " << c.name
+            << "\two_theta: " << std::fixed << std::setprecision(0) << theta * 180.0f / M_PIf
+            << std::setprecision(4)
+            << "\talbedo: " << albedo
+            << "\tmax_rel_error: " << std::scientific << max_error << std::fixed
+            << "\tsample_ns: " << sample_ns
+            << "\teval_pdf_ns: " << eval_pdf_ns
+            << (ok ? "" : "\tFAILED");
+        std::cout << line.str() << std::endl;
+        return ok;
+    }
+
+    struct Estimate
+    {
+        double sum;
+        double sum_sq;
+        int count;
+
+        Estimate() : sum(0.0), sum_sq(0.0), count(0) {}
+
+        void add(double x) { sum += x; sum_sq += x * x; ++count; }
+        double mean() const { return sum / count; }
+        double variance() const { return std::max(sum_sq / count - mean() * mean(), 0.0); }
+    };
+
+    // Lobe selection table against the analytic model:
+    //
+    //   - the value with the table is the analytic one, and sample and evalPdf
+    //     of the table agree on the pdf of the lobe proportional selection
+    //   - the lobe_table lobe albedos sum to an independent estimate of the
+    //     directional albedo, and both selections estimate the same albedo,
+    //     within the noise of the estimates
+    //
+    // Also reports the variance of f / pdf per sample of both lobe selections,
+    // and the cost of evalPdf with the table lookup.
+    bool runTableCase(const BSDFCase& c, unsigned int material_id, int sample_count, double& analytic_variance, double& lobe_table_variance)
+    {
+        State state;
+        state.hitpoint = make_float3(0.0f);
+        state.normal = make_float3(0.0f, 0.0f, 1.0f);
+        state.ffnormal = state.normal;
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        const DisneyLobeTable table = bakeDisneyLobeTable(c.mat, material_id);
+        const double bake_ms = nanosecondsSince(begin, 1) * 1.0e-6;
+
+        float max_error = 0.0f;
+        float max_energy_error = 0.0f;
+        bool energy_ok = true;
+        double analytic_ns = 0.0;
+        double lobe_table_ns = 0.0;
+        analytic_variance = 0.0;
+        lobe_table_variance = 0.0;
+        const int bins[] = { 1, DISNEY_LOBE_TABLE_SIZE / 2, DISNEY_LOBE_TABLE_SIZE - 1 };
+        const int bin_count = sizeof(bins) / sizeof(bins[0]);
+        for (int b = 0; b < bin_count; ++b)
+        {
+            const int i = bins[b];
+            const float NDotV = static_cast<float>(i) / (DISNEY_LOBE_TABLE_SIZE - 1);
+            const float3 wo = make_float3(sqrtf(1.0f - NDotV * NDotV), 0.0f, NDotV);
+
+            unsigned int seed = tea<16>(material_id + 1000, i);
+            Estimate analytic;
+            Estimate lobe_table;
+            std::vector<float3> directions(sample_count);
+            for (int n = 0; n < sample_count; ++n)
+            {
+                float3 f;
+                float pdf;
+
+                BSDFSample s;
+                BSDF<DISNEY>::sample(c.mat, state, wo, seed, s);
+                directions[n] = s.direction;
+                if (s.pdf > 0.0f)
+                {
+                    BSDF<DISNEY>::evalPdf(table, c.mat, state, wo, s.direction, f, pdf);
+                    max_error = std::max(max_error, relativeError(s.f.x, f.x));
+                    max_error = std::max(max_error, relativeError(s.f.y, f.y));
+                    max_error = std::max(max_error, relativeError(s.f.z, f.z));
+                    analytic.add((s.f.x + s.f.y + s.f.z) / (3.0 * s.pdf));
+                }
+                else
+                {
+                    analytic.add(0.0);
+                }
+
+                BSDF<DISNEY>::sample(table, c.mat, state, wo, seed, s);
+                if (s.pdf > 0.0f)
+                {
+                    BSDF<DISNEY>::evalPdf(table, c.mat, state, wo, s.direction, f, pdf);
+                    max_error = std::max(max_error, relativeError(s.pdf, pdf));
+                    lobe_table.add((s.f.x + s.f.y + s.f.z) / (3.0 * s.pdf));
+                }
+                else
+                {
+                    lobe_table.add(0.0);
+                }
+            }
+
+            double albedo = 0.0;
+            for (int lobe = 0; lobe < DISNEY_LOBE_COUNT; ++lobe)
+                albedo += table.albedo[i][lobe];
+            const double table_tolerance = 4.0 * sqrt(analytic.variance() * (1.0 / sample_count + 1.0 / DISNEY_LOBE_TABLE_SAMPLES)) + 1.0e-3;
+            const double selection_tolerance = 4.0 * sqrt((analytic.variance() + lobe_table.variance()) / sample_count) + 1.0e-3;
+            const double table_error = fabs(albedo - analytic.mean());
+            const double selection_error = fabs(lobe_table.mean() - analytic.mean());
+            max_energy_error = std::max(max_energy_error, static_cast<float>(std::max(table_error, selection_error)));
+            energy_ok &= table_error <= table_tolerance && selection_error <= selection_tolerance;
+            analytic_variance += analytic.variance() / bin_count;
+            lobe_table_variance += lobe_table.variance() / bin_count;
+
+            float sum_f = 0.0f;
+            begin = std::chrono::steady_clock::now();
+            for (int n = 0; n < sample_count; ++n)
+            {
+                float3 f;
+                float pdf;
+                BSDF<DISNEY>::evalPdf(c.mat, state, wo, directions[n], f, pdf);
+                sum_f += pdf + f.x;
+            }
+            analytic_ns += nanosecondsSince(begin, sample_count);
+
+            begin = std::chrono::steady_clock::now();
+            for (int n = 0; n < sample_count; ++n)
+            {
+                float3 f;
+                float pdf;
+                BSDF<DISNEY>::evalPdf(table, c.mat, state, wo, directions[n], f, pdf);
+                sum_f += pdf + f.x;
+            }
+            lobe_table_ns += nanosecondsSince(begin, sample_count);
+            timing_sink = sum_f;
+        }
+
+        const bool ok = max_error <= consistency_tolerance && energy_ok;
+        std::ostringstream line;
+        line << "[lobe_table] material: " << c.name
+            << std::fixed << std::setprecision(4)
+            << "\tbake_ms: " << bake_ms
+            << "\tmax_rel_error: " << std::scientific << max_error
+            << "\tmax_energy_error: " << max_energy_error << std::fixed
+            << "\tvariance: " << analytic_variance
+            << "\tlobe_table_variance: " << lobe_table_variance
+            << "\teval_pdf_ns: " << analytic_ns / bin_count
+            << "\tlobe_table_eval_pdf_ns: " << lobe_table_ns / bin_count
+            << (ok ? "" : "\tFAILED");
+        std::cout << line.str() << std::endl;
+        return ok;
+    }
+}
+
+bool benchBSDF(int sample_count)
+{
+    const float thetas[] = { 0.1f, M_PIf * 0.25f, M_PIf * 0.45f };
+
+    bool ok = true;
+    const std::vector<BSDFCase> cases = materialGrid();
+    for (auto c = cases.begin(); c != cases.end(); ++c)
+    {
+        for (int t = 0; t < 3; ++t)
+        {
+            switch (c->mat.bsdf)
+            {
+            case DIFFUSE:
+                ok &= runCase<DIFFUSE>(*c, thetas[t], sample_count);
+                break;
+            default:
+                ok &= runCase<DISNEY>(*c, thetas[t], sample_count);
+                break;
+            }
+        }
+    }
+
+    // Noise per sample of the lobe selections over the grid
+    double analytic_variance = 0.0;
+    double lobe_table_variance = 0.0;
+    for (size_t i = 0; i < cases.size(); ++i)
+    {
+        if (cases[i].mat.bsdf != DISNEY)
+            continue;
+
+        double analytic;
+        double lobe_table;
+        ok &= runTableCase(cases[i], static_cast<unsigned int>(i), sample_count, analytic, lobe_table);
+        analytic_variance += analytic;
+        lobe_table_variance += lobe_table;
+    }
+    std::cout << "[lobe_table] variance: " << analytic_variance << "\tlobe_table_variance: " << lobe_table_variance
+        << "\tvariance_reduction: " << analytic_variance / lobe_table_variance << std::endl;
+
+    std::vector<MaterialParameter> materials;
+    for (auto c = cases.begin(); c != cases.end(); ++c)
+        materials.push_back(c->mat);
+    std::vector<DisneyLobeTable> tables;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    bakeDisneyLobeTables(materials, tables);
+    std::cout << "[lobe_table] materials: " << materials.size() << "\tparallel_bake_ms: " << nanosecondsSince(begin, 1) * 1.0e-6 << std::endl;
+
+    std::cout << "[bsdf] checks: " << (ok ? "ok" : "failed") << std::endl;
+    return ok;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+//
+// CPU checks and timings of the BSDFs in bsdf.h and of the Disney lobe
+// selection tables in lobe_table.h over a grid of materials, including the variance of the
+// analytic and the albedo proportional lobe selection. Run by
+// redflash_bench --bsdf, returns false if a check failed.
+//
+//-----------------------------------------------------------------------------
+
+bool benchBSDF(int sample_count);
@@ -0,0 +1,46 @@
+#pragma once
+
+// Included from bsdf.h
+
+template<>
+struct BSDF<DIFFUSE>
+{
+    static __host__ __device__ __inline__ void evalPdf(const MaterialParameter &mat, const State &state, const float3 &wo, const float3 &wi, float3 &f, float &pdf)
+    {
+        float3 N = state.ffnormal;
+
+        float NDotL = dot(N, wi);
+        float NDotV = dot(N, wo);
+
+        pdf = fabsf(NDotL) * (1.0f / M_PIf);
+
+        if (NDotL <= 0.0f || NDotV <= 0.0f)
+            f = make_float3(0.0f);
+        else
+            f = (1.0f / M_PIf) * mat.albedo * optix::clamp(NDotL, 0.0f, 1.0f);
+    }
+
+    static __host__ __device__ __inline__ void sample(const MaterialParameter &mat, const State &state, const float3 &wo, unsigned int &seed, BSDFSample &s)
+    {
+        float3 N = state.ffnormal;
+
+        float r1 = rnd(seed);
+        float r2 = rnd(seed);
+
+        // The cosine of the sample is its z in the local frame
+        float3 dir;
+        optix::cosine_sample_hemisphere(r1, r2, dir);
+        float NDotL = dir.z;
+
+        optix::Onb onb(N);
+        onb.inverse_transform(dir);
+
+        s.direction = dir;
+        s.pdf = NDotL * (1.0f / M_PIf);
+
+        if (NDotL <= 0.0f || dot(N, wo) <= 0.0f)
+            s.f = make_float3(0.0f);
+        else
+            s.f = (1.0f / M_PIf) * mat.albedo * NDotL;
+    }
+};
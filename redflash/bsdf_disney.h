@@ -0,0 +1,340 @@
+/*
+ Copyright Disney Enterprises, Inc.  All rights reserved.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License
+ and the following modification to it: Section 6 Trademarks.
+ deleted and replaced with:
+
+ 6. Trademarks. This License does not grant permission to use the
+ trade names, trademarks, service marks, or product names of the
+ Licensor and its affiliates, except as required for reproducing
+ the content of the NOTICE file.
+
+ You may obtain a copy of the License at
+ http://www.apache.org/licenses/LICENSE-2.0
+*/
+
+#pragma once
+
+// Included from bsdf.h
+
+static __host__ __device__ __inline__ float sqr(float x) { return x * x; }
+
+static __host__ __device__ __inline__ float SchlickFresnel(float u)
+{
+    float m = optix::clamp(1.0f - u, 0.0f, 1.0f);
+    float m2 = m * m;
+    return m2 * m2*m; // pow(m,5)
+}
+
+// GTR1 with its normalization (a^2 - 1) / (pi log a^2) precomputed, see DisneyConstants
+static __host__ __device__ __inline__ float GTR1(float NDotH, float a2, float norm)
+{
+    float t = 1.0f + (a2 - 1.0f)*NDotH*NDotH;
+    return norm / t;
+}
+
+static __host__ __device__ __inline__ float GTR2(float NDotH, float a)
+{
+    float a2 = a * a;
+    float t = 1.0f + (a2 - 1.0f)*NDotH*NDotH;
+    return a2 / (M_PIf * t*t);
+}
+
+static __host__ __device__ __inline__ float smithG_GGX(float NDotv, float alphaG)
+{
+    float a = alphaG * alphaG;
+    float b = NDotv * NDotv;
+    return 1.0f / (NDotv + sqrtf(a + b - a * b));
+}
+
+// Terms of a material that do not depend on the directions, derived once per
+// call of BSDF<DISNEY> and shared by the value and the pdf.
+struct DisneyConstants
+{
+    float3 Cspec0;
+    float3 Csheen;
+    float specularAlpha;    // GTR2 roughness
+    float clearcoatAlpha2;  // GTR1 roughness squared
+    float clearcoatNorm;    // GTR1 normalization, the only logf of the model
+    float roughg;           // Smith G roughness of the specular lobe
+};
+
+enum DisneyLobe
+{
+    DISNEY_LOBE_DIFFUSE,    // diffuse, subsurface and sheen
+    DISNEY_LOBE_SPECULAR,
+    DISNEY_LOBE_CLEARCOAT,
+    DISNEY_LOBE_COUNT
+};
+
+// Lobe selection table of a static Disney material, built on the host by
+// bakeDisneyLobeTables (lobe_table.h) and indexed by material id. It only
+// steers the sampling, the value and the pdf are evaluated analytically.
+#define DISNEY_LOBE_TABLE_SIZE 16
+
+struct DisneyLobeTable
+{
+    // Directional albedo of every lobe, tabulated over cos(theta_o) in [0, 1]
+    float albedo[DISNEY_LOBE_TABLE_SIZE][DISNEY_LOBE_COUNT];
+};
+
+static __host__ __device__ __inline__ DisneyConstants disneyConstants(const MaterialParameter &mat)
+{
+    DisneyConstants c;
+
+    float3 Cdlin = mat.albedo;
+    float Cdlum = 0.3f*Cdlin.x + 0.6f*Cdlin.y + 0.1f*Cdlin.z; // luminance approx.
+
+    float3 Ctint = Cdlum > 0.0f ? Cdlin / Cdlum : make_float3(1.0f); // normalize lum. to isolate hue+sat
+    c.Cspec0 = optix::lerp(mat.specular*0.08f*optix::lerp(make_float3(1.0f), Ctint, mat.specularTint), Cdlin, mat.metallic);
+    c.Csheen = optix::lerp(make_float3(1.0f), Ctint, mat.sheenTint);
+
+    c.specularAlpha = fmaxf(0.001f, mat.roughness);
+
+    float a = optix::lerp(0.1f, 0.001f, mat.clearcoatGloss);
+    if (a >= 1.0f)
+    {
+        c.clearcoatAlpha2 = 1.0f;
+        c.clearcoatNorm = 1.0f / M_PIf;
+    }
+    else
+    {
+        c.clearcoatAlpha2 = a * a;
+        c.clearcoatNorm = (c.clearcoatAlpha2 - 1.0f) / (M_PIf*logf(c.clearcoatAlpha2));
+    }
+
+    c.roughg = sqr(mat.roughness*0.5f + 0.5f);
+    return c;
+}
+
+// Linear interpolation of the albedo table at cos(theta_o)
+static __host__ __device__ __inline__ float disneyLobeTableAlbedo(const DisneyLobeTable &table, float NDotV, int lobe)
+{
+    float x = optix::clamp(NDotV, 0.0f, 1.0f) * (DISNEY_LOBE_TABLE_SIZE - 1);
+    int i = static_cast<int>(x);
+    if (i > DISNEY_LOBE_TABLE_SIZE - 2)
+        i = DISNEY_LOBE_TABLE_SIZE - 2;
+    return optix::lerp(table.albedo[i][lobe], table.albedo[i + 1][lobe], x - i);
+}
+
+// Probability of sampling each lobe without a table: half of the non metallic
+// weight goes to diffuse, clearcoat and specular split the rest.
+static __host__ __device__ __inline__ void disneyLobeProbabilities(const MaterialParameter &mat, float *p)
+{
+    float diffuseRatio = 0.5f * (1.0f - mat.metallic);
+    float ratio = 1.0f / (1.0f + mat.clearcoat);
+    p[DISNEY_LOBE_DIFFUSE] = diffuseRatio;
+    p[DISNEY_LOBE_SPECULAR] = (1.0f - diffuseRatio) * ratio;
+    p[DISNEY_LOBE_CLEARCOAT] = (1.0f - diffuseRatio) * (1.0f - ratio);
+}
+
+// Lobe probabilities proportional to the tabulated albedo at cos(theta_o). Every
+// lobe the material has keeps a minimum share, so the pdf stays non zero
+// wherever the value is.
+#define DISNEY_LOBE_MIN_PROBABILITY 0.05f
+
+static __host__ __device__ __inline__ void disneyLobeProbabilities(const DisneyLobeTable &table, const MaterialParameter &mat, float NDotV, float *p)
+{
+    bool present[DISNEY_LOBE_COUNT];
+    present[DISNEY_LOBE_DIFFUSE] = mat.metallic < 1.0f;
+    present[DISNEY_LOBE_SPECULAR] = true;
+    present[DISNEY_LOBE_CLEARCOAT] = mat.clearcoat > 0.0f;
+
+    float sum = 0.0f;
+    for (int lobe = 0; lobe < DISNEY_LOBE_COUNT; ++lobe)
+    {
+        p[lobe] = present[lobe] ? disneyLobeTableAlbedo(table, NDotV, lobe) : 0.0f;
+        sum += p[lobe];
+    }
+
+    if (!(sum > 0.0f))
+    {
+        disneyLobeProbabilities(mat, p);
+        return;
+    }
+
+    float total = 0.0f;
+    for (int lobe = 0; lobe < DISNEY_LOBE_COUNT; ++lobe)
+    {
+        p[lobe] = present[lobe] ? fmaxf(p[lobe] / sum, DISNEY_LOBE_MIN_PROBABILITY) : 0.0f;
+        total += p[lobe];
+    }
+    for (int lobe = 0; lobe < DISNEY_LOBE_COUNT; ++lobe)
+        p[lobe] /= total;
+}
+
+template<>
+struct BSDF<DISNEY>
+{
+    /*
+        Eval: https://github.com/wdas/brdf/blob/master/src/brdfs/disney.brdf
+        Pdf: http://simon-kallweit.me/rendercompo2015/
+    */
+    // Value of every lobe (cosine included) and the pdf of sample for wi, where
+    // p holds the probability of sampling each lobe
+    static __host__ __device__ __inline__ void evalLobesPdf(const DisneyConstants &c, const float *p, const MaterialParameter &mat, const State &state, const float3 &wo, const float3 &wi, float3 *lobes, float &pdf)
+    {
+        float3 N = state.ffnormal;
+        float3 V = wo;
+        float3 L = wi;
+
+        float NDotL = dot(N, L);
+        float NDotV = dot(N, V);
+
+        float3 H = normalize(L + V);
+        float NDotH = dot(N, H);
+        float LDotH = dot(L, H);
+
+        // The GTR terms only depend on NDotH^2, the pdf and the value share them
+        float Ds = GTR2(NDotH, c.specularAlpha);
+        float Dr = GTR1(NDotH, c.clearcoatAlpha2, c.clearcoatNorm);
+
+        // pdf: the half vector densities D * cos(theta_h) of the specular and
+        // clearcoat lobes, mapped to wi
+        float jacobian = fabsf(NDotH) / (4.0f * fabsf(LDotH));
+        float pdfDiff = fabsf(NDotL) * (1.0f / M_PIf);
+        pdf = p[DISNEY_LOBE_DIFFUSE] * pdfDiff
+            + (p[DISNEY_LOBE_SPECULAR] * Ds + p[DISNEY_LOBE_CLEARCOAT] * Dr) * jacobian;
+
+        if (NDotL <= 0.0f || NDotV <= 0.0f)
+        {
+            lobes[DISNEY_LOBE_DIFFUSE] = make_float3(0.0f);
+            lobes[DISNEY_LOBE_SPECULAR] = make_float3(0.0f);
+            lobes[DISNEY_LOBE_CLEARCOAT] = make_float3(0.0f);
+            return;
+        }
+
+        float3 Cdlin = mat.albedo;
+
+        // Diffuse fresnel - go from 1 at normal incidence to .5 at grazing
+        // and mix in diffuse retro-reflection based on roughness
+        float FL = SchlickFresnel(NDotL), FV = SchlickFresnel(NDotV);
+        float Fd90 = 0.5f + 2.0f * LDotH*LDotH * mat.roughness;
+        float Fd = optix::lerp(1.0f, Fd90, FL) * optix::lerp(1.0f, Fd90, FV);
+
+        // Based on Hanrahan-Krueger brdf approximation of isotrokPic bssrdf
+        // 1.25 scale is used to (roughly) preserve albedo
+        // Fss90 used to "flatten" retroreflection based on roughness
+        float Fss90 = LDotH * LDotH*mat.roughness;
+        float Fss = optix::lerp(1.0f, Fss90, FL) * optix::lerp(1.0f, Fss90, FV);
+        float ss = 1.25f * (Fss * (1.0f / (NDotL + NDotV) - 0.5f) + 0.5f);
+
+        // specular
+        //float aspect = sqrt(1-mat.anisotrokPic*.9);
+        //float ax = Max(.001f, sqr(mat.roughness)/aspect);
+        //float ay = Max(.001f, sqr(mat.roughness)*aspect);
+        //float Ds = GTR2_aniso(NDotH, Dot(H, X), Dot(H, Y), ax, ay);
+
+        float FH = SchlickFresnel(LDotH);
+        float3 Fs = optix::lerp(c.Cspec0, make_float3(1.0f), FH);
+        float Gs = smithG_GGX(NDotL, c.roughg) * smithG_GGX(NDotV, c.roughg);
+
+        // sheen
+        float3 Fsheen = FH * mat.sheen * c.Csheen;
+
+        // clearcoat (ior = 1.5 -> F0 = 0.04)
+        float Fr = optix::lerp(0.04f, 1.0f, FH);
+        float Gr = smithG_GGX(NDotL, 0.25f) * smithG_GGX(NDotV, 0.25f);
+
+        float cosine = optix::clamp(NDotL, 0.0f, 1.0f);
+        lobes[DISNEY_LOBE_DIFFUSE] = ((1.0f / M_PIf) * optix::lerp(Fd, ss, mat.subsurface)*Cdlin + Fsheen)
+            * (1.0f - mat.metallic) * cosine;
+        lobes[DISNEY_LOBE_SPECULAR] = Gs * Fs*Ds * cosine;
+        lobes[DISNEY_LOBE_CLEARCOAT] = make_float3(0.25f*mat.clearcoat*Gr*Fr*Dr * cosine);
+    }
+
+    static __host__ __device__ __inline__ void evalPdf(const DisneyConstants &c, const float *p, const MaterialParameter &mat, const State &state, const float3 &wo, const float3 &wi, float3 &f, float &pdf)
+    {
+        float3 lobes[DISNEY_LOBE_COUNT];
+        evalLobesPdf(c, p, mat, state, wo, wi, lobes, pdf);
+        f = lobes[DISNEY_LOBE_DIFFUSE] + lobes[DISNEY_LOBE_SPECULAR] + lobes[DISNEY_LOBE_CLEARCOAT];
+    }
+
+    /*
+        https://learnopengl.com/PBR/IBL/Specular-IBL
+    */
+    static __host__ __device__ __inline__ void sample(const DisneyConstants &c, const float *p, const MaterialParameter &mat, const State &state, const float3 &wo, unsigned int &seed, BSDFSample &s)
+    {
+        float3 N = state.ffnormal;
+        float3 V = wo;
+
+        float3 dir;
+
+        float probability = rnd(seed);
+
+        float r1 = rnd(seed);
+        float r2 = rnd(seed);
+
+        optix::Onb onb(N); // basis
+
+        if (probability < p[DISNEY_LOBE_DIFFUSE]) // sample diffuse
+        {
+            optix::cosine_sample_hemisphere(r1, r2, dir);
+            onb.inverse_transform(dir);
+        }
+        else
+        {
+            float cosTheta;
+            if (probability < 1.0f - p[DISNEY_LOBE_CLEARCOAT]) // GTR2 specular
+            {
+                float a = c.specularAlpha;
+                cosTheta = sqrtf((1.0f - r2) / (1.0f + (a*a - 1.0f) *r2));
+            }
+            else if (c.clearcoatAlpha2 < 1.0f) // GTR1 clearcoat
+            {
+                float a2 = c.clearcoatAlpha2;
+                cosTheta = sqrtf((1.0f - powf(a2, 1.0f - r2)) / (1.0f - a2));
+            }
+            else
+            {
+                cosTheta = sqrtf(1.0f - r2);
+            }
+
+            float phi = r1 * 2.0f * M_PIf;
+            float sinTheta = sqrtf(fmaxf(0.0f, 1.0f - (cosTheta * cosTheta)));
+            float sinPhi = sinf(phi);
+            float cosPhi = cosf(phi);
+
+            float3 half = make_float3(sinTheta*cosPhi, sinTheta*sinPhi, cosTheta);
+            onb.inverse_transform(half);
+
+            dir = 2.0f*dot(V, half)*half - V; //reflection vector
+        }
+
+        s.direction = dir;
+        evalPdf(c, p, mat, state, wo, dir, s.f, s.pdf);
+    }
+
+    // Analytic entry points, the material constants are derived per call
+    static __host__ __device__ __inline__ void evalPdf(const MaterialParameter &mat, const State &state, const float3 &wo, const float3 &wi, float3 &f, float &pdf)
+    {
+        float p[DISNEY_LOBE_COUNT];
+        disneyLobeProbabilities(mat, p);
+        evalPdf(disneyConstants(mat), p, mat, state, wo, wi, f, pdf);
+    }
+
+    static __host__ __device__ __inline__ void sample(const MaterialParameter &mat, const State &state, const float3 &wo, unsigned int &seed, BSDFSample &s)
+    {
+        float p[DISNEY_LOBE_COUNT];
+        disneyLobeProbabilities(mat, p);
+        sample(disneyConstants(mat), p, mat, state, wo, seed, s);
+    }
+
+    // Lobe table entry points: the analytic model with the lobes picked in
+    // proportion to their tabulated albedo at wo
+    static __host__ __device__ __inline__ void evalPdf(const DisneyLobeTable &table, const MaterialParameter &mat, const State &state, const float3 &wo, const float3 &wi, float3 &f, float &pdf)
+    {
+        float p[DISNEY_LOBE_COUNT];
+        disneyLobeProbabilities(table, mat, dot(state.ffnormal, wo), p);
+        evalPdf(disneyConstants(mat), p, mat, state, wo, wi, f, pdf);
+    }
+
+    static __host__ __device__ __inline__ void sample(const DisneyLobeTable &table, const MaterialParameter &mat, const State &state, const float3 &wo, unsigned int &seed, BSDFSample &s)
+    {
+        float p[DISNEY_LOBE_COUNT];
+        disneyLobeProbabilities(table, mat, dot(state.ffnormal, wo), p);
+        sample(disneyConstants(mat), p, mat, state, wo, seed, s);
+    }
+};
@@ -0,0 +1,343 @@
+#include "cpu_denoiser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+#include <thread>
+
+namespace
+{
+    const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+    // exp(-e) for e >= 0 to about 2e-4 relative: 2^floor(x) from the exponent bits
+    // times a polynomial for 2^fract(x), x = -e * log2(e). e is clamped to 64,
+    // so that the weights and their products with the colors never turn into
+    // denormals, which are an order of magnitude slower.
+    inline float expNegative(float e)
+    {
+        // Truncating x + 127 floors x
+        const float x = std::min(e, 64.0f) * -1.442695041f;
+        const int i = static_cast<int>(x + 127.0f) - 127;
+        const float f = x - static_cast<float>(i);
+        const float p = 1.0f + f * (0.6960656f + f * (0.2244943f + f * 0.07944024f));
+
+        int bits;
+        memcpy(&bits, &p, sizeof(bits));
+        bits += i << 23;
+        float result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    inline __m128 expNegative(__m128 e)
+    {
+        const __m128 x = _mm_mul_ps(_mm_min_ps(e, _mm_set1_ps(64.0f)), _mm_set1_ps(-1.442695041f));
+        const __m128i i = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(x, _mm_set1_ps(127.0f))), _mm_set1_epi32(127));
+        const __m128 f = _mm_sub_ps(x, _mm_cvtepi32_ps(i));
+        __m128 p = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(0.07944024f)), _mm_set1_ps(0.2244943f));
+        p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(0.6960656f));
+        p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(1.0f));
+        return _mm_castsi128_ps(_mm_add_epi32(_mm_castps_si128(p), _mm_slli_epi32(i, 23)));
+    }
+
+    // Squared distance between pixels p and q of three planes
+    inline float distance2(const float* a, const float* b, const float* c, size_t p, size_t q)
+    {
+        const float da = a[p] - a[q];
+        const float db = b[p] - b[q];
+        const float dc = c[p] - c[q];
+        return da * da + db * db + dc * dc;
+    }
+
+    // Pixels p..p+3 of three planes
+    struct Pixels4
+    {
+        Pixels4(const float* a, const float* b, const float* c, size_t p)
+            : a(_mm_loadu_ps(a + p))
+            , b(_mm_loadu_ps(b + p))
+            , c(_mm_loadu_ps(c + p))
+        {
+        }
+
+        // Squared distances to the pixels q..q+3 of the planes
+        __m128 distance2(const float* pa, const float* pb, const float* pc, size_t q) const
+        {
+            const __m128 da = _mm_sub_ps(a, _mm_loadu_ps(pa + q));
+            const __m128 db = _mm_sub_ps(b, _mm_loadu_ps(pb + q));
+            const __m128 dc = _mm_sub_ps(c, _mm_loadu_ps(pc + q));
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(da, da), _mm_mul_ps(db, db)), _mm_mul_ps(dc, dc));
+        }
+
+        __m128 a;
+        __m128 b;
+        __m128 c;
+    };
+
+    inline float compressScale(float r, float g, float b)
+    {
+        const float luminance = 0.3f * r + 0.6f * g + 0.1f * b;
+        return 1.0f / (1.0f + std::max(luminance, 0.0f));
+    }
+
+    inline __m128 compressScale(__m128 r, __m128 g, __m128 b)
+    {
+        const __m128 luminance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.3f)), _mm_mul_ps(g, _mm_set1_ps(0.6f))), _mm_mul_ps(b, _mm_set1_ps(0.1f)));
+        return _mm_div_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_set1_ps(1.0f), _mm_max_ps(luminance, _mm_setzero_ps())));
+    }
+}
+
+template<typename Function>
+void CpuDenoiser::forEachTile(const Function& function)
+{
+    const int tiles_x = (m_width + m_tile_size - 1) / m_tile_size;
+    const int tiles_y = (m_height + m_tile_size - 1) / m_tile_size;
+    const int tile_count = tiles_x * tiles_y;
+
+    std::atomic<int> next(0);
+    auto worker = [&]()
+    {
+        for (int tile = next++; tile < tile_count; tile = next++)
+        {
+            const int x0 = (tile % tiles_x) * m_tile_size;
+            const int y0 = (tile / tiles_x) * m_tile_size;
+            function(x0, y0, std::min(x0 + m_tile_size, m_width), std::min(y0 + m_tile_size, m_height));
+        }
+    };
+
+    const unsigned int thread_count = std::min<unsigned int>(m_thread_count, tile_count);
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < thread_count; ++t)
+        threads.push_back(std::thread(worker));
+    worker();
+    for (auto t = threads.begin(); t != threads.end(); ++t)
+        t->join();
+}
+
+template<bool UseNormal, bool UseAlbedo>
+void CpuDenoiser::filterTile(const Pass& pass, int x0, int y0, int x1, int y1)
+{
+    const float* r = plane(pass.input + PLANE_R);
+    const float* g = plane(pass.input + PLANE_G);
+    const float* b = plane(pass.input + PLANE_B);
+    const float* cr = plane(pass.input + PLANE_CR);
+    const float* cg = plane(pass.input + PLANE_CG);
+    const float* cb = plane(pass.input + PLANE_CB);
+    const float* nx = plane(PLANE_NX);
+    const float* ny = plane(PLANE_NY);
+    const float* nz = plane(PLANE_NZ);
+    const float* ax = plane(PLANE_AX);
+    const float* ay = plane(PLANE_AY);
+    const float* az = plane(PLANE_AZ);
+
+    float* out_r = plane(pass.output + PLANE_R);
+    float* out_g = plane(pass.output + PLANE_G);
+    float* out_b = plane(pass.output + PLANE_B);
+    float* out_cr = plane(pass.output + PLANE_CR);
+    float* out_cg = plane(pass.output + PLANE_CG);
+    float* out_cb = plane(pass.output + PLANE_CB);
+
+    const __m128 inv_sigma_color2 = _mm_set1_ps(pass.inv_sigma_color2);
+    const __m128 inv_sigma_normal2 = _mm_set1_ps(pass.inv_sigma_normal2);
+    const __m128 inv_sigma_albedo2 = _mm_set1_ps(pass.inv_sigma_albedo2);
+    const int radius = 2 * pass.step;
+
+    for (int y = y0; y < y1; ++y)
+    {
+        const size_t row = static_cast<size_t>(y) * m_width;
+
+        // Taps outside of the image are skipped
+        int tap_rows = 0;
+        size_t tap_row[5];
+        float tap_kernel[5];
+        for (int ky = 0; ky < 5; ++ky)
+        {
+            const int qy = y + (ky - 2) * pass.step;
+            if (qy >= 0 && qy < m_height)
+            {
+                tap_row[tap_rows] = static_cast<size_t>(qy) * m_width;
+                tap_kernel[tap_rows++] = kernel[ky];
+            }
+        }
+
+        int x = x0;
+        while (x < x1)
+        {
+            const size_t p = row + x;
+
+            // 4 pixels at a time, with the sums in registers, where all the
+            // taps of the 4 pixels are inside the row
+            if (x + 4 <= x1 && x >= radius && x + 3 + radius < m_width)
+            {
+                const Pixels4 color(cr, cg, cb, p);
+                const Pixels4 normal(nx, ny, nz, UseNormal ? p : 0);
+                const Pixels4 albedo(ax, ay, az, UseAlbedo ? p : 0);
+
+                __m128 sum_r = _mm_setzero_ps();
+                __m128 sum_g = _mm_setzero_ps();
+                __m128 sum_b = _mm_setzero_ps();
+                __m128 sum_w = _mm_setzero_ps();
+                for (int ky = 0; ky < tap_rows; ++ky)
+                {
+                    for (int kx = 0; kx < 5; ++kx)
+                    {
+                        const size_t q = tap_row[ky] + x + (kx - 2) * pass.step;
+
+                        __m128 e = _mm_mul_ps(color.distance2(cr, cg, cb, q), inv_sigma_color2);
+                        if (UseNormal)
+                            e = _mm_add_ps(e, _mm_mul_ps(normal.distance2(nx, ny, nz, q), inv_sigma_normal2));
+                        if (UseAlbedo)
+                            e = _mm_add_ps(e, _mm_mul_ps(albedo.distance2(ax, ay, az, q), inv_sigma_albedo2));
+
+                        const __m128 w = _mm_mul_ps(_mm_set1_ps(tap_kernel[ky] * kernel[kx]), expNegative(e));
+                        sum_r = _mm_add_ps(sum_r, _mm_mul_ps(_mm_loadu_ps(r + q), w));
+                        sum_g = _mm_add_ps(sum_g, _mm_mul_ps(_mm_loadu_ps(g + q), w));
+                        sum_b = _mm_add_ps(sum_b, _mm_mul_ps(_mm_loadu_ps(b + q), w));
+                        sum_w = _mm_add_ps(sum_w, w);
+                    }
+                }
+
+                // The center tap always has a weight of kernel[2]^2
+                const __m128 inv_w = _mm_div_ps(_mm_set1_ps(1.0f), sum_w);
+                const __m128 fr = _mm_mul_ps(sum_r, inv_w);
+                const __m128 fg = _mm_mul_ps(sum_g, inv_w);
+                const __m128 fb = _mm_mul_ps(sum_b, inv_w);
+                const __m128 scale = compressScale(fr, fg, fb);
+                _mm_storeu_ps(out_r + p, fr);
+                _mm_storeu_ps(out_g + p, fg);
+                _mm_storeu_ps(out_b + p, fb);
+                _mm_storeu_ps(out_cr + p, _mm_mul_ps(fr, scale));
+                _mm_storeu_ps(out_cg + p, _mm_mul_ps(fg, scale));
+                _mm_storeu_ps(out_cb + p, _mm_mul_ps(fb, scale));
+                x += 4;
+                continue;
+            }
+
+            float sum_r = 0.0f;
+            float sum_g = 0.0f;
+            float sum_b = 0.0f;
+            float sum_w = 0.0f;
+            for (int ky = 0; ky < tap_rows; ++ky)
+            {
+                for (int kx = 0; kx < 5; ++kx)
+                {
+                    const int qx = x + (kx - 2) * pass.step;
+                    if (qx < 0 || qx >= m_width)
+                        continue;
+                    const size_t q = tap_row[ky] + qx;
+
+                    float e = distance2(cr, cg, cb, p, q) * pass.inv_sigma_color2;
+                    if (UseNormal)
+                        e += distance2(nx, ny, nz, p, q) * pass.inv_sigma_normal2;
+                    if (UseAlbedo)
+                        e += distance2(ax, ay, az, p, q) * pass.inv_sigma_albedo2;
+
+                    const float w = tap_kernel[ky] * kernel[kx] * expNegative(e);
+                    sum_r += r[q] * w;
+                    sum_g += g[q] * w;
+                    sum_b += b[q] * w;
+                    sum_w += w;
+                }
+            }
+
+            const float inv_w = 1.0f / sum_w;
+            const float fr = sum_r * inv_w;
+            const float fg = sum_g * inv_w;
+            const float fb = sum_b * inv_w;
+            const float scale = compressScale(fr, fg, fb);
+            out_r[p] = fr;
+            out_g[p] = fg;
+            out_b[p] = fb;
+            out_cr[p] = fr * scale;
+            out_cg[p] = fg * scale;
+            out_cb[p] = fb * scale;
+            ++x;
+        }
+    }
+}
+
+void CpuDenoiser::denoise(const CpuDenoiserSettings& settings, int width, int height,
+    const float4* color, const float4* albedo, const float4* normal, float4* output)
+{
+    m_width = width;
+    m_height = height;
+    m_pixel_count = static_cast<size_t>(width) * height;
+    m_tile_size = std::max(settings.tile_size, 8);
+    m_thread_count = settings.thread_count > 0 ? settings.thread_count : std::max(1u, std::thread::hardware_concurrency());
+    m_planes.resize(PLANE_COUNT * m_pixel_count);
+
+    const bool use_normal = normal && settings.use_normal;
+    const bool use_albedo = albedo && settings.use_albedo;
+
+    // Split into planes
+    forEachTile([&](int x0, int y0, int x1, int y1)
+    {
+        for (int y = y0; y < y1; ++y)
+        {
+            for (int x = x0; x < x1; ++x)
+            {
+                const size_t i = static_cast<size_t>(y) * width + x;
+                const float4 c = color[i];
+                const float scale = compressScale(c.x, c.y, c.z);
+                plane(PLANE_R)[i] = c.x;
+                plane(PLANE_G)[i] = c.y;
+                plane(PLANE_B)[i] = c.z;
+                plane(PLANE_CR)[i] = c.x * scale;
+                plane(PLANE_CG)[i] = c.y * scale;
+                plane(PLANE_CB)[i] = c.z * scale;
+                if (use_normal)
+                {
+                    plane(PLANE_NX)[i] = normal[i].x;
+                    plane(PLANE_NY)[i] = normal[i].y;
+                    plane(PLANE_NZ)[i] = normal[i].z;
+                }
+                if (use_albedo)
+                {
+                    plane(PLANE_AX)[i] = albedo[i].x;
+                    plane(PLANE_AY)[i] = albedo[i].y;
+                    plane(PLANE_AZ)[i] = albedo[i].z;
+                }
+            }
+        }
+    });
+
+    const int passes = std::max(settings.passes, 1);
+    for (int p = 0; p < passes; ++p)
+    {
+        Pass pass;
+        pass.input = (p & 1) ? PLANE_R2 : PLANE_R;
+        pass.output = (p & 1) ? PLANE_R : PLANE_R2;
+        pass.step = 1 << p;
+        const float sigma_color = settings.sigma_color / static_cast<float>(1 << p);
+        pass.inv_sigma_color2 = 1.0f / (sigma_color * sigma_color);
+        pass.inv_sigma_normal2 = 1.0f / (settings.sigma_normal * settings.sigma_normal);
+        pass.inv_sigma_albedo2 = 1.0f / (settings.sigma_albedo * settings.sigma_albedo);
+
+        forEachTile([&](int x0, int y0, int x1, int y1)
+        {
+            if (use_normal && use_albedo)
+                filterTile<true, true>(pass, x0, y0, x1, y1);
+            else if (use_albedo)
+                filterTile<false, true>(pass, x0, y0, x1, y1);
+            else if (use_normal)
+                filterTile<true, false>(pass, x0, y0, x1, y1);
+            else
+                filterTile<false, false>(pass, x0, y0, x1, y1);
+        });
+    }
+
+    // Back to float4
+    const int result = (passes & 1) ? PLANE_R2 : PLANE_R;
+    forEachTile([&](int x0, int y0, int x1, int y1)
+    {
+        for (int y = y0; y < y1; ++y)
+        {
+            for (int x = x0; x < x1; ++x)
+            {
+                const size_t i = static_cast<size_t>(y) * width + x;
+                output[i] = optix::make_float4(plane(result + PLANE_R)[i], plane(result + PLANE_G)[i], plane(result + PLANE_B)[i], 1.0f);
+            }
+        }
+    });
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// CPU denoiser
+//
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010): a 5x5 B3-spline
+// kernel applied in passes of doubling tap spacing, where each tap is weighted
+// by a joint bilateral term on the color, the normal and the albedo of the
+// pixel. The color distance uses c / (1 + luminance(c)) so that fireflies do
+// not dominate it, and its sigma halves with every pass.
+//
+// It takes the same inputs as the DLDenoiser stage (liner_buffer,
+// input_albedo_buffer, input_normal_buffer). The images are split into one
+// plane per channel, so that SSE2 filters 4 neighbouring pixels at a time with
+// the sums of all their taps in registers, and every pass is filtered in tiles
+// pulled from a shared counter by all hardware threads.
+// Used by redflash with --denoiser cpu in place of the DLDenoiser stage, and by
+// redflash_bench --denoise.
+//
+//-----------------------------------------------------------------------------
+
+struct CpuDenoiserSettings
+{
+    CpuDenoiserSettings()
+        : passes(5)
+        , sigma_color(0.5f)
+        , sigma_normal(0.4f)
+        , sigma_albedo(0.1f)
+        , use_albedo(true)
+        , use_normal(true)
+        , tile_size(64)
+        , thread_count(0)
+    {
+    }
+
+    // The filter spans 4 * 2^(passes - 1) + 1 pixels
+    int passes;
+    float sigma_color;
+    float sigma_normal;
+    float sigma_albedo;
+    bool use_albedo;
+    bool use_normal;
+    int tile_size;
+
+    // 0 for all hardware threads
+    unsigned int thread_count;
+};
+
+class CpuDenoiser
+{
+public:
+    // Images are width * height float4 pixels, like the OptiX buffers. albedo
+    // and normal may be null, output may alias color.
+    void denoise(const CpuDenoiserSettings& settings, int width, int height,
+        const float4* color, const float4* albedo, const float4* normal, float4* output);
+
+private:
+    enum Plane
+    {
+        // Color, and color / (1 + luminance) for the distances, of both ping-pong images
+        PLANE_R, PLANE_G, PLANE_B,
+        PLANE_CR, PLANE_CG, PLANE_CB,
+        PLANE_R2, PLANE_G2, PLANE_B2,
+        PLANE_CR2, PLANE_CG2, PLANE_CB2,
+        PLANE_NX, PLANE_NY, PLANE_NZ,
+        PLANE_AX, PLANE_AY, PLANE_AZ,
+        PLANE_COUNT
+    };
+
+    struct Pass
+    {
+        // First of the 6 color planes read and written
+        int input;
+        int output;
+        int step;
+        float inv_sigma_color2;
+        float inv_sigma_normal2;
+        float inv_sigma_albedo2;
+    };
+
+    float* plane(int index) { return m_planes.data() + static_cast<size_t>(index) * m_pixel_count; }
+
+    template<bool UseNormal, bool UseAlbedo>
+    void filterTile(const Pass& pass, int x0, int y0, int x1, int y1);
+
+    // Runs function(x0, y0, x1, y1) over the tiles of the image on all threads
+    template<typename Function>
+    void forEachTile(const Function& function);
+
+    int m_width;
+    int m_height;
+    size_t m_pixel_count;
+    int m_tile_size;
+    unsigned int m_thread_count;
+    std::vector<float> m_planes;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include "redflash.h"
+
+//-----------------------------------------------------------------------------
+//
+// Denoiser features
+//
+// The albedo and normal guides of the denoiser are taken from the first
+// vertex of a path that is not specular. A specular vertex (a smooth metal)
+// would guide the denoiser with its own flat albedo and normal while the pixel
+// shows the reflected scene, so the features of the first vertex are replaced
+// by those of the next non specular vertex seen through it, with the albedo
+// tinted by the reflectance of the specular vertices in between. A path that
+// leaves the scene through a specular vertex keeps the features of its first
+// vertex.
+//
+// The camera program sums the features of its samples and updateOutputBuffers
+// averages them over the frames with the same weights as the color, unless
+// accumulate_denoise_features is off (--first_frame_features), in which case
+// only the first frame writes them.
+//
+//-----------------------------------------------------------------------------
+
+// Metals smoother than this are specular for the features
+#define DENOISE_FEATURE_SPECULAR_ROUGHNESS 0.1f
+
+// Features of a path that has no surface vertex yet (zero if it has none)
+static __host__ __device__ __inline__ void resetDenoiseFeatures(DenoiseFeatures& features)
+{
+    features.albedo = make_float3(0.0f);
+    features.normal = make_float3(0.0f);
+    features.tint = make_float3(1.0f);
+    features.pending = true;
+}
+
+static __host__ __device__ __inline__ bool denoiseFeatureSpecular(const MaterialParameter& mat)
+{
+    return mat.bsdf == DISNEY && mat.metallic >= 0.5f && mat.roughness < DENOISE_FEATURE_SPECULAR_ROUGHNESS;
+}
+
+// Records the features of a surface vertex of a path, they replace those of
+// the vertices in front of it as long as these were all specular
+static __host__ __device__ __inline__ void recordDenoiseFeatures(const MaterialParameter& mat, const float3& ffnormal, DenoiseFeatures& features)
+{
+    if (!features.pending)
+        return;
+
+    features.albedo = features.tint * mat.albedo;
+    features.normal = ffnormal;
+    features.pending = denoiseFeatureSpecular(mat);
+
+    // Disney specular color at normal incidence
+    if (features.pending)
+        features.tint *= lerp(make_float3(0.08f * mat.specular), mat.albedo, mat.metallic);
+}
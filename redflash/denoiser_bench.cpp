@@ -0,0 +1,139 @@
+#include "denoiser_bench.h"
+#include "bench_common.h"
+#include "cpu_denoiser.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace optix;
+
+namespace
+{
+    struct Frame
+    {
+        std::vector<float4> reference;
+        std::vector<float4> noisy;
+        std::vector<float4> albedo;
+        std::vector<float4> normal;
+    };
+
+    // Spheres lit from the top left on a checkered floor, with the noise of a
+    // few samples per pixel and rare fireflies
+    Frame syntheticFrame(int width, int height)
+    {
+        Frame frame;
+        const size_t pixel_count = static_cast<size_t>(width) * height;
+        frame.reference.resize(pixel_count);
+        frame.noisy.resize(pixel_count);
+        frame.albedo.resize(pixel_count);
+        frame.normal.resize(pixel_count);
+
+        const float3 light = normalize(make_float3(-0.5f, 0.7f, 0.5f));
+        const float circles[3][3] = { { 0.3f, 0.5f, 0.18f }, { 0.65f, 0.4f, 0.22f }, { 0.85f, 0.75f, 0.1f } };
+
+        std::mt19937 rng(1);
+        std::gamma_distribution<float> noise(2.0f, 0.5f);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                const float u = (x + 0.5f) / width;
+                const float v = (y + 0.5f) / height;
+
+                float3 n = make_float3(0.0f, 1.0f, 0.0f);
+                float3 albedo = ((static_cast<int>(u * 24.0f) + static_cast<int>(v * 14.0f)) & 1) ? make_float3(0.8f) : make_float3(0.3f, 0.35f, 0.4f);
+                for (int i = 0; i < 3; ++i)
+                {
+                    const float dx = (u - circles[i][0]) * width / height;
+                    const float dy = v - circles[i][1];
+                    const float r = circles[i][2];
+                    const float d2 = dx * dx + dy * dy;
+                    if (d2 < r * r)
+                    {
+                        n = make_float3(dx / r, dy / r, sqrtf(1.0f - d2 / (r * r)));
+                        albedo = make_float3(0.9f, 0.3f + 0.3f * i, 0.2f);
+                    }
+                }
+
+                const float3 c = albedo * (0.1f + 2.0f * fmaxf(dot(n, light), 0.0f));
+                const size_t index = static_cast<size_t>(y) * width + x;
+                frame.reference[index] = make_float4(c.x, c.y, c.z, 1.0f);
+                frame.albedo[index] = make_float4(albedo.x, albedo.y, albedo.z, 1.0f);
+                frame.normal[index] = make_float4(n.x, n.y, n.z, 1.0f);
+
+                const float s = uniform(rng) < 0.001f ? 50.0f : noise(rng);
+                frame.noisy[index] = make_float4(c.x * s, c.y * s, c.z * s, 1.0f);
+            }
+        }
+        return frame;
+    }
+
+    // On c / (1 + c), close to what is displayed
+    double rmse(const std::vector<float4>& image, const std::vector<float4>& reference)
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < image.size(); ++i)
+        {
+            const float a[3] = { image[i].x, image[i].y, image[i].z };
+            const float b[3] = { reference[i].x, reference[i].y, reference[i].z };
+            for (int k = 0; k < 3; ++k)
+            {
+                const double d = a[k] / (1.0 + a[k]) - b[k] / (1.0 + b[k]);
+                sum += d * d;
+            }
+        }
+        return sqrt(sum / (3.0 * image.size()));
+    }
+}
+
+bool benchDenoiser(int width, int height)
+{
+    const Frame frame = syntheticFrame(width, height);
+    const double noisy_rmse = rmse(frame.noisy, frame.reference);
+    std::vector<float4> output(frame.noisy.size());
+    CpuDenoiser denoiser;
+
+    bool ok = true;
+    const char* const modes[3] = { "rgb", "rgb_albedo", "rgb_albedo_normal" };
+    const unsigned int hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int mode = 0; mode < 3; ++mode)
+    {
+        for (unsigned int threads = 1;; threads = hardware_threads)
+        {
+            CpuDenoiserSettings settings;
+            settings.use_albedo = mode > 0;
+            settings.use_normal = mode > 1;
+            settings.thread_count = threads;
+
+            const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            denoiser.denoise(settings, width, height, frame.noisy.data(), frame.albedo.data(), frame.normal.data(), output.data());
+            const double seconds = secondsSince(begin);
+
+            const double denoised_rmse = rmse(output, frame.reference);
+            const bool mode_ok = denoised_rmse < 0.5 * noisy_rmse;
+            ok &= mode_ok;
+
+            std::ostringstream line;
+            line << "[denoise] resolution: " << width << "x" << height
+                << "\tmode: " << modes[mode]
+                << "\tthreads: " << threads
+                << "\tms: " << seconds * 1.0e3
+                << "\tnoisy_rmse: " << noisy_rmse
+                << "\tdenoised_rmse: " << denoised_rmse
+                << (mode_ok ? "" : "\tFAILED");
+            std::cout << line.str() << std::endl;
+
+            if (threads == hardware_threads)
+                break;
+        }
+    }
+
+    std::cout << "[denoise] checks: " << (ok ? "ok" : "failed") << std::endl;
+    return ok;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+//
+// Time and quality of the CPU denoiser (cpu_denoiser.h) on a synthetic frame
+// with edges, an albedo texture and per-sample noise with fireflies: RMSE
+// against the noise free frame with the color alone, with albedo and with
+// albedo and normals, and the time on one and on all hardware threads. Run by
+// redflash_bench --denoise, returns false if the denoiser does not reduce the
+// error.
+//
+//-----------------------------------------------------------------------------
+
+bool benchDenoiser(int width, int height);
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+
+using namespace optix;
+
+//-----------------------------------------------------------------------------
+//
+// Reconstruction filters
+//
+// With a filter other than the box, every camera sample is splatted into the
+// pixels whose centers are within the filter radius of it, weighted by the
+// separable filter w(dx) * w(dy). A float4 per pixel keeps the weighted sum of
+// the radiance (xyz) and the sum of the weights (w), the pixel is their
+// ratio. The accumulator is cleared whenever the accumulation is reset, and
+// the ratio is resolved to liner_buffer after each launch.
+//
+// Pixel centers are at integer coordinates and samples lie within half a
+// pixel of the center of the pixel that traced them, so a filter of radius r
+// reaches filterExtent(r) pixels to each side. The splatting loops are
+// specialized on the extent at compile time, see splatFilterTaps.
+//
+// Radii are in pixels. The box filter of radius 0.5 keeps every sample in its
+// own pixel, which is the plain average redflash has always used.
+//
+// The functions below are shared by redflash.cu and the CPU accumulator in
+// splat_accumulator.h.
+//
+//-----------------------------------------------------------------------------
+
+enum FilterType
+{
+    FILTER_BOX,
+    FILTER_GAUSSIAN,
+    FILTER_MITCHELL,
+    FILTER_BLACKMAN_HARRIS,
+    FILTER_TYPE_COUNT
+};
+
+// Largest extent of a filter
+#define FILTER_MAX_EXTENT 3
+
+// Extent argument of splatFilterTaps for loops over the runtime extent
+#define FILTER_RUNTIME_EXTENT -1
+
+// Blackman-Harris falls off faster than the Gaussian, at 2 pixels its blur
+// outweighed the noise it removes at 16 spp (redflash_bench --filter_rmse)
+static __host__ __device__ __inline__ float defaultFilterRadius(int type)
+{
+    return type == FILTER_BOX ? 0.5f : (type == FILTER_MITCHELL ? 2.0f : 1.5f);
+}
+
+// Pixels reached to each side of the pixel of a sample
+static __host__ __device__ __inline__ int filterExtent(float radius)
+{
+    return max(static_cast<int>(ceilf(radius + 0.5f)) - 1, 0);
+}
+
+// One dimension of the separable filter at distance x from its center
+static __host__ __device__ __inline__ float filterWeight(int type, float x, float radius)
+{
+    const float ax = fabsf(x);
+    if (type == FILTER_BOX)
+        return ax <= radius ? 1.0f : 0.0f;
+    if (ax >= radius)
+        return 0.0f;
+
+    if (type == FILTER_GAUSSIAN)
+    {
+        // Shifted down to reach 0 at the radius, alpha 2 like pbrt
+        const float alpha = 2.0f;
+        return expf(-alpha * ax * ax) - expf(-alpha * radius * radius);
+    }
+
+    if (type == FILTER_MITCHELL)
+    {
+        // Mitchell-Netravali with B = C = 1/3 over [-2, 2], scaled to the radius
+        const float B = 1.0f / 3.0f;
+        const float C = 1.0f / 3.0f;
+        const float t = 2.0f * ax / radius;
+        if (t < 1.0f)
+            return ((12.0f - 9.0f * B - 6.0f * C) * t * t * t + (-18.0f + 12.0f * B + 6.0f * C) * t * t + (6.0f - 2.0f * B)) * (1.0f / 6.0f);
+        return ((-B - 6.0f * C) * t * t * t + (6.0f * B + 30.0f * C) * t * t + (-12.0f * B - 48.0f * C) * t + (8.0f * B + 24.0f * C)) * (1.0f / 6.0f);
+    }
+
+    // 4-term Blackman-Harris window over [-radius, radius]
+    const float t = 2.0f * M_PIf * (x + radius) / (2.0f * radius);
+    return 0.35875f - 0.48829f * cosf(t) + 0.14128f * cosf(2.0f * t) - 0.01168f * cosf(3.0f * t);
+}
+
+// Calls splat(dx, dy, weight) for the pixels (dx, dy) around the pixel of a
+// sample at offset jitter from its center. The loops run over Extent pixels to
+// each side, known at compile time, or over extent with FILTER_RUNTIME_EXTENT.
+template<int Extent, typename Splat>
+static __host__ __device__ __inline__ void splatFilterTaps(int type, float radius, int extent, const float2& jitter, Splat& splat)
+{
+    const int e = Extent >= 0 ? Extent : extent;
+    float wx[2 * FILTER_MAX_EXTENT + 1];
+    float wy[2 * FILTER_MAX_EXTENT + 1];
+    for (int i = -e; i <= e; ++i)
+    {
+        wx[i + e] = filterWeight(type, i - jitter.x, radius);
+        wy[i + e] = filterWeight(type, i - jitter.y, radius);
+    }
+
+    for (int dy = -e; dy <= e; ++dy)
+    {
+        for (int dx = -e; dx <= e; ++dx)
+        {
+            const float w = wx[dx + e] * wy[dy + e];
+            if (w != 0.0f)
+                splat(dx, dy, w);
+        }
+    }
+}
+
+// Pixel of an accumulator entry (xyz: weighted sum, w: weight sum). Negative
+// lobes may leave a small or negative weight, such pixels and negative values are 0.
+static __host__ __device__ __inline__ float3 resolveFilteredPixel(const float4& entry)
+{
+    if (!(entry.w > 1.e-6f))
+        return make_float3(0.0f);
+    return fmaxf(make_float3(entry.x, entry.y, entry.z) / entry.w, make_float3(0.0f));
+}
@@ -0,0 +1,210 @@
+#include "filter_bench.h"
+#include "bench_common.h"
+#include "image_metrics.h"
+#include "splat_accumulator.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+using namespace optix;
+
+namespace
+{
+    const int width = 192;
+    const int height = 128;
+    const int max_iterations = 128;
+
+    const char* const filter_names[FILTER_TYPE_COUNT] = { "box", "gaussian", "mitchell", "blackman_harris" };
+
+    struct Sample
+    {
+        int x;
+        int y;
+        float2 jitter;
+        float3 radiance;
+    };
+
+    // Dark set against a bright sky, over a window around the seahorse valley
+    float3 radiance(float px, float py)
+    {
+        const float cx = -0.88f + 0.18f * (px / width - 0.5f);
+        const float cy = 0.18f + 0.18f * (py / width - 0.5f * height / width);
+        float zx = 0.0f;
+        float zy = 0.0f;
+        for (int i = 0; i < max_iterations; ++i)
+        {
+            const float x2 = zx * zx;
+            const float y2 = zy * zy;
+            if (x2 + y2 > 4.0f)
+                return make_float3(0.9f, 0.95f, 1.0f) * (1.0f + 3.0f * py / height);
+            zy = 2.0f * zx * zy + cy;
+            zx = x2 - y2 + cx;
+        }
+        return make_float3(0.06f, 0.04f, 0.03f);
+    }
+
+    // spp samples of every pixel
+    std::vector<Sample> renderSamples(int spp, unsigned int seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> uniform(-0.5f, 0.5f);
+
+        std::vector<Sample> samples;
+        samples.reserve(static_cast<size_t>(width) * height * spp);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                for (int s = 0; s < spp; ++s)
+                {
+                    Sample sample;
+                    sample.x = x;
+                    sample.y = y;
+                    sample.jitter = make_float2(uniform(rng), uniform(rng));
+                    sample.radiance = radiance(x + sample.jitter.x, y + sample.jitter.y);
+                    samples.push_back(sample);
+                }
+            }
+        }
+        return samples;
+    }
+
+    std::vector<float> resolveSamples(FilterType type, const std::vector<Sample>& samples)
+    {
+        SplatAccumulator accumulator(width, height, type, defaultFilterRadius(type));
+        for (size_t i = 0; i < samples.size(); ++i)
+            accumulator.addSample(samples[i].x, samples[i].y, samples[i].jitter, samples[i].radiance);
+        std::vector<float> image;
+        accumulator.resolve(image);
+        return image;
+    }
+
+    // The box filter is the plain mean of the samples of a pixel
+    bool checkBoxMean(const std::vector<Sample>& samples, const std::vector<float>& box)
+    {
+        std::vector<double> sums(box.size(), 0.0);
+        std::vector<int> counts(box.size() / 3, 0);
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            const size_t p = static_cast<size_t>(samples[i].y) * width + samples[i].x;
+            sums[p * 3 + 0] += samples[i].radiance.x;
+            sums[p * 3 + 1] += samples[i].radiance.y;
+            sums[p * 3 + 2] += samples[i].radiance.z;
+            ++counts[p];
+        }
+        for (size_t i = 0; i < box.size(); ++i)
+        {
+            const double mean = sums[i] / counts[i / 3];
+            if (fabs(box[i] - mean) > 1.0e-5 * (1.0 + mean))
+                return false;
+        }
+        return true;
+    }
+
+    // A constant image stays constant under every filter, also at the borders
+    bool checkConstant(FilterType type)
+    {
+        std::mt19937 rng(4);
+        std::uniform_real_distribution<float> uniform(-0.5f, 0.5f);
+        SplatAccumulator accumulator(width, height, type, defaultFilterRadius(type));
+        const float3 value = make_float3(0.25f, 0.5f, 2.0f);
+        for (int s = 0; s < 16; ++s)
+        {
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                    accumulator.addSample(x, y, make_float2(uniform(rng), uniform(rng)), value);
+            }
+        }
+
+        std::vector<float> image;
+        accumulator.resolve(image);
+        for (size_t i = 0; i < image.size(); i += 3)
+        {
+            if (fabsf(image[i] - value.x) > 1.0e-4f || fabsf(image[i + 1] - value.y) > 1.0e-4f || fabsf(image[i + 2] - value.z) > 2.0e-4f)
+                return false;
+        }
+        return true;
+    }
+}
+
+bool benchFilter(int reference_spp)
+{
+    bool ok = true;
+
+    const std::vector<Sample> reference_samples = renderSamples(reference_spp, 1);
+    std::vector<float> references[FILTER_TYPE_COUNT];
+    for (int f = 0; f < FILTER_TYPE_COUNT; ++f)
+    {
+        references[f] = resolveSamples(static_cast<FilterType>(f), reference_samples);
+        const bool constant_ok = checkConstant(static_cast<FilterType>(f));
+        ok &= constant_ok;
+
+        std::ostringstream line;
+        line << "[filter] filter: " << filter_names[f]
+            << "\tradius: " << defaultFilterRadius(f)
+            << "\textent: " << filterExtent(defaultFilterRadius(f))
+            << "\treference_spp: " << reference_spp
+            << "\tblur_rmse: " << imageRMSE(references[f], references[FILTER_BOX])
+            << (constant_ok ? "" : "\tFAILED");
+        std::cout << line.str() << std::endl;
+    }
+    ok &= checkBoxMean(reference_samples, references[FILTER_BOX]);
+
+    for (int spp = 1; spp <= 16; spp *= 4)
+    {
+        const std::vector<Sample> samples = renderSamples(spp, 2 + spp);
+        double box_rmse = 0.0;
+        for (int f = 0; f < FILTER_TYPE_COUNT; ++f)
+        {
+            const FilterType type = static_cast<FilterType>(f);
+            SplatAccumulator accumulator(width, height, type, defaultFilterRadius(type));
+
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < samples.size(); ++i)
+                accumulator.addSample(samples[i].x, samples[i].y, samples[i].jitter, samples[i].radiance);
+            const double specialized_time = secondsSince(begin);
+            std::vector<float> image;
+            accumulator.resolve(image);
+
+            accumulator.clear();
+            begin = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < samples.size(); ++i)
+                accumulator.addSampleGeneric(samples[i].x, samples[i].y, samples[i].jitter, samples[i].radiance);
+            const double generic_time = secondsSince(begin);
+            std::vector<float> generic_image;
+            accumulator.resolve(generic_image);
+
+            // The noise is measured against the filter's own converged image, the
+            // error against the box one also includes the blur of the filter
+            const double noise_rmse = imageRMSE(image, references[f]);
+            const double rmse = imageRMSE(image, references[FILTER_BOX]);
+            if (type == FILTER_BOX)
+                box_rmse = rmse;
+
+            // Both loops must splat the same, and the smooth positive filters must be closer to the
+            // box reference than the box, including their blur
+            bool filter_ok = generic_image == image;
+            if (type == FILTER_GAUSSIAN || type == FILTER_BLACKMAN_HARRIS)
+                filter_ok &= rmse < box_rmse;
+            ok &= filter_ok;
+
+            std::ostringstream line;
+            line << "[filter] filter: " << filter_names[f]
+                << "\tspp: " << spp
+                << "\trmse: " << rmse
+                << "\tnoise_rmse: " << noise_rmse
+                << "\tmsplats_per_sec: " << samples.size() / specialized_time * 1.0e-6
+                << "\tgeneric_msplats_per_sec: " << samples.size() / generic_time * 1.0e-6
+                << (filter_ok ? "" : "\tFAILED");
+            std::cout << line.str() << std::endl;
+        }
+    }
+
+    std::cout << "[filter] checks: " << (ok ? "ok" : "failed") << std::endl;
+    return ok;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+//
+// Reconstruction filters of the CPU splatting accumulator (splat_accumulator.h)
+// on the silhouette of the Mandelbrot set, a fractal edge like the mandelbox
+// against the sky. Each filter is compared at 1, 4 and 16 samples per pixel
+// with the converged box filter (rmse, including the blur of the filter) and
+// with its own converged image (noise_rmse), and the splatting rate with the
+// extent known at compile time is compared with the runtime loops. Run by
+// redflash_bench --filter_rmse, returns false if a check failed.
+//
+//-----------------------------------------------------------------------------
+
+bool benchFilter(int reference_spp);
@@ -0,0 +1,105 @@
+#include "image_metrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const int radius = 5;
+
+    std::vector<double> mappedLuminance(const std::vector<float>& image)
+    {
+        std::vector<double> luminance(image.size() / 3);
+        for (size_t i = 0; i < luminance.size(); ++i)
+        {
+            const double c[3] = { image[i * 3 + 0], image[i * 3 + 1], image[i * 3 + 2] };
+            luminance[i] = 0.3 * c[0] / (1.0 + c[0]) + 0.6 * c[1] / (1.0 + c[1]) + 0.1 * c[2] / (1.0 + c[2]);
+        }
+        return luminance;
+    }
+
+    // Separable Gaussian blur, clamped to the edges
+    std::vector<double> blur(const std::vector<double>& image, int width, int height, const double* weights)
+    {
+        std::vector<double> rows(image.size());
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                double sum = 0.0;
+                for (int k = -radius; k <= radius; ++k)
+                    sum += weights[k + radius] * image[static_cast<size_t>(y) * width + std::min(std::max(x + k, 0), width - 1)];
+                rows[static_cast<size_t>(y) * width + x] = sum;
+            }
+        }
+
+        std::vector<double> result(image.size());
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                double sum = 0.0;
+                for (int k = -radius; k <= radius; ++k)
+                    sum += weights[k + radius] * rows[static_cast<size_t>(std::min(std::max(y + k, 0), height - 1)) * width + x];
+                result[static_cast<size_t>(y) * width + x] = sum;
+            }
+        }
+        return result;
+    }
+}
+
+double imageRMSE(const std::vector<float>& a, const std::vector<float>& b)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        double d = static_cast<double>(a[i]) - static_cast<double>(b[i]);
+        sum += d * d;
+    }
+    return std::sqrt(sum / std::max<size_t>(a.size(), 1));
+}
+
+double imageSSIM(const std::vector<float>& a, const std::vector<float>& b, int width, int height)
+{
+    double weights[2 * radius + 1];
+    double weight_sum = 0.0;
+    for (int k = -radius; k <= radius; ++k)
+    {
+        weights[k + radius] = std::exp(-k * k / (2.0 * 1.5 * 1.5));
+        weight_sum += weights[k + radius];
+    }
+    for (int k = 0; k <= 2 * radius; ++k)
+        weights[k] /= weight_sum;
+
+    const std::vector<double> la = mappedLuminance(a);
+    const std::vector<double> lb = mappedLuminance(b);
+    std::vector<double> aa(la.size());
+    std::vector<double> bb(la.size());
+    std::vector<double> ab(la.size());
+    for (size_t i = 0; i < la.size(); ++i)
+    {
+        aa[i] = la[i] * la[i];
+        bb[i] = lb[i] * lb[i];
+        ab[i] = la[i] * lb[i];
+    }
+
+    const std::vector<double> mean_a = blur(la, width, height, weights);
+    const std::vector<double> mean_b = blur(lb, width, height, weights);
+    const std::vector<double> mean_aa = blur(aa, width, height, weights);
+    const std::vector<double> mean_bb = blur(bb, width, height, weights);
+    const std::vector<double> mean_ab = blur(ab, width, height, weights);
+
+    // Constants for a dynamic range of 1
+    const double c1 = 0.01 * 0.01;
+    const double c2 = 0.03 * 0.03;
+    double sum = 0.0;
+    for (size_t i = 0; i < la.size(); ++i)
+    {
+        const double var_a = mean_aa[i] - mean_a[i] * mean_a[i];
+        const double var_b = mean_bb[i] - mean_b[i] * mean_b[i];
+        const double cov = mean_ab[i] - mean_a[i] * mean_b[i];
+        sum += ((2.0 * mean_a[i] * mean_b[i] + c1) * (2.0 * cov + c2))
+            / ((mean_a[i] * mean_a[i] + mean_b[i] * mean_b[i] + c1) * (var_a + var_b + c2));
+    }
+    return sum / std::max<size_t>(la.size(), 1);
+}
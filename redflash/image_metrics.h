@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// Image quality metrics of redflash_bench. Images are interleaved linear RGB,
+// as returned by readLinearImage.
+//
+// imageSSIM is the mean structural similarity (Wang et al. 2004, 11x11
+// Gaussian window with sigma 1.5) of the luminance of c / (1 + c), which maps
+// the HDR values to [0, 1) the way a tonemapper would, so that fireflies do
+// not dominate the result. 1 for identical images.
+//
+//-----------------------------------------------------------------------------
+
+double imageRMSE(const std::vector<float>& a, const std::vector<float>& b);
+double imageSSIM(const std::vector<float>& a, const std::vector<float>& b, int width, int height);
@@ -0,0 +1,94 @@
+#include "image_writer.h"
+#include "postprocess.h"
+
+#include <chrono>
+#include <utility>
+#include <iostream>
+#include <sutil.h>
+
+AsyncImageWriter::AsyncImageWriter(size_t max_pending)
+    : m_max_pending(max_pending > 0 ? max_pending : 1)
+    , m_busy(false)
+    , m_stop(false)
+{
+    m_thread = std::thread(&AsyncImageWriter::run, this);
+}
+
+AsyncImageWriter::~AsyncImageWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_changed.notify_all();
+    m_thread.join();
+}
+
+double AsyncImageWriter::write(const std::string& filename, int width, int height, std::vector<float4>& pixels)
+{
+    const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_changed.wait(lock, [this]() { return m_queue.size() < m_max_pending; });
+    const double waited = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    Image image;
+    image.filename = filename;
+    image.width = width;
+    image.height = height;
+    image.pixels.swap(pixels);
+    m_queue.push_back(std::move(image));
+    lock.unlock();
+
+    m_changed.notify_all();
+    return waited;
+}
+
+void AsyncImageWriter::finish()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_changed.wait(lock, [this]() { return m_queue.empty() && !m_busy; });
+}
+
+void AsyncImageWriter::run()
+{
+    // The buffers hold display values, they are only quantized (with a dither)
+    PostprocessSettings settings;
+    settings.curve = TONE_CURVE_NONE;
+    settings.encoding = OUTPUT_ENCODING_LINEAR;
+
+    std::vector<unsigned char> rgb;
+    for (;;)
+    {
+        Image image;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_changed.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+                return;
+
+            image = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_busy = true;
+        }
+        m_changed.notify_all();
+
+        const double begin = sutil::currentTime();
+        rgb.resize(static_cast<size_t>(image.width) * image.height * 3);
+        postprocessImage8(settings, image.width, image.height, image.pixels.data(), rgb.data());
+        try
+        {
+            sutil::writePNG(image.filename.c_str(), rgb.data(), image.width, image.height, 3);
+            std::cout << "[info] save_png: " << image.filename << "\t" << (sutil::currentTime() - begin) << " sec." << std::endl;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Failed to write " << image.filename << ": " << e.what() << std::endl;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy = false;
+        }
+        m_changed.notify_all();
+    }
+}
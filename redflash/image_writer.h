@@ -0,0 +1,57 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// Asynchronous PNG writer
+//
+// Quantizes (postprocessImage8) and compresses (sutil::writePNG) images on a
+// background thread, so that redflash --animation renders the next frame
+// while the previous one is written. At most max_pending images wait in the
+// queue, write blocks beyond that so a slow disk can not pile up frames.
+//
+//-----------------------------------------------------------------------------
+
+class AsyncImageWriter
+{
+public:
+    explicit AsyncImageWriter(size_t max_pending = 2);
+
+    // Writes the queued images
+    ~AsyncImageWriter();
+
+    // pixels are width * height display values, bottom row first like the
+    // OptiX buffers, and are moved from. Returns the seconds spent waiting for
+    // room in the queue.
+    double write(const std::string& filename, int width, int height, std::vector<float4>& pixels);
+
+    // Blocks until every queued image is written
+    void finish();
+
+private:
+    struct Image
+    {
+        std::string filename;
+        int width;
+        int height;
+        std::vector<float4> pixels;
+    };
+
+    void run();
+
+    size_t m_max_pending;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<Image> m_queue;
+    bool m_busy;
+    bool m_stop;
+    std::thread m_thread;
+};
@@ -0,0 +1,43 @@
+#include <optix_world.h>
+#include "light_sample.h"
+
+using namespace optix;
+
+rtDeclareVariable(float3, geometric_normal, attribute geometric_normal, );
+rtDeclareVariable(float3, shading_normal, attribute shading_normal, );
+
+rtDeclareVariable(optix::Ray, ray, rtCurrentRay, );
+
+// Light of the hit emitter, see hitLightId in redflash.cu
+rtDeclareVariable(int, emitter_light_id, attribute emitter_light_id, );
+
+// Quad and triangle lights of the scene, primitive i is light emitter_light_offset + i
+rtBuffer<LightParameter> emitter_lights;
+rtDeclareVariable(int, emitter_light_offset, , );
+
+RT_PROGRAM void emitter_intersect(int primIdx)
+{
+    const LightParameter light = emitter_lights[primIdx];
+
+    float t;
+    if (intersectLight(light, ray.origin, ray.direction, ray.tmin, ray.tmax, t) && rtPotentialIntersection(t))
+    {
+        shading_normal = geometric_normal = light.normal;
+        emitter_light_id = emitter_light_offset + primIdx;
+        rtReportIntersection(0);
+    }
+}
+
+
+RT_PROGRAM void bounds(int primIdx, float result[6])
+{
+    const LightParameter light = emitter_lights[primIdx];
+    const float3 p0 = light.position;
+    const float3 p1 = light.position + light.u;
+    const float3 p2 = light.position + light.v;
+    const float3 p3 = light.lightType == QUAD ? p1 + light.v : p0;
+
+    optix::Aabb* aabb = (optix::Aabb*)result;
+    aabb->m_min = fminf(fminf(p0, p1), fminf(p2, p3));
+    aabb->m_max = fmaxf(fmaxf(p0, p1), fmaxf(p2, p3));
+}
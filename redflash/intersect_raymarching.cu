@@ -1,4 +1,5 @@
 #include <optixu/optixu_math_namespace.h>
+#include "motion.h"
 #include "redflash.h"
 #include "random.h"
 #include <optix_world.h>
@@ -16,6 +17,16 @@ rtDeclareVariable(float3, aabb_min, , );
 rtDeclareVariable(float3, aabb_max, , );
 rtDeclareVariable(float3, texcoord, attribute texcoord, );
 
+// Offsets of center at center_motion_steps keys (see motion.h), empty if static
+rtBuffer<float3> center_motion;
+rtDeclareVariable(int, center_motion_steps, , ) = 1;
+rtDeclareVariable(float, current_time, rtCurrentTime, );
+
+#if REDFLASH_PROFILE
+rtDeclareVariable(uint2, launch_index, rtLaunchIndex, );
+rtBuffer<uint4, 2> profile_buffer;
+#endif
+
 RT_FUNCTION float dMenger(float3 z0, float3 offset, float scale) {
     float4 z = make_float4(z0, 1.0);
     for (int n = 0; n < 4; n++) {
@@ -116,13 +127,20 @@ float3 calcNormalBasic(float3 p, float eps)
 
 RT_PROGRAM void intersect(int primIdx)
 {
+    // A moving object is marched at its place at the ray time by moving the ray
+    // the other way, distances and normals do not change
+    const float3 origin = center_motion_steps > 1
+        ? ray.origin - motionLerp(&center_motion[0], center_motion_steps, current_time)
+        : ray.origin;
+
     float eps;
     float t = ray.tmin, d = 0.0;
-    float3 p = ray.origin;
+    float3 p = origin;
+    int i;
 
-    for (int i = 0; i < 300; i++)
+    for (i = 0; i < 300; i++)
     {
-        p = ray.origin + t * ray.direction;
+        p = origin + t * ray.direction;
         d = map(p);
         t += d;
         eps = scene_epsilon * t;
@@ -132,6 +150,8 @@ RT_PROGRAM void intersect(int primIdx)
         }
     }
 
+    PROFILE_COUNT(PROFILE_RAYMARCH_STEPS, min(i + 1, 300));
+
     if (t < ray.tmax && rtPotentialIntersection(t))
     {
         shading_normal = geometric_normal = calcNormal(p, map, scene_epsilon);
@@ -145,4 +165,12 @@ RT_PROGRAM void bounds(int, float result[6])
     optix::Aabb* aabb = (optix::Aabb*)result;
     aabb->m_min = aabb_min;
     aabb->m_max = aabb_max;
-}
\ No newline at end of file
+}
+
+// Bounds at a motion key, for Geometries with motion steps
+RT_PROGRAM void bounds_motion(int, int motionIdx, float result[6])
+{
+    optix::Aabb* aabb = (optix::Aabb*)result;
+    aabb->m_min = aabb_min + center_motion[motionIdx];
+    aabb->m_max = aabb_max + center_motion[motionIdx];
+}
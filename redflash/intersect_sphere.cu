@@ -1,4 +1,6 @@
 #include <optix_world.h>
+#include "motion.h"
+#include "sphere.h"
 
 using namespace optix;
 
@@ -10,15 +12,27 @@ rtDeclareVariable(float3, front_hit_point, attribute front_hit_point, );
 
 rtDeclareVariable(optix::Ray, ray, rtCurrentRay, );
 
-rtDeclareVariable(float3, center, , );
-rtDeclareVariable(float, radius, , );
-rtDeclareVariable(float3, aabb_min, , );
-rtDeclareVariable(float3, aabb_max, , );
+// Material of the hit sphere, see hitMaterialId in redflash.cu
+rtDeclareVariable(int, sphere_material_id, attribute sphere_material_id, );
+rtDeclareVariable(int, sphere_light_id, attribute sphere_light_id, );
+
+rtBuffer<SphereRecord> sphere_records;
+
+// Centers of moving spheres at sphere_motion_steps keys each (see motion.h), empty if static
+rtBuffer<float3> sphere_motion_centers;
+rtDeclareVariable(int, sphere_motion_steps, , ) = 1;
+rtDeclareVariable(float, current_time, rtCurrentTime, );
 
 template<bool use_robust_method>
 static __device__
-void intersect_sphere(void)
+void intersect_sphere(int primIdx)
 {
+    const SphereRecord sphere = sphere_records[primIdx];
+    const float3 center = sphere_motion_steps > 1
+        ? motionLerp(&sphere_motion_centers[primIdx * sphere_motion_steps], sphere_motion_steps, current_time)
+        : sphere.center;
+    const float radius = sphere.radius;
+
     float3 O = ray.origin - center;
     float3 D = ray.direction;
 
@@ -56,7 +70,9 @@ void intersect_sphere(void)
             float t = root1 + root11;
             front_hit_point = ray.origin + t * ray.direction;
             back_hit_point = ray.origin + t * ray.direction;
-            if (rtReportIntersection(0))
+            sphere_material_id = sphere.material_id;
+            sphere_light_id = sphere.light_id;
+            if (rtReportIntersection(sphere.material_index))
                 check_second = false;
         }
         if (check_second) {
@@ -66,7 +82,9 @@ void intersect_sphere(void)
                 float t = root2;
                 front_hit_point = ray.origin + t * ray.direction;
                 back_hit_point = ray.origin + t * ray.direction;
-                rtReportIntersection(0);
+                sphere_material_id = sphere.material_id;
+                sphere_light_id = sphere.light_id;
+                rtReportIntersection(sphere.material_index);
             }
         }
     }
@@ -75,19 +93,30 @@ void intersect_sphere(void)
 
 RT_PROGRAM void sphere_intersect(int primIdx)
 {
-    intersect_sphere<false>();
+    intersect_sphere<false>(primIdx);
 }
 
 
 RT_PROGRAM void sphere_intersect_robust(int primIdx)
 {
-    intersect_sphere<true>();
+    intersect_sphere<true>(primIdx);
 }
 
 
-RT_PROGRAM void bounds(int, float result[6])
+RT_PROGRAM void bounds(int primIdx, float result[6])
+{
+    const SphereRecord sphere = sphere_records[primIdx];
+    optix::Aabb* aabb = (optix::Aabb*)result;
+    aabb->m_min = sphere.center - sphere.radius;
+    aabb->m_max = sphere.center + sphere.radius;
+}
+
+// Bounds at a motion key, for Geometries with motion steps
+RT_PROGRAM void bounds_motion(int primIdx, int motionIdx, float result[6])
 {
+    const SphereRecord sphere = sphere_records[primIdx];
+    const float3 center = sphere_motion_centers[primIdx * sphere_motion_steps + motionIdx];
     optix::Aabb* aabb = (optix::Aabb*)result;
-    aabb->m_min = aabb_min;
-    aabb->m_max = aabb_max;
+    aabb->m_min = center - sphere.radius;
+    aabb->m_max = center + sphere.radius;
 }
@@ -0,0 +1,268 @@
+#include "light_bench.h"
+#include "bench_common.h"
+#include "light_sample.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+using namespace optix;
+
+namespace
+{
+    struct TestLight
+    {
+        std::string name;
+        LightParameter light;
+    };
+
+    LightParameter sphereLight(const float3& center, float radius)
+    {
+        LightParameter light;
+        light.lightType = SPHERE;
+        light.position = center;
+        light.radius = radius;
+        light.area = 4.0f * M_PIf * radius * radius;
+        light.normal = make_float3(0.0f);
+        light.u = light.v = make_float3(0.0f);
+        light.emission = make_float3(1.0f);
+        return light;
+    }
+
+    LightParameter planarLight(LightType type, const float3& position, const float3& u, const float3& v)
+    {
+        LightParameter light;
+        light.lightType = type;
+        light.position = position;
+        light.u = u;
+        light.v = v;
+        light.radius = 0.0f;
+        light.emission = make_float3(1.0f);
+        setupPlanarLight(light);
+        return light;
+    }
+
+    float3 uniformSphere(float u1, float u2)
+    {
+        const float z = 1.0f - 2.0f * u1;
+        const float r = sqrtf(fmaxf(0.0f, 1.0f - z * z));
+        const float phi = 2.0f * M_PIf * u2;
+        return make_float3(r * cosf(phi), r * sinf(phi), z);
+    }
+
+    // Uniform direction in the cone around w with 1 - cos(half angle) = oneMinusCos
+    float3 uniformCone(const float3& w, float oneMinusCos, float u1, float u2)
+    {
+        const float cosTheta = 1.0f - u1 * oneMinusCos;
+        const float sinTheta = sqrtf(fmaxf(0.0f, 1.0f - cosTheta * cosTheta));
+        const float phi = 2.0f * M_PIf * u2;
+        float3 direction = make_float3(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+        optix::Onb onb(w);
+        onb.inverse_transform(direction);
+        return direction;
+    }
+
+    // Cone from origin around 1.5 times the bounding sphere of the light, so
+    // small and distant lights are integrated with few samples
+    float boundingCone(const LightParameter& light, const float3& origin, float3& w)
+    {
+        float3 center = light.position;
+        float radius = light.radius;
+        if (light.lightType != SPHERE)
+        {
+            center = light.position + 0.5f * (light.u + light.v);
+            radius = 0.5f * fmaxf(length(light.u + light.v), length(light.u - light.v));
+            if (light.lightType == TRIANGLE)
+                radius = fmaxf(radius, length(light.position - center));
+        }
+        radius *= 1.5f;
+
+        w = center - origin;
+        const float dist2 = dot(w, w);
+        if (dist2 <= radius * radius)
+            return 2.0f;
+        w /= sqrtf(dist2);
+        const float sinThetaMax2 = radius * radius / dist2;
+        return sinThetaMax2 / (1.0f + sqrtf(1.0f - sinThetaMax2));
+    }
+
+    struct Estimate
+    {
+        double sum = 0.0;
+        double sum2 = 0.0;
+
+        void add(double x)
+        {
+            sum += x;
+            sum2 += x * x;
+        }
+
+        double mean(int n) const { return sum / n; }
+        double variance(int n) const { return fmax(0.0, sum2 / n - mean(n) * mean(n)); }
+    };
+
+    // Integral of lightPdf over uniformly sampled directions around the light, and agreement of
+    // the pdf and the point of sampleLight with lightPdf and intersectLight
+    bool checkPdf(const TestLight& test, const float3& origin, int sample_count, std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        const LightParameter& light = test.light;
+
+        float3 w;
+        const float oneMinusCos = boundingCone(light, origin, w);
+        const double cone_solid_angle = 2.0 * M_PI * oneMinusCos;
+
+        Estimate integral;
+        for (int i = 0; i < sample_count; ++i)
+        {
+            const float u1 = uniform(rng);
+            const float u2 = uniform(rng);
+            const float3 direction = oneMinusCos < 2.0f ? uniformCone(w, oneMinusCos, u1, u2) : uniformSphere(u1, u2);
+            float t;
+            double value = 0.0;
+            if (intersectLight(light, origin, direction, 0.0f, 1.e30f, t) && lightEmits(light, direction))
+                value = lightPdf(light, origin, direction, t) * cone_solid_angle;
+            integral.add(value);
+        }
+        const double mean = integral.mean(sample_count);
+        const double error = sqrt(integral.variance(sample_count) / sample_count);
+
+        int mismatches = 0;
+        int rejected = 0;
+        for (int i = 0; i < sample_count; ++i)
+        {
+            LightSample sample;
+            if (!sampleLight(light, origin, uniform(rng), uniform(rng), sample))
+            {
+                ++rejected;
+                continue;
+            }
+
+            float3 direction = sample.surfacePos - origin;
+            const float dist = length(direction);
+            direction /= dist;
+
+            float t;
+            const bool hit = intersectLight(light, origin, direction, 0.0f, 1.e30f, t);
+            const float pdf = lightPdf(light, origin, direction, hit ? t : dist);
+            if (fabsf(pdf - sample.pdf) > 1.e-3f * sample.pdf || (hit && fabsf(t - dist) > 1.e-3f * dist) || dot(direction, sample.normal) >= 0.0f)
+                ++mismatches;
+        }
+
+        // Within 4 standard errors of one, and grazing samples may be off by rounding
+        const bool ok = fabs(mean - 1.0) < 4.0 * error + 1.e-3 && mismatches <= sample_count / 10000 && rejected == 0;
+
+        std::ostringstream line;
+        line << "[lights] light: " << test.name
+            << "\tpdf_integral: " << mean
+            << "\tstd_error: " << error
+            << "\tsample_mismatches: " << mismatches
+            << "\trejected: " << rejected
+            << (ok ? "" : "\tFAILED");
+        std::cout << line.str() << std::endl;
+        return ok;
+    }
+
+    // Irradiance at the origin, with the normal towards the light center, from a
+    // sphere light with unit radiance: pi sin^2(theta_max)
+    bool compareSphereVariance(float distance, int sample_count, std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        const float3 origin = make_float3(0.0f);
+        const float3 normal = make_float3(0.0f, 0.0f, 1.0f);
+        const LightParameter light = sphereLight(make_float3(0.0f, 0.0f, distance), 1.0f);
+        const double expected = M_PI / (distance * distance);
+
+        // Former sampling: uniform over the area of the whole sphere, back facing samples are wasted
+        Estimate uniform_estimate;
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < sample_count; ++i)
+        {
+            const float3 n = uniformSphere(uniform(rng), uniform(rng));
+            const float3 p = light.position + n * light.radius;
+            float3 wi = p - origin;
+            const float dist2 = dot(wi, wi);
+            wi /= sqrtf(dist2);
+            const float cosLight = -dot(wi, n);
+            const float cosSurface = dot(wi, normal);
+            double value = 0.0;
+            if (cosLight > 0.0f && cosSurface > 0.0f)
+                value = cosSurface * cosLight * light.area / dist2;
+            uniform_estimate.add(value);
+        }
+        const double uniform_time = secondsSince(begin);
+
+        Estimate cone_estimate;
+        begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < sample_count; ++i)
+        {
+            LightSample sample;
+            double value = 0.0;
+            if (sampleLight(light, origin, uniform(rng), uniform(rng), sample))
+            {
+                const float3 wi = normalize(sample.surfacePos - origin);
+                value = fmaxf(0.0f, dot(wi, normal)) / sample.pdf;
+            }
+            cone_estimate.add(value);
+        }
+        const double cone_time = secondsSince(begin);
+
+        const double uniform_mean = uniform_estimate.mean(sample_count);
+        const double cone_mean = cone_estimate.mean(sample_count);
+        const double uniform_error = sqrt(uniform_estimate.variance(sample_count) / sample_count);
+        const double cone_error = sqrt(cone_estimate.variance(sample_count) / sample_count);
+        const bool ok = fabs(uniform_mean - expected) < 4.0 * uniform_error + 1.e-4 * expected
+            && fabs(cone_mean - expected) < 4.0 * cone_error + 1.e-4 * expected
+            && cone_estimate.variance(sample_count) < uniform_estimate.variance(sample_count);
+
+        std::ostringstream line;
+        line << "[lights] sphere_distance: " << distance
+            << "\texpected: " << expected
+            << "\tuniform_mean: " << uniform_mean
+            << "\tcone_mean: " << cone_mean
+            << "\tuniform_variance: " << uniform_estimate.variance(sample_count) / (expected * expected)
+            << "\tcone_variance: " << cone_estimate.variance(sample_count) / (expected * expected)
+            << "\tvariance_reduction: " << uniform_estimate.variance(sample_count) / fmax(cone_estimate.variance(sample_count), 1.e-30)
+            << "\tuniform_msamples_per_sec: " << sample_count / uniform_time * 1.0e-6
+            << "\tcone_msamples_per_sec: " << sample_count / cone_time * 1.0e-6
+            << (ok ? "" : "\tFAILED");
+        std::cout << line.str() << std::endl;
+        return ok;
+    }
+}
+
+bool benchLights(int sample_count)
+{
+    std::mt19937 rng(1);
+    const float3 origin = make_float3(0.3f, -0.2f, 0.1f);
+
+    TestLight lights[] = {
+        { "sphere_near", sphereLight(make_float3(0.5f, 0.4f, 2.0f), 1.5f) },
+        { "sphere_far", sphereLight(make_float3(-20.0f, 30.0f, 50.0f), 0.5f) },
+        { "quad", planarLight(QUAD, make_float3(-1.0f, 2.0f, -1.0f), make_float3(2.0f, 0.0f, 0.0f), make_float3(0.0f, 0.5f, 3.0f)) },
+        { "triangle", planarLight(TRIANGLE, make_float3(1.0f, 1.0f, -1.0f), make_float3(0.0f, 0.0f, 2.0f), make_float3(-2.0f, 1.0f, 0.0f)) },
+    };
+
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(lights) / sizeof(lights[0]); ++i)
+    {
+        // The pdf checks need the emitting side of the planar lights
+        if (lights[i].light.lightType != SPHERE && dot(lights[i].light.position - origin, lights[i].light.normal) > 0.0f)
+        {
+            lights[i].light.u = -lights[i].light.u;
+            lights[i].light.position = lights[i].light.position - lights[i].light.u;
+            setupPlanarLight(lights[i].light);
+        }
+        ok &= checkPdf(lights[i], origin, sample_count, rng);
+    }
+
+    const float distances[] = { 1.1f, 2.0f, 10.0f, 100.0f };
+    for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); ++i)
+        ok &= compareSphereVariance(distances[i], sample_count, rng);
+
+    std::cout << "[lights] checks: " << (ok ? "ok" : "failed") << std::endl;
+    return ok;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+//
+// CPU checks of the light sampling in light_sample.h: the solid angle pdfs of
+// sphere, quad and triangle lights must integrate to one over the directions
+// that hit the light and match the pdf returned with the samples. Also compares
+// the variance of the irradiance from a sphere light between the visible cap
+// sampling and the former uniform sampling of the whole sphere. Run by
+// redflash_bench --lights, returns false if a check failed.
+//
+//-----------------------------------------------------------------------------
+
+bool benchLights(int sample_count);
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include "redflash.h"
+
+//-----------------------------------------------------------------------------
+//
+// Light sampling
+//
+// sampleLight picks a point on a light as seen from a shading point and
+// returns the pdf of its direction in solid angle, lightPdf is the same pdf
+// for a direction found by BSDF sampling. Both dispatch on LightType with a
+// switch, so every light type is inlined into the closest hit programs.
+//
+//   SPHERE    uniform over the cone of directions to the sphere, so every
+//             sample lands on the visible cap
+//   QUAD      uniform over the area of position + [0,1]u + [0,1]v
+//   TRIANGLE  uniform over the area of position, position + u, position + v,
+//             triangle meshes are emitted as one light per triangle
+//
+// Quads and triangles emit on the side of their normal only. Everything is
+// __host__ __device__, redflash_bench --lights checks the pdfs on the CPU.
+//
+//-----------------------------------------------------------------------------
+
+// 1 - cos(theta_max) of the cone of directions from origin to a sphere light,
+// 0 if origin is inside the sphere
+static __host__ __device__ __inline__ float sphereLightCone(const LightParameter& light, const float3& origin, float3& w)
+{
+    w = light.position - origin;
+    const float dist2 = dot(w, w);
+    const float radius2 = light.radius * light.radius;
+    if (dist2 <= radius2)
+        return 0.0f;
+
+    w /= sqrtf(dist2);
+    const float sinThetaMax2 = radius2 / dist2;
+    const float cosThetaMax = sqrtf(1.0f - sinThetaMax2);
+
+    // Avoids the cancellation of 1 - cosThetaMax for small or distant lights
+    return sinThetaMax2 / (1.0f + cosThetaMax);
+}
+
+// Nearest intersection of a ray with a light in (tmin, tmax)
+static __host__ __device__ __inline__ bool intersectLight(const LightParameter& light, const float3& origin, const float3& direction, float tmin, float tmax, float& t)
+{
+    if (light.lightType == SPHERE)
+    {
+        const float3 O = origin - light.position;
+        const float b = dot(O, direction);
+        const float c = dot(O, O) - light.radius * light.radius;
+        const float disc = b * b - c;
+        if (disc <= 0.0f)
+            return false;
+
+        const float sdisc = sqrtf(disc);
+        t = -b - sdisc;
+        if (t > tmin && t < tmax)
+            return true;
+        t = -b + sdisc;
+        return t > tmin && t < tmax;
+    }
+
+    // Moeller-Trumbore on the parallelogram or triangle spanned by u and v
+    const float3 p = cross(direction, light.v);
+    const float det = dot(light.u, p);
+    if (fabsf(det) < 1.e-12f)
+        return false;
+
+    const float invDet = 1.0f / det;
+    const float3 s = origin - light.position;
+    const float a = dot(s, p) * invDet;
+    const float3 q = cross(s, light.u);
+    const float b = dot(direction, q) * invDet;
+    if (a < 0.0f || b < 0.0f)
+        return false;
+    if (light.lightType == QUAD ? (a > 1.0f || b > 1.0f) : (a + b > 1.0f))
+        return false;
+
+    t = dot(light.v, q) * invDet;
+    return t > tmin && t < tmax;
+}
+
+// Sample on a light as seen from origin. Returns false if the light can not be
+// seen from origin. sample.pdf is in solid angle and sample.emission is not
+// divided by the probability of picking the light.
+static __host__ __device__ __inline__ bool sampleLight(const LightParameter& light, const float3& origin, float u1, float u2, LightSample& sample)
+{
+    sample.emission = light.emission;
+
+    switch (light.lightType)
+    {
+    case SPHERE:
+    {
+        float3 w;
+        const float oneMinusCosThetaMax = sphereLightCone(light, origin, w);
+        if (oneMinusCosThetaMax <= 0.0f)
+            return false;
+
+        const float cosTheta = 1.0f - u1 * oneMinusCosThetaMax;
+        const float sinTheta = sqrtf(fmaxf(0.0f, 1.0f - cosTheta * cosTheta));
+        const float phi = 2.0f * M_PIf * u2;
+        float3 direction = make_float3(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+        optix::Onb onb(w);
+        onb.inverse_transform(direction);
+
+        // Directions at the rim of the cone may miss by rounding, they touch the
+        // sphere at the point closest to the ray
+        float t;
+        if (!intersectLight(light, origin, direction, 0.0f, 1.e30f, t))
+            t = dot(light.position - origin, direction);
+
+        sample.surfacePos = origin + direction * t;
+        sample.normal = normalize(sample.surfacePos - light.position);
+        sample.pdf = 1.0f / (2.0f * M_PIf * oneMinusCosThetaMax);
+        return true;
+    }
+    case QUAD:
+    case TRIANGLE:
+    default:
+    {
+        float a = u1;
+        float b = u2;
+        if (light.lightType == TRIANGLE)
+        {
+            // Uniform barycentrics
+            const float su1 = sqrtf(u1);
+            a = 1.0f - su1;
+            b = u2 * su1;
+        }
+
+        sample.surfacePos = light.position + a * light.u + b * light.v;
+        sample.normal = light.normal;
+
+        const float3 toLight = sample.surfacePos - origin;
+        const float dist2 = dot(toLight, toLight);
+        const float cosLight = -dot(toLight, light.normal) * (1.0f / sqrtf(dist2));
+        if (cosLight <= 0.0f)
+            return false;
+
+        sample.pdf = dist2 / (light.area * cosLight);
+        return true;
+    }
+    }
+}
+
+// Solid angle pdf of sampleLight for a direction from origin that hits the
+// light at distance t
+static __host__ __device__ __inline__ float lightPdf(const LightParameter& light, const float3& origin, const float3& direction, float t)
+{
+    switch (light.lightType)
+    {
+    case SPHERE:
+    {
+        float3 w;
+        const float oneMinusCosThetaMax = sphereLightCone(light, origin, w);
+        return oneMinusCosThetaMax > 0.0f ? 1.0f / (2.0f * M_PIf * oneMinusCosThetaMax) : 0.0f;
+    }
+    case QUAD:
+    case TRIANGLE:
+    default:
+    {
+        const float cosLight = -dot(direction, light.normal);
+        return cosLight > 0.0f ? (t * t) / (light.area * cosLight) : 0.0f;
+    }
+    }
+}
+
+// True if the light emits towards -direction
+static __host__ __device__ __inline__ bool lightEmits(const LightParameter& light, const float3& direction)
+{
+    return light.lightType == SPHERE || dot(direction, light.normal) < 0.0f;
+}
+
+// Area and normal of a quad or triangle light from its edges
+static __host__ __device__ __inline__ void setupPlanarLight(LightParameter& light)
+{
+    const float3 n = cross(light.u, light.v);
+    const float parallelogramArea = length(n);
+    light.normal = n / parallelogramArea;
+    light.area = light.lightType == TRIANGLE ? 0.5f * parallelogramArea : parallelogramArea;
+}
@@ -0,0 +1,77 @@
+#include "lobe_table.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+DisneyLobeTable bakeDisneyLobeTable(const MaterialParameter& mat, unsigned int material_id, int samples)
+{
+    DisneyLobeTable table;
+    memset(&table, 0, sizeof(table));
+    if (mat.bsdf != DISNEY)
+        return table;
+
+    const DisneyConstants constants = disneyConstants(mat);
+
+    State state;
+    state.hitpoint = make_float3(0.0f);
+    state.normal = make_float3(0.0f, 0.0f, 1.0f);
+    state.ffnormal = state.normal;
+
+    // Monte Carlo estimate of every lobe with the analytic lobe selection,
+    // which covers the hemisphere wherever one of the lobes is non zero
+    float p[DISNEY_LOBE_COUNT];
+    disneyLobeProbabilities(mat, p);
+
+    for (int i = 0; i < DISNEY_LOBE_TABLE_SIZE; ++i)
+    {
+        const float NDotV = std::max(static_cast<float>(i) / (DISNEY_LOBE_TABLE_SIZE - 1), 0.001f);
+        const float3 wo = make_float3(sqrtf(1.0f - NDotV * NDotV), 0.0f, NDotV);
+
+        unsigned int seed = tea<16>(material_id, i);
+        double albedo[DISNEY_LOBE_COUNT] = {};
+        for (int n = 0; n < samples; ++n)
+        {
+            BSDFSample s;
+            BSDF<DISNEY>::sample(constants, p, mat, state, wo, seed, s);
+            if (!(s.pdf > 0.0f))
+                continue;
+
+            float3 lobes[DISNEY_LOBE_COUNT];
+            float pdf;
+            BSDF<DISNEY>::evalLobesPdf(constants, p, mat, state, wo, s.direction, lobes, pdf);
+            for (int lobe = 0; lobe < DISNEY_LOBE_COUNT; ++lobe)
+            {
+                const float3 weight = lobes[lobe] / pdf;
+                albedo[lobe] += (weight.x + weight.y + weight.z) / 3.0;
+            }
+        }
+
+        for (int lobe = 0; lobe < DISNEY_LOBE_COUNT; ++lobe)
+            table.albedo[i][lobe] = static_cast<float>(albedo[lobe] / samples);
+    }
+
+    return table;
+}
+
+void bakeDisneyLobeTables(const std::vector<MaterialParameter>& materials, std::vector<DisneyLobeTable>& tables, int samples)
+{
+    tables.resize(materials.size());
+
+    // Materials are handed out one at a time, their cost differs with the BSDF type
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < materials.size(); i = next++)
+            tables[i] = bakeDisneyLobeTable(materials[i], static_cast<unsigned int>(i), samples);
+    };
+
+    const size_t thread_count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), materials.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < thread_count; ++t)
+        threads.push_back(std::thread(worker));
+    worker();
+    for (auto t = threads.begin(); t != threads.end(); ++t)
+        t->join();
+}
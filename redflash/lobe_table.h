@@ -0,0 +1,29 @@
+#pragma once
+
+#include "bsdf.h"
+
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// Disney lobe selection tables
+//
+// Static Disney materials can pick their lobes from a DisneyLobeTable
+// (bsdf_disney.h): the directional albedo of every lobe is estimated over
+// cos(theta_o), and the sampling picks lobes in proportion to it at wo instead
+// of the fixed metallic based ratio of the analytic model. The value and the
+// pdf stay analytic, the table only lowers the variance per sample.
+//
+// The tables are built at scene load, one per entry of the material parameters
+// and indexed by material id. Materials of other BSDF types get an empty table.
+//
+//-----------------------------------------------------------------------------
+
+// BSDF samples per albedo table entry
+#define DISNEY_LOBE_TABLE_SAMPLES 4096
+
+// Builds the tables of all materials on all hardware threads
+void bakeDisneyLobeTables(const std::vector<MaterialParameter>& materials, std::vector<DisneyLobeTable>& tables, int samples = DISNEY_LOBE_TABLE_SAMPLES);
+
+// Table of one material, also used by the CPU checks
+DisneyLobeTable bakeDisneyLobeTable(const MaterialParameter& mat, unsigned int material_id, int samples = DISNEY_LOBE_TABLE_SAMPLES);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+
+using namespace optix;
+
+//-----------------------------------------------------------------------------
+//
+// Motion blur
+//
+// Every path samples a time in the shutter interval and traces all of its rays
+// at that time. Times are in frames from the current one: the motion range of
+// moving geometry and transforms is [0, 1], the frame up to the next one, and
+// --shutter 0 0.5 is a 180 degree shutter.
+//
+// Moving sphere centers and the raymarched object are given as motion keys,
+// evenly spaced over the motion range like the motion steps of OptiX, linear in
+// between and clamped outside the range. The bounds programs report the bounds
+// at each key, so the acceleration interpolates node bounds to the ray time
+// instead of bounding the whole sweep of a primitive. Transforms of animated
+// objects get matrix keys in the same range.
+//
+//-----------------------------------------------------------------------------
+
+// Key before time and the fraction towards the next one. Needs steps >= 2.
+static __host__ __device__ __inline__ float motionKey(float time, int steps, int& key)
+{
+    const float s = fminf(fmaxf(time, 0.0f), 1.0f) * (steps - 1);
+    key = min(static_cast<int>(s), steps - 2);
+    return s - key;
+}
+
+// Value at time of steps keys of a primitive, keys[0] at time 0 and keys[steps - 1] at time 1
+static __host__ __device__ __inline__ float3 motionLerp(const float3* keys, int steps, float time)
+{
+    if (steps < 2)
+        return keys[0];
+    int key;
+    const float frac = motionKey(time, steps, key);
+    return lerp(keys[key], keys[key + 1], frac);
+}
@@ -0,0 +1,139 @@
+#include "motion_bench.h"
+#include "bench_common.h"
+#include "sphere_bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+using namespace optix;
+
+namespace
+{
+    const int sphere_count = 10000;
+    const unsigned int motion_steps = 4;
+
+    // Up to small_motion radii of motion the interpolated node bounds (the motion
+    // BVH of OptiX) must keep min_small_motion_speed of the static throughput
+    const float small_motion = 2.0f;
+    const double min_small_motion_speed = 0.4;
+
+    // motion_steps keys per sphere from its center, each step distance / (motion_steps - 1) long in a random direction
+    std::vector<float3> randomWalks(const std::vector<SphereRecord>& spheres, float distance)
+    {
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+        std::vector<float3> keys;
+        keys.reserve(spheres.size() * motion_steps);
+        for (size_t i = 0; i < spheres.size(); ++i)
+        {
+            float3 center = spheres[i].center;
+            keys.push_back(center);
+            for (unsigned int k = 1; k < motion_steps; ++k)
+            {
+                float3 step;
+                do
+                {
+                    step = make_float3(uniform(rng), uniform(rng), uniform(rng));
+                } while (dot(step, step) > 1.0f || dot(step, step) < 1.0e-4f);
+                center += normalize(step) * (distance / (motion_steps - 1));
+                keys.push_back(center);
+            }
+        }
+        return keys;
+    }
+
+    // Closest hits of all rays at their times, returns the rays per second of the
+    // fastest of a few passes so that the throughputs can be compared
+    double traceRays(const SphereBVH& bvh, const std::vector<TestRay>& rays, float tmin, float tmax, int& hits)
+    {
+        double best_rate = 0.0;
+        for (int pass = 0; pass < 3; ++pass)
+        {
+            hits = 0;
+            const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < rays.size(); ++i)
+            {
+                SphereHit hit;
+                hits += bvh.intersect(rays[i].origin, rays[i].direction, tmin, tmax, hit, rays[i].time) ? 1 : 0;
+            }
+            best_rate = std::max(best_rate, rays.size() / secondsSince(begin));
+        }
+        return best_rate;
+    }
+}
+
+bool benchMotion(int ray_count)
+{
+    const std::vector<TestRay> rays = testRays(ray_count, true);
+    const std::vector<SphereRecord> spheres = sphereField(sphere_count);
+    const float radius = spheres[0].radius;
+    const float tmin = 1.0e-3f;
+    const float tmax = 1.0e16f;
+
+    SphereBVH static_bvh;
+    static_bvh.build(spheres);
+    int static_hits;
+    const double static_rate = traceRays(static_bvh, rays, tmin, tmax, static_hits);
+
+    bool ok = true;
+    for (float distance = 0.5f; distance <= 32.0f; distance *= 4.0f)
+    {
+        const std::vector<float3> keys = randomWalks(spheres, distance * radius);
+
+        SphereBVH swept;
+        swept.buildMotion(spheres, keys, motion_steps, false);
+        SphereBVH interpolated;
+        interpolated.buildMotion(spheres, keys, motion_steps, true);
+
+        int swept_hits;
+        int interpolated_hits;
+        const double swept_rate = traceRays(swept, rays, tmin, tmax, swept_hits);
+        const double interpolated_rate = traceRays(interpolated, rays, tmin, tmax, interpolated_hits);
+
+        // Both must match a loop over the moved spheres, and at time 0 the static BVH
+        bool check_ok = swept_hits == interpolated_hits;
+        const int check_count = std::min(ray_count, 2000);
+        for (int i = 0; i < check_count && check_ok; ++i)
+        {
+            float t;
+            const bool expected = bruteForce(spheres, rays[i], tmin, tmax, t, keys, motion_steps);
+            SphereHit swept_hit;
+            SphereHit interpolated_hit;
+            const bool swept_found = swept.intersect(rays[i].origin, rays[i].direction, tmin, tmax, swept_hit, rays[i].time);
+            const bool interpolated_found = interpolated.intersect(rays[i].origin, rays[i].direction, tmin, tmax, interpolated_hit, rays[i].time);
+            check_ok = expected == swept_found && expected == interpolated_found
+                && (!expected || (swept_hit.t == t && interpolated_hit.t == t));
+
+            SphereHit static_hit;
+            SphereHit start_hit;
+            const bool static_found = static_bvh.intersect(rays[i].origin, rays[i].direction, tmin, tmax, static_hit);
+            const bool start_found = interpolated.intersect(rays[i].origin, rays[i].direction, tmin, tmax, start_hit, 0.0f);
+            check_ok &= static_found == start_found && (!static_found || (static_hit.t == start_hit.t && static_hit.primIdx == start_hit.primIdx));
+        }
+
+        const double speed = interpolated_rate / static_rate;
+        const bool speed_ok = distance > small_motion || speed >= min_small_motion_speed;
+        ok &= check_ok && speed_ok;
+
+        std::ostringstream line;
+        line << "[motion] spheres: " << sphere_count
+            << "\tmotion_steps: " << motion_steps
+            << "\tdistance_in_radii: " << distance
+            << "\thit_rate: " << static_cast<double>(interpolated_hits) / ray_count
+            << "\tstatic_mrays_per_sec: " << static_rate * 1.0e-6
+            << "\tswept_mrays_per_sec: " << swept_rate * 1.0e-6
+            << "\tinterpolated_mrays_per_sec: " << interpolated_rate * 1.0e-6
+            << "\tinterpolated_vs_static: " << speed
+            << (check_ok && speed_ok ? "" : "\tFAILED");
+        std::cout << line.str() << std::endl;
+    }
+
+    std::cout << "[motion] checks: " << (ok ? "ok" : "failed") << std::endl;
+    return ok;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+//
+// Motion blur on the CPU sphere intersector (sphere_bvh.h): a field of spheres
+// moving along random walks of motion keys is traced at random ray times with
+// node bounds over the whole sweep and with node bounds interpolated to the
+// ray time (see motion.h), against the same spheres standing still. Both are
+// checked against a brute force loop over the spheres moved to the ray time,
+// and at time 0 against a static BVH of the first keys. For motion of up to
+// two radii the interpolated bounds must keep 40% of the static throughput.
+// Run by redflash_bench --motion, returns false if a check failed.
+//
+//-----------------------------------------------------------------------------
+
+bool benchMotion(int ray_count);
@@ -0,0 +1,376 @@
+#include "postprocess.h"
+
+#include <algorithm>
+#include <atomic>
+#include <emmintrin.h>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER)
+#define POSTPROCESS_INLINE __forceinline
+#else
+#define POSTPROCESS_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace
+{
+    // Rows per work item of a thread
+    const int chunk_rows = 8;
+
+    const unsigned char bayer[8][8] = {
+        {  0, 32,  8, 40,  2, 34, 10, 42 },
+        { 48, 16, 56, 24, 50, 18, 58, 26 },
+        { 12, 44,  4, 36, 14, 46,  6, 38 },
+        { 60, 28, 52, 20, 62, 30, 54, 22 },
+        {  3, 35, 11, 43,  1, 33,  9, 41 },
+        { 51, 19, 59, 27, 49, 17, 57, 25 },
+        { 15, 47,  7, 39, 13, 45,  5, 37 },
+        { 63, 31, 55, 23, 61, 29, 53, 21 }
+    };
+
+    // Channels of 4 pixels
+    struct Pixels4
+    {
+        __m128 r;
+        __m128 g;
+        __m128 b;
+    };
+
+    POSTPROCESS_INLINE Pixels4 loadPixels4(const float4* p)
+    {
+        __m128 p0 = _mm_loadu_ps(&p[0].x);
+        __m128 p1 = _mm_loadu_ps(&p[1].x);
+        __m128 p2 = _mm_loadu_ps(&p[2].x);
+        __m128 p3 = _mm_loadu_ps(&p[3].x);
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        Pixels4 pixels = { p0, p1, p2 };
+        return pixels;
+    }
+
+    POSTPROCESS_INLINE void storePixels4(float4* p, const Pixels4& pixels)
+    {
+        __m128 p0 = pixels.r;
+        __m128 p1 = pixels.g;
+        __m128 p2 = pixels.b;
+        __m128 p3 = _mm_set1_ps(1.0f);
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        _mm_storeu_ps(&p[0].x, p0);
+        _mm_storeu_ps(&p[1].x, p1);
+        _mm_storeu_ps(&p[2].x, p2);
+        _mm_storeu_ps(&p[3].x, p3);
+    }
+
+    // Same order as clamp of tonemap.h, fmaxf(0, fminf(x, 1)): _mm_min_ps returns
+    // its second operand for NaN, so NaN is 1 in both
+    POSTPROCESS_INLINE __m128 clamp01(__m128 x)
+    {
+        return _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(1.0f)), _mm_setzero_ps());
+    }
+
+    // log2 of positive normal floats: exponent plus the atanh series of the
+    // mantissa m in [1, 2), t = (m - 1) / (m + 1) < 1/3, to about 2e-6
+    POSTPROCESS_INLINE __m128 log2x4(__m128 x)
+    {
+        const __m128i bits = _mm_castps_si128(x);
+        const __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+        const __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+
+        const __m128 t = _mm_div_ps(_mm_sub_ps(m, _mm_set1_ps(1.0f)), _mm_add_ps(m, _mm_set1_ps(1.0f)));
+        const __m128 t2 = _mm_mul_ps(t, t);
+        __m128 p = _mm_add_ps(_mm_mul_ps(t2, _mm_set1_ps(0.3205989f)), _mm_set1_ps(0.4121986f));
+        p = _mm_add_ps(_mm_mul_ps(t2, p), _mm_set1_ps(0.5770780f));
+        p = _mm_add_ps(_mm_mul_ps(t2, p), _mm_set1_ps(0.9617967f));
+        p = _mm_add_ps(_mm_mul_ps(t2, p), _mm_set1_ps(2.8853901f));
+        return _mm_add_ps(exponent, _mm_mul_ps(t, p));
+    }
+
+    // 2^x for x in [-126, 126]: 2^round(x) from the exponent bits times the
+    // Taylor series of 2^f, f in [-1/2, 1/2], to about 3e-6
+    POSTPROCESS_INLINE __m128 exp2x4(__m128 x)
+    {
+        x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.0f)), _mm_set1_ps(126.0f));
+
+        // Truncating the positive x + 127.5 rounds x
+        const __m128i i = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(x, _mm_set1_ps(127.5f))), _mm_set1_epi32(127));
+        const __m128 f = _mm_sub_ps(x, _mm_cvtepi32_ps(i));
+        __m128 p = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(0.001333355f)), _mm_set1_ps(0.009618129f));
+        p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(0.05550411f));
+        p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(0.2402265f));
+        p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(0.6931472f));
+        p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(1.0f));
+        return _mm_castsi128_ps(_mm_add_epi32(_mm_castps_si128(p), _mm_slli_epi32(i, 23)));
+    }
+
+    // x^exponent, 0 for x <= 0
+    POSTPROCESS_INLINE __m128 powx4(__m128 x, float exponent)
+    {
+        const __m128 positive = _mm_cmpgt_ps(x, _mm_set1_ps(1.0e-30f));
+        const __m128 result = exp2x4(_mm_mul_ps(log2x4(_mm_max_ps(x, _mm_set1_ps(1.0e-30f))), _mm_set1_ps(exponent)));
+        return _mm_and_ps(positive, result);
+    }
+
+    POSTPROCESS_INLINE __m128 aces(__m128 x)
+    {
+        const __m128 numerator = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.51f)), _mm_set1_ps(0.03f)));
+        const __m128 denominator = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.43f)), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+        return clamp01(_mm_div_ps(numerator, denominator));
+    }
+
+    POSTPROCESS_INLINE __m128 hable(__m128 x)
+    {
+        const __m128 A = _mm_set1_ps(0.15f);
+        const __m128 numerator = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(A, x), _mm_set1_ps(0.10f * 0.50f))), _mm_set1_ps(0.20f * 0.02f));
+        const __m128 denominator = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(A, x), _mm_set1_ps(0.50f))), _mm_set1_ps(0.20f * 0.30f));
+        return _mm_sub_ps(_mm_div_ps(numerator, denominator), _mm_set1_ps(0.02f / 0.30f));
+    }
+
+    template<ToneCurve Curve>
+    POSTPROCESS_INLINE Pixels4 toneCurve(Pixels4 x, const PostprocessSettings& settings)
+    {
+        switch (Curve)
+        {
+        case TONE_CURVE_ACES:
+            x.r = aces(x.r);
+            x.g = aces(x.g);
+            x.b = aces(x.b);
+            break;
+        case TONE_CURVE_REINHARD:
+        {
+            const __m128 luminance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x.r, _mm_set1_ps(0.3f)), _mm_mul_ps(x.g, _mm_set1_ps(0.6f))), _mm_mul_ps(x.b, _mm_set1_ps(0.1f)));
+            const __m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(luminance, _mm_set1_ps(1.0f / settings.reinhard_limit))));
+            x.r = _mm_mul_ps(x.r, scale);
+            x.g = _mm_mul_ps(x.g, scale);
+            x.b = _mm_mul_ps(x.b, scale);
+            break;
+        }
+        case TONE_CURVE_FILMIC:
+        {
+            const __m128 inv_white = _mm_set1_ps(1.0f / hableCurve(TONEMAP_FILMIC_WHITE));
+            x.r = clamp01(_mm_mul_ps(hable(x.r), inv_white));
+            x.g = clamp01(_mm_mul_ps(hable(x.g), inv_white));
+            x.b = clamp01(_mm_mul_ps(hable(x.b), inv_white));
+            break;
+        }
+        case TONE_CURVE_NONE:
+        default:
+            break;
+        }
+        return x;
+    }
+
+    template<OutputEncoding Encoding>
+    POSTPROCESS_INLINE __m128 encode(__m128 x)
+    {
+        switch (Encoding)
+        {
+        case OUTPUT_ENCODING_GAMMA22:
+            return powx4(x, 1.0f / 2.2f);
+        case OUTPUT_ENCODING_SRGB:
+        {
+            x = _mm_max_ps(x, _mm_setzero_ps());
+            const __m128 linear = _mm_cmple_ps(x, _mm_set1_ps(0.0031308f));
+            const __m128 curve = _mm_sub_ps(_mm_mul_ps(powx4(x, 1.0f / 2.4f), _mm_set1_ps(1.055f)), _mm_set1_ps(0.055f));
+            return _mm_or_ps(_mm_and_ps(linear, _mm_mul_ps(x, _mm_set1_ps(12.92f))), _mm_andnot_ps(linear, curve));
+        }
+        case OUTPUT_ENCODING_LINEAR:
+        default:
+            return x;
+        }
+    }
+
+    template<ToneCurve Curve, OutputEncoding Encoding>
+    POSTPROCESS_INLINE Pixels4 display4(const float4* p, const PostprocessSettings& settings)
+    {
+        Pixels4 x = loadPixels4(p);
+        const __m128 exposure = _mm_set1_ps(settings.exposure);
+        x.r = _mm_mul_ps(x.r, exposure);
+        x.g = _mm_mul_ps(x.g, exposure);
+        x.b = _mm_mul_ps(x.b, exposure);
+        x = toneCurve<Curve>(x, settings);
+        x.r = encode<Encoding>(x.r);
+        x.g = encode<Encoding>(x.g);
+        x.b = encode<Encoding>(x.b);
+        return x;
+    }
+
+    // The pixels that do not fill a group of 4
+    inline float3 display(const float4& p, const PostprocessSettings& settings)
+    {
+        const float3 x = make_float3(p.x, p.y, p.z) * settings.exposure;
+        return encodeOutput(applyToneCurve(x, settings.curve, settings.reinhard_limit), settings.encoding);
+    }
+
+    // Offset added to 255 * value before truncating: the dither threshold of
+    // pixel (x, y) or 1/2 for rounding
+    inline float ditherOffset(const PostprocessSettings& settings, int x, int y)
+    {
+        return settings.dither ? (bayer[y & 7][x & 7] + 0.5f) / 64.0f : 0.5f;
+    }
+
+    // NaN is 0, like the SIMD path of ByteRows
+    inline unsigned char quantize(float value, float offset)
+    {
+        const float v = value * 255.0f + offset;
+        return static_cast<unsigned char>(!(v > 0.0f) ? 0 : (v >= 255.0f ? 255 : static_cast<int>(v)));
+    }
+
+    // Display values of rows [y0, y1)
+    struct FloatRows
+    {
+        const PostprocessSettings& settings;
+        int width;
+        const float4* input;
+        float4* output;
+
+        template<ToneCurve Curve, OutputEncoding Encoding>
+        void run(int y0, int y1) const
+        {
+            for (int y = y0; y < y1; ++y)
+            {
+                const size_t row = static_cast<size_t>(y) * width;
+                int x = 0;
+                for (; x + 4 <= width; x += 4)
+                    storePixels4(output + row + x, display4<Curve, Encoding>(input + row + x, settings));
+                for (; x < width; ++x)
+                {
+                    const float3 c = display(input[row + x], settings);
+                    output[row + x] = optix::make_float4(c.x, c.y, c.z, 1.0f);
+                }
+            }
+        }
+    };
+
+    // 8 bit RGB of rows [y0, y1), flipped
+    struct ByteRows
+    {
+        const PostprocessSettings& settings;
+        int width;
+        int height;
+        const float4* input;
+        unsigned char* rgb;
+
+        template<ToneCurve Curve, OutputEncoding Encoding>
+        void run(int y0, int y1) const
+        {
+            const __m128 scale = _mm_set1_ps(255.0f);
+            const __m128 zero = _mm_setzero_ps();
+            for (int y = y0; y < y1; ++y)
+            {
+                const float4* src = input + static_cast<size_t>(y) * width;
+                unsigned char* dst = rgb + static_cast<size_t>(height - 1 - y) * width * 3;
+
+                // Groups of 4 start at x = 0 or 4 modulo 8
+                const __m128 offsets[2] = {
+                    _mm_setr_ps(ditherOffset(settings, 0, y), ditherOffset(settings, 1, y), ditherOffset(settings, 2, y), ditherOffset(settings, 3, y)),
+                    _mm_setr_ps(ditherOffset(settings, 4, y), ditherOffset(settings, 5, y), ditherOffset(settings, 6, y), ditherOffset(settings, 7, y))
+                };
+
+                int x = 0;
+                for (; x + 4 <= width; x += 4)
+                {
+                    const Pixels4 c = display4<Curve, Encoding>(src + x, settings);
+                    const __m128 offset = offsets[(x >> 2) & 1];
+
+                    // Clamped to [0, 255] before the conversion, which gives 0x80000000
+                    // for values out of the int range. _mm_max_ps returns its second
+                    // operand for NaN, so NaN becomes 0 like in quantize.
+                    const __m128i r = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(c.r, scale), offset), zero), scale));
+                    const __m128i g = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(c.g, scale), offset), zero), scale));
+                    const __m128i b = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(c.b, scale), offset), zero), scale));
+                    const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(r, g), _mm_packs_epi32(b, _mm_setzero_si128()));
+
+                    unsigned char bytes[16];
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), packed);
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        dst[(x + i) * 3 + 0] = bytes[i];
+                        dst[(x + i) * 3 + 1] = bytes[4 + i];
+                        dst[(x + i) * 3 + 2] = bytes[8 + i];
+                    }
+                }
+                for (; x < width; ++x)
+                {
+                    const float3 c = display(src[x], settings);
+                    const float offset = ditherOffset(settings, x, y);
+                    dst[x * 3 + 0] = quantize(c.x, offset);
+                    dst[x * 3 + 1] = quantize(c.y, offset);
+                    dst[x * 3 + 2] = quantize(c.z, offset);
+                }
+            }
+        }
+    };
+
+    // Rows::run specialized for the encoding and curve of the settings
+    template<OutputEncoding Encoding, typename Rows>
+    void runRows(const Rows& rows, ToneCurve curve, int y0, int y1)
+    {
+        switch (curve)
+        {
+        case TONE_CURVE_ACES:
+            rows.template run<TONE_CURVE_ACES, Encoding>(y0, y1);
+            break;
+        case TONE_CURVE_REINHARD:
+            rows.template run<TONE_CURVE_REINHARD, Encoding>(y0, y1);
+            break;
+        case TONE_CURVE_FILMIC:
+            rows.template run<TONE_CURVE_FILMIC, Encoding>(y0, y1);
+            break;
+        case TONE_CURVE_NONE:
+        default:
+            rows.template run<TONE_CURVE_NONE, Encoding>(y0, y1);
+            break;
+        }
+    }
+
+    template<typename Rows>
+    void runRows(const Rows& rows, const PostprocessSettings& settings, int y0, int y1)
+    {
+        switch (settings.encoding)
+        {
+        case OUTPUT_ENCODING_GAMMA22:
+            runRows<OUTPUT_ENCODING_GAMMA22>(rows, settings.curve, y0, y1);
+            break;
+        case OUTPUT_ENCODING_SRGB:
+            runRows<OUTPUT_ENCODING_SRGB>(rows, settings.curve, y0, y1);
+            break;
+        case OUTPUT_ENCODING_LINEAR:
+        default:
+            runRows<OUTPUT_ENCODING_LINEAR>(rows, settings.curve, y0, y1);
+            break;
+        }
+    }
+
+    // Runs rows over chunks of rows on all threads
+    template<typename Rows>
+    void forEachRows(const PostprocessSettings& settings, int height, const Rows& rows)
+    {
+        const int chunk_count = (height + chunk_rows - 1) / chunk_rows;
+        std::atomic<int> next(0);
+        auto worker = [&]()
+        {
+            for (int chunk = next++; chunk < chunk_count; chunk = next++)
+                runRows(rows, settings, chunk * chunk_rows, std::min((chunk + 1) * chunk_rows, height));
+        };
+
+        const unsigned int hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+        const unsigned int thread_count = std::min<unsigned int>(settings.thread_count > 0 ? settings.thread_count : hardware_threads, chunk_count);
+        std::vector<std::thread> threads;
+        for (unsigned int t = 1; t < thread_count; ++t)
+            threads.push_back(std::thread(worker));
+        worker();
+        for (auto t = threads.begin(); t != threads.end(); ++t)
+            t->join();
+    }
+}
+
+void postprocessImage(const PostprocessSettings& settings, int width, int height, const float4* input, float4* output)
+{
+    const FloatRows rows = { settings, width, input, output };
+    forEachRows(settings, height, rows);
+}
+
+void postprocessImage8(const PostprocessSettings& settings, int width, int height, const float4* input, unsigned char* rgb)
+{
+    const ByteRows rows = { settings, width, height, input, rgb };
+    forEachRows(settings, height, rows);
+}
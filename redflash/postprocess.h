@@ -0,0 +1,49 @@
+#pragma once
+
+#include "tonemap.h"
+
+//-----------------------------------------------------------------------------
+//
+// Host post-process
+//
+// Exposure, tone curve and output encoding of tonemap.h over a float4 image,
+// and quantization to 8 bits with an ordered dither for the PNG files. Four
+// pixels are processed at a time with SSE2, the encodings use polynomial
+// log2 / exp2 (within 1e-5 of powf, well below an 8 bit step) in place of
+// three powf calls per pixel, and the rows are spread over all hardware
+// threads. redflash_bench --postprocess compares it with the per-pixel powf
+// path of sutil::displayBufferPNG at 4K.
+//
+//-----------------------------------------------------------------------------
+
+struct PostprocessSettings
+{
+    PostprocessSettings()
+        : exposure(1.0f)
+        , curve(TONE_CURVE_ACES)
+        , encoding(OUTPUT_ENCODING_GAMMA22)
+        , reinhard_limit(1.0f)
+        , dither(true)
+        , thread_count(0)
+    {
+    }
+
+    float exposure;
+    ToneCurve curve;
+    OutputEncoding encoding;
+    float reinhard_limit;
+
+    // Ordered 8x8 Bayer dither before the 8 bit quantization, otherwise rounding
+    bool dither;
+
+    // 0 for all hardware threads
+    unsigned int thread_count;
+};
+
+// Display values of a width * height image, output may alias input. The alpha
+// of the output is 1.
+void postprocessImage(const PostprocessSettings& settings, int width, int height, const float4* input, float4* output);
+
+// 8 bit RGB of a width * height image. The images of the OptiX buffers have
+// their bottom row first, rgb has the top row first like a PNG file.
+void postprocessImage8(const PostprocessSettings& settings, int width, int height, const float4* input, unsigned char* rgb);
@@ -0,0 +1,203 @@
+#include "postprocess_bench.h"
+#include "bench_common.h"
+#include "postprocess.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Smooth gradients over six decades of radiance with per-pixel noise
+    std::vector<float4> syntheticFrame(int width, int height)
+    {
+        std::vector<float4> frame(static_cast<size_t>(width) * height);
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> noise(0.8f, 1.2f);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                const float u = (x + 0.5f) / width;
+                const float v = (y + 0.5f) / height;
+                const float radiance = powf(10.0f, 6.0f * u - 4.0f);
+                frame[static_cast<size_t>(y) * width + x] = make_float4(
+                    radiance * (0.5f + 0.5f * v) * noise(rng),
+                    radiance * (1.0f - 0.5f * v) * noise(rng),
+                    radiance * 0.7f * noise(rng),
+                    1.0f);
+            }
+        }
+        return frame;
+    }
+
+    // tonemap_acesFilm on the host followed by the quantization of
+    // sutil::displayBufferPNG: std::pow and a truncation per channel
+    void referencePNG(const std::vector<float4>& frame, int width, int height, std::vector<unsigned char>& rgb)
+    {
+        const float gamma_inv = 1.0f / 2.2f;
+        for (int y = 0; y < height; ++y)
+        {
+            unsigned char* dst = &rgb[static_cast<size_t>(height - 1 - y) * width * 3];
+            for (int x = 0; x < width; ++x)
+            {
+                const float4& p = frame[static_cast<size_t>(y) * width + x];
+                const float3 c = tonemap_acesFilm(make_float3(p.x, p.y, p.z));
+                const float channels[3] = { c.x, c.y, c.z };
+                for (int k = 0; k < 3; ++k)
+                {
+                    const int P = static_cast<int>(std::pow(channels[k], gamma_inv) * 255.0f);
+                    *dst++ = static_cast<unsigned char>(P < 0 ? 0 : P > 0xff ? 0xff : P);
+                }
+            }
+        }
+    }
+
+    // 8 bit output of out of range and NaN radiance. Every row has one value in 5
+    // pixels, the first 4 take the SIMD path and the last the scalar one, which
+    // must agree for every curve and encoding. Without a curve and encoding the
+    // values are clamped to [0, 255] and NaN is 0.
+    bool checkQuantizeRange()
+    {
+        const float values[] = { -1.0e30f, -1.0f, 0.0f, 0.5f, 1.0f, 2.0f, 1.0e7f, 1.0e9f, 1.0e30f,
+            std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN() };
+        const int width = 5;
+        const int height = static_cast<int>(sizeof(values) / sizeof(values[0]));
+        std::vector<float4> frame(static_cast<size_t>(width) * height);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+                frame[static_cast<size_t>(y) * width + x] = make_float4(values[y], values[y], values[y], 1.0f);
+        }
+
+        bool ok = true;
+        std::vector<unsigned char> rgb(frame.size() * 3);
+        for (int curve = TONE_CURVE_NONE; curve <= TONE_CURVE_FILMIC; ++curve)
+        {
+            for (int encoding = OUTPUT_ENCODING_LINEAR; encoding <= OUTPUT_ENCODING_SRGB; ++encoding)
+            {
+                PostprocessSettings settings;
+                settings.curve = static_cast<ToneCurve>(curve);
+                settings.encoding = static_cast<OutputEncoding>(encoding);
+                settings.dither = false;
+                settings.thread_count = 1;
+                postprocessImage8(settings, width, height, frame.data(), rgb.data());
+
+                for (int y = 0; y < height; ++y)
+                {
+                    // rgb has the top row first
+                    const unsigned char* row = &rgb[static_cast<size_t>(height - 1 - y) * width * 3];
+                    const float v = values[y];
+                    const int expected = !(v > 0.0f) ? 0 : (v >= 1.0f ? 255 : static_cast<int>(v * 255.0f + 0.5f));
+                    for (int i = 0; i < width * 3; ++i)
+                    {
+                        const bool raw = curve == TONE_CURVE_NONE && encoding == OUTPUT_ENCODING_LINEAR;
+                        if (row[i] != row[width * 3 - 3 + i % 3] || (raw && row[i] != expected))
+                        {
+                            std::cout << "[postprocess] curve: " << curve << "\tencoding: " << encoding << "\tvalue: " << v
+                                << "\tsimd: " << static_cast<int>(row[i]) << "\tscalar: " << static_cast<int>(row[width * 3 - 3 + i % 3]) << "\tFAILED" << std::endl;
+                            ok = false;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        return ok;
+    }
+
+    void printLine(const char* path, int width, int height, unsigned int threads, double seconds, double reference_seconds)
+    {
+        std::ostringstream line;
+        line << "[postprocess] resolution: " << width << "x" << height
+            << "\tpath: " << path
+            << "\tthreads: " << threads
+            << "\tms: " << seconds * 1.0e3
+            << "\tmpixel_per_sec: " << width * height / seconds * 1.0e-6
+            << "\tspeedup: " << reference_seconds / seconds;
+        std::cout << line.str() << std::endl;
+    }
+}
+
+bool benchPostprocess(int width, int height)
+{
+    const std::vector<float4> frame = syntheticFrame(width, height);
+    const size_t pixel_count = frame.size();
+    std::vector<unsigned char> reference(pixel_count * 3);
+    std::vector<unsigned char> rgb(pixel_count * 3);
+    std::vector<float4> output(pixel_count);
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    referencePNG(frame, width, height, reference);
+    const double reference_seconds = secondsSince(begin);
+    printLine("std_pow", width, height, 1, reference_seconds, reference_seconds);
+
+    const unsigned int hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int threads = 1;; threads = hardware_threads)
+    {
+        PostprocessSettings settings;
+        settings.thread_count = threads;
+
+        begin = std::chrono::steady_clock::now();
+        postprocessImage(settings, width, height, frame.data(), output.data());
+        printLine("simd_float", width, height, threads, secondsSince(begin), reference_seconds);
+
+        begin = std::chrono::steady_clock::now();
+        postprocessImage8(settings, width, height, frame.data(), rgb.data());
+        printLine("simd_png_dither", width, height, threads, secondsSince(begin), reference_seconds);
+
+        if (threads == hardware_threads)
+            break;
+    }
+
+    // Float output against the scalar formulas of every curve and encoding
+    bool ok = true;
+    for (int curve = TONE_CURVE_NONE; curve <= TONE_CURVE_FILMIC; ++curve)
+    {
+        for (int encoding = OUTPUT_ENCODING_LINEAR; encoding <= OUTPUT_ENCODING_SRGB; ++encoding)
+        {
+            PostprocessSettings settings;
+            settings.curve = static_cast<ToneCurve>(curve);
+            settings.encoding = static_cast<OutputEncoding>(encoding);
+            settings.exposure = 0.7f;
+            postprocessImage(settings, width, height, frame.data(), output.data());
+
+            float max_error = 0.0f;
+            for (size_t i = 0; i < pixel_count; i += 7)
+            {
+                const float3 x = make_float3(frame[i].x, frame[i].y, frame[i].z) * settings.exposure;
+                const float3 expected = encodeOutput(applyToneCurve(x, settings.curve, settings.reinhard_limit), settings.encoding);
+                const float3 error = fabs(make_float3(output[i].x, output[i].y, output[i].z) - expected);
+
+                // Relative above 1, curve none leaves the radiance unbounded
+                max_error = std::max(max_error, fmaxf(error) / std::max(1.0f, fmaxf(expected)));
+            }
+            if (max_error > 1.0e-4f)
+            {
+                std::cout << "[postprocess] curve: " << curve << "\tencoding: " << encoding << "\tmax_error: " << max_error << "\tFAILED" << std::endl;
+                ok = false;
+            }
+        }
+    }
+
+    // Rounding in place of the truncation of sutil is half a step brighter
+    PostprocessSettings settings;
+    settings.dither = false;
+    postprocessImage8(settings, width, height, frame.data(), rgb.data());
+    int max_difference = 0;
+    for (size_t i = 0; i < rgb.size(); ++i)
+        max_difference = std::max(max_difference, std::abs(static_cast<int>(rgb[i]) - static_cast<int>(reference[i])));
+    std::cout << "[postprocess] png_max_difference_to_std_pow: " << max_difference << std::endl;
+    ok &= max_difference <= 1;
+    ok &= checkQuantizeRange();
+
+    std::cout << "[postprocess] checks: " << (ok ? "ok" : "failed") << std::endl;
+    return ok;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+//
+// Time of the host post-process (postprocess.h) on a synthetic HDR frame
+// against the per-pixel std::pow path of sutil::displayBufferPNG, on one and
+// on all hardware threads, for float and 8 bit output. Run by redflash_bench
+// --postprocess at 3840x2160, returns false if the SIMD output differs from
+// the scalar tonemap.h formulas by more than an 8 bit step, or if the SIMD
+// and scalar 8 bit paths disagree on out of range or NaN radiance.
+//
+//-----------------------------------------------------------------------------
+
+bool benchPostprocess(int width, int height);
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include "redflash.h"
+
+//-----------------------------------------------------------------------------
+//
+// Radiance cache
+//
+// A hashed world-space grid of the radiance leaving diffuse-like surfaces.
+// Entries are keyed by the grid cell of the hit point and an octahedral bucket
+// of its normal, and hold the sum of the radiance samples and their count.
+//
+// Paths look the cache up from their second vertex on. A vertex whose entry has
+// enough samples adds the cached radiance and terminates the path, so only the
+// first bounce is traced in full. Otherwise the vertex is recorded and, when
+// the path ends, the radiance it gathered past the vertex divided by the
+// throughput up to it is added to the entry. The cache fills progressively
+// from the samples of the render and is cleared whenever the accumulation is
+// reset (camera or scene change).
+//
+// The table has a power of two capacity and uses linear probing. A slot holds
+// a non zero checksum of its cell, 0 marks an empty slot. A cell whose probes
+// are all taken by other cells is not cached.
+//
+// The functions below are shared by redflash.cu and the CPU implementation in
+// radiance_cache_grid.h.
+//
+//-----------------------------------------------------------------------------
+
+#define RADIANCE_CACHE_CAPACITY (1u << 20)
+#define RADIANCE_CACHE_PROBES 8
+
+// Vertices of a path that update the cache
+#define RADIANCE_CACHE_VERTICES 2
+
+// Normal buckets per side of the octahedral map
+#define RADIANCE_CACHE_NORMAL_RESOLUTION 4
+
+struct RadianceCacheQuery
+{
+    unsigned int slot;
+    unsigned int checksum;
+};
+
+static __host__ __device__ __inline__ unsigned int radianceCacheHash(unsigned int x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Bucket of the octahedral projection of a normalized direction
+static __host__ __device__ __inline__ unsigned int radianceCacheNormalBucket(const float3& n)
+{
+    const float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    float u = n.x / l1;
+    float v = n.y / l1;
+    if (n.z < 0.0f)
+    {
+        const float pu = u;
+        u = (1.0f - fabsf(v)) * (pu >= 0.0f ? 1.0f : -1.0f);
+        v = (1.0f - fabsf(pu)) * (v >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    const int r = RADIANCE_CACHE_NORMAL_RESOLUTION;
+    const int bu = clamp(static_cast<int>((u * 0.5f + 0.5f) * r), 0, r - 1);
+    const int bv = clamp(static_cast<int>((v * 0.5f + 0.5f) * r), 0, r - 1);
+    return static_cast<unsigned int>(bu + bv * r);
+}
+
+// Slot and checksum come from two independently seeded hashes of the cell, so
+// distinct cells share an entry only if both collide
+static __host__ __device__ __inline__ RadianceCacheQuery radianceCacheQuery(const float3& position, const float3& normal, float cell_size, unsigned int capacity)
+{
+    const float inv_cell_size = 1.0f / cell_size;
+    const unsigned int key[4] = {
+        static_cast<unsigned int>(static_cast<int>(floorf(position.x * inv_cell_size))),
+        static_cast<unsigned int>(static_cast<int>(floorf(position.y * inv_cell_size))),
+        static_cast<unsigned int>(static_cast<int>(floorf(position.z * inv_cell_size))),
+        radianceCacheNormalBucket(normal)
+    };
+
+    unsigned int h = 0u;
+    unsigned int c = 0x9e3779b9u;
+    for (int i = 0; i < 4; ++i)
+    {
+        h = radianceCacheHash(h ^ key[i]);
+        c = radianceCacheHash(c + key[i]);
+    }
+
+    RadianceCacheQuery query;
+    query.slot = h & (capacity - 1);
+    query.checksum = c | 1u;
+    return query;
+}
+
+// Slot of the given probe of a query
+static __host__ __device__ __inline__ unsigned int radianceCacheProbe(const RadianceCacheQuery& query, unsigned int probe, unsigned int capacity)
+{
+    return (query.slot + probe) & (capacity - 1);
+}
+
+// Only the radiance leaving diffuse-like surfaces is close enough to independent
+// of the outgoing direction to be cached per cell
+static __host__ __device__ __inline__ bool radianceCacheEligible(const MaterialParameter& mat, float min_roughness)
+{
+    return mat.bsdf == DIFFUSE || mat.roughness >= min_roughness;
+}
+
+// Mean radiance of an entry (xyz: sum, w: sample count) once it has min_samples
+static __host__ __device__ __inline__ bool radianceCacheMean(const float4& entry, float min_samples, float3& radiance)
+{
+    if (entry.w < min_samples || entry.w <= 0.0f)
+        return false;
+    radiance = make_float3(entry.x, entry.y, entry.z) / entry.w;
+    return true;
+}
+
+// Radiance leaving a recorded vertex towards the previous one. gathered is the
+// radiance the path collected from the vertex on, attenuation its throughput
+// up to the vertex. Returns false for vertices whose throughput is too small
+// to divide by.
+static __host__ __device__ __inline__ bool radianceCacheSample(const float3& gathered, const float3& attenuation, float3& radiance)
+{
+    if (!(fminf(attenuation.x, fminf(attenuation.y, attenuation.z)) > 1.e-4f))
+        return false;
+    radiance = gathered / attenuation;
+
+    // Also false for NaN
+    return radiance.x < 1.e30f && radiance.y < 1.e30f && radiance.z < 1.e30f;
+}
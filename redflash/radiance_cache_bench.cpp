@@ -0,0 +1,269 @@
+#include "radiance_cache_bench.h"
+#include "bench_common.h"
+#include "radiance_cache_grid.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <tuple>
+#include <vector>
+
+using namespace optix;
+
+namespace
+{
+    float3 randomDirection(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        const float z = 1.0f - 2.0f * uniform(rng);
+        const float r = sqrtf(fmaxf(0.0f, 1.0f - z * z));
+        const float phi = 2.0f * M_PIf * uniform(rng);
+        return make_float3(r * cosf(phi), r * sinf(phi), z);
+    }
+
+    // Every lookup finds the slot its cell was inserted at, and distinct cells
+    // never share a slot
+    bool checkHashing(int cell_count)
+    {
+        const float cell_size = 1.0f;
+        RadianceCacheGrid grid(cell_size);
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> uniform(-100.0f, 100.0f);
+
+        std::vector<float3> positions(cell_count);
+        std::vector<float3> normals(cell_count);
+        for (int i = 0; i < cell_count; ++i)
+        {
+            positions[i] = make_float3(uniform(rng), uniform(rng), uniform(rng));
+            normals[i] = randomDirection(rng);
+        }
+
+        std::vector<int> slots(cell_count);
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < cell_count; ++i)
+            slots[i] = grid.find(positions[i], normals[i], true);
+        const double insert_time = secondsSince(begin);
+
+        int mismatches = 0;
+        begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < cell_count; ++i)
+            mismatches += grid.find(positions[i], normals[i], false) != slots[i] ? 1 : 0;
+        const double lookup_time = secondsSince(begin);
+
+        // Cells by grid coordinates and normal bucket
+        typedef std::tuple<int, int, int, unsigned int> Cell;
+        std::map<Cell, int> cell_slots;
+        std::map<int, Cell> slot_cells;
+        int shared = 0;
+        for (int i = 0; i < cell_count; ++i)
+        {
+            if (slots[i] < 0)
+                continue;
+            const Cell cell(static_cast<int>(floorf(positions[i].x / cell_size)), static_cast<int>(floorf(positions[i].y / cell_size)),
+                static_cast<int>(floorf(positions[i].z / cell_size)), radianceCacheNormalBucket(normals[i]));
+            auto known = cell_slots.find(cell);
+            if (known != cell_slots.end())
+                mismatches += known->second != slots[i] ? 1 : 0;
+            cell_slots[cell] = slots[i];
+
+            auto owner = slot_cells.find(slots[i]);
+            if (owner != slot_cells.end() && owner->second != cell)
+                ++shared;
+            slot_cells[slots[i]] = cell;
+        }
+
+        const bool ok = mismatches == 0 && shared == 0;
+        std::ostringstream line;
+        line << "[radiance_cache] cells: " << cell_count
+            << "\toccupancy: " << grid.occupancy()
+            << "\toverflows: " << grid.overflowCount()
+            << "\tmismatches: " << mismatches
+            << "\tshared_slots: " << shared
+            << "\tinsert_mqueries_per_sec: " << cell_count / insert_time * 1.0e-6
+            << "\tlookup_mqueries_per_sec: " << cell_count / lookup_time * 1.0e-6
+            << (ok ? "" : "\tFAILED");
+        std::cout << line.str() << std::endl;
+        return ok;
+    }
+
+    //-------------------------------------------------------------------------
+    // Inside of a unit sphere with diffuse albedo a(x) and emission E(x) on the
+    // cap z > 0.7. The form factor between two patches of a sphere does not
+    // depend on their position, so the irradiance is uniform and
+    //   L(x) = E(x) + a(x) M,  M = mean(E) / (1 - mean(a))
+    //-------------------------------------------------------------------------
+
+    float emission(const float3& x)
+    {
+        return x.z > 0.7f ? 1.0f : 0.0f;
+    }
+
+    float albedo(const float3& x)
+    {
+        return 0.3f + 0.6f * (x.x * 0.5f + 0.5f);
+    }
+
+    // mean(E) = 0.15, mean(a) = 0.6
+    float exactRadiance(const float3& x)
+    {
+        return emission(x) + albedo(x) * (0.15f / 0.4f);
+    }
+
+    struct FurnaceResult
+    {
+        double bias;
+        double rmse;
+        double stddev;
+        double vertices;
+        double seconds;
+    };
+
+    // One path per point and frame. max_vertices bounds the path length, the
+    // cache (if any) is looked up from the second vertex on.
+    FurnaceResult renderFurnace(const std::vector<float3>& points, int frame_count, int max_vertices, RadianceCacheGrid* cache, float min_samples)
+    {
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+        std::vector<double> sum(points.size(), 0.0);
+        std::vector<double> sum2(points.size(), 0.0);
+        long long vertices = 0;
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frame_count; ++frame)
+        {
+            for (size_t k = 0; k < points.size(); ++k)
+            {
+                float3 x = points[k];
+                float radiance = 0.0f;
+                float attenuation = 1.0f;
+
+                int recorded = 0;
+                int slots[RADIANCE_CACHE_VERTICES];
+                float before[RADIANCE_CACHE_VERTICES];
+                float throughput[RADIANCE_CACHE_VERTICES];
+
+                for (int depth = 0;; ++depth)
+                {
+                    const float3 n = -x;
+                    ++vertices;
+
+                    float3 cached;
+                    if (cache && depth > 0 && cache->lookup(x, n, min_samples, cached))
+                    {
+                        radiance += attenuation * cached.x;
+                        break;
+                    }
+
+                    if (cache && recorded < RADIANCE_CACHE_VERTICES)
+                    {
+                        const int slot = cache->find(x, n, true);
+                        if (slot >= 0)
+                        {
+                            slots[recorded] = slot;
+                            before[recorded] = radiance;
+                            throughput[recorded] = attenuation;
+                            ++recorded;
+                        }
+                    }
+
+                    radiance += attenuation * emission(x);
+                    if (depth + 1 >= max_vertices)
+                        break;
+
+                    // Cosine sampling of the Lambertian BSDF, the chord to the next hit is 2 cos(theta)
+                    attenuation *= albedo(x);
+                    float3 d;
+                    cosine_sample_hemisphere(uniform(rng), uniform(rng), d);
+                    optix::Onb onb(n);
+                    onb.inverse_transform(d);
+                    x = normalize(x + d * (2.0f * dot(d, n)));
+                }
+
+                for (int i = 0; i < recorded; ++i)
+                {
+                    float3 sample;
+                    if (radianceCacheSample(make_float3(radiance - before[i]), make_float3(throughput[i]), sample))
+                        cache->add(slots[i], sample);
+                }
+
+                sum[k] += radiance;
+                sum2[k] += static_cast<double>(radiance) * radiance;
+            }
+        }
+
+        FurnaceResult result;
+        result.seconds = secondsSince(begin);
+        result.vertices = static_cast<double>(vertices) / (static_cast<double>(frame_count) * points.size());
+
+        double mean_exact = 0.0;
+        double bias = 0.0;
+        double error2 = 0.0;
+        double variance = 0.0;
+        for (size_t k = 0; k < points.size(); ++k)
+        {
+            const double exact = exactRadiance(points[k]);
+            const double mean = sum[k] / frame_count;
+            mean_exact += exact;
+            bias += mean - exact;
+            error2 += (mean - exact) * (mean - exact);
+            variance += fmax(0.0, sum2[k] / frame_count - mean * mean);
+        }
+        mean_exact /= points.size();
+        result.bias = bias / points.size() / mean_exact;
+        result.rmse = sqrt(error2 / points.size()) / mean_exact;
+        result.stddev = sqrt(variance / points.size()) / mean_exact;
+        return result;
+    }
+
+    void printFurnace(const std::string& mode, float cell_size, int max_vertices, const FurnaceResult& r, const RadianceCacheGrid* cache)
+    {
+        std::ostringstream line;
+        line << "[radiance_cache] mode: " << mode
+            << "\tcell_size: " << cell_size
+            << "\tmax_vertices: " << max_vertices
+            << "\trel_bias: " << r.bias
+            << "\trel_rmse: " << r.rmse
+            << "\trel_stddev_per_sample: " << r.stddev
+            << "\tvertices_per_path: " << r.vertices
+            << "\tms: " << r.seconds * 1.0e3;
+        if (cache)
+            line << "\toccupancy: " << cache->occupancy();
+        std::cout << line.str() << std::endl;
+    }
+}
+
+bool benchRadianceCache(int frame_count)
+{
+    bool ok = checkHashing(200000);
+
+    std::mt19937 rng(2);
+    std::vector<float3> points(1024);
+    for (size_t i = 0; i < points.size(); ++i)
+        points[i] = randomDirection(rng);
+
+    const int depths[] = { 2, 4, 16 };
+    FurnaceResult reference;
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); ++i)
+    {
+        reference = renderFurnace(points, frame_count, depths[i], nullptr, 0.0f);
+        printFurnace("path", 0.0f, depths[i], reference, nullptr);
+    }
+
+    // The deepest path tracing is the unbiased baseline the cache must stay close to
+    const float cell_sizes[] = { 0.025f, 0.05f, 0.1f, 0.2f, 0.4f };
+    const float min_samples = 4.0f;
+    for (size_t i = 0; i < sizeof(cell_sizes) / sizeof(cell_sizes[0]); ++i)
+    {
+        RadianceCacheGrid cache(cell_sizes[i]);
+        const FurnaceResult r = renderFurnace(points, frame_count, 16, &cache, min_samples);
+        printFurnace("cache", cell_sizes[i], 16, r, &cache);
+        ok &= fabs(r.bias) < 0.1 && r.stddev < reference.stddev && r.vertices < reference.vertices;
+    }
+
+    std::cout << "[radiance_cache] checks: " << (ok ? "ok" : "failed") << std::endl;
+    return ok;
+}
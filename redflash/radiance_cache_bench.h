@@ -0,0 +1,14 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+//
+// CPU checks and measurements of the radiance cache (radiance_cache_grid.h):
+// hashing and lookup of random cells, then the bias/variance trade-off on the
+// inside of a diffuse sphere with an emitting cap, whose radiance is known in
+// closed form. Plain path tracing truncated at several depths is compared with
+// the cache at several cell sizes over the given number of progressive frames.
+// Run by redflash_bench --radiance_cache_bias, returns false if a check failed.
+//
+//-----------------------------------------------------------------------------
+
+bool benchRadianceCache(int frame_count);
@@ -0,0 +1,73 @@
+#include "radiance_cache_grid.h"
+
+#include <algorithm>
+
+RadianceCacheGrid::RadianceCacheGrid(float cell_size, unsigned int capacity)
+    : m_cell_size(cell_size)
+    , m_keys(capacity)
+    , m_values(capacity)
+    , m_overflows(0)
+{
+    clear();
+}
+
+void RadianceCacheGrid::clear()
+{
+    std::fill(m_keys.begin(), m_keys.end(), 0u);
+    std::fill(m_values.begin(), m_values.end(), make_float4(0.0f));
+    m_overflows = 0;
+}
+
+int RadianceCacheGrid::probe(const RadianceCacheQuery& query) const
+{
+    const unsigned int capacity = static_cast<unsigned int>(m_keys.size());
+    for (unsigned int i = 0; i < RADIANCE_CACHE_PROBES; ++i)
+    {
+        const unsigned int slot = radianceCacheProbe(query, i, capacity);
+        if (m_keys[slot] == query.checksum || m_keys[slot] == 0u)
+            return static_cast<int>(slot);
+    }
+    return -1;
+}
+
+int RadianceCacheGrid::find(const float3& position, const float3& normal, bool insert)
+{
+    const RadianceCacheQuery query = radianceCacheQuery(position, normal, m_cell_size, static_cast<unsigned int>(m_keys.size()));
+    const int slot = probe(query);
+    if (slot < 0)
+    {
+        if (insert)
+            ++m_overflows;
+        return -1;
+    }
+
+    if (m_keys[slot] != query.checksum)
+    {
+        if (!insert)
+            return -1;
+        m_keys[slot] = query.checksum;
+    }
+    return slot;
+}
+
+bool RadianceCacheGrid::lookup(const float3& position, const float3& normal, float min_samples, float3& radiance) const
+{
+    const RadianceCacheQuery query = radianceCacheQuery(position, normal, m_cell_size, static_cast<unsigned int>(m_keys.size()));
+    const int slot = probe(query);
+    return slot >= 0 && m_keys[slot] == query.checksum && radianceCacheMean(m_values[slot], min_samples, radiance);
+}
+
+void RadianceCacheGrid::add(int slot, const float3& radiance)
+{
+    float4& entry = m_values[slot];
+    entry.x += radiance.x;
+    entry.y += radiance.y;
+    entry.z += radiance.z;
+    entry.w += 1.0f;
+}
+
+float RadianceCacheGrid::occupancy() const
+{
+    const size_t used = m_keys.size() - std::count(m_keys.begin(), m_keys.end(), 0u);
+    return static_cast<float>(used) / m_keys.size();
+}
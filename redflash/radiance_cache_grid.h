@@ -0,0 +1,45 @@
+#pragma once
+
+#include "radiance_cache.h"
+
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// CPU implementation of the radiance cache of redflash.cu, on the same hashing
+// and probing (radiance_cache.h). It backs the checks and the bias/variance
+// measurements of redflash_bench --radiance_cache_bias.
+//
+//-----------------------------------------------------------------------------
+
+class RadianceCacheGrid
+{
+public:
+    // capacity must be a power of two
+    RadianceCacheGrid(float cell_size, unsigned int capacity = RADIANCE_CACHE_CAPACITY);
+
+    void clear();
+
+    // Slot of the cell of position and normal, -1 if it is not cached.
+    // With insert, an empty slot is claimed for a new cell.
+    int find(const float3& position, const float3& normal, bool insert);
+
+    // Mean radiance of a cell once it has min_samples
+    bool lookup(const float3& position, const float3& normal, float min_samples, float3& radiance) const;
+
+    void add(int slot, const float3& radiance);
+
+    // Fraction of the slots in use, and cells that found no free slot
+    float occupancy() const;
+    unsigned int overflowCount() const { return m_overflows; }
+
+private:
+    // Slot of the cell of query, or the first empty slot of its probes if the
+    // cell is not cached yet. -1 if neither.
+    int probe(const RadianceCacheQuery& query) const;
+
+    float m_cell_size;
+    std::vector<unsigned int> m_keys;
+    std::vector<float4> m_values;
+    unsigned int m_overflows;
+};
@@ -20,6 +20,19 @@
 #include <optixu/optixu_math_stream_namespace.h>
 
 #include "redflash.h"
+#include "redflash_host.h"
+#include "animation.h"
+#include "lobe_table.h"
+#include "cpu_denoiser.h"
+#include "filter.h"
+#include "image_writer.h"
+#include "light_sample.h"
+#include "motion.h"
+#include "postprocess.h"
+#include "radiance_cache.h"
+#include "sphere.h"
+#include "telemetry.h"
+#include "wavefront.h"
 #include <sutil.h>
 #include <Arcball.h>
 #include <OptiXMesh.h>
@@ -36,6 +49,8 @@
 #include <stdio.h>
 #include <cstdlib>
 #include <iomanip>
+#include <random>
+#include <sstream>
 
 namespace fs = std::experimental::filesystem;
 
@@ -54,33 +69,81 @@ int width = 1920 / 4;
 int height = 1080 / 4;
 bool use_pbo = true;
 bool flag_debug = false;
+std::string scene_name = "default";
+int sphere_field_count = 10000;
 
 // sampling
 int max_depth = 10;
-int rr_begin_depth = 1;// unused
+int rr_begin_depth = RR_DEFAULT_BEGIN_DEPTH;
+int rr_mode = RR_OFF;
 int sample_per_launch = 1;
+bool use_wavefront = false;
+bool use_lobe_tables = false;
+bool use_radiance_cache = false;
+float radiance_cache_cell_size = 1.0f;
+float radiance_cache_roughness = 0.5f;
+float radiance_cache_min_samples = 8.0f;
+bool accumulate_denoise_features = true;
+int filter_type = FILTER_BOX;
+float filter_radius = 0.0f; // 0 for defaultFilterRadius
 int frame_number = 1;
 int total_sample = 0;
 bool auto_set_sample_per_launch = false;
 double auto_set_sample_per_launch_scale = 0.95;
 double last_frame_scale = 1.7;
 
+// Motion blur (see motion.h): paths sample a time in [shutter_open, shutter_close]
+// frames, off while both are equal. Moving primitives and animated transforms get
+// motion_steps keys over the frame.
+float shutter_open = 0.0f;
+float shutter_close = 0.0f;
+int motion_steps = 2;
+
+// Displacement per frame of the spheres (except the ground) and the raymarched object
+float3 object_motion = make_float3(0.0f);
+
+// Entry points. The megakernel is a single launch, the wavefront passes are
+// issued by launchWavefront().
+enum EntryPoint
+{
+    ENTRY_PATHTRACE,
+    ENTRY_WAVEFRONT_GENERATE,
+    ENTRY_WAVEFRONT_EXTEND,
+    ENTRY_WAVEFRONT_SORT,
+    ENTRY_WAVEFRONT_SHADE,
+    ENTRY_WAVEFRONT_SHADOW,
+    ENTRY_WAVEFRONT_ACCUMULATE,
+    ENTRY_FILTER_RESOLVE,
+    ENTRY_COUNT
+};
+
+// Wavefront ray queues, swapped after every bounce
+Buffer wavefront_queues[2];
+
+// Extension and shadow rays traced by the wavefront passes
+unsigned long long wavefront_ray_count = 0;
+
 // Intersect Programs
 Program pgram_intersection = 0;
 Program pgram_bounding_box = 0;
 Program pgram_intersection_raymarching = 0;
 Program pgram_bounding_box_raymarching = 0;
+Program pgram_bounding_box_raymarching_motion = 0;
 Program pgram_intersection_sphere = 0;
 Program pgram_bounding_box_sphere = 0;
+Program pgram_bounding_box_sphere_motion = 0;
+Program pgram_intersection_emitter = 0;
+Program pgram_bounding_box_emitter = 0;
 
-// Common Material
+// Common Material, one per BSDF type with its own specialized closest hit
 Program common_closest_hit = 0;
 Program common_any_hit = 0;
-Material common_material = 0;
+Material common_materials[BSDF_TYPE_COUNT];
 
 int materialCount = 0;
 optix::Buffer m_bufferMaterialParameters;
 std::vector<MaterialParameter> materialParameters;
+optix::Buffer m_bufferDisneyLobeTables;
 
 // Light Material
 Program light_closest_hit = 0;
@@ -90,6 +153,7 @@ optix::Buffer m_bufferLightParameters;
 // Post-processing
 CommandList commandListWithDenoiser;
 CommandList commandListWithoutDenoiser;
+CommandList commandListDenoiserOnly;
 PostprocessingStage tonemapStage;
 PostprocessingStage denoiserStage;
 Buffer denoisedBuffer;
@@ -120,6 +184,10 @@ int showBuffer = 0;
 // 0 - RGB only, 1 - RGB + albedo, 2 - RGB + albedo + normals
 int denoiseMode = 2;
 
+// Denoise with CpuDenoiser (cpu_denoiser.h) in place of the DLDenoiser stage
+bool use_cpu_denoiser = false;
+CpuDenoiser cpu_denoiser;
+
 // The path to the training data file set with -t or empty
 std::string training_file;
 
@@ -135,6 +203,29 @@ bool useFirstTrainingDataPath = true;
 // Contains info for the currently shown buffer
 std::string bufferInfo;
 
+// Output prefix of the Chrome trace and summary set with --telemetry or empty
+std::string telemetry_prefix;
+
+// Keyframed camera and transforms set with --animation, rendered at animation_fps
+std::string animation_file;
+AnimationTrack animation;
+float animation_fps = 24.0f;
+
+// Transform above a geometry group with a track in the animation and its current keys
+struct AnimatedObject
+{
+    const TransformTrack* track;
+    Transform transform;
+
+    // 12 floats per motion key, the top 3 rows of the object to world matrix
+    std::vector<float> keys;
+};
+std::vector<AnimatedObject> animated_objects;
+
+// Top level accelerations, refit when only the animated transforms change
+Acceleration top_acceleration;
+Acceleration top_light_acceleration;
+
 
 // Camera state
 float3         camera_up;
@@ -272,6 +363,18 @@ Buffer getNormalBuffer()
     return context["input_normal_buffer"]->getBuffer();
 }
 
+Buffer getFilterBuffer()
+{
+    return context["filter_buffer"]->getBuffer();
+}
+
+#if REDFLASH_PROFILE
+Buffer getProfileBuffer()
+{
+    return context["profile_buffer"]->getBuffer();
+}
+#endif
+
 
 void destroyContext()
 {
@@ -293,6 +396,38 @@ void registerExitHandler()
 #endif
 }
 
+// Motion keys of the moving primitives, 1 if they are static
+int objectMotionSteps()
+{
+    const bool moving = object_motion.x != 0.0f || object_motion.y != 0.0f || object_motion.z != 0.0f;
+    return shutter_close > shutter_open && moving ? motion_steps : 1;
+}
+
+// Position at each of the objectMotionSteps() keys of a primitive at position at time 0
+void appendMotionKeys(const float3& position, bool moving, std::vector<float3>& keys)
+{
+    const int steps = objectMotionSteps();
+    for (int k = 0; k < steps; ++k)
+        keys.push_back(moving && steps > 1 ? position + object_motion * (static_cast<float>(k) / (steps - 1)) : position);
+}
+
+// Geometry with motion keys over the frame, clamped outside (see motion.h)
+void setGeometryMotion(Geometry geometry, int steps)
+{
+    geometry->setMotionSteps(steps);
+    geometry->setMotionRange(0.0f, 1.0f);
+    geometry->setMotionBorderMode(RT_MOTIONBORDERMODE_CLAMP, RT_MOTIONBORDERMODE_CLAMP);
+}
+
+// Acceleration over geometry that moves with object_motion
+Acceleration createMotionAcceleration()
+{
+    Acceleration accel = context->createAcceleration("Trbvh");
+    if (objectMotionSteps() > 1)
+        accel->setProperty("motion_steps", std::to_string(objectMotionSteps()));
+    return accel;
+}
+
 GeometryInstance createRaymrachingObject(const float3& center, const float3& world_scale, const float3& unit_scale)
 {
     Geometry raymarching = context->createGeometry();
@@ -306,25 +441,86 @@ GeometryInstance createRaymrachingObject(const float3& center, const float3& wor
     raymarching["aabb_min"]->setFloat(center - world_scale);
     raymarching["aabb_max"]->setFloat(center + world_scale);
 
+    // Offsets of the center at the motion keys
+    std::vector<float3> motion;
+    appendMotionKeys(make_float3(0.0f), true, motion);
+    const int steps = static_cast<int>(motion.size());
+    Buffer motion_buffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, steps > 1 ? steps : 0);
+    if (steps > 1)
+    {
+        memcpy(motion_buffer->map(0, RT_BUFFER_MAP_WRITE_DISCARD), motion.data(), motion.size() * sizeof(float3));
+        motion_buffer->unmap();
+        setGeometryMotion(raymarching, steps);
+        raymarching->setBoundingBoxProgram(pgram_bounding_box_raymarching_motion);
+    }
+    raymarching["center_motion"]->setBuffer(motion_buffer);
+    raymarching["center_motion_steps"]->setInt(steps);
+
     GeometryInstance gi = context->createGeometryInstance();
     gi->setGeometry(raymarching);
+    gi["primitive_type"]->setInt(PRIMITIVE_RAYMARCHING);
     return gi;
 }
 
-GeometryInstance createSphereObject(const float3& center, const float radius)
+// All spheres in one GeometryInstance, see sphere.h. materials is indexed by SphereRecord::material_index.
+// Moving spheres have the same number of motion_centers each, see appendMotionKeys.
+GeometryInstance createSphereBatch(const std::vector<SphereRecord>& spheres, const std::vector<Material>& materials,
+    const std::vector<float3>& motion_centers = std::vector<float3>())
 {
+    Buffer records = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_USER);
+    records->setElementSize(sizeof(SphereRecord));
+    records->setSize(spheres.size());
+    memcpy(records->map(0, RT_BUFFER_MAP_WRITE_DISCARD), spheres.data(), spheres.size() * sizeof(SphereRecord));
+    records->unmap();
+
     Geometry sphere = context->createGeometry();
-    sphere->setPrimitiveCount(1u);
+    sphere->setPrimitiveCount(static_cast<unsigned int>(spheres.size()));
     sphere->setIntersectionProgram(pgram_intersection_sphere);
     sphere->setBoundingBoxProgram(pgram_bounding_box_sphere);
+    sphere["sphere_records"]->setBuffer(records);
 
-    sphere["center"]->setFloat(center);
-    sphere["radius"]->setFloat(radius);
-    sphere["aabb_min"]->setFloat(center - radius);
-    sphere["aabb_max"]->setFloat(center + radius);
+    const int steps = motion_centers.empty() ? 1 : static_cast<int>(motion_centers.size() / spheres.size());
+    Buffer motion = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, steps > 1 ? motion_centers.size() : 0);
+    if (steps > 1)
+    {
+        memcpy(motion->map(0, RT_BUFFER_MAP_WRITE_DISCARD), motion_centers.data(), motion_centers.size() * sizeof(float3));
+        motion->unmap();
+        setGeometryMotion(sphere, steps);
+        sphere->setBoundingBoxProgram(pgram_bounding_box_sphere_motion);
+    }
+    sphere["sphere_motion_centers"]->setBuffer(motion);
+    sphere["sphere_motion_steps"]->setInt(steps);
 
     GeometryInstance gi = context->createGeometryInstance();
     gi->setGeometry(sphere);
+    gi->setMaterialCount(static_cast<unsigned int>(materials.size()));
+    for (size_t i = 0; i < materials.size(); ++i)
+        gi->setMaterial(static_cast<unsigned int>(i), materials[i]);
+    gi["primitive_type"]->setInt(PRIMITIVE_SPHERE);
+    return gi;
+}
+
+// Quad and triangle lights in one GeometryInstance, lights[i] is sysLightParameters[light_offset + i]
+GeometryInstance createEmitterBatch(const std::vector<LightParameter>& lights, int light_offset)
+{
+    Buffer records = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_USER);
+    records->setElementSize(sizeof(LightParameter));
+    records->setSize(lights.size());
+    memcpy(records->map(0, RT_BUFFER_MAP_WRITE_DISCARD), lights.data(), lights.size() * sizeof(LightParameter));
+    records->unmap();
+
+    Geometry emitter = context->createGeometry();
+    emitter->setPrimitiveCount(static_cast<unsigned int>(lights.size()));
+    emitter->setIntersectionProgram(pgram_intersection_emitter);
+    emitter->setBoundingBoxProgram(pgram_bounding_box_emitter);
+    emitter["emitter_lights"]->setBuffer(records);
+    emitter["emitter_light_offset"]->setInt(light_offset);
+
+    GeometryInstance gi = context->createGeometryInstance();
+    gi->setGeometry(emitter);
+    gi->setMaterialCount(1);
+    gi->setMaterial(0, light_material);
+    gi["primitive_type"]->setInt(PRIMITIVE_EMITTER);
     return gi;
 }
 
@@ -341,7 +537,7 @@ GeometryInstance createMesh(
     mesh.ignore_mats = false;
 
     // NOTE: registerMaterial ŏ㏑̂ŁA̎w͈ӖȂ
-    mesh.material = common_material;
+    mesh.material = common_materials[DISNEY];
 
     mesh.closest_hit = common_closest_hit;
     mesh.any_hit = common_any_hit;
@@ -349,53 +545,125 @@ GeometryInstance createMesh(
     // NOTE: OptiXł͍sDۂ̂ŁAE珇ԂɓKp
     Matrix4x4 mat = Matrix4x4::translate(center) * Matrix4x4::rotate(radians, axis) * Matrix4x4::scale(scale);
 
-    loadMesh(filename, mesh, mat);
+    {
+        telemetry::Scope scope(TELEMETRY_ASSET_LOAD);
+        loadMesh(filename, mesh, mat);
+    }
+    mesh.geom_instance["primitive_type"]->setInt(PRIMITIVE_TRIANGLE);
     return mesh.geom_instance;
 }
 
-void setupBSDF(std::vector<std::string> &bsdf_paths)
+
+// Resizes the path state and queues of the wavefront mode to one path per pixel.
+// They stay empty when the megakernel is used.
+void resizeWavefrontBuffers()
 {
-    const int bsdf_type_count = bsdf_paths.size();
+    const RTsize path_count = use_wavefront ? static_cast<RTsize>(width) * height : 0;
+
+    context["wavefront_paths"]->getBuffer()->setSize(path_count);
+    context["wavefront_hits"]->getBuffer()->setSize(path_count);
+    context["wavefront_shadow_rays"]->getBuffer()->setSize(path_count);
+    context["wavefront_sorted_queue"]->getBuffer()->setSize(path_count);
+    wavefront_queues[0]->setSize(path_count);
+    wavefront_queues[1]->setSize(path_count);
+}
 
-    std::vector<std::string> ptxs;
-    for (int i = 0; i < bsdf_type_count; ++i)
-    {
-        ptxs.push_back(sutil::getPtxString(SAMPLE_NAME, bsdf_paths[i].c_str()));
-    }
+// The radiance cache is empty unless enabled, see radiance_cache.h
+void createRadianceCacheBuffers()
+{
+    const RTsize capacity = use_radiance_cache ? RADIANCE_CACHE_CAPACITY : 0;
+    context["radiance_cache_keys"]->set(context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_UNSIGNED_INT, capacity));
+    context["radiance_cache_values"]->set(context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_FLOAT4, capacity));
+}
 
-    std::string var_prefix = "prgs_BSDF_";
-    std::vector<std::string> bsdf_prg_names = { "Sample", "Eval", "Pdf" };
+// Drops all cached radiance, whenever the accumulation is reset
+void clearRadianceCache()
+{
+    if (!use_radiance_cache)
+        return;
 
-    for (auto it = bsdf_prg_names.cbegin(); it != bsdf_prg_names.end(); ++it) {
-        optix::Buffer buffer_BSDF_prgs = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_PROGRAM_ID, bsdf_type_count);
-        int* BSDF_prgs = (int*)buffer_BSDF_prgs->map(0, RT_BUFFER_MAP_WRITE_DISCARD);
+    telemetry::Scope scope(TELEMETRY_RADIANCE_CACHE_CLEAR);
+    Buffer keys = context["radiance_cache_keys"]->getBuffer();
+    Buffer values = context["radiance_cache_values"]->getBuffer();
+    memset(keys->map(0, RT_BUFFER_MAP_WRITE_DISCARD), 0, RADIANCE_CACHE_CAPACITY * sizeof(unsigned int));
+    keys->unmap();
+    memset(values->map(0, RT_BUFFER_MAP_WRITE_DISCARD), 0, RADIANCE_CACHE_CAPACITY * sizeof(float4));
+    values->unmap();
+}
 
-        for (int i = 0; i < bsdf_type_count; ++i)
-        {
-            Program prg = context->createProgramFromPTXString(ptxs[i], *it);
-            BSDF_prgs[i] = prg->getId();
-        }
+// Radius of the reconstruction filter in pixels, see filter.h
+float filterRadius()
+{
+    return filter_radius > 0.0f ? filter_radius : defaultFilterRadius(filter_type);
+}
 
-        buffer_BSDF_prgs->unmap();
-        context[var_prefix + *it]->setBuffer(buffer_BSDF_prgs);
-    }
+// Drops the splatted samples, whenever the accumulation is reset
+void clearFilterBuffer()
+{
+    if (filter_type == FILTER_BOX)
+        return;
+
+    Buffer buffer = getFilterBuffer();
+    memset(buffer->map(0, RT_BUFFER_MAP_WRITE_DISCARD), 0, static_cast<size_t>(width) * height * sizeof(float4));
+    buffer->unmap();
+}
+
+void createWavefrontBuffers()
+{
+    Buffer paths = context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_USER, 0);
+    paths->setElementSize(sizeof(WavefrontPath));
+    context["wavefront_paths"]->set(paths);
+
+    Buffer hits = context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_USER, 0);
+    hits->setElementSize(sizeof(WavefrontHit));
+    context["wavefront_hits"]->set(hits);
+
+    Buffer shadowRays = context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_USER, 0);
+    shadowRays->setElementSize(sizeof(WavefrontShadowRay));
+    context["wavefront_shadow_rays"]->set(shadowRays);
+
+    context["wavefront_sorted_queue"]->set(context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_UNSIGNED_INT, 0));
+    wavefront_queues[0] = context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_UNSIGNED_INT, 0);
+    wavefront_queues[1] = context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_UNSIGNED_INT, 0);
+    context["wavefront_queue"]->set(wavefront_queues[0]);
+    context["wavefront_next_queue"]->set(wavefront_queues[1]);
+
+    context["wavefront_counters"]->set(context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_UNSIGNED_INT, WAVEFRONT_COUNTER_COUNT));
+    context["wavefront_wave"]->setUint(0);
+
+    resizeWavefrontBuffers();
 }
 
 void createContext()
 {
+    // Checked when the options are parsed, this catches callers that set them directly
+    if (use_wavefront && wavefrontUnsupportedOption())
+        throw Exception(std::string(wavefrontUnsupportedOption()) + " is not supported in wavefront mode");
+
     context = Context::create();
-    context->setRayTypeCount(2);
-    context->setEntryPointCount(1);
+    context->setRayTypeCount(3);
+    context->setEntryPointCount(ENTRY_COUNT);
     context->setStackSize(1800);
     context->setMaxTraceDepth(2);
 
     context["scene_epsilon"]->setFloat(0.001f);
-    // context["rr_begin_depth"]->setUint( rr_begin_depth );
+    context["rr_begin_depth"]->setUint(rr_begin_depth);
+    context["rr_mode"]->setUint(rr_mode);
     context["max_depth"]->setUint(max_depth);
+    context["use_lobe_tables"]->setUint(use_lobe_tables);
+    context["use_radiance_cache"]->setUint(use_radiance_cache);
+    context["radiance_cache_cell_size"]->setFloat(radiance_cache_cell_size);
+    context["radiance_cache_roughness"]->setFloat(radiance_cache_roughness);
+    context["radiance_cache_min_samples"]->setFloat(radiance_cache_min_samples);
+    context["accumulate_denoise_features"]->setUint(accumulate_denoise_features);
+    context["filter_type"]->setUint(filter_type);
+    context["filter_radius"]->setFloat(filterRadius());
+    context["filter_extent"]->setInt(filterExtent(filterRadius()));
     context["sample_per_launch"]->setUint(sample_per_launch);
     context["total_sample"]->setUint(total_sample);
     context["usePostTonemap"]->setUint(use_post_tonemap);
     context["tonemap_exposure"]->setFloat(tonemap_exposure);
+    context["shutter"]->setFloat(shutter_open, shutter_close);
 
     Buffer output_buffer = sutil::createOutputBuffer(context, RT_FORMAT_FLOAT4, width, height, use_pbo);
     context["output_buffer"]->set(output_buffer);
@@ -413,42 +681,80 @@ void createContext()
     Buffer normalBuffer = sutil::createInputOutputBuffer(context, RT_FORMAT_FLOAT4, width, height, use_pbo);
     context["input_normal_buffer"]->set(normalBuffer);
 
+    // Weighted sums and weights of the splatted samples, empty with the box filter
+    const RTsize filter_width = filter_type != FILTER_BOX ? width : 0;
+    const RTsize filter_height = filter_type != FILTER_BOX ? height : 0;
+    context["filter_buffer"]->set(context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_FLOAT4, filter_width, filter_height));
+
+#if REDFLASH_PROFILE
+    // Per-pixel counters: raymarch steps, bounces, shadow rays, BSDF evaluations
+    Buffer profileBuffer = context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_UNSIGNED_INT4, width, height);
+    context["profile_buffer"]->set(profileBuffer);
+#endif
+
     denoisedBuffer = sutil::createOutputBuffer(context, RT_FORMAT_FLOAT4, width, height, use_pbo);
     emptyBuffer = context->createBuffer(RT_BUFFER_OUTPUT, RT_FORMAT_FLOAT4, 0, 0);
     trainingDataBuffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_UNSIGNED_BYTE, 0);
 
     // Setup programs
     const char *ptx = sutil::getPtxString(SAMPLE_NAME, "redflash.cu");
-    context->setRayGenerationProgram(0, context->createProgramFromPTXString(ptx, "pathtrace_camera"));
-    context->setExceptionProgram(0, context->createProgramFromPTXString(ptx, "exception"));
+    context->setRayGenerationProgram(ENTRY_PATHTRACE, context->createProgramFromPTXString(ptx, "pathtrace_camera"));
+    context->setExceptionProgram(ENTRY_PATHTRACE, context->createProgramFromPTXString(ptx, "exception"));
+    context->setRayGenerationProgram(ENTRY_FILTER_RESOLVE, context->createProgramFromPTXString(ptx, "filter_resolve"));
     context->setMissProgram(0, context->createProgramFromPTXString(ptx, "envmap_miss"));
     context["bad_color"]->setFloat(1000000.0f, 0.0f, 1000000.0f); // Super magenta to make sure it doesn't get averaged out in the progressive rendering.
 
     // Common Materials
-    common_material = context->createMaterial();
-    common_closest_hit = context->createProgramFromPTXString(ptx, "closest_hit");
+    // The BSDFs are compiled into the closest hit programs (see bsdf.h), indexed by BSDFType
+    const char* const closest_hit_names[BSDF_TYPE_COUNT] = { "closest_hit_diffuse", "closest_hit_disney" };
     common_any_hit = context->createProgramFromPTXString(ptx, "shadow");
-    common_material->setClosestHitProgram(0, common_closest_hit);
-    common_material->setAnyHitProgram(1, common_any_hit);
+    for (int i = 0; i < BSDF_TYPE_COUNT; ++i)
+    {
+        common_materials[i] = context->createMaterial();
+        common_materials[i]->setClosestHitProgram(0, context->createProgramFromPTXString(ptx, closest_hit_names[i]));
+        common_materials[i]->setAnyHitProgram(1, common_any_hit);
+
+        // For sphere batches, which select the material per sphere
+        common_materials[i]["bsdf_id"]->setInt(i);
+    }
+    common_closest_hit = common_materials[DISNEY]->getClosestHitProgram(0);
 
     // Light Materials
     light_material = context->createMaterial();
     light_closest_hit = context->createProgramFromPTXString(ptx, "light_closest_hit");
     light_material->setClosestHitProgram(0, light_closest_hit);
 
+    // Wavefront passes
+    context->setRayGenerationProgram(ENTRY_WAVEFRONT_GENERATE, context->createProgramFromPTXString(ptx, "wavefront_generate"));
+    context->setRayGenerationProgram(ENTRY_WAVEFRONT_EXTEND, context->createProgramFromPTXString(ptx, "wavefront_extend"));
+    context->setRayGenerationProgram(ENTRY_WAVEFRONT_SORT, context->createProgramFromPTXString(ptx, "wavefront_sort"));
+    context->setRayGenerationProgram(ENTRY_WAVEFRONT_SHADE, context->createProgramFromPTXString(ptx, "wavefront_shade"));
+    context->setRayGenerationProgram(ENTRY_WAVEFRONT_SHADOW, context->createProgramFromPTXString(ptx, "wavefront_shadow"));
+    context->setRayGenerationProgram(ENTRY_WAVEFRONT_ACCUMULATE, context->createProgramFromPTXString(ptx, "wavefront_accumulate"));
+    context->setMissProgram(WAVEFRONT_RAY_TYPE, context->createProgramFromPTXString(ptx, "wavefront_miss"));
+    Program wavefront_closest_hit = context->createProgramFromPTXString(ptx, "wavefront_closest_hit");
+    for (int i = 0; i < BSDF_TYPE_COUNT; ++i)
+        common_materials[i]->setClosestHitProgram(WAVEFRONT_RAY_TYPE, wavefront_closest_hit);
+    light_material->setClosestHitProgram(WAVEFRONT_RAY_TYPE, context->createProgramFromPTXString(ptx, "wavefront_light_closest_hit"));
+    createWavefrontBuffers();
+    createRadianceCacheBuffers();
+
     // Raymarching programs
     ptx = sutil::getPtxString(SAMPLE_NAME, "intersect_raymarching.cu");
     pgram_bounding_box_raymarching = context->createProgramFromPTXString(ptx, "bounds");
+    pgram_bounding_box_raymarching_motion = context->createProgramFromPTXString(ptx, "bounds_motion");
     pgram_intersection_raymarching = context->createProgramFromPTXString(ptx, "intersect");
 
     // Sphere programs
     ptx = sutil::getPtxString(SAMPLE_NAME, "intersect_sphere.cu");
     pgram_bounding_box_sphere = context->createProgramFromPTXString(ptx, "bounds");
+    pgram_bounding_box_sphere_motion = context->createProgramFromPTXString(ptx, "bounds_motion");
     pgram_intersection_sphere = context->createProgramFromPTXString(ptx, "sphere_intersect");
 
-    // BSDF
-    std::vector<std::string> bsdf_paths{ "bsdf_diffuse.cu", "bsdf_disney.cu" };
-    setupBSDF(bsdf_paths);
+    // Quad and triangle light programs
+    ptx = sutil::getPtxString(SAMPLE_NAME, "intersect_emitter.cu");
+    pgram_bounding_box_emitter = context->createProgramFromPTXString(ptx, "bounds");
+    pgram_intersection_emitter = context->createProgramFromPTXString(ptx, "emitter_intersect");
 }
 
 void setupPostprocessing()
@@ -483,36 +789,244 @@ void setupPostprocessing()
     if (commandListWithDenoiser)
     {
         commandListWithDenoiser->destroy();
+        commandListDenoiserOnly->destroy();
+        commandListWithDenoiser = 0;
+        commandListDenoiserOnly = 0;
+    }
+
+    if (commandListWithoutDenoiser)
+    {
         commandListWithoutDenoiser->destroy();
     }
 
     // Create two command lists with two postprocessing topologies we want:
     // One with the denoiser stage, one without. Note that both share the same
     // tonemap stage.
+    // The wavefront passes are launched by executeFrame() before the list, so
+    // in that mode the list without denoiser is only needed for the tonemap.
+    // The CPU denoiser runs after the list without denoiser (denoiseOnCpu), the
+    // lists with the DLDenoiser stage are not created.
+
+    if (!use_cpu_denoiser)
+    {
+        commandListWithDenoiser = context->createCommandList();
+        if (!use_wavefront)
+            commandListWithDenoiser->appendLaunch(ENTRY_PATHTRACE, width, height);
+        if (filter_type != FILTER_BOX)
+            commandListWithDenoiser->appendLaunch(ENTRY_FILTER_RESOLVE, width, height);
+        if (use_post_tonemap)
+            commandListWithDenoiser->appendPostprocessingStage(tonemapStage, width, height);
+        commandListWithDenoiser->appendPostprocessingStage(denoiserStage, width, height);
+        commandListWithDenoiser->finalize();
+    }
 
-    commandListWithDenoiser = context->createCommandList();
-    commandListWithDenoiser->appendLaunch(0, width, height);
-    if (use_post_tonemap)
-        commandListWithDenoiser->appendPostprocessingStage(tonemapStage, width, height);
-    commandListWithDenoiser->appendPostprocessingStage(denoiserStage, width, height);
-    commandListWithDenoiser->finalize();
+    commandListWithoutDenoiser = 0;
+    if (!use_wavefront || use_post_tonemap)
+    {
+        commandListWithoutDenoiser = context->createCommandList();
+        if (!use_wavefront)
+            commandListWithoutDenoiser->appendLaunch(ENTRY_PATHTRACE, width, height);
+        if (filter_type != FILTER_BOX)
+            commandListWithoutDenoiser->appendLaunch(ENTRY_FILTER_RESOLVE, width, height);
+        if (use_post_tonemap)
+            commandListWithoutDenoiser->appendPostprocessingStage(tonemapStage, width, height);
+        commandListWithoutDenoiser->finalize();
+    }
 
-    commandListWithoutDenoiser = context->createCommandList();
-    commandListWithoutDenoiser->appendLaunch(0, width, height);
-    if (use_post_tonemap)
-        commandListWithoutDenoiser->appendPostprocessingStage(tonemapStage, width, height);
-    commandListWithoutDenoiser->finalize();
+    // Denoiser alone, run after commandListWithoutDenoiser so that the launch and
+    // the denoiser can be timed separately in file mode.
+    if (!use_cpu_denoiser)
+    {
+        commandListDenoiserOnly = context->createCommandList();
+        commandListDenoiserOnly->appendPostprocessingStage(denoiserStage, width, height);
+        commandListDenoiserOnly->finalize();
+    }
 
     postprocessing_needs_init = false;
 }
 
-void registerMaterial(GeometryInstance& gi, MaterialParameter& mat, bool isLight = false)
+// Same as the DLDenoiser stage with CpuDenoiser: denoises liner_buffer guided by
+// the albedo and normal buffers of denoiseMode, blends the original back in by
+// denoiseBlend and writes denoisedBuffer tonemapped like redflash.cu.
+void denoiseOnCpu()
+{
+    Buffer liner = getLinerBuffer();
+    Buffer albedo = getAlbedoBuffer();
+    Buffer normal = getNormalBuffer();
+
+    CpuDenoiserSettings settings;
+    settings.use_albedo = denoiseMode > 0;
+    settings.use_normal = denoiseMode > 1;
+
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    std::vector<float4> denoised(pixel_count);
+    const float4* color = static_cast<const float4*>(liner->map(0, RT_BUFFER_MAP_READ));
+    const float4* albedo_data = static_cast<const float4*>(albedo->map(0, RT_BUFFER_MAP_READ));
+    const float4* normal_data = static_cast<const float4*>(normal->map(0, RT_BUFFER_MAP_READ));
+    cpu_denoiser.denoise(settings, width, height, color, albedo_data, normal_data, denoised.data());
+
+    if (denoiseBlend > 0.0f)
+    {
+        for (size_t i = 0; i < pixel_count; ++i)
+            denoised[i] = lerp(denoised[i], color[i], denoiseBlend);
+    }
+
+    // The tonemap of the camera program (ACES and gamma 2.2) on the host
+    PostprocessSettings postprocess;
+    postprocess.exposure = tonemap_exposure;
+    postprocess.curve = TONE_CURVE_ACES;
+    postprocess.encoding = OUTPUT_ENCODING_GAMMA22;
+    postprocessImage(postprocess, width, height, denoised.data(), static_cast<float4*>(denoisedBuffer->map(0, RT_BUFFER_MAP_WRITE_DISCARD)));
+    denoisedBuffer->unmap();
+
+    normal->unmap();
+    albedo->unmap();
+    liner->unmap();
+}
+
+// Checks the sort pass against the CPU implementation in wavefront.h (--debug only)
+void validateWavefrontSort(Buffer queueBuffer, unsigned int queue_length)
+{
+    const size_t path_count = static_cast<size_t>(width) * height;
+    std::vector<unsigned int> queue(queue_length);
+    std::vector<unsigned int> sorted(queue_length);
+    std::vector<unsigned int> keys(path_count);
+
+    memcpy(&queue[0], queueBuffer->map(0, RT_BUFFER_MAP_READ), queue_length * sizeof(unsigned int));
+    queueBuffer->unmap();
+
+    Buffer sortedBuffer = context["wavefront_sorted_queue"]->getBuffer();
+    memcpy(&sorted[0], sortedBuffer->map(0, RT_BUFFER_MAP_READ), queue_length * sizeof(unsigned int));
+    sortedBuffer->unmap();
+
+    Buffer hitBuffer = context["wavefront_hits"]->getBuffer();
+    const WavefrontHit* hits = static_cast<const WavefrontHit*>(hitBuffer->map(0, RT_BUFFER_MAP_READ));
+    for (size_t i = 0; i < path_count; ++i)
+        keys[i] = hits[i].key;
+    hitBuffer->unmap();
+
+    std::vector<unsigned int> counters;
+    std::vector<unsigned int> cpu_sorted;
+    wavefront::clearCounters(counters);
+    wavefront::countKeys(queue, keys, counters);
+    wavefront::sortQueue(queue, keys, counters, cpu_sorted);
+
+    // Paths of equal key may be in any order on the GPU, the key sequence must match
+    bool ok = wavefront::isSortedQueue(queue, keys, sorted);
+    for (size_t i = 0; ok && i < sorted.size(); ++i)
+        ok = keys[sorted[i]] == keys[cpu_sorted[i]];
+
+    if (!ok)
+        std::cerr << "[debug] wavefront sort does not match the CPU queue, queue_length: " << queue_length << std::endl;
+}
+
+// Renders sample_per_launch samples per pixel with the wavefront passes, see wavefront.h.
+// Every sample is a wave of one path per pixel that is advanced bounce by bounce
+// until its queue is empty.
+void launchWavefront()
+{
+    Buffer counterBuffer = context["wavefront_counters"]->getBuffer();
+
+    for (int wave = 0; wave < sample_per_launch; ++wave)
+    {
+        Buffer queue = wavefront_queues[0];
+        Buffer next_queue = wavefront_queues[1];
+
+        context["wavefront_queue"]->set(queue);
+        context["wavefront_wave"]->setUint(wave);
+        context->launch(ENTRY_WAVEFRONT_GENERATE, width, height);
+
+        unsigned int queue_length = width * height;
+        while (queue_length > 0)
+        {
+            context["wavefront_queue"]->set(queue);
+            context["wavefront_next_queue"]->set(next_queue);
+
+            unsigned int* counters = static_cast<unsigned int*>(counterBuffer->map(0, RT_BUFFER_MAP_WRITE_DISCARD));
+            memset(counters, 0, WAVEFRONT_COUNTER_COUNT * sizeof(unsigned int));
+            counterBuffer->unmap();
+
+            context->launch(ENTRY_WAVEFRONT_EXTEND, queue_length, 1);
+
+            // Bucket offsets of the counting sort from the key histogram of the extension pass
+            counters = static_cast<unsigned int*>(counterBuffer->map());
+            wavefrontScanHistogram(counters);
+            counterBuffer->unmap();
+
+            context->launch(ENTRY_WAVEFRONT_SORT, queue_length, 1);
+            if (flag_debug)
+                validateWavefrontSort(queue, queue_length);
+
+            context->launch(ENTRY_WAVEFRONT_SHADE, queue_length, 1);
+
+            counters = static_cast<unsigned int*>(counterBuffer->map(0, RT_BUFFER_MAP_READ));
+            const unsigned int shadow_count = counters[WAVEFRONT_COUNTER_SHADOW];
+            const unsigned int next_length = counters[WAVEFRONT_COUNTER_EXTEND];
+            counterBuffer->unmap();
+
+            if (shadow_count > 0)
+                context->launch(ENTRY_WAVEFRONT_SHADOW, shadow_count, 1);
+
+            wavefront_ray_count += queue_length + shadow_count;
+            std::swap(queue, next_queue);
+            queue_length = next_length;
+        }
+    }
+
+    context->launch(ENTRY_WAVEFRONT_ACCUMULATE, width, height);
+}
+
+// Renders one launch without post-processing
+void launchPathtrace()
+{
+    if (use_wavefront)
+        launchWavefront();
+    else
+        context->launch(ENTRY_PATHTRACE, width, height);
+    if (filter_type != FILTER_BOX)
+        context->launch(ENTRY_FILTER_RESOLVE, width, height);
+}
+
+// Renders one launch and runs the post-processing of commandList. The megakernel
+// launch is part of the command lists, the wavefront passes are issued here.
+void executeFrame(CommandList commandList)
+{
+    if (use_wavefront)
+        launchWavefront();
+    if (commandList)
+        commandList->execute();
+}
+
+// Returns the material id
+int addMaterialParameter(const MaterialParameter& mat)
 {
     materialParameters.push_back(mat);
+    return materialCount++;
+}
+
+void registerMaterial(GeometryInstance& gi, MaterialParameter& mat, bool isLight = false)
+{
     gi->setMaterialCount(1);
-    gi->setMaterial(0, isLight ? light_material : common_material);
+    gi->setMaterial(0, isLight ? light_material : common_materials[mat.bsdf]);
     gi["bsdf_id"]->setInt(mat.bsdf);
-    gi["material_id"]->setInt(materialCount++);
+    gi["material_id"]->setInt(addMaterialParameter(mat));
+}
+
+// Sphere of a batch with a common material (see createSphereBatch)
+SphereRecord createSphereRecord(const float3& center, const float radius, const MaterialParameter& mat)
+{
+    SphereRecord sphere;
+    sphere.center = center;
+    sphere.radius = radius;
+    sphere.material_id = addMaterialParameter(mat);
+    sphere.light_id = -1;
+    sphere.material_index = mat.bsdf;
+    return sphere;
+}
+
+std::vector<Material> commonMaterials()
+{
+    return std::vector<Material>(common_materials, common_materials + BSDF_TYPE_COUNT);
 }
 
 void updateMaterialParameters()
@@ -609,15 +1123,73 @@ GeometryGroup createGeometry()
 
     // Create shadow group (no light)
     GeometryGroup shadow_group = context->createGeometryGroup(gis.begin(), gis.end());
-    shadow_group->setAcceleration(context->createAcceleration("Trbvh"));
+    shadow_group->setAcceleration(createMotionAcceleration());
     return shadow_group;
 }
 
+// One sided quad light, emitting on the side of cross(u, v)
+LightParameter createQuadLight(const float3& corner, const float3& u, const float3& v, const float3& emission)
+{
+    LightParameter light;
+    light.lightType = QUAD;
+    light.position = corner;
+    light.u = u;
+    light.v = v;
+    light.radius = 0.0f;
+    light.emission = emission;
+    setupPlanarLight(light);
+    return light;
+}
+
+// Appends one triangle light per triangle of an indexed mesh, emitting on the
+// side of counterclockwise triangles
+void addMeshEmitter(const std::vector<float3>& vertices, const std::vector<int3>& indices, const float3& emission, std::vector<LightParameter>& lights)
+{
+    for (auto tri = indices.begin(); tri != indices.end(); ++tri)
+    {
+        LightParameter light;
+        light.lightType = TRIANGLE;
+        light.position = vertices[tri->x];
+        light.u = vertices[tri->y] - vertices[tri->x];
+        light.v = vertices[tri->z] - vertices[tri->x];
+        light.radius = 0.0f;
+        light.emission = emission;
+        setupPlanarLight(light);
+        lights.push_back(light);
+    }
+}
+
+// Octahedron mesh emitting outwards
+void addOctahedronEmitter(const float3& center, float size, const float3& emission, std::vector<LightParameter>& lights)
+{
+    std::vector<float3> vertices;
+    std::vector<int3> indices;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int sign = 1; sign >= -1; sign -= 2)
+        {
+            float3 offset = make_float3(0.0f);
+            (axis == 0 ? offset.x : (axis == 1 ? offset.y : offset.z)) = sign * size;
+            vertices.push_back(center + offset);
+        }
+    }
+
+    // Vertex 2 * axis + (sign < 0), one triangle per octant
+    for (int octant = 0; octant < 8; ++octant)
+    {
+        const int x = (octant & 1), y = 2 + ((octant >> 1) & 1), z = 4 + ((octant >> 2) & 1);
+        const bool flip = ((octant & 1) + ((octant >> 1) & 1) + ((octant >> 2) & 1)) % 2 == 1;
+        indices.push_back(flip ? make_int3(x, z, y) : make_int3(x, y, z));
+    }
+
+    addMeshEmitter(vertices, indices, emission, lights);
+}
+
 GeometryGroup createGeometryLight()
 {
     // Light
     std::vector<LightParameter> lightParameters;
-    std::vector<GeometryInstance> gis;
+    std::vector<SphereRecord> spheres;
 
     /*{
         LightParameter light;
@@ -653,19 +1225,32 @@ GeometryGroup createGeometryLight()
     for (auto light = lightParameters.begin(); light != lightParameters.end(); ++light)
     {
         light->area = 4.0f * M_PIf * light->radius * light->radius;
-        light->normal = optix::normalize(light->normal);
-
-        gis.push_back(createSphereObject(light->position, light->radius));
-        gis.back()["lightMaterialId"]->setInt(index);
+        light->normal = make_float3(0.0f);
 
         MaterialParameter mat;
         mat.emission = light->emission;
-        registerMaterial(gis.back(), mat, true);
+        spheres.push_back(createSphereRecord(light->position, light->radius, mat));
+        spheres.back().light_id = index;
+        spheres.back().material_index = 0;
 
         ++index;
     }
 
+    // Quad and triangle lights follow the sphere lights
+    std::vector<LightParameter> emitters;
+    if (scene_name == "spheres")
+    {
+        emitters.push_back(createQuadLight(make_float3(-30.0f, 120.0f, -30.0f), make_float3(60.0f, 0.0f, 0.0f), make_float3(0.0f, 0.0f, 60.0f), make_float3(4.0f)));
+        addOctahedronEmitter(make_float3(0.0f, 45.0f, 0.0f), 8.0f, make_float3(10.0f, 6.0f, 2.0f), emitters);
+    }
+    const int emitter_offset = static_cast<int>(lightParameters.size());
+    lightParameters.insert(lightParameters.end(), emitters.begin(), emitters.end());
+
     // Create geometry group
+    std::vector<GeometryInstance> gis;
+    gis.push_back(createSphereBatch(spheres, std::vector<Material>(1, light_material)));
+    if (!emitters.empty())
+        gis.push_back(createEmitterBatch(emitters, emitter_offset));
     GeometryGroup light_group = context->createGeometryGroup(gis.begin(), gis.end());
     light_group->setAcceleration(context->createAcceleration("Trbvh"));
 
@@ -680,23 +1265,224 @@ GeometryGroup createGeometryLight()
     return light_group;
 }
 
+GeometryGroup createGeometrySpheres()
+{
+    MaterialParameter mat;
+    std::vector<SphereRecord> spheres;
+
+    // Ground, it does not move
+    mat.albedo = make_float3(0.5f);
+    mat.metallic = 0.0f;
+    mat.roughness = 0.8f;
+    spheres.push_back(createSphereRecord(make_float3(0.0f, -10000.0f, 0.0f), 10000.0f, mat));
+
+    // Roughness (x) by metallic (z) grid
+    const int grid_size = 8;
+    for (int z = 0; z < grid_size; ++z)
+    {
+        for (int x = 0; x < grid_size; ++x)
+        {
+            const float3 center = make_float3((x - 3.5f) * 25.0f, 10.0f, (z - 3.5f) * 25.0f);
+            mat.albedo = make_float3(0.9f, 0.6f, 0.3f);
+            mat.roughness = (x + 0.5f) / grid_size;
+            mat.metallic = static_cast<float>(z) / (grid_size - 1);
+            mat.bsdf = (x == 0 && z == 0) ? DIFFUSE : DISNEY;
+            spheres.push_back(createSphereRecord(center, 10.0f, mat));
+        }
+    }
+
+    std::vector<float3> motion_centers;
+    if (objectMotionSteps() > 1)
+    {
+        for (size_t i = 0; i < spheres.size(); ++i)
+            appendMotionKeys(spheres[i].center, i > 0, motion_centers);
+    }
+
+    std::vector<GeometryInstance> gis;
+    gis.push_back(createSphereBatch(spheres, commonMaterials(), motion_centers));
+    GeometryGroup sphere_group = context->createGeometryGroup(gis.begin(), gis.end());
+    sphere_group->setAcceleration(createMotionAcceleration());
+    return sphere_group;
+}
+
+// sphere_field_count random spheres over the ground, sharing a small palette of materials
+GeometryGroup createGeometrySphereField()
+{
+    MaterialParameter mat;
+    std::vector<SphereRecord> spheres;
+    spheres.reserve(sphere_field_count + 1);
+
+    // Ground, it does not move
+    mat.albedo = make_float3(0.5f);
+    mat.metallic = 0.0f;
+    mat.roughness = 0.8f;
+    spheres.push_back(createSphereRecord(make_float3(0.0f, -10000.0f, 0.0f), 10000.0f, mat));
+
+    const int palette_size = 16;
+    int palette[palette_size];
+    for (int i = 0; i < palette_size; ++i)
+    {
+        mat.albedo = make_float3(0.9f, 0.6f, 0.3f) * (0.5f + 0.5f * (i % 4) / 3.0f);
+        mat.roughness = (i / 4 + 0.5f) / 4.0f;
+        mat.metallic = (i % 2) ? 1.0f : 0.0f;
+        mat.bsdf = DISNEY;
+        palette[i] = addMaterialParameter(mat);
+    }
+
+    // The volume per sphere is kept constant, so deeper scenes have smaller spheres
+    const float3 extent = make_float3(200.0f, 50.0f, 200.0f);
+    const float radius = 0.4f * powf(8.0f * extent.x * extent.y * extent.z / sphere_field_count, 1.0f / 3.0f);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    for (int i = 0; i < sphere_field_count; ++i)
+    {
+        SphereRecord sphere;
+        sphere.center = make_float3(uniform(rng) * extent.x, (uniform(rng) + 1.0f) * extent.y + radius, uniform(rng) * extent.z);
+        sphere.radius = radius;
+        sphere.material_id = palette[i % palette_size];
+        sphere.light_id = -1;
+        sphere.material_index = DISNEY;
+        spheres.push_back(sphere);
+    }
+
+    std::vector<float3> motion_centers;
+    if (objectMotionSteps() > 1)
+    {
+        for (size_t i = 0; i < spheres.size(); ++i)
+            appendMotionKeys(spheres[i].center, i > 0, motion_centers);
+    }
+
+    std::vector<GeometryInstance> gis;
+    gis.push_back(createSphereBatch(spheres, commonMaterials(), motion_centers));
+    GeometryGroup sphere_group = context->createGeometryGroup(gis.begin(), gis.end());
+    sphere_group->setAcceleration(createMotionAcceleration());
+    return sphere_group;
+}
+
+// Matrix keys of a track over the frame starting at time, a single one without motion blur
+std::vector<float> transformKeys(const TransformTrack& track, float time)
+{
+    const int steps = shutter_close > shutter_open ? motion_steps : 1;
+    std::vector<float> keys(steps * 12);
+    for (int k = 0; k < steps; ++k)
+    {
+        const float key_time = steps > 1 ? time + static_cast<float>(k) / (steps - 1) / animation_fps : time;
+        float matrix[16];
+        AnimationTrack::evaluateTransform(track, key_time, matrix);
+        memcpy(&keys[k * 12], matrix, 12 * sizeof(float));
+    }
+    return keys;
+}
+
+void setTransformKeys(Transform transform, const std::vector<float>& keys)
+{
+    const int steps = static_cast<int>(keys.size() / 12);
+    if (steps == 1)
+    {
+        float matrix[16] = {};
+        memcpy(matrix, keys.data(), 12 * sizeof(float));
+        matrix[15] = 1.0f;
+        transform->setMatrix(false, matrix, 0);
+        return;
+    }
+
+    transform->setMotionRange(0.0f, 1.0f);
+    transform->setMotionBorderMode(RT_MOTIONBORDERMODE_CLAMP, RT_MOTIONBORDERMODE_CLAMP);
+    transform->setMotionKeys(steps, RT_MOTIONKEYTYPE_MATRIX_FLOAT12, keys.data());
+}
+
 void setupScene()
 {
-    GeometryGroup tri_gg = createGeometryTriangles();
-    GeometryGroup gg = createGeometry();
+    materialParameters.clear();
+    materialCount = 0;
+
+    // Geometry groups and their object names in animation tracks
+    std::vector<GeometryGroup> groups;
+    std::vector<std::string> group_names;
+    if (scene_name == "spheres")
+    {
+        groups.push_back(createGeometrySpheres());
+        group_names.push_back("spheres");
+    }
+    else if (scene_name == "sphere_field")
+    {
+        groups.push_back(createGeometrySphereField());
+        group_names.push_back("sphere_field");
+    }
+    else
+    {
+        groups.push_back(createGeometry());
+        group_names.push_back("mandelbox");
+        if (scene_name != "mandelbox")
+        {
+            groups.push_back(createGeometryTriangles());
+            group_names.push_back("meshes");
+        }
+    }
     GeometryGroup light_gg = createGeometryLight();
 
+    for (auto track = animation.transforms().begin(); track != animation.transforms().end(); ++track)
+    {
+        if (std::find(group_names.begin(), group_names.end(), track->object) == group_names.end())
+            throw Exception("Animated object '" + track->object + "' is not in scene " + scene_name);
+    }
+
     Group top_group = context->createGroup();
-    top_group->setAcceleration(context->createAcceleration("Trbvh"));
-    top_group->addChild(gg);
-    top_group->addChild(tri_gg);
-    context["top_shadower"]->set(top_group);
+    top_acceleration = context->createAcceleration("Trbvh");
+    top_group->setAcceleration(top_acceleration);
 
     Group top_group_light = context->createGroup();
-    top_group_light->setAcceleration(context->createAcceleration("Trbvh"));
-    top_group_light->addChild(gg);
-    top_group_light->addChild(tri_gg);
+    top_light_acceleration = context->createAcceleration("Trbvh");
+    top_group_light->setAcceleration(top_light_acceleration);
+
+    // Moving transforms and geometry below them make the top level move as well
+    const bool moving_transforms = shutter_close > shutter_open && !animation.transforms().empty();
+    if (objectMotionSteps() > 1 || moving_transforms)
+    {
+        const std::string steps = std::to_string(motion_steps);
+        top_acceleration->setProperty("motion_steps", steps);
+        top_light_acceleration->setProperty("motion_steps", steps);
+    }
+
+    // Animated groups are placed under a Transform shared by both top groups,
+    // their own accelerations are never rebuilt
+    animated_objects.clear();
+    for (size_t i = 0; i < groups.size(); ++i)
+    {
+        const TransformTrack* track = nullptr;
+        for (auto t = animation.transforms().begin(); t != animation.transforms().end(); ++t)
+        {
+            if (t->object == group_names[i])
+                track = &*t;
+        }
+
+        if (!track)
+        {
+            top_group->addChild(groups[i]);
+            top_group_light->addChild(groups[i]);
+            continue;
+        }
+
+        AnimatedObject object;
+        object.track = track;
+        object.transform = context->createTransform();
+        object.transform->setChild(groups[i]);
+        object.keys = transformKeys(*track, 0.0f);
+        setTransformKeys(object.transform, object.keys);
+        animated_objects.push_back(object);
+
+        top_group->addChild(object.transform);
+        top_group_light->addChild(object.transform);
+    }
     top_group_light->addChild(light_gg);
+
+    if (!animated_objects.empty())
+    {
+        top_acceleration->setProperty("refit", "1");
+        top_light_acceleration->setProperty("refit", "1");
+    }
+
+    context["top_shadower"]->set(top_group);
     context["top_object"]->set(top_group_light);
 
     // Envmap
@@ -705,7 +1491,10 @@ void setupScene()
     const std::string texpath = resolveDataPath("Ice_Lake/Ice_Lake_Ref.hdr");
     //const std::string texpath = resolveDataPath("Ice_Lake/Ice_Lake_Env.hdr");
     //const std::string texpath = resolveDataPath("Desert_Highway/Road_to_MonumentValley_Env.hdr");
-    context["envmap"]->setTextureSampler(sutil::loadTexture(context, texpath, default_color));
+    {
+        telemetry::Scope scope(TELEMETRY_ASSET_LOAD);
+        context["envmap"]->setTextureSampler(sutil::loadTexture(context, texpath, default_color));
+    }
 
     // Material Parameters
     m_bufferMaterialParameters = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_USER);
@@ -713,6 +1502,23 @@ void setupScene()
     m_bufferMaterialParameters->setSize(materialParameters.size());
     updateMaterialParameters();
     context["sysMaterialParameters"]->setBuffer(m_bufferMaterialParameters);
+
+    // Disney lobe selection tables, empty unless enabled
+    m_bufferDisneyLobeTables = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_USER);
+    m_bufferDisneyLobeTables->setElementSize(sizeof(DisneyLobeTable));
+    m_bufferDisneyLobeTables->setSize(use_lobe_tables ? materialParameters.size() : 0);
+    if (use_lobe_tables)
+    {
+        telemetry::Scope scope(TELEMETRY_LOBE_TABLES, static_cast<int64_t>(materialParameters.size()));
+        std::vector<DisneyLobeTable> tables;
+        bakeDisneyLobeTables(materialParameters, tables);
+        memcpy(m_bufferDisneyLobeTables->map(0, RT_BUFFER_MAP_WRITE_DISCARD), tables.data(), tables.size() * sizeof(DisneyLobeTable));
+        m_bufferDisneyLobeTables->unmap();
+    }
+    context["sysDisneyLobeTables"]->setBuffer(m_bufferDisneyLobeTables);
+
+    clearRadianceCache();
+    clearFilterBuffer();
 }
 
 void setupCamera()
@@ -747,6 +1553,17 @@ void setupCamera()
     //camera_eye = make_float3(-815.63f, -527.19f, -674.00f);
     //camera_lookat = make_float3(-7.06f, 76.34f, 26.96f);
 
+    if (scene_name == "mandelbox")
+    {
+        camera_eye = make_float3(-815.63f, -527.19f, -674.00f);
+        camera_lookat = make_float3(-7.06f, 76.34f, 26.96f);
+    }
+    else if (scene_name == "spheres" || scene_name == "sphere_field")
+    {
+        camera_eye = make_float3(0.0f, 180.0f, 260.0f);
+        camera_lookat = make_float3(0.0f, 0.0f, 0.0f);
+    }
+
     camera_rotate = Matrix4x4::identity();
 }
 
@@ -787,6 +1604,8 @@ void updateCamera()
     {
         frame_number = 1;
         total_sample = 0;
+        clearRadianceCache();
+        clearFilterBuffer();
     }
 
     camera_changed = false;
@@ -808,6 +1627,127 @@ void updateCamera()
     context["normal_matrix"]->setMatrix3x3fv(false, normal_matrix.getData());
 }
 
+// Sets the camera and the transforms that changed to the animation at time and
+// returns the number of transforms updated
+int updateAnimation(float time)
+{
+    if (animation.hasCamera())
+        animation.evaluateCamera(time, camera_eye, camera_lookat);
+
+    // Every frame accumulates from scratch
+    camera_changed = true;
+
+    int updated = 0;
+    for (auto object = animated_objects.begin(); object != animated_objects.end(); ++object)
+    {
+        std::vector<float> keys = transformKeys(*object->track, time);
+        if (keys == object->keys)
+            continue;
+
+        object->keys.swap(keys);
+        setTransformKeys(object->transform, object->keys);
+        ++updated;
+    }
+
+    // The transforms are only in the top level accelerations
+    if (updated > 0)
+    {
+        top_acceleration->markDirty();
+        top_light_acceleration->markDirty();
+    }
+    return updated;
+}
+
+// File of frame i of an animation written to out_file, name_0000.png for name.png
+std::string animationFrameFile(const std::string& out_file, int frame)
+{
+    const size_t dot = out_file.find_last_of('.');
+    const size_t slash = out_file.find_last_of("/\\");
+    const bool has_extension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+
+    std::ostringstream name;
+    name << out_file.substr(0, has_extension ? dot : out_file.size())
+        << "_" << std::setw(4) << std::setfill('0') << frame
+        << (has_extension ? out_file.substr(dot) : std::string(".png"));
+    return name.str();
+}
+
+// Renders every frame of the animation with the given samples per pixel. The
+// PNG of a frame is written by a background thread while the next one renders.
+void renderAnimation(const std::string& out_file, int samples)
+{
+    const int frame_count = animation.frameCount(animation_fps);
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    AsyncImageWriter writer;
+    std::vector<float4> pixels;
+
+    const double begin = sutil::currentTime();
+    for (int i = 0; i < frame_count; ++i)
+    {
+        const float time = i / animation_fps;
+        const double frame_begin = sutil::currentTime();
+
+        int updated;
+        {
+            telemetry::Scope scope(TELEMETRY_SCENE_UPDATE);
+            updated = updateAnimation(time);
+            updateCamera();
+
+            // An empty launch refits the dirty accelerations, so that the
+            // launches below time the rendering alone
+            context->launch(ENTRY_PATHTRACE, 0, 0);
+        }
+        const double update_end = sutil::currentTime();
+
+        while (total_sample < samples)
+        {
+            context["sample_per_launch"]->setUint(sample_per_launch);
+            context["frame_number"]->setUint(frame_number);
+            context["total_sample"]->setUint(total_sample);
+            {
+                telemetry::Scope scope(TELEMETRY_LAUNCH, sample_per_launch);
+                executeFrame(commandListWithoutDenoiser);
+            }
+            frame_number++;
+            total_sample += sample_per_launch;
+        }
+        const double render_end = sutil::currentTime();
+
+        {
+            telemetry::Scope scope(TELEMETRY_DENOISE);
+            if (use_cpu_denoiser)
+                denoiseOnCpu();
+            else
+                commandListDenoiserOnly->execute();
+        }
+        const double denoise_end = sutil::currentTime();
+
+        pixels.resize(pixel_count);
+        memcpy(pixels.data(), denoisedBuffer->map(0, RT_BUFFER_MAP_READ), pixel_count * sizeof(float4));
+        denoisedBuffer->unmap();
+        const double readback_end = sutil::currentTime();
+
+        const double write_wait = writer.write(animationFrameFile(out_file, i), width, height, pixels);
+        const double frame_end = sutil::currentTime();
+
+        std::cout << "[animation] frame: " << i
+            << "\ttime: " << time
+            << "\ttransforms_updated: " << updated
+            << "\tupdate_ms: " << (update_end - frame_begin) * 1.0e3
+            << "\trender_ms: " << (render_end - update_end) * 1.0e3
+            << "\tdenoise_ms: " << (denoise_end - render_end) * 1.0e3
+            << "\treadback_ms: " << (readback_end - denoise_end) * 1.0e3
+            << "\twrite_wait_ms: " << write_wait * 1.0e3
+            << "\tframe_ms: " << (frame_end - frame_begin) * 1.0e3 << std::endl;
+    }
+    writer.finish();
+
+    const double seconds = sutil::currentTime() - begin;
+    std::cout << "[animation] frames: " << frame_count
+        << "\ttotal_sec: " << seconds
+        << "\tmean_frame_ms: " << seconds / frame_count * 1.0e3 << std::endl;
+}
+
 
 void glutInitialize(int* argc, char** argv)
 {
@@ -867,16 +1807,24 @@ void glutDisplay()
     Variable(denoiserStage->queryVariable("blend"))->setFloat(denoiseBlend);
 
     bool isEarlyFrame = (frame_number <= numNonDenoisedFrames);
+    uint64_t launch_begin = telemetry::now();
     if (isEarlyFrame)
     {
         // NOTE: commandList gȂꍇ
         // context->launch( 0, width, height );
 
-        commandListWithoutDenoiser->execute();
+        executeFrame(commandListWithoutDenoiser);
     }
     else
     {
-        commandListWithDenoiser->execute();
+        executeFrame(use_cpu_denoiser ? commandListWithoutDenoiser : commandListWithDenoiser);
+    }
+    telemetry::record(TELEMETRY_LAUNCH, launch_begin, telemetry::now(), sample_per_launch);
+
+    if (!isEarlyFrame && use_cpu_denoiser)
+    {
+        telemetry::Scope scope(TELEMETRY_DENOISE);
+        denoiseOnCpu();
     }
 
     switch (showBuffer)
@@ -1258,6 +2206,12 @@ void glutResize(int w, int h)
     sutil::resizeBuffer(getAlbedoBuffer(), width, height);
     sutil::resizeBuffer(getNormalBuffer(), width, height);
     sutil::resizeBuffer(denoisedBuffer, width, height);
+    if (filter_type != FILTER_BOX)
+        getFilterBuffer()->setSize(width, height);
+    resizeWavefrontBuffers();
+#if REDFLASH_PROFILE
+    sutil::resizeBuffer(getProfileBuffer(), width, height);
+#endif
     postprocessing_needs_init = true;
 
     glViewport(0, 0, width, height);
@@ -1282,6 +2236,26 @@ void printUsageAndExit(const std::string& argv0)
         "  -n | --nopbo              Disable GL interop for display buffer.\n"
         "  -s | --sample             Sample number.\n"
         "  -t | --time               Time limit(ssc).\n"
+        "  --scene <name>            default | mandelbox | spheres | sphere_field\n"
+        "  --sphere_count <n>        Number of spheres of the sphere_field scene (default: 10000).\n"
+        "  --rr <mode>               Russian roulette: off (default) | throughput | efficiency\n"
+        "  --rr_depth <n>            Path depth at which Russian roulette starts (default: 3).\n"
+        "  --wavefront               Trace in separate passes over ray queues sorted by material.\n"
+        "                            Not with --radiance_cache, --filter other than box or a REDFLASH_PROFILE build.\n"
+        "  --lobe_tables             Pick Disney lobes by their albedo, tabulated at scene load.\n"
+        "  --radiance_cache          Terminate paths into a radiance cache after the first bounce.\n"
+        "  --radiance_cache_cell <x> World-space cell size of the radiance cache (default: 1).\n"
+        "  --radiance_cache_roughness <x>  Cache Disney surfaces from this roughness on (default: 0.5).\n"
+        "  --denoiser <name>         optix (default, DLDenoiser stage) | cpu (tiled CPU filter)\n"
+        "  --first_frame_features    Take the denoiser albedo and normals from the first frame only.\n"
+        "  --filter <name>           Reconstruction filter: box (default) | gaussian | mitchell | blackman_harris\n"
+        "  --filter_radius <x>       Radius of --filter in pixels up to 3.5 (default: 2 mitchell, 1.5 others, box is 0.5).\n"
+        "  --telemetry <prefix>      Write <prefix>.trace.json (chrome://tracing) and <prefix>.summary.json at exit.\n"
+        "  --animation <file>        Render the keyframes of file (see animation.h) to <name>_0000.png, ... of --file.\n"
+        "  --animation_fps <x>       Frames per second of --animation (default: 24).\n"
+        "  --shutter <open> <close>  Motion blur over this part of the frame, 0 <= open <= close <= 1 (default: 0 0).\n"
+        "  --motion_steps <n>        Motion keys of moving geometry and transforms (default: 2).\n"
+        "  --object_motion <x> <y> <z>  Move the spheres and the mandelbox by this much per frame.\n"
         "App Keystrokes:\n"
         "  q  Quit\n"
         "  s  Save image to '" << SAMPLE_NAME << ".png'\n"
@@ -1290,14 +2264,174 @@ void printUsageAndExit(const std::string& argv0)
     exit(1);
 }
 
-void displayBufferPNG(const char* filename, Buffer& buffer)
+// Rendered images are quantized with a dither by the host post-process. Data
+// buffers (denoiser features, radiance, profile heatmaps) pass dither = false
+// and keep the plain truncation of sutil, so their PNGs hold exact values.
+void displayBufferPNG(const char* filename, Buffer& buffer, bool dither = true)
 {
+    telemetry::Scope scope(TELEMETRY_WRITE_PNG);
     double begin = sutil::currentTime();
-    sutil::displayBufferPNG(filename, buffer, true);
+    if (dither && buffer->getFormat() == RT_FORMAT_FLOAT4)
+    {
+        // The buffer holds display values, it is only quantized (with a dither)
+        RTsize buffer_width, buffer_height;
+        buffer->getSize(buffer_width, buffer_height);
+        const int w = static_cast<int>(buffer_width);
+        const int h = static_cast<int>(buffer_height);
+
+        PostprocessSettings postprocess;
+        postprocess.curve = TONE_CURVE_NONE;
+        postprocess.encoding = OUTPUT_ENCODING_LINEAR;
+        std::vector<unsigned char> pixels(static_cast<size_t>(w) * h * 3);
+        postprocessImage8(postprocess, w, h, static_cast<const float4*>(buffer->map(0, RT_BUFFER_MAP_READ)), pixels.data());
+        buffer->unmap();
+        sutil::writePNG(filename, pixels.data(), w, h, 3);
+    }
+    else
+    {
+        sutil::displayBufferPNG(filename, buffer, true);
+    }
     double end = sutil::currentTime();
     std::cout << "[info] save_png: " << filename << "\t" << (end - begin) << " sec." << std::endl;
 }
 
+bool parseRussianRouletteMode(const std::string& name, int& mode)
+{
+    if (name == "off")
+        mode = RR_OFF;
+    else if (name == "throughput")
+        mode = RR_THROUGHPUT;
+    else if (name == "efficiency")
+        mode = RR_EFFICIENCY;
+    else
+        return false;
+    return true;
+}
+
+// --filter names, indexed by FilterType
+const char* const filter_type_names[FILTER_TYPE_COUNT] = { "box", "gaussian", "mitchell", "blackman_harris" };
+
+bool parseFilterType(const std::string& name, int& type)
+{
+    for (int i = 0; i < FILTER_TYPE_COUNT; ++i)
+    {
+        if (name == filter_type_names[i])
+        {
+            type = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* wavefrontUnsupportedOption()
+{
+#if REDFLASH_PROFILE
+    // The counters are indexed by the launch index, which is a queue slot in the wavefront passes
+    return "A REDFLASH_PROFILE build";
+#else
+    if (use_radiance_cache)
+        return "--radiance_cache";
+    if (filter_type != FILTER_BOX)
+        return "--filter other than box";
+    return nullptr;
+#endif
+}
+
+void saveTelemetry()
+{
+    std::ostringstream resolution;
+    resolution << width << "x" << height;
+    telemetry::setMetadata("resolution", resolution.str());
+    telemetry::setMetadata("max_depth", std::to_string(max_depth));
+    telemetry::setMetadata("sample_per_launch", std::to_string(sample_per_launch));
+    telemetry::setMetadata("total_sample", std::to_string(total_sample));
+
+    telemetry::writeChromeTrace(telemetry_prefix + ".trace.json");
+    telemetry::writeSummary(telemetry_prefix + ".summary.json");
+}
+
+#if REDFLASH_PROFILE
+// Maps t in [0, 1] to a blue - cyan - green - yellow - red ramp
+float3 profileFalseColor(float t)
+{
+    const float3 ramp[5] = {
+        make_float3(0.0f, 0.0f, 1.0f),
+        make_float3(0.0f, 1.0f, 1.0f),
+        make_float3(0.0f, 1.0f, 0.0f),
+        make_float3(1.0f, 1.0f, 0.0f),
+        make_float3(1.0f, 0.0f, 0.0f)
+    };
+
+    t = clamp(t, 0.0f, 1.0f) * 4.0f;
+    int i = std::min(static_cast<int>(t), 3);
+    return lerp(ramp[i], ramp[i + 1], t - i);
+}
+
+// Writes one false-color image per counter and a CSV histogram of all counters
+void saveProfile(const std::string& out_file)
+{
+    const char* counter_names[4] = { "raymarch_steps", "bounces", "shadow_rays", "bsdf_evals" };
+    const int bin_count = 32;
+
+    Buffer profileBuffer = getProfileBuffer();
+    RTsize buffer_width, buffer_height;
+    profileBuffer->getSize(buffer_width, buffer_height);
+    const size_t pixel_count = buffer_width * buffer_height;
+
+    std::vector<unsigned int> counters(pixel_count * 4);
+    memcpy(&counters[0], profileBuffer->map(0, RT_BUFFER_MAP_READ), counters.size() * sizeof(unsigned int));
+    profileBuffer->unmap();
+
+    Buffer imageBuffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT4, buffer_width, buffer_height);
+
+    const std::string csv_file = out_file + "_profile.csv";
+    std::ofstream csv(csv_file.c_str());
+    csv << "counter,bin,lower,upper,pixels" << std::endl;
+
+    for (int c = 0; c < 4; ++c)
+    {
+        unsigned int max_value = 0;
+        unsigned long long sum = 0;
+        for (size_t i = 0; i < pixel_count; ++i)
+        {
+            max_value = std::max(max_value, counters[i * 4 + c]);
+            sum += counters[i * 4 + c];
+        }
+
+        // False-color image normalized by the most expensive pixel
+        float4* dst = static_cast<float4*>(imageBuffer->map(0, RT_BUFFER_MAP_WRITE_DISCARD));
+        for (size_t i = 0; i < pixel_count; ++i)
+        {
+            float t = max_value > 0 ? static_cast<float>(counters[i * 4 + c]) / max_value : 0.0f;
+            dst[i] = make_float4(profileFalseColor(t), 1.0f);
+        }
+        imageBuffer->unmap();
+        displayBufferPNG((out_file + "_profile_" + counter_names[c] + ".png").c_str(), imageBuffer, false);
+
+        // Histogram over [0, max_value]
+        std::vector<unsigned int> bins(bin_count, 0);
+        const double bin_width = std::max(1.0, (max_value + 1.0) / bin_count);
+        for (size_t i = 0; i < pixel_count; ++i)
+        {
+            int bin = std::min(static_cast<int>(counters[i * 4 + c] / bin_width), bin_count - 1);
+            bins[bin]++;
+        }
+        for (int b = 0; b < bin_count; ++b)
+        {
+            csv << counter_names[c] << "," << b << "," << b * bin_width << "," << (b + 1) * bin_width << "," << bins[b] << std::endl;
+        }
+
+        std::cout << "[info] profile_" << counter_names[c] << ": mean_per_sample: " << static_cast<double>(sum) / pixel_count / std::max(total_sample, 1) << "\tmax_per_pixel: " << max_value << std::endl;
+    }
+
+    imageBuffer->destroy();
+    std::cout << "[info] save_csv: " << csv_file << std::endl;
+}
+#endif
+
+// redflash_bench is built from this file too and provides its own main()
+#ifndef REDFLASH_BENCH
 int main(int argc, char** argv)
 {
     double launch_time = sutil::currentTime();
@@ -1480,6 +2614,194 @@ int main(int argc, char** argv)
         {
             flag_debug = true;
         }
+        else if (arg == "--rr")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            if (!parseRussianRouletteMode(argv[++i], rr_mode))
+            {
+                std::cerr << "Option '" << arg << "' must be off, throughput or efficiency.\n";
+                printUsageAndExit(argv[0]);
+            }
+        }
+        else if (arg == "--rr_depth")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            rr_begin_depth = atoi(argv[++i]);
+        }
+        else if (arg == "--wavefront")
+        {
+            use_wavefront = true;
+        }
+        else if (arg == "--lobe_tables")
+        {
+            use_lobe_tables = true;
+        }
+        else if (arg == "--radiance_cache")
+        {
+            use_radiance_cache = true;
+        }
+        else if (arg == "--radiance_cache_cell")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            radiance_cache_cell_size = static_cast<float>(atof(argv[++i]));
+        }
+        else if (arg == "--radiance_cache_roughness")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            radiance_cache_roughness = static_cast<float>(atof(argv[++i]));
+        }
+        else if (arg == "--first_frame_features")
+        {
+            accumulate_denoise_features = false;
+        }
+        else if (arg == "--filter")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            if (!parseFilterType(argv[++i], filter_type))
+            {
+                std::cerr << "Option '" << arg << "' must be box, gaussian, mitchell or blackman_harris.\n";
+                printUsageAndExit(argv[0]);
+            }
+        }
+        else if (arg == "--filter_radius")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            filter_radius = static_cast<float>(atof(argv[++i]));
+            if (filter_radius <= 0.0f || filterExtent(filter_radius) > FILTER_MAX_EXTENT)
+            {
+                std::cerr << "Option '" << arg << "' must be in (0, 3.5].\n";
+                printUsageAndExit(argv[0]);
+            }
+        }
+        else if (arg == "--denoiser")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            const std::string name = argv[++i];
+            if (name != "optix" && name != "cpu")
+            {
+                std::cerr << "Option '" << arg << "' must be optix or cpu.\n";
+                printUsageAndExit(argv[0]);
+            }
+            use_cpu_denoiser = name == "cpu";
+        }
+        else if (arg == "--scene")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            scene_name = argv[++i];
+        }
+        else if (arg == "--sphere_count")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            sphere_field_count = atoi(argv[++i]);
+        }
+        else if (arg == "--telemetry")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            telemetry_prefix = argv[++i];
+        }
+        else if (arg == "--animation")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            animation_file = argv[++i];
+        }
+        else if (arg == "--animation_fps")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            animation_fps = static_cast<float>(atof(argv[++i]));
+            if (animation_fps <= 0.0f)
+            {
+                std::cerr << "Option '" << arg << "' must be positive.\n";
+                printUsageAndExit(argv[0]);
+            }
+        }
+        else if (arg == "--shutter")
+        {
+            if (i >= argc - 2)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional arguments.\n";
+                printUsageAndExit(argv[0]);
+            }
+            shutter_open = static_cast<float>(atof(argv[++i]));
+            shutter_close = static_cast<float>(atof(argv[++i]));
+            if (shutter_open < 0.0f || shutter_close < shutter_open || shutter_close > 1.0f)
+            {
+                std::cerr << "Option '" << arg << "' needs 0 <= open <= close <= 1.\n";
+                printUsageAndExit(argv[0]);
+            }
+        }
+        else if (arg == "--motion_steps")
+        {
+            if (i == argc - 1)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional argument.\n";
+                printUsageAndExit(argv[0]);
+            }
+            motion_steps = atoi(argv[++i]);
+            if (motion_steps < 2)
+            {
+                std::cerr << "Option '" << arg << "' must be at least 2.\n";
+                printUsageAndExit(argv[0]);
+            }
+        }
+        else if (arg == "--object_motion")
+        {
+            if (i >= argc - 3)
+            {
+                std::cerr << "Option '" << argv[i] << "' requires additional arguments.\n";
+                printUsageAndExit(argv[0]);
+            }
+            object_motion.x = static_cast<float>(atof(argv[++i]));
+            object_motion.y = static_cast<float>(atof(argv[++i]));
+            object_motion.z = static_cast<float>(atof(argv[++i]));
+        }
         else
         {
             std::cerr << "Unknown option '" << arg << "'\n";
@@ -1487,6 +2809,24 @@ int main(int argc, char** argv)
         }
     }
 
+    if (use_wavefront && wavefrontUnsupportedOption())
+    {
+        std::cerr << wavefrontUnsupportedOption() << " cannot be combined with '--wavefront'.\n";
+        printUsageAndExit(argv[0]);
+    }
+
+    if (!animation_file.empty() && out_file.empty())
+    {
+        std::cerr << "Option '--animation' requires -f | --file.\n";
+        printUsageAndExit(argv[0]);
+    }
+
+    if (!telemetry_prefix.empty())
+    {
+        telemetry::init();
+        atexit(saveTelemetry);
+    }
+
     try
     {
         if (use_pbo && out_file.empty()) {
@@ -1497,7 +2837,17 @@ int main(int argc, char** argv)
 #endif
         }
 
-        createContext();
+        if (!animation_file.empty())
+        {
+            std::string error;
+            if (!animation.load(animation_file, error))
+                throw Exception(error);
+        }
+
+        {
+            telemetry::Scope scope(TELEMETRY_CREATE_CONTEXT);
+            createContext();
+        }
 
         if (training_file.length() == 0 && training_file_2.length() != 0)
             useFirstTrainingDataPath = false;
@@ -1508,7 +2858,10 @@ int main(int argc, char** argv)
             loadTrainingFile(training_file_2);
 
         setupCamera();
-        setupScene();
+        {
+            telemetry::Scope scope(TELEMETRY_SCENE_SETUP);
+            setupScene();
+        }
 
         context->validate();
 
@@ -1542,6 +2895,26 @@ int main(int argc, char** argv)
             std::cout << "[info] auto_set_sample_per_launch_scale: " << auto_set_sample_per_launch_scale << std::endl;
             std::cout << "[info] last_frame_scale: " << last_frame_scale << std::endl;
             std::cout << "[info] tonemap_exposure: " << tonemap_exposure << std::endl;
+            std::cout << "[info] rr_mode: " << rr_mode << std::endl;
+            std::cout << "[info] rr_begin_depth: " << rr_begin_depth << std::endl;
+            std::cout << "[info] wavefront: " << use_wavefront << std::endl;
+            std::cout << "[info] lobe_tables: " << use_lobe_tables << std::endl;
+            std::cout << "[info] radiance_cache: " << use_radiance_cache << std::endl;
+            if (use_radiance_cache)
+            {
+                std::cout << "[info] radiance_cache_cell: " << radiance_cache_cell_size << std::endl;
+                std::cout << "[info] radiance_cache_roughness: " << radiance_cache_roughness << std::endl;
+            }
+            std::cout << "[info] denoiser: " << (use_cpu_denoiser ? "cpu" : "optix") << std::endl;
+            std::cout << "[info] accumulate_denoise_features: " << accumulate_denoise_features << std::endl;
+            std::cout << "[info] filter: " << filter_type_names[filter_type] << std::endl;
+            if (filter_type != FILTER_BOX)
+                std::cout << "[info] filter_radius: " << filterRadius() << std::endl;
+            if (shutter_close > shutter_open)
+            {
+                std::cout << "[info] shutter: " << shutter_open << " " << shutter_close << std::endl;
+                std::cout << "[info] motion_steps: " << motion_steps << std::endl;
+            }
 
 
             if (use_time_limit)
@@ -1553,6 +2926,19 @@ int main(int argc, char** argv)
                 std::cout << "[info] sample: " << sampleMax << std::endl;
             }
 
+            if (!animation_file.empty())
+            {
+                std::cout << "[info] animation: " << animation_file << std::endl;
+                std::cout << "[info] animation_fps: " << animation_fps << std::endl;
+                std::cout << "[info] animation_frames: " << animation.frameCount(animation_fps) << std::endl;
+                std::cout << "[info] animated_objects: " << animated_objects.size() << std::endl;
+                renderAnimation(out_file, sampleMax);
+                destroyContext();
+
+                std::cout << "[info] total_time: " << (sutil::currentTime() - launch_time) << " sec." << std::endl;
+                return 0;
+            }
+
             double last_time = sutil::currentTime();
 
             bool finalFrame = false;
@@ -1596,23 +2982,22 @@ int main(int argc, char** argv)
                 context["frame_number"]->setUint(frame_number);
                 context["total_sample"]->setUint(total_sample);
 
+                {
+                    telemetry::Scope scope(TELEMETRY_LAUNCH, sample_per_launch);
+                    executeFrame(commandListWithoutDenoiser);
+                }
+
                 if (finalFrame)
                 {
-                    if (denoiser_perf_mode)
+                    const int denoise_iter = denoiser_perf_mode ? denoiser_perf_iter : 1;
+                    for (int i = 0; i < denoise_iter; i++)
                     {
-                        for (int i = 0; i < denoiser_perf_iter; i++)
-                        {
-                            commandListWithDenoiser->execute();
-                        }
+                        telemetry::Scope scope(TELEMETRY_DENOISE);
+                        if (use_cpu_denoiser)
+                            denoiseOnCpu();
+                        else
+                            commandListDenoiserOnly->execute();
                     }
-                    else
-                    {
-                        commandListWithDenoiser->execute();
-                    }
-                }
-                else
-                {
-                    commandListWithoutDenoiser->execute();
                 }
 
                 frame_number++;
@@ -1630,11 +3015,15 @@ int main(int argc, char** argv)
             if (flag_debug)
             {
                 displayBufferPNG((out_file + "_original.png").c_str(), getOutputBuffer());
-                displayBufferPNG((out_file + "_albedo.png").c_str(), getAlbedoBuffer());
-                displayBufferPNG((out_file + "_normal.png").c_str(), getNormalBuffer());
-                displayBufferPNG((out_file + "_liner.png").c_str(), getLinerBuffer());
+                displayBufferPNG((out_file + "_albedo.png").c_str(), getAlbedoBuffer(), false);
+                displayBufferPNG((out_file + "_normal.png").c_str(), getNormalBuffer(), false);
+                displayBufferPNG((out_file + "_liner.png").c_str(), getLinerBuffer(), false);
             }
 
+#if REDFLASH_PROFILE
+            saveProfile(out_file);
+#endif
+
             destroyContext();
 
             double finish_time = sutil::currentTime();
@@ -1646,4 +3035,5 @@ int main(int argc, char** argv)
         return 0;
     }
     SUTIL_CATCH(context->get())
-}
\ No newline at end of file
+}
+#endif // REDFLASH_BENCH
@@ -2,7 +2,15 @@
 #include <optixu/optixu_matrix_namespace.h>
 #include <common.h>
 #include "redflash.h"
+#include "russian_roulette.h"
+#include "wavefront.h"
+#include "bsdf.h"
+#include "denoise_features.h"
+#include "filter.h"
+#include "light_sample.h"
+#include "radiance_cache.h"
 #include "random.h"
+#include "tonemap.h"
 
 using namespace optix;
 
@@ -34,39 +42,223 @@ rtDeclareVariable(unsigned int, frame_number, , );
 rtDeclareVariable(unsigned int, total_sample, , );
 rtDeclareVariable(unsigned int, sample_per_launch, , );
 rtDeclareVariable(unsigned int, rr_begin_depth, , );
+rtDeclareVariable(unsigned int, rr_mode, , );
 rtDeclareVariable(unsigned int, max_depth, , );
 rtDeclareVariable(unsigned int, use_post_tonemap, , );
 rtDeclareVariable(float, tonemap_exposure, , );
 
+// Open and close time of the shutter in frames, equal without motion blur (see motion.h)
+rtDeclareVariable(float2, shutter, , );
+
 rtBuffer<float4, 2> output_buffer;
 rtBuffer<float4, 2> liner_buffer;
 rtBuffer<float4, 2> input_albedo_buffer;
 rtBuffer<float4, 2> input_normal_buffer;
+rtDeclareVariable(unsigned int, accumulate_denoise_features, , );
+
+// Reconstruction filter (see filter.h). Samples of the other filters are
+// splatted into filter_buffer and resolved by filter_resolve.
+rtDeclareVariable(unsigned int, filter_type, , );
+rtDeclareVariable(float, filter_radius, , );
+rtDeclareVariable(int, filter_extent, , );
+rtBuffer<float4, 2> filter_buffer;
+
+#if REDFLASH_PROFILE
+rtBuffer<uint4, 2> profile_buffer;
+#endif
+
+RT_FUNCTION float luminance(const float3& c)
+{
+    return 0.3f * c.x + 0.6f * c.y + 0.1f * c.z;
+}
+
+// Luminance of the running mean of a pixel, only read for RR_EFFICIENCY
+RT_FUNCTION float russianRoulettePixelMean(const uint2& pixel)
+{
+    return (rr_mode == RR_EFFICIENCY && frame_number > 1) ? luminance(make_float3(liner_buffer[pixel])) : 0.0f;
+}
+
+// Probability that a path continues after a vertex, see russian_roulette.h. attenuation_before
+// is the throughput that reached the vertex and vertex_radiance what it added to the path.
+RT_FUNCTION float russianRoulette(const float3& attenuation_before, const float3& attenuation, const float3& vertex_radiance, float pixel_mean)
+{
+    const float before = luminance(attenuation_before);
+    const float after = luminance(attenuation);
+    const float scale = before > 0.0f ? 1.0f / before : 0.0f;
+    return russianRouletteProbability(rr_mode, after, luminance(vertex_radiance) * scale, after * scale, pixel_mean);
+}
+
+// Display value of a pixel of liner_buffer
+RT_FUNCTION float3 outputColor(const float3& pixel_liner)
+{
+    return use_post_tonemap ? pixel_liner : linear_to_sRGB(tonemap_acesFilm(pixel_liner * tonemap_exposure));
+}
+
+// Writes the samples of this launch, averaged with the previous frames, to the output buffers.
+// albedo and normal are the sums of the denoiser features of the samples (denoise_features.h).
+// With a reconstruction filter the color is written by filter_resolve instead.
+RT_FUNCTION void updateOutputBuffers(const float3& result, const float3& albedo, const float3& normal)
+{
+    float inv_sample_per_launch = 1.0f / static_cast<float>(sample_per_launch);
+    float3 pixel_liner = result * inv_sample_per_launch;
+    float3 pixel_albedo = albedo * inv_sample_per_launch;
+
+    // Mean of the eye space normals, pixels without any surface face the camera
+    float3 pixel_normal = (length(normal) > 0.0f) ? normal_matrix * normal * inv_sample_per_launch : make_float3(0.0, 0.0, 1.0);
+
+    if (frame_number > 1)
+    {
+        float a = static_cast<float>(sample_per_launch) / static_cast<float>(total_sample + sample_per_launch);
+        pixel_liner = lerp(make_float3(liner_buffer[launch_index]), pixel_liner, a);
+
+        // The features converge with the same weights as the color
+        if (accumulate_denoise_features)
+        {
+            pixel_albedo = lerp(make_float3(input_albedo_buffer[launch_index]), pixel_albedo, a);
+            pixel_normal = lerp(make_float3(input_normal_buffer[launch_index]), pixel_normal, a);
+        }
+    }
+
+    // Save to buffer
+    if (filter_type == FILTER_BOX)
+    {
+        liner_buffer[launch_index] = make_float4(pixel_liner, 1.0);
+        output_buffer[launch_index] = make_float4(outputColor(pixel_liner), 1.0);
+    }
+
+    // NOTE: accumulate_denoise_features Ȃ1t[ڂXVȂ
+    if (frame_number == 1 || accumulate_denoise_features)
+    {
+        input_albedo_buffer[launch_index] = make_float4(pixel_albedo, 1.0f);
+        input_normal_buffer[launch_index] = make_float4(pixel_normal, 1.0f);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//
+//  Radiance cache, see radiance_cache.h
+//
+//-----------------------------------------------------------------------------
+
+rtDeclareVariable(unsigned int, use_radiance_cache, , );
+rtDeclareVariable(float, radiance_cache_cell_size, , );
+rtDeclareVariable(float, radiance_cache_roughness, , );
+rtDeclareVariable(float, radiance_cache_min_samples, , );
+rtBuffer<unsigned int> radiance_cache_keys;
+rtBuffer<float4> radiance_cache_values;
+
+RT_FUNCTION RadianceCacheQuery radianceCacheQuery(const float3& position, const float3& normal)
+{
+    return radianceCacheQuery(position, normal, radiance_cache_cell_size, static_cast<unsigned int>(radiance_cache_keys.size()));
+}
+
+// Slot of the cell of a query, -1 if it is not cached. With insert, an empty
+// slot is claimed for a new cell.
+RT_FUNCTION int radianceCacheFind(const RadianceCacheQuery& query, bool insert)
+{
+    const unsigned int capacity = static_cast<unsigned int>(radiance_cache_keys.size());
+    for (unsigned int i = 0; i < RADIANCE_CACHE_PROBES; ++i)
+    {
+        const unsigned int slot = radianceCacheProbe(query, i, capacity);
+        unsigned int key = radiance_cache_keys[slot];
+        if (key == 0u)
+        {
+            if (!insert)
+                return -1;
+
+            // Another path may claim the slot first, for this cell or another one
+            key = atomicCAS(&radiance_cache_keys[slot], 0u, query.checksum);
+            if (key == 0u)
+                return slot;
+        }
+        if (key == query.checksum)
+            return slot;
+    }
+    return -1;
+}
+
+RT_FUNCTION bool radianceCacheLookup(const RadianceCacheQuery& query, float3& radiance)
+{
+    const int slot = radianceCacheFind(query, false);
+    return slot >= 0 && radianceCacheMean(radiance_cache_values[slot], radiance_cache_min_samples, radiance);
+}
+
+RT_FUNCTION void radianceCacheAdd(int slot, const float3& radiance)
+{
+    float4& entry = radiance_cache_values[slot];
+    atomicAdd(&entry.x, radiance.x);
+    atomicAdd(&entry.y, radiance.y);
+    atomicAdd(&entry.z, radiance.z);
+    atomicAdd(&entry.w, 1.0f);
+}
 
-__device__ inline float3 linear_to_sRGB(const float3& c)
+// Time of a path in the shutter interval. Without motion blur no random number
+// is drawn, so the sequences of the other samples stay the same.
+RT_FUNCTION float sampleShutterTime(unsigned int& seed)
 {
-    const float kInvGamma = 1.0f / 2.2f;
-    return make_float3(powf(c.x, kInvGamma), powf(c.y, kInvGamma), powf(c.z, kInvGamma));
+    return shutter.y > shutter.x ? lerp(shutter.x, shutter.y, rnd(seed)) : shutter.x;
 }
 
-__device__ inline float3 tonemap_reinhard(const float3& c, float limit)
+
+//-----------------------------------------------------------------------------
+//
+//  Reconstruction filter, see filter.h
+//
+//-----------------------------------------------------------------------------
+
+// Adds a weighted sample to the filter_buffer pixels around launch_index that are on the screen
+struct FilterSplat
+{
+    uint2 screen;
+    float3 radiance;
+
+    RT_FUNCTION void operator()(int dx, int dy, float weight)
+    {
+        const int x = static_cast<int>(launch_index.x) + dx;
+        const int y = static_cast<int>(launch_index.y) + dy;
+        if (x < 0 || y < 0 || x >= static_cast<int>(screen.x) || y >= static_cast<int>(screen.y))
+            return;
+
+        // Neighbouring pixels splat into the same entries
+        float4& entry = filter_buffer[make_uint2(x, y)];
+        atomicAdd(&entry.x, weight * radiance.x);
+        atomicAdd(&entry.y, weight * radiance.y);
+        atomicAdd(&entry.z, weight * radiance.z);
+        atomicAdd(&entry.w, weight);
+    }
+};
+
+// Splats a sample at offset jitter from the center of the launch_index pixel,
+// over the extent of the filter known at compile time
+RT_FUNCTION void splatSample(const float2& jitter, const float3& radiance)
 {
-    float luminance = 0.3f * c.x + 0.6f * c.y + 0.1f * c.z;
-    float3 col = c * 1.0f / (1.0f + luminance / limit);
-    return make_float3(col.x, col.y, col.z);
+    size_t2 screen = output_buffer.size();
+    FilterSplat splat = { make_uint2(screen.x, screen.y), radiance };
+    switch (filter_extent)
+    {
+    case 0: splatFilterTaps<0>(filter_type, filter_radius, filter_extent, jitter, splat); break;
+    case 1: splatFilterTaps<1>(filter_type, filter_radius, filter_extent, jitter, splat); break;
+    case 2: splatFilterTaps<2>(filter_type, filter_radius, filter_extent, jitter, splat); break;
+    default: splatFilterTaps<3>(filter_type, filter_radius, filter_extent, jitter, splat); break;
+    }
 }
 
-// https://knarkowicz.wordpress.com/2016/01/06/aces-filmic-tone-mapping-curve/
-__device__ inline float3 tonemap_acesFilm(const float3 x)
+// Launched over the screen after pathtrace_camera when filtering, once all
+// neighbouring samples are splatted
+RT_PROGRAM void filter_resolve()
 {
-    const float a = 2.51;
-    const float b = 0.03;
-    const float c = 2.43;
-    const float d = 0.59;
-    const float e = 0.14;
-    return clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0.0, 1.0);
+    const float3 pixel_liner = resolveFilteredPixel(filter_buffer[launch_index]);
+    liner_buffer[launch_index] = make_float4(pixel_liner, 1.0f);
+    output_buffer[launch_index] = make_float4(outputColor(pixel_liner), 1.0f);
 }
 
+
+//-----------------------------------------------------------------------------
+//
+//  Path tracing camera
+//
+//-----------------------------------------------------------------------------
+
 RT_PROGRAM void pathtrace_camera()
 {
     size_t2 screen = output_buffer.size();
@@ -74,6 +266,15 @@ RT_PROGRAM void pathtrace_camera()
     float3 albedo = make_float3(0.0f);
     float3 normal = make_float3(0.0f);
     unsigned int seed = tea<16>(screen.x * launch_index.y + launch_index.x, total_sample);
+    const float pixel_mean = russianRoulettePixelMean(launch_index);
+
+#if REDFLASH_PROFILE
+    // Counters are accumulated over all frames of a progressive render
+    if (frame_number == 1)
+    {
+        profile_buffer[launch_index] = make_uint4(0);
+    }
+#endif
 
     for (int i = 0; i < sample_per_launch; i++)
     {
@@ -81,6 +282,7 @@ RT_PROGRAM void pathtrace_camera()
         float2 d = (make_float2(launch_index) + subpixel_jitter) / make_float2(screen) * 2.f - 1.f;
         float3 ray_origin = eye;
         float3 ray_direction = normalize(d.x*U + d.y*V + W);
+        const float ray_time = sampleShutterTime(seed);
 
         // Initialze per-ray data
         PerRayData_pathtrace prd;
@@ -89,6 +291,13 @@ RT_PROGRAM void pathtrace_camera()
         prd.done = false;
         prd.seed = seed;
         prd.depth = 0;
+        resetDenoiseFeatures(prd.features);
+
+        // Vertices that update the radiance cache once the path is done
+        int cache_vertices = 0;
+        int cache_slots[RADIANCE_CACHE_VERTICES];
+        float3 cache_radiance[RADIANCE_CACHE_VERTICES];
+        float3 cache_attenuation[RADIANCE_CACHE_VERTICES];
 
         // Each iteration is a segment of the ray path.  The closest hit will
         // return new segments to be traced here.
@@ -96,26 +305,33 @@ RT_PROGRAM void pathtrace_camera()
         {
             Ray ray = make_Ray(ray_origin, ray_direction, RADIANCE_RAY_TYPE, scene_epsilon, RT_DEFAULT_MAX);
             prd.wo = -ray.direction;
-            rtTrace(top_object, ray, prd);
+            prd.radianceCacheSlot = -1;
+            const float3 radiance_before = prd.radiance;
+            const float3 attenuation_before = prd.attenuation;
+            // Shadow rays of the closest hit programs inherit the time
+            rtTrace(top_object, ray, ray_time, prd);
+            PROFILE_COUNT(PROFILE_BOUNCES, 1);
+
+            if (prd.radianceCacheSlot >= 0 && cache_vertices < RADIANCE_CACHE_VERTICES)
+            {
+                cache_slots[cache_vertices] = prd.radianceCacheSlot;
+                cache_radiance[cache_vertices] = radiance_before;
+                cache_attenuation[cache_vertices] = attenuation_before;
+                ++cache_vertices;
+            }
 
             if (prd.done || prd.depth >= max_depth)
             {
                 break;
             }
 
-            // Russian roulette termination 
-            /*if(prd.depth >= rr_begin_depth)
+            // Russian roulette termination
+            if (rr_mode != RR_OFF && prd.depth >= static_cast<int>(rr_begin_depth))
             {
-                float pcont = fmaxf(prd.attenuation);
-                if(rnd(prd.seed) >= pcont)
+                float pcont = russianRoulette(attenuation_before, prd.attenuation, prd.radiance - radiance_before, pixel_mean);
+                if (rnd(prd.seed) >= pcont)
                     break;
                 prd.attenuation /= pcont;
-            }*/
-
-            if (prd.depth == 0)
-            {
-                albedo += prd.albedo;
-                normal += prd.normal;
             }
 
             // Update ray data for the next path segment
@@ -125,42 +341,25 @@ RT_PROGRAM void pathtrace_camera()
             prd.depth++;
         }
 
+        for (int v = 0; v < cache_vertices; ++v)
+        {
+            float3 sample;
+            if (radianceCacheSample(prd.radiance - cache_radiance[v], cache_attenuation[v], sample))
+                radianceCacheAdd(cache_slots[v], sample);
+        }
+
+        if (filter_type != FILTER_BOX)
+            splatSample(subpixel_jitter, prd.radiance);
+
         result += prd.radiance;
+        albedo += prd.features.albedo;
+        normal += prd.features.normal;
     }
 
     //
     // Update the output buffer
     //
-    float3 normal_eyespace = (length(normal) > 0.0f) ? normalize(normal_matrix * normal) : make_float3(0.0, 0.0, 1.0);
-
-    float inv_sample_per_launch = 1.0f / static_cast<float>(sample_per_launch);
-    float3 pixel_liner = result * inv_sample_per_launch;
-    float3 pixel_albedo = albedo * inv_sample_per_launch;
-    float3 pixel_normal = normal_eyespace;
-
-    if (frame_number > 1)
-    {
-        float a = static_cast<float>(sample_per_launch) / static_cast<float>(total_sample + sample_per_launch);
-        pixel_liner = lerp(make_float3(liner_buffer[launch_index]), pixel_liner, a);
-
-        // NOTE: mCYp̏1t[ڂXVȂ
-        // pixel_albedo = lerp(make_float3(input_albedo_buffer[launch_index]), pixel_albedo, a);
-        // pixel_normal = lerp(make_float3(input_normal_buffer[launch_index]), pixel_normal, a);
-    }
-
-    float3 pixel_output = use_post_tonemap ? pixel_liner : linear_to_sRGB(tonemap_acesFilm(pixel_liner * tonemap_exposure));
-
-    // Save to buffer
-    liner_buffer[launch_index] = make_float4(pixel_liner, 1.0);
-    output_buffer[launch_index] = make_float4(pixel_output, 1.0);
-
-    // NOTE: fmCYp̏1t[ڂXVȂ
-    // NOTE: DOFƂ[Vu[Ȃ疈t[XV̂Ȃ
-    if (frame_number == 1)
-    {
-        input_albedo_buffer[launch_index] = make_float4(pixel_albedo, 1.0f);
-        input_normal_buffer[launch_index] = make_float4(pixel_normal, 1.0f);
-    }
+    updateOutputBuffers(result, albedo, normal);
 }
 
 
@@ -179,64 +378,104 @@ rtBuffer<MaterialParameter> sysMaterialParameters;
 rtDeclareVariable(int, material_id, , );
 rtDeclareVariable(int, bsdf_id, , );
 
+// Disney lobe selection tables indexed by material id, see lobe_table.h
+rtBuffer<DisneyLobeTable> sysDisneyLobeTables;
+rtDeclareVariable(unsigned int, use_lobe_tables, , );
+
+// BSDF entry points for a material. Disney materials pick their lobes from
+// their lobe table when use_lobe_tables is set.
+template<BSDFType Type>
+RT_FUNCTION void evalPdfMaterial(int id, const MaterialParameter &mat, const State &state, const float3 &wo, const float3 &wi, float3 &f, float &pdf)
+{
+    BSDF<Type>::evalPdf(mat, state, wo, wi, f, pdf);
+}
+
+template<>
+RT_FUNCTION void evalPdfMaterial<DISNEY>(int id, const MaterialParameter &mat, const State &state, const float3 &wo, const float3 &wi, float3 &f, float &pdf)
+{
+    if (use_lobe_tables)
+        BSDF<DISNEY>::evalPdf(sysDisneyLobeTables[id], mat, state, wo, wi, f, pdf);
+    else
+        BSDF<DISNEY>::evalPdf(mat, state, wo, wi, f, pdf);
+}
+
+template<BSDFType Type>
+RT_FUNCTION void sampleMaterial(int id, const MaterialParameter &mat, const State &state, const float3 &wo, unsigned int &seed, BSDFSample &s)
+{
+    BSDF<Type>::sample(mat, state, wo, seed, s);
+}
+
+template<>
+RT_FUNCTION void sampleMaterial<DISNEY>(int id, const MaterialParameter &mat, const State &state, const float3 &wo, unsigned int &seed, BSDFSample &s)
+{
+    if (use_lobe_tables)
+        BSDF<DISNEY>::sample(sysDisneyLobeTables[id], mat, state, wo, seed, s);
+    else
+        BSDF<DISNEY>::sample(mat, state, wo, seed, s);
+}
+
 rtDeclareVariable(int, sysNumberOfLights, , );
 rtBuffer<LightParameter> sysLightParameters;
 rtDeclareVariable(int, lightMaterialId, , );
+rtDeclareVariable(int, primitive_type, , );
 
-rtBuffer< rtCallableProgramId<void(MaterialParameter &mat, State &state, PerRayData_pathtrace &prd)> > prgs_BSDF_Pdf;
-rtBuffer< rtCallableProgramId<void(MaterialParameter &mat, State &state, PerRayData_pathtrace &prd)> > prgs_BSDF_Sample;
-rtBuffer< rtCallableProgramId<float3(MaterialParameter &mat, State &state, PerRayData_pathtrace &prd)> > prgs_BSDF_Eval;
+// Spheres are batched into one GeometryInstance and report the material of the
+// hit sphere as attributes (see sphere.h), other primitives use the variables
+// of their GeometryInstance.
+rtDeclareVariable(int, sphere_material_id, attribute sphere_material_id, );
+rtDeclareVariable(int, sphere_light_id, attribute sphere_light_id, );
 
-RT_PROGRAM void light_closest_hit()
+// Quad and triangle lights, see intersect_emitter.cu
+rtDeclareVariable(int, emitter_light_id, attribute emitter_light_id, );
+
+RT_FUNCTION int hitMaterialId()
 {
-    const float3 world_shading_normal = normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, shading_normal));
-    const float3 world_geometric_normal = normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, geometric_normal));
-    const float3 ffnormal = faceforward(world_shading_normal, -ray.direction, world_geometric_normal);
+    return primitive_type == PRIMITIVE_SPHERE ? sphere_material_id : material_id;
+}
 
-    current_prd.albedo = make_float3(0.0f);
-    current_prd.normal = ffnormal;
+RT_FUNCTION int hitLightId()
+{
+    if (primitive_type == PRIMITIVE_SPHERE)
+        return sphere_light_id;
+    if (primitive_type == PRIMITIVE_EMITTER)
+        return emitter_light_id;
+    return lightMaterialId;
+}
 
-    LightParameter light = sysLightParameters[lightMaterialId];
-    float cosTheta = dot(-ray.direction, light.normal);
 
-    if ((light.lightType == QUAD && cosTheta > 0.0f) || light.lightType == SPHERE)
-    {
-        if (current_prd.depth == 0 || current_prd.specularBounce)
-            current_prd.radiance += light.emission * current_prd.attenuation;
-        else
-        {
-            float lightPdf = (t_hit * t_hit) / (light.area * clamp(cosTheta, 1.e-3f, 1.0f));
-            current_prd.radiance += powerHeuristic(current_prd.pdf, lightPdf) * current_prd.attenuation * light.emission;
-        }
-    }
+// Emission picked up by a path from origin that hits a light, MIS weighted against light sampling
+RT_FUNCTION float3 lightRadiance(const LightParameter& light, const float3& origin, const float3& direction, float t, float bsdfPdf, int depth, bool specularBounce)
+{
+    if (!lightEmits(light, direction))
+        return make_float3(0.0f);
 
-    current_prd.done = true;
+    if (depth == 0 || specularBounce)
+        return light.emission;
+
+    return powerHeuristic(bsdfPdf, lightPdf(light, origin, direction, t)) * light.emission;
 }
 
-RT_FUNCTION float3 UniformSampleSphere(float u1, float u2)
+RT_PROGRAM void light_closest_hit()
 {
-    float z = 1.f - 2.f * u1;
-    float r = sqrtf(max(0.f, 1.f - z * z));
-    float phi = 2.f * M_PIf * u2;
-    float x = r * cosf(phi);
-    float y = r * sinf(phi);
+    const float3 world_shading_normal = normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, shading_normal));
+    const float3 world_geometric_normal = normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, geometric_normal));
+    const float3 ffnormal = faceforward(world_shading_normal, -ray.direction, world_geometric_normal);
 
-    return make_float3(x, y, z);
-}
+    LightParameter light = sysLightParameters[hitLightId()];
+    current_prd.radiance += lightRadiance(light, ray.origin, ray.direction, t_hit, current_prd.pdf, current_prd.depth, current_prd.specularBounce) * current_prd.attenuation;
 
-RT_CALLABLE_PROGRAM void sphere_sample(LightParameter &light, PerRayData_pathtrace &prd, LightSample &sample)
-{
-    const float r1 = rnd(prd.seed);
-    const float r2 = rnd(prd.seed);
-    sample.surfacePos = light.position + UniformSampleSphere(r1, r2) * light.radius;
-    sample.normal = normalize(sample.surfacePos - light.position);
-    sample.emission = light.emission * sysNumberOfLights;
+    current_prd.done = true;
 }
 
-RT_FUNCTION float3 DirectLight(MaterialParameter &mat, State &state)
+
+// Picks a light and evaluates the MIS weighted contribution of a sample on it,
+// without testing occlusion. Returns false if the sample can not contribute,
+// otherwise the caller traces a shadow ray along lightDir up to lightDist.
+template<BSDFType Type>
+RT_FUNCTION bool sampleDirectLight(int materialId, MaterialParameter &mat, State &state, PerRayData_pathtrace &prd, float3 &lightDir, float &lightDist, float3 &result)
 {
     //Pick a light to sample
-    int index = optix::clamp(static_cast<int>(floorf(rnd(current_prd.seed) * sysNumberOfLights)), 0, sysNumberOfLights - 1);
+    int index = optix::clamp(static_cast<int>(floorf(rnd(prd.seed) * sysNumberOfLights)), 0, sysNumberOfLights - 1);
     LightParameter light = sysLightParameters[index];
     LightSample lightSample;
 
@@ -244,48 +483,61 @@ RT_FUNCTION float3 DirectLight(MaterialParameter &mat, State &state)
     float3 surfacePos = state.hitpoint;
     float3 surfaceNormal = state.ffnormal;
 
-    // sysLightSample[light.lightType](light, current_prd, lightSample);
-    sphere_sample(light, current_prd, lightSample);
+    const float r1 = rnd(prd.seed);
+    const float r2 = rnd(prd.seed);
+    if (!sampleLight(light, surfacePos, r1, r2, lightSample))
+        return false;
 
-    float3 lightDir = lightSample.surfacePos - surfacePos;
-    float lightDist = length(lightDir);
-    float lightDistSq = lightDist * lightDist;
-    lightDir /= sqrtf(lightDistSq);
+    lightDir = lightSample.surfacePos - surfacePos;
+    lightDist = length(lightDir);
+    lightDir /= lightDist;
 
     if (dot(lightDir, surfaceNormal) <= 0.0f || dot(lightDir, lightSample.normal) >= 0.0f)
-        return make_float3(0.0f);
-
-    PerRayData_pathtrace_shadow prd_shadow;
-    prd_shadow.inShadow = false;
-    optix::Ray shadowRay = optix::make_Ray(surfacePos, lightDir, 1, scene_epsilon, lightDist - scene_epsilon);
-    rtTrace(top_object, shadowRay, prd_shadow);
-
-    if (prd_shadow.inShadow)
-        return make_float3(0.0f);
+        return false;
 
-    float NdotL = dot(lightSample.normal, -lightDir);
-    float lightPdf = lightDistSq / (light.area * NdotL);
-    // if (lightPdf <= 0.0f)
-    //    return make_float3(0.0f);
+    float3 f;
+    float bsdfPdf;
+    evalPdfMaterial<Type>(materialId, mat, state, prd.wo, lightDir, f, bsdfPdf);
 
-    current_prd.direction = lightDir;
-
-    prgs_BSDF_Pdf[bsdf_id](mat, state, current_prd);
-    float3 f = prgs_BSDF_Eval[bsdf_id](mat, state, current_prd);
-    float3 result = powerHeuristic(lightPdf, current_prd.pdf) * current_prd.attenuation * f * lightSample.emission / max(0.001f, lightPdf);
+    // The light was picked with probability 1 / sysNumberOfLights
+    const float lightPdf = lightSample.pdf;
+    result = powerHeuristic(lightPdf, bsdfPdf) * prd.attenuation * f * lightSample.emission * sysNumberOfLights / max(0.001f, lightPdf);
 
     // FIXME: {̌𖾂
     if (isnan(result.x) || isnan(result.y) || isnan(result.z))
-        return make_float3(0.0f);
+        return false;
 
     // NOTE: ̋Px̃CÖ׃`FbN
     if (result.x < 0.0f || result.y < 0.0f || result.z < 0.0f)
+        return false;
+
+    return true;
+}
+
+template<BSDFType Type>
+RT_FUNCTION float3 DirectLight(int materialId, MaterialParameter &mat, State &state)
+{
+    float3 lightDir;
+    float lightDist;
+    float3 result;
+    if (!sampleDirectLight<Type>(materialId, mat, state, current_prd, lightDir, lightDist, result))
+        return make_float3(0.0f);
+    PROFILE_COUNT(PROFILE_BSDF_EVALS, 1);
+
+    PerRayData_pathtrace_shadow prd_shadow;
+    prd_shadow.inShadow = false;
+    optix::Ray shadowRay = optix::make_Ray(state.hitpoint, lightDir, 1, scene_epsilon, lightDist - scene_epsilon);
+    rtTrace(top_object, shadowRay, prd_shadow);
+    PROFILE_COUNT(PROFILE_SHADOW_RAYS, 1);
+
+    if (prd_shadow.inShadow)
         return make_float3(0.0f);
 
     return result;
 }
 
-RT_PROGRAM void closest_hit()
+template<BSDFType Type>
+RT_FUNCTION void closestHit()
 {
     float3 world_shading_normal = normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, shading_normal));
     float3 world_geometric_normal = normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, geometric_normal));
@@ -299,12 +551,27 @@ RT_PROGRAM void closest_hit()
     state.ffnormal = ffnormal;
 
     // FIXME: materialCustomProgramId ݂ȖOŊ֐|C^nāAp[^vV[WɃZbg
-    MaterialParameter mat = sysMaterialParameters[material_id];
+    const int materialId = hitMaterialId();
+    MaterialParameter mat = sysMaterialParameters[materialId];
+    recordDenoiseFeatures(mat, ffnormal, current_prd.features);
+
+    // Past the first vertex, terminate into the radiance cache where it has an
+    // estimate, otherwise have the camera program update it from this vertex
+    if (use_radiance_cache && radianceCacheEligible(mat, radiance_cache_roughness))
+    {
+        const RadianceCacheQuery query = radianceCacheQuery(hitpoint, ffnormal);
+        float3 cached;
+        if (current_prd.depth > 0 && radianceCacheLookup(query, cached))
+        {
+            current_prd.radiance += cached * current_prd.attenuation;
+            current_prd.done = true;
+            return;
+        }
+        current_prd.radianceCacheSlot = radianceCacheFind(query, true);
+    }
 
     current_prd.radiance += mat.emission * current_prd.attenuation;
     current_prd.wo = -ray.direction;
-    current_prd.albedo = mat.albedo;
-    current_prd.normal = ffnormal;
 
     // FIXME: SampleɂĂ
     current_prd.origin = hitpoint;
@@ -315,17 +582,20 @@ RT_PROGRAM void closest_hit()
     // Direct light Sampling
     if (!current_prd.specularBounce && current_prd.depth < max_depth)
     {
-        current_prd.radiance += DirectLight(mat, state);
+        current_prd.radiance += DirectLight<Type>(materialId, mat, state);
     }
 
     // BRDF Sampling
-    prgs_BSDF_Sample[bsdf_id](mat, state, current_prd);
-    prgs_BSDF_Pdf[bsdf_id](mat, state, current_prd);
-    float3 f = prgs_BSDF_Eval[bsdf_id](mat, state, current_prd);
+    BSDFSample bsdfSample;
+    sampleMaterial<Type>(materialId, mat, state, current_prd.wo, current_prd.seed, bsdfSample);
+    PROFILE_COUNT(PROFILE_BSDF_EVALS, 1);
+
+    current_prd.direction = bsdfSample.direction;
+    current_prd.pdf = bsdfSample.pdf;
 
     if (current_prd.pdf > 0.0f)
     {
-        current_prd.attenuation *= f / current_prd.pdf;
+        current_prd.attenuation *= bsdfSample.f / current_prd.pdf;
     }
     else
     {
@@ -333,6 +603,17 @@ RT_PROGRAM void closest_hit()
     }
 }
 
+// One closest hit program per BSDF type, see createContext()
+RT_PROGRAM void closest_hit_diffuse()
+{
+    closestHit<DIFFUSE>();
+}
+
+RT_PROGRAM void closest_hit_disney()
+{
+    closestHit<DISNEY>();
+}
+
 
 //-----------------------------------------------------------------------------
 //
@@ -368,14 +649,245 @@ RT_PROGRAM void exception()
 //-----------------------------------------------------------------------------
 
 rtTextureSampler<float4, 2> envmap;
-RT_PROGRAM void envmap_miss()
+
+RT_FUNCTION float3 envmapRadiance(const float3& direction)
 {
-    float theta = atan2f(ray.direction.x, ray.direction.z);
-    float phi = M_PIf * 0.5f - acosf(ray.direction.y);
+    float theta = atan2f(direction.x, direction.z);
+    float phi = M_PIf * 0.5f - acosf(direction.y);
     float u = (theta + M_PIf) * (0.5f * M_1_PIf);
     float v = 0.5f * (1.0f + sin(phi));
-    current_prd.radiance += make_float3(tex2D(envmap, u, v)) * current_prd.attenuation;
-    current_prd.albedo = make_float3(0.0f);
-    current_prd.normal = -ray.direction;
+    return make_float3(tex2D(envmap, u, v));
+}
+
+RT_PROGRAM void envmap_miss()
+{
+    current_prd.radiance += envmapRadiance(ray.direction) * current_prd.attenuation;
     current_prd.done = true;
-}
\ No newline at end of file
+}
+
+//-----------------------------------------------------------------------------
+//
+//  Wavefront path tracing, see wavefront.h
+//
+//  wavefront_generate and wavefront_accumulate are launched over the screen,
+//  the other passes over the length of their queue (as a length x 1 launch).
+//
+//-----------------------------------------------------------------------------
+
+rtDeclareVariable(WavefrontHit, current_hit, rtPayload, );
+rtDeclareVariable(unsigned int, wavefront_wave, , );
+
+rtBuffer<WavefrontPath> wavefront_paths;
+rtBuffer<WavefrontHit> wavefront_hits;
+rtBuffer<WavefrontShadowRay> wavefront_shadow_rays;
+rtBuffer<unsigned int> wavefront_queue;
+rtBuffer<unsigned int> wavefront_sorted_queue;
+rtBuffer<unsigned int> wavefront_next_queue;
+rtBuffer<unsigned int> wavefront_counters;
+
+RT_PROGRAM void wavefront_closest_hit()
+{
+    float3 world_shading_normal = normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, shading_normal));
+    float3 world_geometric_normal = normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, geometric_normal));
+    float3 ffnormal = faceforward(world_shading_normal, -ray.direction, world_geometric_normal);
+
+    current_hit.state.hitpoint = ray.origin + t_hit * ray.direction + ffnormal * scene_epsilon * 10.0;
+    current_hit.state.normal = world_shading_normal;
+    current_hit.state.ffnormal = ffnormal;
+    current_hit.t = t_hit;
+    current_hit.material_id = hitMaterialId();
+    current_hit.key = wavefrontSurfaceKey(bsdf_id, primitive_type);
+}
+
+RT_PROGRAM void wavefront_light_closest_hit()
+{
+    current_hit.t = t_hit;
+    current_hit.light_id = hitLightId();
+    current_hit.key = WAVEFRONT_KEY_LIGHT;
+}
+
+RT_PROGRAM void wavefront_miss()
+{
+    current_hit.key = WAVEFRONT_KEY_MISS;
+}
+
+RT_PROGRAM void wavefront_generate()
+{
+    size_t2 screen = output_buffer.size();
+    const unsigned int pixel = screen.x * launch_index.y + launch_index.x;
+    WavefrontPath& path = wavefront_paths[pixel];
+
+    // One path per pixel, its radiance is summed over the waves of a launch
+    if (wavefront_wave == 0)
+    {
+        path.radiance = make_float3(0.0f);
+        path.albedo = make_float3(0.0f);
+        path.normal = make_float3(0.0f);
+        path.seed = tea<16>(pixel, total_sample);
+    }
+    else
+    {
+        path.albedo += path.features.albedo;
+        path.normal += path.features.normal;
+    }
+    resetDenoiseFeatures(path.features);
+
+    float2 subpixel_jitter = make_float2(rnd(path.seed) - 0.5f, rnd(path.seed) - 0.5f);
+    float2 d = (make_float2(launch_index) + subpixel_jitter) / make_float2(screen) * 2.f - 1.f;
+    path.origin = eye;
+    path.direction = normalize(d.x*U + d.y*V + W);
+    path.time = sampleShutterTime(path.seed);
+    path.attenuation = make_float3(1.0f);
+    path.pdf = 0.0f;
+    path.pixel = pixel;
+    path.depth = 0;
+    path.specularBounce = false;
+
+    wavefront_queue[pixel] = pixel;
+}
+
+RT_PROGRAM void wavefront_extend()
+{
+    const unsigned int path_index = wavefront_queue[launch_index.x];
+    const float3 origin = wavefront_paths[path_index].origin;
+    const float3 direction = wavefront_paths[path_index].direction;
+
+    WavefrontHit hit;
+    Ray ray = make_Ray(origin, direction, WAVEFRONT_RAY_TYPE, scene_epsilon, RT_DEFAULT_MAX);
+    rtTrace(top_object, ray, wavefront_paths[path_index].time, hit);
+
+    wavefront_hits[path_index] = hit;
+
+    // Histogram for the sort pass
+    wavefrontPush(&wavefront_counters[WAVEFRONT_COUNTER_HISTOGRAM + hit.key]);
+}
+
+RT_PROGRAM void wavefront_sort()
+{
+    const unsigned int path_index = wavefront_queue[launch_index.x];
+    const unsigned int slot = wavefrontSortedSlot(&wavefront_counters[0], wavefront_hits[path_index].key);
+    wavefront_sorted_queue[slot] = path_index;
+}
+
+// Shades a surface hit and samples the next segment, returns false if the path terminates.
+// Follows closestHit and the bounce loop of pathtrace_camera.
+template<BSDFType Type>
+RT_FUNCTION bool wavefrontShadeSurface(unsigned int path_index, WavefrontPath& path, const WavefrontHit& hit)
+{
+    MaterialParameter mat = sysMaterialParameters[hit.material_id];
+    State state = hit.state;
+    recordDenoiseFeatures(mat, state.ffnormal, path.features);
+
+    // Per-ray data for the light sampling
+    PerRayData_pathtrace prd;
+    prd.attenuation = path.attenuation;
+    prd.wo = -path.direction;
+    prd.seed = path.seed;
+    prd.depth = path.depth;
+
+    path.radiance += mat.emission * path.attenuation;
+    path.specularBounce = false;
+
+    // Radiance of this vertex for the roulette, the light sample before its shadow test
+    float3 vertex_radiance = mat.emission * path.attenuation;
+
+    // Direct light Sampling, the occlusion is tested by the shadow pass
+    if (!path.specularBounce && path.depth < max_depth)
+    {
+        WavefrontShadowRay shadow_ray;
+        float light_dist;
+        if (sampleDirectLight<Type>(hit.material_id, mat, state, prd, shadow_ray.direction, light_dist, shadow_ray.contribution))
+        {
+            shadow_ray.origin = state.hitpoint;
+            shadow_ray.tmax = light_dist - scene_epsilon;
+            shadow_ray.path = path_index;
+            wavefront_shadow_rays[wavefrontPush(&wavefront_counters[WAVEFRONT_COUNTER_SHADOW])] = shadow_ray;
+            vertex_radiance += shadow_ray.contribution;
+        }
+    }
+
+    // BRDF Sampling
+    BSDFSample bsdfSample;
+    sampleMaterial<Type>(hit.material_id, mat, state, prd.wo, prd.seed, bsdfSample);
+    path.seed = prd.seed;
+
+    if (bsdfSample.pdf <= 0.0f || path.depth >= max_depth)
+        return false;
+
+    const float3 attenuation_before = path.attenuation;
+    path.attenuation *= bsdfSample.f / bsdfSample.pdf;
+    path.pdf = bsdfSample.pdf;
+    path.origin = state.hitpoint;
+    path.direction = bsdfSample.direction;
+
+    // Russian roulette termination
+    if (rr_mode != RR_OFF && path.depth >= static_cast<int>(rr_begin_depth))
+    {
+        size_t2 screen = output_buffer.size();
+        const uint2 pixel = make_uint2(path.pixel % screen.x, path.pixel / screen.x);
+        float pcont = russianRoulette(attenuation_before, path.attenuation, vertex_radiance, russianRoulettePixelMean(pixel));
+        if (rnd(path.seed) >= pcont)
+            return false;
+        path.attenuation /= pcont;
+    }
+
+    path.depth++;
+    return true;
+}
+
+RT_PROGRAM void wavefront_shade()
+{
+    const unsigned int path_index = wavefront_sorted_queue[launch_index.x];
+    const WavefrontHit hit = wavefront_hits[path_index];
+    WavefrontPath path = wavefront_paths[path_index];
+
+    bool alive = false;
+    if (hit.key == WAVEFRONT_KEY_MISS)
+    {
+        path.radiance += envmapRadiance(path.direction) * path.attenuation;
+    }
+    else if (hit.key == WAVEFRONT_KEY_LIGHT)
+    {
+        LightParameter light = sysLightParameters[hit.light_id];
+        path.radiance += lightRadiance(light, path.origin, path.direction, hit.t, path.pdf, path.depth, path.specularBounce) * path.attenuation;
+    }
+    else if (wavefrontKeyBSDF(hit.key) == DIFFUSE)
+    {
+        alive = wavefrontShadeSurface<DIFFUSE>(path_index, path, hit);
+    }
+    else
+    {
+        alive = wavefrontShadeSurface<DISNEY>(path_index, path, hit);
+    }
+
+    wavefront_paths[path_index] = path;
+
+    // Compact the surviving paths into the queue of the next bounce
+    if (alive)
+    {
+        wavefront_next_queue[wavefrontPush(&wavefront_counters[WAVEFRONT_COUNTER_EXTEND])] = path_index;
+    }
+}
+
+RT_PROGRAM void wavefront_shadow()
+{
+    const WavefrontShadowRay shadow_ray = wavefront_shadow_rays[launch_index.x];
+
+    PerRayData_pathtrace_shadow prd_shadow;
+    prd_shadow.inShadow = false;
+    optix::Ray shadowRay = optix::make_Ray(shadow_ray.origin, shadow_ray.direction, 1, scene_epsilon, shadow_ray.tmax);
+    rtTrace(top_object, shadowRay, wavefront_paths[shadow_ray.path].time, prd_shadow);
+
+    // A path has at most one shadow ray per bounce, so this does not race
+    if (!prd_shadow.inShadow)
+    {
+        wavefront_paths[shadow_ray.path].radiance += shadow_ray.contribution;
+    }
+}
+
+RT_PROGRAM void wavefront_accumulate()
+{
+    size_t2 screen = output_buffer.size();
+    const WavefrontPath& path = wavefront_paths[screen.x * launch_index.y + launch_index.x];
+    updateOutputBuffers(path.radiance, path.albedo + path.features.albedo, path.normal + path.features.normal);
+}
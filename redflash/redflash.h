@@ -8,6 +8,24 @@ using namespace optix;
 #define RT_FUNCTION __forceinline__ __device__
 #endif
 
+// Per-pixel performance counters. Enabled with the REDFLASH_PROFILE cmake option,
+// otherwise PROFILE_COUNT expands to nothing and profile_buffer is never declared.
+#ifndef REDFLASH_PROFILE
+#define REDFLASH_PROFILE 0
+#endif
+
+// Components of profile_buffer (uint4)
+#define PROFILE_RAYMARCH_STEPS x
+#define PROFILE_BOUNCES y
+#define PROFILE_SHADOW_RAYS z
+#define PROFILE_BSDF_EVALS w
+
+#if REDFLASH_PROFILE
+#define PROFILE_COUNT(counter, n) (profile_buffer[launch_index].counter += (n))
+#else
+#define PROFILE_COUNT(counter, n)
+#endif
+
 struct State
 {
     float3 hitpoint;
@@ -18,7 +36,8 @@ struct State
 enum BSDFType
 {
     DIFFUSE,
-    DISNEY
+    DISNEY,
+    BSDF_TYPE_COUNT
 };
 
 struct MaterialParameter
@@ -57,9 +76,24 @@ struct MaterialParameter
     BSDFType bsdf;
 };
 
+enum RussianRouletteMode
+{
+    RR_OFF,
+    // Survival probability from the luminance of the path throughput
+    RR_THROUGHPUT,
+    // Weight window around the running mean of the pixel, see russian_roulette.h
+    RR_EFFICIENCY
+};
+
+// Path depth at which the roulette starts by default. Starting at 1 needs more
+// path vertices than the fixed depth to reach the same RMSE, see
+// redflash_bench --rr_compare.
+#define RR_DEFAULT_BEGIN_DEPTH 3
+
+// See light_sample.h
 enum LightType
 {
-    SPHERE, QUAD
+    SPHERE, QUAD, TRIANGLE
 };
 
 struct LightParameter
@@ -82,13 +116,25 @@ struct LightSample
     float pdf;
 };
 
+// Albedo and normal of a path for the denoiser, see denoise_features.h
+struct DenoiseFeatures
+{
+    float3 albedo;
+    float3 normal;
+
+    // Reflectance of the specular vertices in front of the current one
+    float3 tint;
+
+    // Set while only specular vertices were found
+    bool pending;
+};
+
 struct PerRayData_pathtrace
 {
     float3 radiance;
     float3 attenuation;
 
-    float3 albedo;
-    float3 normal;
+    DenoiseFeatures features;
 
     float3 origin;
     float3 direction;
@@ -100,6 +146,9 @@ struct PerRayData_pathtrace
     int depth;
     bool done;
     bool specularBounce;
+
+    // Slot of the radiance cache entry of the hit, -1 if none (see radiance_cache.h)
+    int radianceCacheSlot;
 };
 
 struct PerRayData_pathtrace_shadow
@@ -0,0 +1,880 @@
+//-----------------------------------------------------------------------------
+//
+// redflash_bench: headless benchmark of the redflash path tracer
+//
+// Renders fixed scenes with a fixed sample count. The per-pixel seeds are
+// derived from the pixel index and total_sample only, so two runs with the
+// same options produce the same image and timings can be compared directly.
+//
+//-----------------------------------------------------------------------------
+
+#include <optixu/optixpp_namespace.h>
+#include <optixu/optixu_math_stream_namespace.h>
+
+#include "bsdf_bench.h"
+#include "cpu_denoiser.h"
+#include "denoiser_bench.h"
+#include "filter.h"
+#include "filter_bench.h"
+#include "image_metrics.h"
+#include "light_bench.h"
+#include "motion_bench.h"
+#include "postprocess_bench.h"
+#include "radiance_cache_bench.h"
+#include "redflash_host.h"
+#include "rr_bench.h"
+#include "sphere_bench.h"
+#include "wavefront.h"
+#include <sutil.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+#  include <psapi.h>
+#else
+#  include <sys/resource.h>
+#endif
+
+namespace fs = std::experimental::filesystem;
+
+using namespace optix;
+
+struct BenchOptions
+{
+    int samples;
+    std::string reference_dir;
+    bool update_reference;
+
+    // Sample count of the reference image to compare against (0 = same as samples)
+    int reference_samples;
+
+    // Stop as soon as the RMSE against the reference drops to this value (0 = off)
+    double target_rmse;
+};
+
+struct BenchResult
+{
+    std::string scene;
+    std::string backend;
+    int width;
+    int height;
+    int samples;
+    double setup_time;
+    double compile_time;
+    double render_time;
+    double samples_per_sec;
+    double rays_per_sec;
+    bool rays_counted;
+    size_t peak_host_memory;
+    double rmse;
+    bool has_reference;
+    double time_to_target;
+    int samples_to_target;
+    bool reached_target;
+};
+
+size_t peakHostMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#  ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#  else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#  endif
+#endif
+}
+
+// Copies the RGB channels of a float4 buffer in launch index order (bottom row first)
+std::vector<float> readLinearImage(Buffer buffer)
+{
+    RTsize w, h;
+    buffer->getSize(w, h);
+
+    std::vector<float> image(w * h * 3);
+    const float4* src = static_cast<const float4*>(buffer->map(0, RT_BUFFER_MAP_READ));
+    for (size_t i = 0; i < w * h; ++i)
+    {
+        image[i * 3 + 0] = src[i].x;
+        image[i * 3 + 1] = src[i].y;
+        image[i * 3 + 2] = src[i].z;
+    }
+    buffer->unmap();
+
+    return image;
+}
+
+// Portable float map, little endian, bottom row first
+bool writePFM(const std::string& filename, const std::vector<float>& image, int w, int h)
+{
+    std::ofstream ofs(filename.c_str(), std::ios::binary);
+    if (!ofs)
+        return false;
+
+    ofs << "PF\n" << w << " " << h << "\n-1.0\n";
+    ofs.write(reinterpret_cast<const char*>(&image[0]), image.size() * sizeof(float));
+    return ofs.good();
+}
+
+bool readPFM(const std::string& filename, std::vector<float>& image, int& w, int& h)
+{
+    std::ifstream ifs(filename.c_str(), std::ios::binary);
+    if (!ifs)
+        return false;
+
+    std::string magic;
+    float scale;
+    ifs >> magic >> w >> h >> scale;
+    ifs.get();
+    if (magic != "PF" || w <= 0 || h <= 0 || scale >= 0.0f)
+        return false;
+
+    image.resize(static_cast<size_t>(w) * h * 3);
+    ifs.read(reinterpret_cast<char*>(&image[0]), image.size() * sizeof(float));
+    return ifs.good();
+}
+
+std::string referencePath(const std::string& reference_dir, const std::string& scene, int samples)
+{
+    return reference_dir + "/" + scene + "_" + std::to_string(width) + "x" + std::to_string(height) + "_" + std::to_string(samples) + "spp.pfm";
+}
+
+BenchResult benchOptiX(const std::string& scene, const BenchOptions& options)
+{
+    BenchResult result = BenchResult();
+    result.scene = scene;
+    result.backend = use_wavefront ? "optix_wavefront" : "optix";
+    result.width = width;
+    result.height = height;
+
+    const int samples = options.samples;
+    const int reference_samples = options.reference_samples > 0 ? options.reference_samples : samples;
+    const std::string reference_file = referencePath(options.reference_dir, scene, reference_samples);
+    std::vector<float> reference;
+    int reference_width, reference_height;
+    result.has_reference = readPFM(reference_file, reference, reference_width, reference_height)
+        && reference_width == width && reference_height == height;
+
+    scene_name = scene;
+    camera_changed = true;
+
+    double begin = sutil::currentTime();
+    createContext();
+    setupCamera();
+    setupScene();
+    context->validate();
+    result.setup_time = sutil::currentTime() - begin;
+
+    // The first launch compiles the kernel and builds the accelerations
+    begin = sutil::currentTime();
+    context->launch(0, 0, 0);
+    result.compile_time = sutil::currentTime() - begin;
+
+    updateCamera();
+
+    wavefront_ray_count = 0;
+    const bool track_rmse = options.target_rmse > 0.0 && result.has_reference;
+    double render_time = 0.0;
+    while (total_sample < samples)
+    {
+        sample_per_launch = std::min(sample_per_launch, samples - total_sample);
+        context["sample_per_launch"]->setUint(sample_per_launch);
+        context["frame_number"]->setUint(frame_number);
+        context["total_sample"]->setUint(total_sample);
+
+        begin = sutil::currentTime();
+        launchPathtrace();
+        render_time += sutil::currentTime() - begin;
+
+        frame_number++;
+        total_sample += sample_per_launch;
+
+        // The read back is not part of the render time
+        if (track_rmse && imageRMSE(readLinearImage(getLinerBuffer()), reference) <= options.target_rmse)
+        {
+            result.time_to_target = render_time;
+            result.samples_to_target = total_sample;
+            result.reached_target = true;
+            break;
+        }
+    }
+    result.render_time = render_time;
+    result.samples = total_sample;
+
+    const double pixel_samples = static_cast<double>(width) * height * total_sample;
+    result.samples_per_sec = pixel_samples / result.render_time;
+
+    if (use_wavefront)
+    {
+        // The wavefront passes know their queue lengths
+        result.rays_per_sec = static_cast<double>(wavefront_ray_count) / result.render_time;
+        result.rays_counted = true;
+    }
+    else
+#if REDFLASH_PROFILE
+    {
+        Buffer profileBuffer = getProfileBuffer();
+        const uint4* counters = static_cast<const uint4*>(profileBuffer->map(0, RT_BUFFER_MAP_READ));
+        double rays = 0.0;
+        for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i)
+            rays += static_cast<double>(counters[i].y) + counters[i].z;
+        profileBuffer->unmap();
+        result.rays_per_sec = rays / result.render_time;
+        result.rays_counted = true;
+    }
+#else
+    {
+        // Only camera rays are known without the profile counters
+        result.rays_per_sec = pixel_samples / result.render_time;
+        result.rays_counted = false;
+    }
+#endif
+
+    std::vector<float> image = readLinearImage(getLinerBuffer());
+
+    if (result.has_reference)
+        result.rmse = imageRMSE(image, reference);
+
+    if (options.update_reference)
+    {
+        const std::string update_file = referencePath(options.reference_dir, scene, total_sample);
+        fs::create_directories(options.reference_dir);
+        if (writePFM(update_file, image, width, height))
+            std::cout << "[info] save_reference: " << update_file << std::endl;
+        else
+            std::cerr << "Failed to write reference " << update_file << std::endl;
+    }
+
+    destroyContext();
+    frame_number = 1;
+    total_sample = 0;
+
+    result.peak_host_memory = peakHostMemory();
+    return result;
+}
+
+// Liner buffer denoised on the CPU with the albedo and normal buffers, as RGB
+std::vector<float> denoiseLinearImage(CpuDenoiser& denoiser)
+{
+    Buffer liner = getLinerBuffer();
+    Buffer albedo = getAlbedoBuffer();
+    Buffer normal = getNormalBuffer();
+
+    std::vector<float4> denoised(static_cast<size_t>(width) * height);
+    denoiser.denoise(CpuDenoiserSettings(), width, height,
+        static_cast<const float4*>(liner->map(0, RT_BUFFER_MAP_READ)),
+        static_cast<const float4*>(albedo->map(0, RT_BUFFER_MAP_READ)),
+        static_cast<const float4*>(normal->map(0, RT_BUFFER_MAP_READ)),
+        denoised.data());
+    normal->unmap();
+    albedo->unmap();
+    liner->unmap();
+
+    std::vector<float> image(denoised.size() * 3);
+    for (size_t i = 0; i < denoised.size(); ++i)
+    {
+        image[i * 3 + 0] = denoised[i].x;
+        image[i * 3 + 1] = denoised[i].y;
+        image[i * 3 + 2] = denoised[i].z;
+    }
+    return image;
+}
+
+struct DenoisedLevel
+{
+    int samples;
+    double rmse;
+    double ssim;
+};
+
+// Renders one sample per frame, so that the first frame has the features of a
+// single sample, and compares the denoised image with the reference at 1, 2,
+// 4, ... samples and at the last one
+std::vector<DenoisedLevel> renderDenoisedLevels(const std::string& scene, const BenchOptions& options, const std::vector<float>& reference)
+{
+    scene_name = scene;
+    camera_changed = true;
+    createContext();
+    setupCamera();
+    setupScene();
+    context->validate();
+    updateCamera();
+
+    CpuDenoiser denoiser;
+    std::vector<DenoisedLevel> levels;
+    int next_level = 1;
+    sample_per_launch = 1;
+    while (total_sample < options.samples)
+    {
+        context["sample_per_launch"]->setUint(sample_per_launch);
+        context["frame_number"]->setUint(frame_number);
+        context["total_sample"]->setUint(total_sample);
+        launchPathtrace();
+
+        frame_number++;
+        total_sample += sample_per_launch;
+
+        if (total_sample == next_level || total_sample == options.samples)
+        {
+            const std::vector<float> image = denoiseLinearImage(denoiser);
+            DenoisedLevel level;
+            level.samples = total_sample;
+            level.rmse = imageRMSE(image, reference);
+            level.ssim = imageSSIM(image, reference, width, height);
+            levels.push_back(level);
+            next_level *= 2;
+        }
+    }
+
+    destroyContext();
+    frame_number = 1;
+    total_sample = 0;
+    return levels;
+}
+
+// Denoised quality with the features of the first frame and with the features
+// accumulated over all frames, and the samples the accumulated features need to
+// match the quality of the first frame features at the most samples. Returns
+// false without a reference or if the accumulated features are worse.
+bool benchDenoiseFeatures(const std::string& scene, const BenchOptions& options)
+{
+    const int reference_samples = options.reference_samples > 0 ? options.reference_samples : options.samples;
+    const std::string reference_file = referencePath(options.reference_dir, scene, reference_samples);
+    std::vector<float> reference;
+    int reference_width, reference_height;
+    if (!readPFM(reference_file, reference, reference_width, reference_height) || reference_width != width || reference_height != height)
+    {
+        std::cerr << "No reference " << reference_file << ", render one with --update_reference and a high --sample count.\n";
+        return false;
+    }
+
+    const bool initial_accumulate = accumulate_denoise_features;
+    const char* const names[2] = { "first_frame", "accumulated" };
+    std::vector<DenoisedLevel> levels[2];
+    for (int accumulate = 0; accumulate < 2; ++accumulate)
+    {
+        accumulate_denoise_features = accumulate != 0;
+        levels[accumulate] = renderDenoisedLevels(scene, options, reference);
+        for (auto level = levels[accumulate].begin(); level != levels[accumulate].end(); ++level)
+        {
+            std::cout << "[features] scene: " << scene
+                << "\tfeatures: " << names[accumulate]
+                << "\tsamples: " << level->samples
+                << "\trmse: " << level->rmse
+                << "\tssim: " << level->ssim << std::endl;
+        }
+    }
+    accumulate_denoise_features = initial_accumulate;
+
+    const DenoisedLevel& target = levels[0].back();
+    int rmse_samples = 0;
+    int ssim_samples = 0;
+    for (auto level = levels[1].begin(); level != levels[1].end(); ++level)
+    {
+        if (rmse_samples == 0 && level->rmse <= target.rmse)
+            rmse_samples = level->samples;
+        if (ssim_samples == 0 && level->ssim >= target.ssim)
+            ssim_samples = level->samples;
+    }
+
+    std::cout << "[features] scene: " << scene << "\tfirst_frame_samples: " << target.samples << "\tequal_rmse_samples: ";
+    if (rmse_samples > 0)
+        std::cout << rmse_samples << "\trmse_spp_saving: " << static_cast<double>(target.samples) / rmse_samples;
+    else
+        std::cout << "n/a";
+    std::cout << "\tequal_ssim_samples: ";
+    if (ssim_samples > 0)
+        std::cout << ssim_samples << "\tssim_spp_saving: " << static_cast<double>(target.samples) / ssim_samples;
+    else
+        std::cout << "n/a";
+    std::cout << std::endl;
+
+    const bool ok = levels[1].back().rmse <= target.rmse;
+    std::cout << "[features] checks: " << (ok ? "ok" : "failed") << std::endl;
+    return ok;
+}
+
+// Runs the queue passes of the wavefront mode on the CPU with random keys and
+// checks that sorting and compaction keep every path exactly once
+bool selftestWavefrontQueue()
+{
+    const unsigned int path_count = 100000;
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<unsigned int> key_dist(0, WAVEFRONT_KEY_COUNT - 1);
+
+    std::vector<unsigned int> keys(path_count);
+    std::vector<unsigned char> alive(path_count);
+    std::vector<unsigned int> queue;
+    for (unsigned int i = 0; i < path_count; ++i)
+    {
+        keys[i] = key_dist(rng);
+        alive[i] = (rng() % 4) != 0;
+
+        // The queue of a later bounce only holds part of the paths
+        if (rng() % 3 != 0)
+            queue.push_back(i);
+    }
+    std::shuffle(queue.begin(), queue.end(), rng);
+
+    std::vector<unsigned int> counters;
+    std::vector<unsigned int> sorted;
+    wavefront::clearCounters(counters);
+    wavefront::countKeys(queue, keys, counters);
+    wavefront::sortQueue(queue, keys, counters, sorted);
+    bool ok = wavefront::isSortedQueue(queue, keys, sorted);
+
+    // After the sort every offset has moved to the start of the next bucket
+    for (int k = 0; k + 1 < WAVEFRONT_KEY_COUNT; ++k)
+        ok = ok && counters[WAVEFRONT_COUNTER_OFFSETS + k] == counters[WAVEFRONT_COUNTER_OFFSETS + k + 1] - counters[WAVEFRONT_COUNTER_HISTOGRAM + k + 1];
+    ok = ok && counters[WAVEFRONT_COUNTER_OFFSETS + WAVEFRONT_KEY_COUNT - 1] == queue.size();
+
+    std::vector<unsigned int> next;
+    wavefront::compactQueue(sorted, alive, counters, next);
+    size_t expected = 0;
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        if (!alive[sorted[i]])
+            continue;
+        ok = ok && expected < next.size() && next[expected] == sorted[i];
+        ++expected;
+    }
+    ok = ok && expected == next.size();
+
+    std::cout << "[selftest] wavefront_queue: " << (ok ? "ok" : "failed") << "\tqueue_length: " << queue.size() << "\tnext_length: " << next.size() << std::endl;
+    return ok;
+}
+
+void printResult(const BenchResult& r)
+{
+    std::cout << "[bench] scene: " << r.scene
+        << "\tbackend: " << r.backend
+        << "\tresolution: " << r.width << "x" << r.height
+        << "\tsamples: " << r.samples
+        << "\tsetup_time: " << r.setup_time
+        << "\tcompile_time: " << r.compile_time
+        << "\trender_time: " << r.render_time
+        << "\tsamples_per_sec: " << r.samples_per_sec
+        << "\t" << (r.rays_counted ? "rays_per_sec: " : "camera_rays_per_sec: ") << r.rays_per_sec
+        << "\tpeak_host_memory_mb: " << r.peak_host_memory / (1024.0 * 1024.0)
+        << "\trmse: ";
+    if (r.has_reference)
+        std::cout << r.rmse;
+    else
+        std::cout << "n/a";
+    if (r.reached_target)
+        std::cout << "\ttime_to_target_rmse: " << r.time_to_target << "\tsamples_to_target_rmse: " << r.samples_to_target;
+    std::cout << std::endl;
+}
+
+void writeResultsJSON(const std::string& filename, const std::vector<BenchResult>& results)
+{
+    std::ofstream ofs(filename.c_str());
+    if (!ofs)
+    {
+        std::cerr << "Failed to write " << filename << std::endl;
+        return;
+    }
+
+    ofs << "[";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult& r = results[i];
+        ofs << (i == 0 ? "\n" : ",\n");
+        ofs << "  {\"scene\": \"" << r.scene << "\""
+            << ", \"backend\": \"" << r.backend << "\""
+            << ", \"width\": " << r.width
+            << ", \"height\": " << r.height
+            << ", \"samples\": " << r.samples
+            << ", \"setup_time\": " << r.setup_time
+            << ", \"compile_time\": " << r.compile_time
+            << ", \"render_time\": " << r.render_time
+            << ", \"samples_per_sec\": " << r.samples_per_sec
+            << ", \"rays_per_sec\": " << r.rays_per_sec
+            << ", \"rays_counted\": " << (r.rays_counted ? "true" : "false")
+            << ", \"peak_host_memory\": " << r.peak_host_memory
+            << ", \"rmse\": ";
+        if (r.has_reference)
+            ofs << r.rmse;
+        else
+            ofs << "null";
+        ofs << ", \"time_to_target_rmse\": ";
+        if (r.reached_target)
+            ofs << r.time_to_target << ", \"samples_to_target_rmse\": " << r.samples_to_target;
+        else
+            ofs << "null, \"samples_to_target_rmse\": null";
+        ofs << "}";
+    }
+    ofs << "\n]" << std::endl;
+
+    std::cout << "[info] save_json: " << filename << std::endl;
+}
+
+// CPU benchmarks of the host/device code, run instead of the renders. Each one
+// prints its results and checks as [name] lines and returns false if a check
+// failed.
+struct CpuBench
+{
+    const char* flag;
+    const char* usage;
+    bool (*run)(int);
+
+    // Sample, ray or frame count, or frame height passed to run unless -s is given
+    int default_count;
+};
+
+const CpuBench cpu_benches[] = {
+    { "--rr_compare", "Compare the time to equal RMSE of the Russian roulette modes on a closed form scene (-s: max frames).", benchRussianRoulette, 4096 },
+    { "--bsdf", "Check and time the BSDFs over a grid of materials (-s: samples).", benchBSDF, 100000 },
+    { "--spheres", "Check and time the sphere intersector with 10 to 1M spheres (-s: rays).", benchSpheres, 200000 },
+    { "--lights", "Check the light sampling pdfs and compare the sphere light variance (-s: samples).", benchLights, 1000000 },
+    { "--radiance_cache_bias", "Report the bias and variance of the radiance cache against path tracing (-s: frames).", benchRadianceCache, 256 },
+    { "--denoise", "Time the denoiser on a noisy 16:9 frame and check its RMSE (-s: height).",
+        [](int height) { return benchDenoiser(height * 16 / 9, height); }, 1080 },
+    { "--postprocess", "Time the SIMD tonemap and 8 bit output on a 16:9 frame against std::pow (-s: height).",
+        [](int height) { return benchPostprocess(height * 16 / 9, height); }, 2160 },
+    { "--motion", "Check and time the sphere intersector on moving spheres at random ray times (-s: rays).", benchMotion, 200000 },
+    { "--filter_rmse", "Compare the RMSE of the reconstruction filters at 1 to 16 spp with the box filter (-s: reference spp).", benchFilter, 256 },
+};
+
+const size_t cpu_bench_count = sizeof(cpu_benches) / sizeof(cpu_benches[0]);
+
+const CpuBench* findCpuBench(const std::string& flag)
+{
+    for (size_t i = 0; i < cpu_bench_count; ++i)
+    {
+        if (flag == cpu_benches[i].flag)
+            return &cpu_benches[i];
+    }
+    return nullptr;
+}
+
+void printUsageAndExit(const std::string& argv0)
+{
+    std::cerr << "\nUsage: " << argv0 << " [options]\n";
+    std::cerr <<
+        "App Options:\n"
+        "  -h | --help                 Print this usage message and exit.\n"
+        "  --scene <name>              Scene to render, may be repeated (default: mandelbox and spheres).\n"
+        "                              default | mandelbox | spheres | sphere_field\n"
+        "  --sphere_count <n>          Number of spheres of the sphere_field scene (default: 10000).\n"
+        "  --sphere_scaling            Render sphere_field with 10 to 1M spheres instead of --scene.\n"
+        "  --backend <name>            optix (default, megakernel) | optix_wavefront (passes over ray queues)\n"
+        "                              optix_wavefront is not supported with --radiance_cache, --filter other\n"
+        "                              than box or a REDFLASH_PROFILE build.\n"
+        "  -s | --sample <n>           Samples per pixel (default: 64).\n"
+        "  -S | --sample_per_launch    Samples per launch (default: 4).\n"
+        "  -d | --dim=<width>x<height> Resolution (default: 480x270).\n"
+        "  --max_depth <n>             Maximum path depth.\n"
+        "  --rr <mode>                 Russian roulette: off (default) | throughput | efficiency\n"
+        "  --rr_depth <n>              Path depth at which Russian roulette starts (default: 3).\n"
+        "  --lobe_tables               Pick Disney lobes by their albedo, tabulated at scene load.\n"
+        "  --radiance_cache            Terminate paths into a radiance cache after the first bounce.\n"
+        "  --radiance_cache_cell <x>   World-space cell size of the radiance cache (default: 1).\n"
+        "  --radiance_cache_roughness <x>  Cache Disney surfaces from this roughness on (default: 0.5).\n"
+        "  --filter <name>             Reconstruction filter: box (default) | gaussian | mitchell | blackman_harris\n"
+        "                              The RMSE is against the box filtered reference.\n"
+        "  --filter_radius <x>         Radius of --filter in pixels up to 3.5.\n"
+        "  --selftest                  Check the CPU implementation of the wavefront queues and exit.\n"
+        "  --denoise_features          Compare the denoised RMSE and SSIM against the reference with first frame\n"
+        "                              and accumulated denoiser features, and report the sample saving.\n"
+        "  --target_rmse <x>           Stop once the RMSE against the reference reaches x and\n"
+        "                              report the time and samples it took.\n"
+        "  --reference_dir <dir>       Directory of the reference images (default: <samples>/data/bench).\n"
+        "  --update_reference          Store the rendered images as the new references.\n"
+        "  --reference_samples <n>     Compare against the reference rendered with n samples\n"
+        "                              (default: same as --sample).\n"
+        "  -o | --output <file>        Write the results as JSON.\n"
+        "CPU benchmarks, run one instead of the renders (default -s in brackets):\n";
+    for (size_t i = 0; i < cpu_bench_count; ++i)
+    {
+        std::cerr << "  " << std::left << std::setw(28) << cpu_benches[i].flag << cpu_benches[i].usage
+            << " [" << cpu_benches[i].default_count << "]\n";
+    }
+    std::cerr << std::endl;
+
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> scenes;
+    std::string output_file;
+    bool sphere_scaling = false;
+    bool denoise_features = false;
+    bool selftest = false;
+    bool samples_given = false;
+    const CpuBench* cpu_bench = nullptr;
+
+    BenchOptions options;
+    options.samples = 64;
+    options.reference_dir = std::string(sutil::samplesDir()) + "/data/bench";
+    options.update_reference = false;
+    options.reference_samples = 0;
+    options.target_rmse = 0.0;
+
+    use_pbo = false;
+    sample_per_launch = 4;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+
+        // Options taking an additional argument
+        if ((arg == "--scene" || arg == "--backend" || arg == "-s" || arg == "--sample" || arg == "-S" || arg == "--sample_per_launch"
+            || arg == "--max_depth" || arg == "--rr" || arg == "--rr_depth" || arg == "--target_rmse"
+            || arg == "--reference_dir" || arg == "--reference_samples" || arg == "-o" || arg == "--output"
+            || arg == "--sphere_count" || arg == "--radiance_cache_cell" || arg == "--radiance_cache_roughness"
+            || arg == "--filter" || arg == "--filter_radius") && i == argc - 1)
+        {
+            std::cerr << "Option '" << arg << "' requires additional argument.\n";
+            printUsageAndExit(argv[0]);
+        }
+
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsageAndExit(argv[0]);
+        }
+        else if (arg == "--scene")
+        {
+            scenes.push_back(argv[++i]);
+        }
+        else if (arg == "--backend")
+        {
+            const std::string name = argv[++i];
+            if (name != "optix" && name != "optix_wavefront")
+            {
+                std::cerr << "Option '" << arg << "' must be optix or optix_wavefront.\n";
+                printUsageAndExit(argv[0]);
+            }
+            use_wavefront = name == "optix_wavefront";
+        }
+        else if (arg == "-s" || arg == "--sample")
+        {
+            options.samples = atoi(argv[++i]);
+            samples_given = true;
+        }
+        else if (arg == "-S" || arg == "--sample_per_launch")
+        {
+            sample_per_launch = atoi(argv[++i]);
+        }
+        else if (arg == "--max_depth")
+        {
+            max_depth = atoi(argv[++i]);
+        }
+        else if (arg == "--rr")
+        {
+            if (!parseRussianRouletteMode(argv[++i], rr_mode))
+            {
+                std::cerr << "Option '" << arg << "' must be off, throughput or efficiency.\n";
+                printUsageAndExit(argv[0]);
+            }
+        }
+        else if (arg == "--rr_depth")
+        {
+            rr_begin_depth = atoi(argv[++i]);
+        }
+        else if (arg == "--target_rmse")
+        {
+            options.target_rmse = atof(argv[++i]);
+        }
+        else if (arg == "--reference_dir")
+        {
+            options.reference_dir = argv[++i];
+        }
+        else if (arg == "--reference_samples")
+        {
+            options.reference_samples = atoi(argv[++i]);
+        }
+        else if (arg == "--update_reference")
+        {
+            options.update_reference = true;
+        }
+        else if (arg == "--lobe_tables")
+        {
+            use_lobe_tables = true;
+        }
+        else if (arg == "--radiance_cache")
+        {
+            use_radiance_cache = true;
+        }
+        else if (arg == "--radiance_cache_cell")
+        {
+            radiance_cache_cell_size = static_cast<float>(atof(argv[++i]));
+        }
+        else if (arg == "--radiance_cache_roughness")
+        {
+            radiance_cache_roughness = static_cast<float>(atof(argv[++i]));
+        }
+        else if (arg == "--filter")
+        {
+            if (!parseFilterType(argv[++i], filter_type))
+            {
+                std::cerr << "Option '" << arg << "' must be box, gaussian, mitchell or blackman_harris.\n";
+                printUsageAndExit(argv[0]);
+            }
+        }
+        else if (arg == "--filter_radius")
+        {
+            filter_radius = static_cast<float>(atof(argv[++i]));
+            if (filter_radius <= 0.0f || filterExtent(filter_radius) > FILTER_MAX_EXTENT)
+            {
+                std::cerr << "Option '" << arg << "' must be in (0, 3.5].\n";
+                printUsageAndExit(argv[0]);
+            }
+        }
+        else if (arg == "--selftest")
+        {
+            selftest = true;
+        }
+        else if (const CpuBench* bench = findCpuBench(arg))
+        {
+            if (cpu_bench && cpu_bench != bench)
+            {
+                std::cerr << "Option '" << arg << "' cannot be combined with '" << cpu_bench->flag << "'.\n";
+                printUsageAndExit(argv[0]);
+            }
+            cpu_bench = bench;
+        }
+        else if (arg == "--sphere_count")
+        {
+            sphere_field_count = atoi(argv[++i]);
+        }
+        else if (arg == "--sphere_scaling")
+        {
+            sphere_scaling = true;
+        }
+        else if (arg == "--denoise_features")
+        {
+            denoise_features = true;
+        }
+        else if (arg == "-o" || arg == "--output")
+        {
+            output_file = argv[++i];
+        }
+        else if (arg.find("-d") == 0 || arg.find("--dim") == 0)
+        {
+            size_t index = arg.find_first_of('=');
+            if (index == std::string::npos)
+            {
+                std::cerr << "Option '" << arg << " is malformed. Please use the syntax -d | --dim=<width>x<height>.\n";
+                printUsageAndExit(argv[0]);
+            }
+            std::string dim = arg.substr(index + 1);
+            try
+            {
+                sutil::parseDimensions(dim.c_str(), width, height);
+            }
+            catch (Exception e)
+            {
+                std::cerr << "Option '" << arg << " is malformed. Please use the syntax -d | --dim=<width>x<height>.\n";
+                printUsageAndExit(argv[0]);
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown option '" << arg << "'\n";
+            printUsageAndExit(argv[0]);
+        }
+    }
+
+    if (scenes.empty())
+    {
+        scenes.push_back("mandelbox");
+        scenes.push_back("spheres");
+    }
+
+    if (options.samples < 1 || sample_per_launch < 1)
+    {
+        std::cerr << "Sample counts must be positive.\n";
+        printUsageAndExit(argv[0]);
+    }
+
+    if (selftest && cpu_bench)
+    {
+        std::cerr << "Option '--selftest' cannot be combined with '" << cpu_bench->flag << "'.\n";
+        printUsageAndExit(argv[0]);
+    }
+
+    if (selftest)
+        return selftestWavefrontQueue() ? 0 : 1;
+
+    if (cpu_bench)
+        return cpu_bench->run(samples_given ? options.samples : cpu_bench->default_count) ? 0 : 1;
+
+    if (options.update_reference && filter_type != FILTER_BOX)
+    {
+        std::cerr << "References are rendered with the box filter.\n";
+        printUsageAndExit(argv[0]);
+    }
+
+    if (use_wavefront && wavefrontUnsupportedOption())
+    {
+        std::cerr << wavefrontUnsupportedOption() << " cannot be combined with '--backend optix_wavefront'.\n";
+        printUsageAndExit(argv[0]);
+    }
+
+    std::vector<BenchResult> results;
+    try
+    {
+        if (denoise_features)
+        {
+            bool ok = true;
+            for (auto scene = scenes.begin(); scene != scenes.end(); ++scene)
+            {
+                const int initial_sample_per_launch = sample_per_launch;
+                ok &= benchDenoiseFeatures(*scene, options);
+                sample_per_launch = initial_sample_per_launch;
+            }
+            return ok ? 0 : 1;
+        }
+
+        if (sphere_scaling)
+        {
+            // The acceleration build is part of compile_time
+            for (sphere_field_count = 10; sphere_field_count <= 1000000; sphere_field_count *= 10)
+            {
+                const int initial_sample_per_launch = sample_per_launch;
+                results.push_back(benchOptiX("sphere_field", options));
+                sample_per_launch = initial_sample_per_launch;
+                results.back().scene = "sphere_field_" + std::to_string(sphere_field_count);
+                printResult(results.back());
+            }
+        }
+        else
+        {
+            for (auto scene = scenes.begin(); scene != scenes.end(); ++scene)
+            {
+                const int initial_sample_per_launch = sample_per_launch;
+                results.push_back(benchOptiX(*scene, options));
+                sample_per_launch = initial_sample_per_launch;
+                printResult(results.back());
+            }
+        }
+    }
+    SUTIL_CATCH(context->get())
+
+    if (!output_file.empty())
+        writeResultsJSON(output_file, results);
+
+    return 0;
+}
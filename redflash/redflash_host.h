@@ -0,0 +1,65 @@
+#pragma once
+
+#include <optixu/optixpp_namespace.h>
+
+#include "redflash.h"
+
+#include <string>
+
+//-----------------------------------------------------------------------------
+//
+// Host-side renderer state and entry points defined in redflash.cpp, shared
+// with the headless redflash_bench driver.
+//
+//-----------------------------------------------------------------------------
+
+extern optix::Context context;
+extern int width;
+extern int height;
+extern bool use_pbo;
+
+extern int max_depth;
+extern int rr_begin_depth;
+extern int rr_mode;
+extern int sample_per_launch;
+extern bool use_wavefront;
+extern bool use_lobe_tables;
+extern bool use_radiance_cache;
+extern float radiance_cache_cell_size;
+extern float radiance_cache_roughness;
+extern bool accumulate_denoise_features;
+
+// See filter.h, a radius of 0 is the default of the filter
+extern int filter_type;
+extern float filter_radius;
+extern int frame_number;
+extern int total_sample;
+extern bool camera_changed;
+
+// Extension and shadow rays traced in wavefront mode
+extern unsigned long long wavefront_ray_count;
+
+// "default" (meshes + raymarching), "mandelbox", "spheres" or "sphere_field"
+extern std::string scene_name;
+extern int sphere_field_count;
+
+bool parseRussianRouletteMode(const std::string& name, int& mode);
+bool parseFilterType(const std::string& name, int& type);
+
+// Option the wavefront passes do not support, nullptr if the options can be rendered with them
+const char* wavefrontUnsupportedOption();
+
+void createContext();
+void destroyContext();
+void setupScene();
+void setupCamera();
+void updateCamera();
+void launchPathtrace();
+
+optix::Buffer getOutputBuffer();
+optix::Buffer getLinerBuffer();
+optix::Buffer getAlbedoBuffer();
+optix::Buffer getNormalBuffer();
+#if REDFLASH_PROFILE
+optix::Buffer getProfileBuffer();
+#endif
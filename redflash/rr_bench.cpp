@@ -0,0 +1,240 @@
+#include "rr_bench.h"
+#include "bench_common.h"
+#include "russian_roulette.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+using namespace optix;
+
+namespace
+{
+    // Same as the default of redflash
+    const int max_depth = 10;
+
+    //-------------------------------------------------------------------------
+    // Inside of a unit sphere with diffuse albedo a(x) and emission 1 on the
+    // cap z > 0.7. Every pair of points sees each other with the same
+    // cos * cos / d^2 = 1/4, so the light sample of a uniform point on the cap
+    // (area 0.6 pi) returns a(x) * 0.15 without noise, and
+    //   L(x) = E(x) + a(x) M,  M = mean(E) / (1 - mean(a)) = 0.15 / 0.5
+    //-------------------------------------------------------------------------
+
+    float emission(const float3& x)
+    {
+        return x.z > 0.7f ? 1.0f : 0.0f;
+    }
+
+    float albedo(const float3& x)
+    {
+        return 0.05f + 0.9f * (x.x * 0.5f + 0.5f);
+    }
+
+    float exactRadiance(const float3& x)
+    {
+        return emission(x) + albedo(x) * (0.15f / 0.5f);
+    }
+
+    // Fibonacci lattice, the pixels of the bench
+    std::vector<float3> spherePoints(int count)
+    {
+        std::vector<float3> points(count);
+        const float golden_angle = M_PIf * (3.0f - sqrtf(5.0f));
+        for (int i = 0; i < count; ++i)
+        {
+            const float z = 1.0f - (2.0f * i + 1.0f) / count;
+            const float r = sqrtf(fmaxf(0.0f, 1.0f - z * z));
+            points[i] = make_float3(r * cosf(golden_angle * i), r * sinf(golden_angle * i), z);
+        }
+        return points;
+    }
+
+    struct Pixels
+    {
+        std::vector<float3> points;
+        std::vector<double> exact;
+        double mean_exact;
+
+        // Darkest tenth of the points
+        std::vector<size_t> dark;
+    };
+
+    // RMSE relative to the mean radiance (as imageRMSE over the mean), or the RMSE of the
+    // errors relative to the radiance of each pixel over all or the dark pixels
+    double rmse(const Pixels& pixels, const std::vector<double>& sum, int frames, bool per_pixel, bool dark_only)
+    {
+        const size_t count = dark_only ? pixels.dark.size() : pixels.points.size();
+        double error2 = 0.0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t k = dark_only ? pixels.dark[i] : i;
+            const double error = sum[k] / frames - pixels.exact[k];
+            error2 += per_pixel ? error * error / (pixels.exact[k] * pixels.exact[k]) : error * error;
+        }
+        return sqrt(error2 / count) / (per_pixel ? 1.0 : pixels.mean_exact);
+    }
+
+    struct ModeResult
+    {
+        double seconds;
+        int frames;
+        double vertices;
+        double rmse;
+        double dark_rmse;
+        bool reached_target;
+    };
+
+    // One path per point and frame, like pathtrace_camera with one sample per launch: the
+    // mean of the previous frames is the pixel mean of the roulette. Stops once the error
+    // reaches target_rmse.
+    ModeResult renderToTarget(int mode, int rr_begin_depth, const Pixels& pixels, bool per_pixel, double target_rmse, int max_frames)
+    {
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+        std::vector<double> sum(pixels.points.size(), 0.0);
+        long long vertices = 0;
+
+        ModeResult result = ModeResult();
+        for (int frame = 0; frame < max_frames; ++frame)
+        {
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            for (size_t k = 0; k < pixels.points.size(); ++k)
+            {
+                const float pixel_mean = frame > 0 ? static_cast<float>(sum[k] / frame) : 0.0f;
+                float3 x = pixels.points[k];
+                float radiance = 0.0f;
+                float attenuation = 1.0f;
+
+                for (int depth = 0;; ++depth)
+                {
+                    const float3 n = -x;
+                    ++vertices;
+
+                    // Emission is seen by the camera only, later bounces take the light sample
+                    const float vertex_radiance = (depth == 0 ? emission(x) : 0.0f) + albedo(x) * 0.15f;
+                    radiance += attenuation * vertex_radiance;
+                    if (depth + 1 >= max_depth)
+                        break;
+
+                    // Cosine sampling of the Lambertian BSDF, the chord to the next hit is 2 cos(theta)
+                    const float bsdf_weight = albedo(x);
+                    attenuation *= bsdf_weight;
+                    float3 d;
+                    cosine_sample_hemisphere(uniform(rng), uniform(rng), d);
+                    optix::Onb onb(n);
+                    onb.inverse_transform(d);
+                    x = normalize(x + d * (2.0f * dot(d, n)));
+
+                    if (mode != RR_OFF && depth >= rr_begin_depth)
+                    {
+                        const float pcont = russianRouletteProbability(mode, attenuation, vertex_radiance, bsdf_weight, pixel_mean);
+                        if (uniform(rng) >= pcont)
+                            break;
+                        attenuation /= pcont;
+                    }
+                }
+
+                sum[k] += radiance;
+            }
+            result.seconds += secondsSince(begin);
+
+            // The error is not part of the time
+            result.frames = frame + 1;
+            result.rmse = rmse(pixels, sum, result.frames, per_pixel, false);
+            if (result.rmse <= target_rmse)
+            {
+                result.reached_target = true;
+                break;
+            }
+        }
+
+        result.dark_rmse = rmse(pixels, sum, result.frames, true, true);
+        result.vertices = static_cast<double>(vertices) / pixels.points.size();
+        return result;
+    }
+}
+
+bool benchRussianRoulette(int max_frames)
+{
+    Pixels pixels;
+    pixels.points = spherePoints(4096);
+    pixels.exact.resize(pixels.points.size());
+    pixels.mean_exact = 0.0;
+    for (size_t k = 0; k < pixels.points.size(); ++k)
+    {
+        pixels.exact[k] = exactRadiance(pixels.points[k]);
+        pixels.mean_exact += pixels.exact[k] / pixels.points.size();
+    }
+
+    pixels.dark.resize(pixels.points.size());
+    for (size_t k = 0; k < pixels.points.size(); ++k)
+        pixels.dark[k] = k;
+    std::sort(pixels.dark.begin(), pixels.dark.end(), [&pixels](size_t a, size_t b) { return pixels.exact[a] < pixels.exact[b]; });
+    pixels.dark.resize(pixels.points.size() / 10);
+
+    struct Mode
+    {
+        const char* name;
+        int mode;
+        int rr_begin_depth;
+    };
+    const Mode modes[] = {
+        { "off", RR_OFF, 0 },
+        { "throughput", RR_THROUGHPUT, 1 },
+        { "efficiency", RR_EFFICIENCY, 1 },
+        { "throughput", RR_THROUGHPUT, RR_DEFAULT_BEGIN_DEPTH },
+        { "efficiency", RR_EFFICIENCY, RR_DEFAULT_BEGIN_DEPTH },
+    };
+
+    // The RMSE over the mean as redflash_bench --target_rmse, and the RMSE of the
+    // per-pixel relative error that the weight window of RR_EFFICIENCY aims at
+    const char* const metrics[] = { "rmse", "per_pixel_rmse" };
+    const double targets[] = { 0.01, 0.02 };
+
+    // The cost is counted in path vertices, the time of this scene is mostly
+    // random numbers and too noisy to compare. At the default depth the
+    // roulette must reach the RMSE target with fewer vertices than the fixed
+    // depth, and the efficiency mode also the per-pixel target.
+    bool ok = true;
+    for (int metric = 0; metric < 2; ++metric)
+    {
+        ModeResult off = ModeResult();
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m)
+        {
+            const ModeResult r = renderToTarget(modes[m].mode, modes[m].rr_begin_depth, pixels, metric == 1, targets[metric], max_frames);
+            if (modes[m].mode == RR_OFF)
+                off = r;
+
+            bool mode_ok = r.reached_target;
+            const bool guarded = modes[m].rr_begin_depth == RR_DEFAULT_BEGIN_DEPTH && (metric == 0 || modes[m].mode == RR_EFFICIENCY);
+            if (modes[m].mode != RR_OFF && guarded)
+                mode_ok &= r.vertices < off.vertices;
+            ok &= mode_ok;
+
+            std::ostringstream line;
+            line << "[rr] mode: " << modes[m].name;
+            if (modes[m].mode != RR_OFF)
+                line << "\trr_depth: " << modes[m].rr_begin_depth;
+            else
+                line << "\tmax_depth: " << max_depth;
+            line << "\tmetric: " << metrics[metric]
+                << "\ttarget: " << targets[metric]
+                << "\tsamples_to_target: " << r.frames
+                << "\tvertices_to_target: " << r.vertices
+                << "\tvertices_vs_off: " << r.vertices / off.vertices
+                << "\tms_to_target: " << r.seconds * 1.0e3
+                << "\tdark_per_pixel_rmse: " << r.dark_rmse
+                << (mode_ok ? "" : "\tFAILED");
+            std::cout << line.str() << std::endl;
+        }
+    }
+
+    std::cout << "[rr] checks: " << (ok ? "ok" : "failed") << std::endl;
+    return ok;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+//
+// Cost to equal RMSE of the Russian roulette modes (russian_roulette.h) on the
+// CPU, on the inside of a diffuse sphere with an emitting cap whose radiance
+// is known in closed form. The albedo spans 0.05 to 0.95, so the points range
+// from dark to bright pixels. Each mode renders progressive frames of one path
+// per point until the RMSE over the mean radiance (as redflash_bench
+// --target_rmse on the GPU) or the RMSE of the per-pixel relative error
+// reaches a target, and reports the samples, path vertices per point and time
+// it took. Run by redflash_bench --rr_compare, returns false if a mode does
+// not converge within max_frames, or if the roulette at the default start
+// depth (RR_DEFAULT_BEGIN_DEPTH) needs more path vertices than the fixed
+// depth.
+//
+//-----------------------------------------------------------------------------
+
+bool benchRussianRoulette(int max_frames);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include "redflash.h"
+
+//-----------------------------------------------------------------------------
+//
+// Russian roulette
+//
+// RR_THROUGHPUT continues a path with the luminance of its throughput.
+//
+// RR_EFFICIENCY is a weight window around the pixel estimate: the expected
+// contribution of the rest of the path, its throughput times the radiance
+// arriving along the sampled direction, is compared with the running mean of
+// the pixel. The incident radiance is estimated from what the last vertex
+// returned (emission and the light sample) as if the surroundings reflected
+// like the vertex, v / (1 - w) for the BSDF weight w of the sample, and is
+// averaged with the pixel mean so that a vertex in shadow is not cut to the
+// floor. Without a pixel mean (first frame) it falls back to the throughput.
+//
+// Only the ratio to the pixel mean matters, so dark and bright pixels are
+// treated alike. Shared by redflash.cu and redflash_bench --rr_compare, which
+// compares the modes on the CPU.
+//
+//-----------------------------------------------------------------------------
+
+// Probability that a path continues, from luminances:
+//   throughput       path throughput after the vertex
+//   vertex_radiance  radiance the vertex returned per unit of the throughput before it
+//   bsdf_weight      f cos / pdf of the sampled direction, throughput after / before
+//   pixel_mean       running mean of the pixel, 0 if there is none yet
+static __host__ __device__ __inline__ float russianRouletteProbability(int mode, float throughput, float vertex_radiance, float bsdf_weight,
+    float pixel_mean)
+{
+    float p = throughput;
+    if (mode == RR_EFFICIENCY && pixel_mean > 0.0f)
+    {
+        const float incident = vertex_radiance / (1.0f - fminf(bsdf_weight, 0.9f));
+        p *= 0.5f * (1.0f + incident / pixel_mean);
+    }
+    return clamp(p, 0.05f, 1.0f);
+}
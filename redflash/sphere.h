@@ -0,0 +1,70 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+
+using namespace optix;
+
+//-----------------------------------------------------------------------------
+//
+// Batched spheres
+//
+// All spheres of a GeometryInstance live in one buffer of SphereRecords and the
+// intersection and bounds programs in intersect_sphere.cu are indexed by
+// primIdx, so a scene with many spheres is a single Geometry under a single
+// acceleration instead of one GeometryInstance per sphere.
+//
+// The material of the hit sphere is passed to the closest hit programs as
+// attributes (see hitMaterialId in redflash.cu), and its BSDF type selects the
+// Material of the GeometryInstance through rtReportIntersection.
+//
+//-----------------------------------------------------------------------------
+
+struct SphereRecord
+{
+    float3 center;
+    float radius;
+
+    // Index into sysMaterialParameters, and into sysLightParameters for lights (-1 otherwise)
+    int material_id;
+    int light_id;
+
+    // Material of the GeometryInstance reported on a hit
+    int material_index;
+};
+
+// Distances of the two intersections of a ray with a normalized direction,
+// false if the ray misses the sphere. root1 <= root2.
+static __host__ __device__ __inline__ bool sphereRoots(const SphereRecord& sphere, const float3& origin, const float3& direction, float& root1, float& root2)
+{
+    const float3 O = origin - sphere.center;
+    const float b = dot(O, direction);
+    const float c = dot(O, O) - sphere.radius * sphere.radius;
+    const float disc = b * b - c;
+    if (disc <= 0.0f)
+        return false;
+
+    const float sdisc = sqrtf(disc);
+    root1 = -b - sdisc;
+    root2 = -b + sdisc;
+    return true;
+}
+
+// Nearest intersection in (tmin, tmax), the same as the non robust intersection program
+static __host__ __device__ __inline__ bool intersectSphere(const SphereRecord& sphere, const float3& origin, const float3& direction, float tmin, float tmax, float& t)
+{
+    float root1, root2;
+    if (!sphereRoots(sphere, origin, direction, root1, root2))
+        return false;
+
+    if (root1 > tmin && root1 < tmax)
+    {
+        t = root1;
+        return true;
+    }
+    if (root2 > tmin && root2 < tmax)
+    {
+        t = root2;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,83 @@
+#include "sphere_bench.h"
+#include "bench_common.h"
+#include "sphere_bvh.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using namespace optix;
+
+namespace
+{
+    // Largest sphere count checked against the brute force intersection
+    const int brute_force_limit = 10000;
+}
+
+bool benchSpheres(int ray_count)
+{
+    const std::vector<TestRay> rays = testRays(ray_count);
+    const float tmin = 1.0e-3f;
+    const float tmax = 1.0e16f;
+
+    bool ok = true;
+    for (int count = 10; count <= 1000000; count *= 10)
+    {
+        const std::vector<SphereRecord> spheres = sphereField(count);
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        SphereBVH bvh;
+        bvh.build(spheres);
+        const double build_time = secondsSince(begin);
+
+        int hits = 0;
+        begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < ray_count; ++i)
+        {
+            SphereHit hit;
+            hits += bvh.intersect(rays[i].origin, rays[i].direction, tmin, tmax, hit) ? 1 : 0;
+        }
+        const double closest_time = secondsSince(begin);
+
+        int occluded = 0;
+        begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < ray_count; ++i)
+            occluded += bvh.occluded(rays[i].origin, rays[i].direction, tmin, tmax) ? 1 : 0;
+        const double any_time = secondsSince(begin);
+
+        // The nearest distance must match a loop over all spheres
+        bool count_ok = occluded == hits;
+        if (count <= brute_force_limit)
+        {
+            const int check_count = std::min(ray_count, 10000);
+            for (int i = 0; i < check_count; ++i)
+            {
+                SphereHit hit;
+                float t;
+                const bool expected = bruteForce(spheres, rays[i], tmin, tmax, t);
+                const bool found = bvh.intersect(rays[i].origin, rays[i].direction, tmin, tmax, hit);
+                if (expected != found || (found && hit.t != t))
+                {
+                    count_ok = false;
+                    break;
+                }
+            }
+        }
+        ok &= count_ok;
+
+        std::ostringstream line;
+        line << "[spheres] count: " << count
+            << "\tnodes: " << bvh.nodeCount()
+            << "\tbuild_ms: " << build_time * 1.0e3
+            << "\thit_rate: " << static_cast<double>(hits) / ray_count
+            << "\tclosest_hit_mrays_per_sec: " << ray_count / closest_time * 1.0e-6
+            << "\tany_hit_mrays_per_sec: " << ray_count / any_time * 1.0e-6
+            << (count_ok ? "" : "\tFAILED");
+        std::cout << line.str() << std::endl;
+    }
+
+    std::cout << "[spheres] checks: " << (ok ? "ok" : "failed") << std::endl;
+    return ok;
+}
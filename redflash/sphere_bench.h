@@ -0,0 +1,12 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+//
+// Scaling of the CPU sphere intersector (sphere_bvh.h) from 10 to 1M spheres:
+// build time and closest/any hit throughput on one thread, checked against a
+// brute force loop over the SphereRecords for the smaller counts. Run by
+// redflash_bench --spheres, returns false if a check failed.
+//
+//-----------------------------------------------------------------------------
+
+bool benchSpheres(int ray_count);
@@ -0,0 +1,221 @@
+#include "sphere_bvh.h"
+
+#include <algorithm>
+
+using namespace optix;
+
+namespace
+{
+    float component(const float3& v, unsigned int axis)
+    {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+
+    // True if the ray overlaps the box within (tmin, tmax)
+    bool intersectBox(const float3& bmin, const float3& bmax, const float3& origin, const float3& inv_direction, float tmin, float tmax)
+    {
+        const float tx0 = (bmin.x - origin.x) * inv_direction.x;
+        const float tx1 = (bmax.x - origin.x) * inv_direction.x;
+        const float ty0 = (bmin.y - origin.y) * inv_direction.y;
+        const float ty1 = (bmax.y - origin.y) * inv_direction.y;
+        const float tz0 = (bmin.z - origin.z) * inv_direction.z;
+        const float tz1 = (bmax.z - origin.z) * inv_direction.z;
+
+        const float t0 = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), tmin));
+        const float t1 = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), tmax));
+        return t0 <= t1;
+    }
+}
+
+void SphereBVH::build(const std::vector<SphereRecord>& spheres, unsigned int leaf_size)
+{
+    buildMotion(spheres, std::vector<float3>(), 1, false, leaf_size);
+}
+
+void SphereBVH::buildMotion(const std::vector<SphereRecord>& spheres, const std::vector<float3>& motion_centers,
+    unsigned int motion_steps, bool interpolate_bounds, unsigned int leaf_size)
+{
+    m_motion_steps = motion_steps > 1 ? motion_steps : 1;
+    m_motion_centers.clear();
+    if (m_motion_steps > 1)
+        m_motion_centers = motion_centers;
+    m_interpolate_bounds = m_motion_steps > 1 && interpolate_bounds;
+    m_key_bounds.clear();
+
+    m_spheres = spheres;
+    m_indices.resize(spheres.size());
+    for (size_t i = 0; i < spheres.size(); ++i)
+        m_indices[i] = static_cast<unsigned int>(i);
+
+    m_nodes.clear();
+    m_nodes.reserve(2 * spheres.size() / std::max(leaf_size, 1u) + 1);
+    if (!spheres.empty())
+        buildNode(0, static_cast<unsigned int>(spheres.size()), std::max(leaf_size, 1u));
+}
+
+float3 SphereBVH::keyCenter(unsigned int i, unsigned int k) const
+{
+    return m_motion_steps > 1 ? m_motion_centers[i * m_motion_steps + k] : m_spheres[i].center;
+}
+
+float3 SphereBVH::splitCenter(unsigned int i) const
+{
+    return m_motion_steps > 1 ? motionLerp(&m_motion_centers[i * m_motion_steps], m_motion_steps, 0.5f) : m_spheres[i].center;
+}
+
+unsigned int SphereBVH::buildNode(unsigned int begin, unsigned int end, unsigned int leaf_size)
+{
+    const unsigned int index = static_cast<unsigned int>(m_nodes.size());
+    m_nodes.push_back(Node());
+
+    const size_t key_bounds_begin = m_key_bounds.size();
+    if (m_interpolate_bounds)
+        m_key_bounds.resize(key_bounds_begin + 2 * m_motion_steps);
+
+    float3 bmin = make_float3(1e30f);
+    float3 bmax = make_float3(-1e30f);
+    for (unsigned int k = 0; k < m_motion_steps; ++k)
+    {
+        float3 key_min = make_float3(1e30f);
+        float3 key_max = make_float3(-1e30f);
+        for (unsigned int i = begin; i < end; ++i)
+        {
+            const float3 center = keyCenter(m_indices[i], k);
+            const float radius = m_spheres[m_indices[i]].radius;
+            key_min = fminf(key_min, center - radius);
+            key_max = fmaxf(key_max, center + radius);
+        }
+        if (m_interpolate_bounds)
+        {
+            m_key_bounds[key_bounds_begin + 2 * k] = key_min;
+            m_key_bounds[key_bounds_begin + 2 * k + 1] = key_max;
+        }
+        bmin = fminf(bmin, key_min);
+        bmax = fmaxf(bmax, key_max);
+    }
+    m_nodes[index].bmin = bmin;
+    m_nodes[index].bmax = bmax;
+
+    // Split on the centers in the middle of the motion
+    float3 cmin = make_float3(1e30f);
+    float3 cmax = make_float3(-1e30f);
+    for (unsigned int i = begin; i < end; ++i)
+    {
+        const float3 center = splitCenter(m_indices[i]);
+        cmin = fminf(cmin, center);
+        cmax = fmaxf(cmax, center);
+    }
+
+    if (end - begin <= leaf_size)
+    {
+        m_nodes[index].first = begin;
+        m_nodes[index].count = end - begin;
+        m_nodes[index].axis = 0;
+        return index;
+    }
+
+    const float3 extent = cmax - cmin;
+    const unsigned int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+    const unsigned int middle = begin + (end - begin) / 2;
+    std::nth_element(m_indices.begin() + begin, m_indices.begin() + middle, m_indices.begin() + end,
+        [&](unsigned int a, unsigned int b) { return component(splitCenter(a), axis) < component(splitCenter(b), axis); });
+
+    buildNode(begin, middle, leaf_size);
+    const unsigned int right = buildNode(middle, end, leaf_size);
+    m_nodes[index].first = right;
+    m_nodes[index].count = 0;
+    m_nodes[index].axis = axis;
+    return index;
+}
+
+template<bool AnyHit>
+bool SphereBVH::traverse(const float3& origin, const float3& direction, float tmin, float tmax, SphereHit& hit, float time) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    // Key and fraction of the interpolated node bounds
+    int key = 0;
+    const float frac = m_interpolate_bounds ? motionKey(time, m_motion_steps, key) : 0.0f;
+
+    const float3 inv_direction = make_float3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    const bool negative[3] = { direction.x < 0.0f, direction.y < 0.0f, direction.z < 0.0f };
+
+    bool found = false;
+    unsigned int stack[64];
+    int stack_size = 0;
+    unsigned int node = 0;
+    while (true)
+    {
+        const Node& n = m_nodes[node];
+        bool overlap;
+        if (m_interpolate_bounds)
+        {
+            const float3* bounds = &m_key_bounds[(node * m_motion_steps + key) * 2];
+            overlap = intersectBox(lerp(bounds[0], bounds[2], frac), lerp(bounds[1], bounds[3], frac), origin, inv_direction, tmin, tmax);
+        }
+        else
+        {
+            overlap = intersectBox(n.bmin, n.bmax, origin, inv_direction, tmin, tmax);
+        }
+
+        if (overlap)
+        {
+            if (n.count > 0)
+            {
+                for (unsigned int i = n.first; i < n.first + n.count; ++i)
+                {
+                    float t;
+                    if (intersectSphere(sphereAt(m_indices[i], time), origin, direction, tmin, tmax, t))
+                    {
+                        found = true;
+                        if (AnyHit)
+                            return true;
+                        tmax = t;
+                        hit.primIdx = m_indices[i];
+                    }
+                }
+            }
+            else
+            {
+                // Visit the child on the side the ray comes from first
+                const unsigned int left = node + 1;
+                const unsigned int right = n.first;
+                if (negative[n.axis])
+                {
+                    stack[stack_size++] = left;
+                    node = right;
+                }
+                else
+                {
+                    stack[stack_size++] = right;
+                    node = left;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+            break;
+        node = stack[--stack_size];
+    }
+
+    if (found)
+    {
+        const SphereRecord s = sphereAt(hit.primIdx, time);
+        hit.t = tmax;
+        hit.normal = (origin + tmax * direction - s.center) / s.radius;
+    }
+    return found;
+}
+
+bool SphereBVH::intersect(const float3& origin, const float3& direction, float tmin, float tmax, SphereHit& hit, float time) const
+{
+    return traverse<false>(origin, direction, tmin, tmax, hit, time);
+}
+
+bool SphereBVH::occluded(const float3& origin, const float3& direction, float tmin, float tmax, float time) const
+{
+    SphereHit hit;
+    return traverse<true>(origin, direction, tmin, tmax, hit, time);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "motion.h"
+#include "sphere.h"
+
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// CPU intersector for sphere batches. Uses the same SphereRecords and the same
+// intersection as intersect_sphere.cu, so it is the reference for the batched
+// OptiX geometry and the CPU side of redflash_bench --spheres. Moving spheres
+// take their centers from motion keys like intersect_sphere.cu, see motion.h.
+//
+//-----------------------------------------------------------------------------
+
+struct SphereHit
+{
+    float t;
+    float3 normal;
+    unsigned int primIdx;
+};
+
+class SphereBVH
+{
+public:
+    // Median split on the longest axis of the centers, up to leaf_size spheres per leaf
+    void build(const std::vector<SphereRecord>& spheres, unsigned int leaf_size = 4);
+
+    // Spheres with motion_steps centers each in motion_centers, splitting on the
+    // centers at the middle of the motion. Nodes bound the whole sweep of their
+    // spheres, or with interpolate_bounds the node bounds of each key are
+    // interpolated to the ray time like the motion BVH of OptiX.
+    void buildMotion(const std::vector<SphereRecord>& spheres, const std::vector<float3>& motion_centers,
+        unsigned int motion_steps, bool interpolate_bounds, unsigned int leaf_size = 4);
+
+    // Nearest hit in (tmin, tmax) at time, direction must be normalized
+    bool intersect(const float3& origin, const float3& direction, float tmin, float tmax, SphereHit& hit, float time = 0.0f) const;
+
+    // Any hit in (tmin, tmax) at time
+    bool occluded(const float3& origin, const float3& direction, float tmin, float tmax, float time = 0.0f) const;
+
+    size_t nodeCount() const { return m_nodes.size(); }
+
+private:
+    struct Node
+    {
+        float3 bmin;
+        float3 bmax;
+
+        // Leaves: first index and count of m_indices. Interior nodes: count is 0,
+        // the left child follows the node and first is the right child.
+        unsigned int first;
+        unsigned int count;
+        unsigned int axis;
+    };
+
+    unsigned int buildNode(unsigned int begin, unsigned int end, unsigned int leaf_size);
+
+    // Center of sphere i at motion key k and in the middle of the motion
+    float3 keyCenter(unsigned int i, unsigned int k) const;
+    float3 splitCenter(unsigned int i) const;
+
+    // Sphere i moved to its center at time
+    SphereRecord sphereAt(unsigned int i, float time) const
+    {
+        SphereRecord s = m_spheres[i];
+        if (m_motion_steps > 1)
+            s.center = motionLerp(&m_motion_centers[i * m_motion_steps], m_motion_steps, time);
+        return s;
+    }
+
+    template<bool AnyHit>
+    bool traverse(const float3& origin, const float3& direction, float tmin, float tmax, SphereHit& hit, float time) const;
+
+    std::vector<SphereRecord> m_spheres;
+    std::vector<unsigned int> m_indices;
+    std::vector<Node> m_nodes;
+
+    // motion_steps centers per sphere, empty for static spheres
+    std::vector<float3> m_motion_centers;
+    unsigned int m_motion_steps = 1;
+
+    // bmin and bmax of every key of every node with interpolated bounds
+    bool m_interpolate_bounds = false;
+    std::vector<float3> m_key_bounds;
+};
@@ -0,0 +1,86 @@
+#include "splat_accumulator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace optix;
+
+namespace
+{
+    // Adds weighted radiance to the pixels around (x, y) that are on the image
+    struct SplatToPixels
+    {
+        float4* pixels;
+        int width;
+        int height;
+        int x;
+        int y;
+        float3 radiance;
+
+        void operator()(int dx, int dy, float weight)
+        {
+            const int px = x + dx;
+            const int py = y + dy;
+            if (px < 0 || py < 0 || px >= width || py >= height)
+                return;
+            float4& p = pixels[static_cast<size_t>(py) * width + px];
+            p.x += weight * radiance.x;
+            p.y += weight * radiance.y;
+            p.z += weight * radiance.z;
+            p.w += weight;
+        }
+    };
+}
+
+SplatAccumulator::SplatAccumulator(int width, int height, FilterType type, float radius)
+    : m_width(width)
+    , m_height(height)
+    , m_type(type)
+    , m_radius(radius)
+    , m_extent(filterExtent(radius))
+    , m_pixels(static_cast<size_t>(width) * height)
+{
+    if (m_extent > FILTER_MAX_EXTENT)
+        throw std::invalid_argument("filter radius reaches too many pixels");
+    clear();
+}
+
+void SplatAccumulator::clear()
+{
+    std::fill(m_pixels.begin(), m_pixels.end(), make_float4(0.0f));
+}
+
+template<int Extent>
+void SplatAccumulator::splat(int x, int y, const float2& jitter, const float3& radiance)
+{
+    SplatToPixels splat = { m_pixels.data(), m_width, m_height, x, y, radiance };
+    splatFilterTaps<Extent>(m_type, m_radius, m_extent, jitter, splat);
+}
+
+void SplatAccumulator::addSample(int x, int y, const float2& jitter, const float3& radiance)
+{
+    switch (m_extent)
+    {
+    case 0: splat<0>(x, y, jitter, radiance); break;
+    case 1: splat<1>(x, y, jitter, radiance); break;
+    case 2: splat<2>(x, y, jitter, radiance); break;
+    default: splat<3>(x, y, jitter, radiance); break;
+    }
+}
+
+void SplatAccumulator::addSampleGeneric(int x, int y, const float2& jitter, const float3& radiance)
+{
+    splat<FILTER_RUNTIME_EXTENT>(x, y, jitter, radiance);
+}
+
+void SplatAccumulator::resolve(std::vector<float>& rgb) const
+{
+    rgb.resize(m_pixels.size() * 3);
+    for (size_t i = 0; i < m_pixels.size(); ++i)
+    {
+        const float3 c = resolveFilteredPixel(m_pixels[i]);
+        rgb[i * 3 + 0] = c.x;
+        rgb[i * 3 + 1] = c.y;
+        rgb[i * 3 + 2] = c.z;
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "filter.h"
+
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// CPU implementation of the filtered accumulation of redflash.cu, on the same
+// filters and splatting loops (filter.h). It backs the RMSE measurements of
+// redflash_bench --filter.
+//
+//-----------------------------------------------------------------------------
+
+class SplatAccumulator
+{
+public:
+    // radius must not reach more than FILTER_MAX_EXTENT pixels, see filterExtent
+    SplatAccumulator(int width, int height, FilterType type, float radius);
+
+    void clear();
+
+    // Adds a sample of pixel (x, y) at offset jitter in [-0.5, 0.5]^2 from its center
+    void addSample(int x, int y, const float2& jitter, const float3& radiance);
+
+    // Same with the loops over the runtime extent instead of a specialized one
+    void addSampleGeneric(int x, int y, const float2& jitter, const float3& radiance);
+
+    // Interleaved linear RGB of the weighted means, like readLinearImage
+    void resolve(std::vector<float>& rgb) const;
+
+    int extent() const { return m_extent; }
+
+private:
+    template<int Extent>
+    void splat(int x, int y, const float2& jitter, const float3& radiance);
+
+    int m_width;
+    int m_height;
+    FilterType m_type;
+    float m_radius;
+    int m_extent;
+
+    // Weighted sum of the radiance (xyz) and of the weights (w) per pixel
+    std::vector<float4> m_pixels;
+};
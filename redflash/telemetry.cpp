@@ -0,0 +1,192 @@
+#include "telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <vector>
+
+namespace
+{
+    const char* const event_names[TELEMETRY_EVENT_COUNT] = {
+        "create_context",
+        "asset_load",
+        "scene_setup",
+        "launch",
+        "denoise",
+        "write_png",
+        "lobe_tables",
+        "radiance_cache_clear",
+        "scene_update",
+    };
+
+    struct Record
+    {
+        uint64_t begin;
+        uint64_t end;
+        int64_t value;
+        TelemetryEvent event;
+    };
+
+    struct Aggregate
+    {
+        uint64_t count;
+        uint64_t total;
+        uint64_t min;
+        uint64_t max;
+        int64_t value;
+    };
+
+    std::vector<Record> ring;
+    size_t ring_head = 0;
+    uint64_t recorded = 0;
+    uint64_t epoch = 0;
+    Aggregate aggregates[TELEMETRY_EVENT_COUNT];
+    std::map<std::string, std::string> metadata;
+
+    double toMilliseconds(uint64_t ns)
+    {
+        return static_cast<double>(ns) * 1.0e-6;
+    }
+
+    double toMicroseconds(uint64_t ns)
+    {
+        return static_cast<double>(ns) * 1.0e-3;
+    }
+}
+
+void telemetry::init(size_t capacity)
+{
+    ring.assign(std::max<size_t>(capacity, 1), Record());
+    ring_head = 0;
+    recorded = 0;
+    epoch = now();
+    metadata.clear();
+
+    for (int i = 0; i < TELEMETRY_EVENT_COUNT; ++i)
+    {
+        aggregates[i].count = 0;
+        aggregates[i].total = 0;
+        aggregates[i].min = std::numeric_limits<uint64_t>::max();
+        aggregates[i].max = 0;
+        aggregates[i].value = 0;
+    }
+}
+
+bool telemetry::enabled()
+{
+    return !ring.empty();
+}
+
+uint64_t telemetry::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void telemetry::record(TelemetryEvent event, uint64_t begin, uint64_t end, int64_t value)
+{
+    if (ring.empty())
+        return;
+
+    Record& r = ring[ring_head];
+    r.begin = begin;
+    r.end = end;
+    r.value = value;
+    r.event = event;
+    ring_head = (ring_head + 1 == ring.size()) ? 0 : ring_head + 1;
+    ++recorded;
+
+    const uint64_t duration = end - begin;
+    Aggregate& a = aggregates[event];
+    a.count++;
+    a.total += duration;
+    a.min = std::min(a.min, duration);
+    a.max = std::max(a.max, duration);
+    a.value += value;
+}
+
+void telemetry::setMetadata(const std::string& key, const std::string& value)
+{
+    metadata[key] = value;
+}
+
+void telemetry::writeChromeTrace(const std::string& filename)
+{
+    if (ring.empty())
+        return;
+
+    std::ofstream ofs(filename.c_str());
+    if (!ofs)
+    {
+        std::cerr << "Failed to write trace " << filename << std::endl;
+        return;
+    }
+
+    // Oldest record first once the ring has wrapped
+    const size_t count = static_cast<size_t>(std::min<uint64_t>(recorded, ring.size()));
+    const size_t first = (recorded > ring.size()) ? ring_head : 0;
+
+    ofs << std::fixed << std::setprecision(3);
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Record& r = ring[(first + i) % ring.size()];
+        ofs << (i == 0 ? "\n" : ",\n");
+        ofs << "{\"name\":\"" << event_names[r.event] << "\",\"cat\":\"redflash\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+            << ",\"ts\":" << toMicroseconds(r.begin - epoch)
+            << ",\"dur\":" << toMicroseconds(r.end - r.begin)
+            << ",\"args\":{\"value\":" << r.value << "}}";
+    }
+    ofs << "\n]}" << std::endl;
+
+    std::cout << "[info] save_trace: " << filename << std::endl;
+}
+
+void telemetry::writeSummary(const std::string& filename)
+{
+    if (ring.empty())
+        return;
+
+    std::ofstream ofs(filename.c_str());
+    if (!ofs)
+    {
+        std::cerr << "Failed to write summary " << filename << std::endl;
+        return;
+    }
+
+    ofs << std::fixed << std::setprecision(6);
+    ofs << "{\n  \"metadata\": {";
+    for (std::map<std::string, std::string>::const_iterator it = metadata.begin(); it != metadata.end(); ++it)
+    {
+        ofs << (it == metadata.begin() ? "\n" : ",\n");
+        ofs << "    \"" << it->first << "\": \"" << it->second << "\"";
+    }
+    ofs << "\n  },\n";
+    ofs << "  \"dropped_events\": " << (recorded > ring.size() ? recorded - ring.size() : 0) << ",\n";
+    ofs << "  \"events\": {";
+
+    bool first = true;
+    for (int i = 0; i < TELEMETRY_EVENT_COUNT; ++i)
+    {
+        const Aggregate& a = aggregates[i];
+        if (a.count == 0)
+            continue;
+
+        ofs << (first ? "\n" : ",\n");
+        ofs << "    \"" << event_names[i] << "\": {"
+            << "\"count\": " << a.count
+            << ", \"total_ms\": " << toMilliseconds(a.total)
+            << ", \"mean_ms\": " << toMilliseconds(a.total) / a.count
+            << ", \"min_ms\": " << toMilliseconds(a.min)
+            << ", \"max_ms\": " << toMilliseconds(a.max)
+            << ", \"value\": " << a.value << "}";
+        first = false;
+    }
+    ofs << "\n  }\n}" << std::endl;
+
+    std::cout << "[info] save_summary: " << filename << std::endl;
+}
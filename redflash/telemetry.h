@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+//
+// Render telemetry
+//
+// Timed events are written into a preallocated ring buffer and folded into
+// per-event aggregates, so recording one event is a clock read plus a few
+// stores. At exit the ring is exported as a Chrome trace (chrome://tracing)
+// and the aggregates as a JSON summary.
+//
+//-----------------------------------------------------------------------------
+
+enum TelemetryEvent
+{
+    TELEMETRY_CREATE_CONTEXT,
+    TELEMETRY_ASSET_LOAD,
+    TELEMETRY_SCENE_SETUP,
+    TELEMETRY_LAUNCH,
+    TELEMETRY_DENOISE,
+    TELEMETRY_WRITE_PNG,
+    TELEMETRY_LOBE_TABLES,
+    TELEMETRY_RADIANCE_CACHE_CLEAR,
+    TELEMETRY_SCENE_UPDATE,
+    TELEMETRY_EVENT_COUNT
+};
+
+namespace telemetry
+{
+    // Allocates the ring buffer. Recording is a no-op until this is called.
+    void init(size_t capacity = 1 << 16);
+    bool enabled();
+
+    // Monotonic timestamp in nanoseconds
+    uint64_t now();
+
+    // value is an event specific counter (e.g. samples of a launch)
+    void record(TelemetryEvent event, uint64_t begin, uint64_t end, int64_t value = 0);
+
+    // Adds a key/value pair to the summary (resolution, sample count, ...)
+    void setMetadata(const std::string& key, const std::string& value);
+
+    void writeChromeTrace(const std::string& filename);
+    void writeSummary(const std::string& filename);
+
+    // Records [construction, destruction) as one event
+    class Scope
+    {
+    public:
+        explicit Scope(TelemetryEvent event, int64_t value = 0) : m_event(event), m_value(value), m_begin(now()) {}
+        ~Scope() { record(m_event, m_begin, now(), m_value); }
+
+        void setValue(int64_t value) { m_value = value; }
+
+    private:
+        TelemetryEvent m_event;
+        int64_t m_value;
+        uint64_t m_begin;
+    };
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <optixu/optixu_math_namespace.h>
+#include "redflash.h"
+
+//-----------------------------------------------------------------------------
+//
+// Tone curves and output encodings
+//
+// Shared by the camera program (redflash.cu) and the host post-process in
+// postprocess.h, which has SIMD versions of the same formulas. A display
+// value is encode(curve(exposure * linear)).
+//
+//-----------------------------------------------------------------------------
+
+enum ToneCurve
+{
+    TONE_CURVE_NONE,
+    TONE_CURVE_ACES,
+    TONE_CURVE_REINHARD,
+    TONE_CURVE_FILMIC
+};
+
+enum OutputEncoding
+{
+    OUTPUT_ENCODING_LINEAR,
+
+    // Pure 2.2 power, what redflash has always written
+    OUTPUT_ENCODING_GAMMA22,
+
+    // The piecewise sRGB OETF
+    OUTPUT_ENCODING_SRGB
+};
+
+// Rational fit of the ACES RRT + ODT by Krzysztof Narkowicz,
+// https://knarkowicz.wordpress.com/2016/01/06/aces-filmic-tone-mapping-curve/
+static __host__ __device__ __inline__ float3 tonemap_acesFilm(const float3 x)
+{
+    const float a = 2.51f;
+    const float b = 0.03f;
+    const float c = 2.43f;
+    const float d = 0.59f;
+    const float e = 0.14f;
+    return clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0.0f, 1.0f);
+}
+
+// Luminance based, limit is the luminance mapped to 1/2
+static __host__ __device__ __inline__ float3 tonemap_reinhard(const float3& c, float limit)
+{
+    float luminance = 0.3f * c.x + 0.6f * c.y + 0.1f * c.z;
+    return c * 1.0f / (1.0f + luminance / limit);
+}
+
+// John Hable's Uncharted 2 curve, normalized to a white point of 11.2
+static __host__ __device__ __inline__ float hableCurve(float x)
+{
+    const float A = 0.15f;
+    const float B = 0.50f;
+    const float C = 0.10f;
+    const float D = 0.20f;
+    const float E = 0.02f;
+    const float F = 0.30f;
+    return (x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F) - E / F;
+}
+
+#define TONEMAP_FILMIC_WHITE 11.2f
+
+static __host__ __device__ __inline__ float3 tonemap_filmic(const float3& x)
+{
+    const float inv_white = 1.0f / hableCurve(TONEMAP_FILMIC_WHITE);
+    return clamp(make_float3(hableCurve(x.x), hableCurve(x.y), hableCurve(x.z)) * inv_white, 0.0f, 1.0f);
+}
+
+static __host__ __device__ __inline__ float3 linear_to_sRGB(const float3& c)
+{
+    const float kInvGamma = 1.0f / 2.2f;
+    return make_float3(powf(c.x, kInvGamma), powf(c.y, kInvGamma), powf(c.z, kInvGamma));
+}
+
+static __host__ __device__ __inline__ float srgbOETF(float x)
+{
+    return x <= 0.0031308f ? 12.92f * x : 1.055f * powf(x, 1.0f / 2.4f) - 0.055f;
+}
+
+static __host__ __device__ __inline__ float3 applyToneCurve(const float3& x, ToneCurve curve, float reinhard_limit)
+{
+    switch (curve)
+    {
+    case TONE_CURVE_ACES:
+        return tonemap_acesFilm(x);
+    case TONE_CURVE_REINHARD:
+        return tonemap_reinhard(x, reinhard_limit);
+    case TONE_CURVE_FILMIC:
+        return tonemap_filmic(x);
+    case TONE_CURVE_NONE:
+    default:
+        return x;
+    }
+}
+
+static __host__ __device__ __inline__ float3 encodeOutput(const float3& x, OutputEncoding encoding)
+{
+    switch (encoding)
+    {
+    case OUTPUT_ENCODING_GAMMA22:
+        return linear_to_sRGB(fmaxf(x, make_float3(0.0f)));
+    case OUTPUT_ENCODING_SRGB:
+        return make_float3(srgbOETF(fmaxf(x.x, 0.0f)), srgbOETF(fmaxf(x.y, 0.0f)), srgbOETF(fmaxf(x.z, 0.0f)));
+    case OUTPUT_ENCODING_LINEAR:
+    default:
+        return x;
+    }
+}
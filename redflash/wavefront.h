@@ -0,0 +1,209 @@
+#pragma once
+
+#include "redflash.h"
+
+//-----------------------------------------------------------------------------
+//
+// Wavefront path tracing
+//
+// Instead of tracing a whole path per thread, the paths of a launch are kept
+// in buffers and advanced one bounce at a time by separate passes:
+//
+//   generate -> extend -> sort -> shade -> shadow -> (extend ...) -> accumulate
+//
+// The extension pass records a sort key for every hit (BSDF x primitive type,
+// light or miss). The sort pass is a counting sort of the ray queue by that key
+// so the shading pass runs neighbouring threads on the same BSDF and geometry.
+// The shading pass appends surviving paths to the next queue and shadow rays
+// to the shadow queue, so both are compacted as they are written.
+//
+// Everything below is plain host/device code: the OptiX programs in redflash.cu
+// and the CPU implementation in namespace wavefront share it.
+//
+//-----------------------------------------------------------------------------
+
+enum PrimitiveType
+{
+    PRIMITIVE_TRIANGLE,
+    PRIMITIVE_SPHERE,
+    PRIMITIVE_RAYMARCHING,
+    // Quad and triangle lights, only ever hit with light_material
+    PRIMITIVE_EMITTER,
+    PRIMITIVE_TYPE_COUNT
+};
+
+enum
+{
+    WAVEFRONT_RAY_TYPE = 2
+};
+
+// Sort keys. Surface hits are grouped by BSDF first, then by primitive type.
+// Light hits and misses terminate the path and get a bucket of their own.
+#define WAVEFRONT_KEY_LIGHT (BSDF_TYPE_COUNT * PRIMITIVE_TYPE_COUNT)
+#define WAVEFRONT_KEY_MISS (WAVEFRONT_KEY_LIGHT + 1)
+#define WAVEFRONT_KEY_COUNT (WAVEFRONT_KEY_MISS + 1)
+
+// Layout of the wavefront_counters buffer
+#define WAVEFRONT_COUNTER_EXTEND 0
+#define WAVEFRONT_COUNTER_SHADOW 1
+#define WAVEFRONT_COUNTER_HISTOGRAM 2
+#define WAVEFRONT_COUNTER_OFFSETS (WAVEFRONT_COUNTER_HISTOGRAM + WAVEFRONT_KEY_COUNT)
+#define WAVEFRONT_COUNTER_COUNT (WAVEFRONT_COUNTER_OFFSETS + WAVEFRONT_KEY_COUNT)
+
+struct WavefrontPath
+{
+    float3 radiance;
+    float3 attenuation;
+
+    // Denoiser features summed over the previous waves of the launch, and
+    // those of the path of the current wave
+    float3 albedo;
+    float3 normal;
+    DenoiseFeatures features;
+
+    float3 origin;
+    float3 direction;
+
+    // Pdf of the BSDF sample that produced direction
+    float pdf;
+
+    // Shutter time of all rays of the path, see motion.h
+    float time;
+
+    unsigned int seed;
+    unsigned int pixel;
+    int depth;
+    bool specularBounce;
+};
+
+struct WavefrontHit
+{
+    State state;
+    float t;
+    int material_id;
+    int light_id;
+    unsigned int key;
+};
+
+struct WavefrontShadowRay
+{
+    float3 origin;
+    float3 direction;
+    float tmax;
+
+    // Added to the path radiance when the ray is not occluded
+    float3 contribution;
+    unsigned int path;
+};
+
+static __host__ __device__ __inline__ unsigned int wavefrontSurfaceKey(int bsdf, int primitive_type)
+{
+    return static_cast<unsigned int>(bsdf * PRIMITIVE_TYPE_COUNT + primitive_type);
+}
+
+// BSDF type of a surface key
+static __host__ __device__ __inline__ int wavefrontKeyBSDF(unsigned int key)
+{
+    return static_cast<int>(key / PRIMITIVE_TYPE_COUNT);
+}
+
+// Reserves one slot of a queue whose length is *counter
+static __host__ __device__ __inline__ unsigned int wavefrontPush(unsigned int* counter)
+{
+#ifdef __CUDACC__
+    return atomicAdd(counter, 1u);
+#else
+    return (*counter)++;
+#endif
+}
+
+// counters[WAVEFRONT_COUNTER_OFFSETS + k] = sum of the histogram below key k
+static __host__ __device__ __inline__ void wavefrontScanHistogram(unsigned int* counters)
+{
+    unsigned int offset = 0;
+    for (int k = 0; k < WAVEFRONT_KEY_COUNT; ++k)
+    {
+        counters[WAVEFRONT_COUNTER_OFFSETS + k] = offset;
+        offset += counters[WAVEFRONT_COUNTER_HISTOGRAM + k];
+    }
+}
+
+// Slot of an element with the given key in the sorted queue. Requires the
+// offsets from wavefrontScanHistogram; elements of one key are not kept in
+// their original order on the GPU.
+static __host__ __device__ __inline__ unsigned int wavefrontSortedSlot(unsigned int* counters, unsigned int key)
+{
+    return wavefrontPush(&counters[WAVEFRONT_COUNTER_OFFSETS + key]);
+}
+
+#ifndef __CUDACC__
+#include <cstddef>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//
+// CPU implementation of the queue passes. Used to validate the queues read
+// back from the GPU and runs without a device (redflash_bench --selftest).
+//
+//-----------------------------------------------------------------------------
+
+namespace wavefront
+{
+    inline void clearCounters(std::vector<unsigned int>& counters)
+    {
+        counters.assign(WAVEFRONT_COUNTER_COUNT, 0u);
+    }
+
+    // Histogram of the keys of the queued paths, as counted by the extension pass
+    inline void countKeys(const std::vector<unsigned int>& queue, const std::vector<unsigned int>& keys, std::vector<unsigned int>& counters)
+    {
+        for (size_t i = 0; i < queue.size(); ++i)
+        {
+            counters[WAVEFRONT_COUNTER_HISTOGRAM + keys[queue[i]]]++;
+        }
+    }
+
+    // Counting sort of the queue by key, as done by the sort pass
+    inline void sortQueue(const std::vector<unsigned int>& queue, const std::vector<unsigned int>& keys, std::vector<unsigned int>& counters, std::vector<unsigned int>& sorted)
+    {
+        wavefrontScanHistogram(&counters[0]);
+        sorted.resize(queue.size());
+        for (size_t i = 0; i < queue.size(); ++i)
+        {
+            sorted[wavefrontSortedSlot(&counters[0], keys[queue[i]])] = queue[i];
+        }
+    }
+
+    // Appends the paths that are still alive to next, as done by the shading pass
+    inline void compactQueue(const std::vector<unsigned int>& queue, const std::vector<unsigned char>& alive, std::vector<unsigned int>& counters, std::vector<unsigned int>& next)
+    {
+        next.resize(queue.size());
+        for (size_t i = 0; i < queue.size(); ++i)
+        {
+            if (alive[queue[i]])
+                next[wavefrontPush(&counters[WAVEFRONT_COUNTER_EXTEND])] = queue[i];
+        }
+        next.resize(counters[WAVEFRONT_COUNTER_EXTEND]);
+    }
+
+    // True if sorted holds the same paths as queue, ordered by key
+    inline bool isSortedQueue(const std::vector<unsigned int>& queue, const std::vector<unsigned int>& keys, const std::vector<unsigned int>& sorted)
+    {
+        if (queue.size() != sorted.size())
+            return false;
+
+        std::vector<unsigned int> seen(keys.size(), 0u);
+        for (size_t i = 0; i < queue.size(); ++i)
+            seen[queue[i]]++;
+
+        for (size_t i = 0; i < sorted.size(); ++i)
+        {
+            if (sorted[i] >= keys.size() || seen[sorted[i]]-- == 0)
+                return false;
+            if (i > 0 && keys[sorted[i - 1]] > keys[sorted[i]])
+                return false;
+        }
+        return true;
+    }
+}
+#endif
@@ -743,6 +743,11 @@ void sutil::displayBufferPNG(const char* filename, RTbuffer buffer, bool disable
     RT_CHECK_ERROR(rtBufferUnmap(buffer));
 }
 
+void sutil::writePNG(const char* filename, const unsigned char* pixels, int width, int height, int channels)
+{
+    SavePNG(pixels, filename, width, height, channels);
+}
+
 
 void sutil::displayBufferGL( optix::Buffer buffer, bufferPixelFormat format, bool disable_srgb_conversion )
 {
@@ -154,6 +154,14 @@ void SUTILAPI displayBufferPNG(
     RTbuffer buffer,                      // Buffer to be displayed
     bool disable_srgb_conversion = true); // Enables/disables srgb conversion before the image is saved. Disabled by default.          
 
+// Write 8 bit pixels, top row first, to a PNG image file
+void SUTILAPI writePNG(
+    const char* filename,                 // Image file to be created
+    const unsigned char* pixels,          // width * height * channels bytes
+    int width,
+    int height,
+    int channels);                        // 1, 3 or 4
+
 // Display contents of buffer, where the OpenGL/GLUT context is managed by caller.
 void SUTILAPI displayBufferGL(
         optix::Buffer buffer,       // Buffer to be displayed